@@ -0,0 +1,173 @@
+/* Distributed under the terms of the GNU General Public License v2 */
+/* L3info - SYR2 Project - SYR DeaDBeeF
+ * ============================================================================
+ * Adaptive Bitrate
+ * ----------------------------------------------------------------------------
+ * Quality tier of a session, from the loss and round-trip time of its link.
+ * ----------------------------------------------------------------------------
+ * Antoine Pinsard
+ * Oct. 19, 2026
+ */
+#include "abr.h"
+
+
+// Reduction of the blocks of each tier, see codec.h
+static const int reductions[ABR_NB_TIERS] = {
+    0, CODEC_HALF_RATE, CODEC_HALF_RATE | CODEC_MONO
+};
+
+
+/**
+ * Initialize the state of a session of nb_tiers tiers, 1 if it does not
+ * adapt, starting at the full quality at now.
+ */
+void abr_init(struct abr* abr, int nb_tiers, long long now) {
+    int i;
+
+    assert(abr != NULL);
+    assert(nb_tiers > 0 && nb_tiers <= ABR_NB_TIERS);
+
+    abr->nb_tiers = nb_tiers;
+    abr->tier = 0;
+    abr->nb_switches = 0;
+    abr->loss = 0;
+    abr->rtt = 0;
+    abr->min_rtt = 0;
+    abr->heartbeats = 0;
+    abr->received = 0;
+    abr->lost = 0;
+    abr->last_switch = now;
+    abr->last_step = 0;
+    abr->good_since = 0;
+    for (i = 0; i < ABR_NB_TIERS; i++) {
+        abr->probes[i] = ABR_PROBE;
+    }
+    memset(abr->packets, 0, sizeof(abr->packets));
+    memset(abr->sent, 0, sizeof(abr->sent));
+}
+
+
+/**
+ * Remember that the given packet of the session was sent at now.
+ */
+void abr_sent(struct abr* abr, uint32_t packet, long long now) {
+    assert(abr != NULL);
+
+    abr->packets[packet % ABR_HISTORY] = packet;
+    abr->sent[packet % ABR_HISTORY] = now;
+}
+
+
+/**
+ * Update the estimates of the link with a digest received at now, then step
+ * down or up a tier as they tell, see abr.h.
+ *
+ * Return 1 if the tier changed, 0 otherwise.
+ */
+int abr_update(struct abr* abr, const struct heartbeat_digest* digest,
+               long long now)
+{
+    uint32_t packet;
+    long long* probe;
+    long long sample
+            , queue;
+    int32_t received
+          , lost;
+    int slot
+      , poor
+      , good;
+
+    assert(abr != NULL);
+    assert(digest != NULL);
+
+    // Blocks found late are no longer lost, so that lost may decrease.
+    received = digest->received - abr->received;
+    lost = digest->lost - abr->lost;
+    if (received < 0) {
+        received = 0;
+    }
+    if (lost < 0) {
+        lost = 0;
+    }
+    abr->received = digest->received;
+    abr->lost = digest->lost;
+    if (received + lost > 0) {
+        abr->loss += ABR_LOSS_GAIN
+                   * ((double) lost / (received + lost) - abr->loss);
+    }
+
+    // The packet of the latest block may be completed by a later message, so
+    // that the one before it is the latest the client received whole.
+    packet = (digest->highest + 1) / CODEC_BLOCKS - 1;
+    slot = packet % ABR_HISTORY;
+    if (abr->packets[slot] == packet && abr->sent[slot] > 0 &&
+        abr->sent[slot] <= now)
+    {
+        sample = now - abr->sent[slot];
+        if (abr->rtt == 0) {
+            abr->rtt = sample;
+            abr->min_rtt = sample;
+        }
+        abr->rtt += ABR_RTT_GAIN * (sample - abr->rtt);
+        if (sample < abr->min_rtt) {
+            abr->min_rtt = sample;
+        }
+    }
+    queue = abr->rtt - abr->min_rtt;
+
+    poor = abr->loss > ABR_LOSS_HIGH || queue > ABR_QUEUE_HIGH;
+    good = abr->loss < ABR_LOSS_LOW && queue < ABR_QUEUE_LOW;
+    if (!good) {
+        abr->good_since = 0;
+    }
+    else if (abr->good_since == 0) {
+        abr->good_since = now;
+    }
+
+    // The last step up holds once the link stayed good for the probe delay
+    // of the tier it left, and is undone if the link gets poor before.
+    if (abr->last_step > 0) {
+        probe = &abr->probes[abr->tier + 1];
+        if (now - abr->last_switch >= *probe) {
+            *probe = ABR_PROBE;
+        }
+        else if (poor) {
+            *probe = *probe * 2 < ABR_MAX_PROBE ? *probe * 2 : ABR_MAX_PROBE;
+        }
+    }
+
+    if (poor && abr->tier < abr->nb_tiers - 1 &&
+        (abr->last_step > 0 || now - abr->last_switch >= ABR_HOLD))
+    {
+        abr->tier++;
+        abr->last_step = -1;
+    }
+    else if (good && abr->tier > 0 &&
+             now - abr->good_since >= abr->probes[abr->tier] &&
+             now - abr->last_switch >= abr->probes[abr->tier])
+    {
+        abr->tier--;
+        abr->last_step = 1;
+        abr->good_since = now;
+    }
+    else {
+        return 0;
+    }
+
+    // The loss of the previous tier no longer tells about the link.
+    abr->loss = 0;
+    abr->last_switch = now;
+    abr->nb_switches++;
+
+    return 1;
+}
+
+
+/**
+ * Return the reduction of the blocks of the current tier, see codec.h.
+ */
+int abr_reduction(struct abr* abr) {
+    assert(abr != NULL);
+
+    return reductions[abr->tier];
+}
@@ -0,0 +1,89 @@
+/* Distributed under the terms of the GNU General Public License v2 */
+/* L3info - SYR2 Project - SYR DeaDBeeF
+ * ============================================================================
+ * Adaptive Bitrate
+ * ----------------------------------------------------------------------------
+ * Quality tier of a session, chosen from the state of the link to its client
+ * as told by the digests of its heartbeats, see deadbeef.h:
+ *
+ *  - the loss ratio of the blocks received since the previous digest,
+ *    smoothed with a gain of ABR_LOSS_GAIN;
+ *  - the round-trip time, from the time the latest packet the client
+ *    received whole was sent to the time the heartbeat was received,
+ *    smoothed with a gain of ABR_RTT_GAIN, higher than that of RFC 6298 as
+ *    there are only a few heartbeats per second. The queueing delay of the
+ *    link is how much it exceeds the lowest round-trip time seen.
+ *
+ * Tier 0 is the full quality of the stream. The next tiers reduce its blocks
+ * to half the sample rate, then to mono as well, see codec.h, so that fewer
+ * messages are sent for the same duration. A tier is a reduction of the
+ * compressed stream, so that only clients advertising both CAP_RICE and
+ * CAP_REDUCED have more than one tier.
+ *
+ * The session steps down a tier when the link is poor: loss above
+ * ABR_LOSS_HIGH or queueing delay above ABR_QUEUE_HIGH, and steps up a tier
+ * once the link has been good for the probe delay of the tier: loss below
+ * ABR_LOSS_LOW and queueing delay below ABR_QUEUE_LOW. Besides the gap
+ * between those thresholds, oscillation is avoided in two ways:
+ *
+ *  - a step down waits ABR_HOLD after the previous change of tier, so that
+ *    the estimates reflect the current tier, unless it undoes a step up;
+ *  - a step up from a tier that is undone within its probe delay doubles
+ *    the delay, up to ABR_MAX_PROBE, so that a link whose capacity lies
+ *    between two tiers is probed less and less often. The delay is reset to
+ *    ABR_PROBE once a step up from the tier holds that long.
+ * ----------------------------------------------------------------------------
+ * Antoine Pinsard
+ * Oct. 19, 2026
+ */
+#ifndef _ABR_H_
+#define _ABR_H_
+
+#include <stdint.h>
+#include "codec.h"
+#include "deadbeef.h"
+#include "protocol.h"
+
+#define ABR_NB_TIERS 3
+// Packets whose send time is remembered, a power of 2
+#define ABR_HISTORY 1024
+
+#define ABR_LOSS_GAIN 0.25
+#define ABR_RTT_GAIN 0.25
+#define ABR_LOSS_HIGH 0.05
+#define ABR_LOSS_LOW 0.01
+// Queueing delays in microseconds
+#define ABR_QUEUE_HIGH 150000
+#define ABR_QUEUE_LOW 40000
+// Delays in microseconds
+#define ABR_HOLD 3000000
+#define ABR_PROBE 8000000
+#define ABR_MAX_PROBE 64000000
+
+struct abr {
+    int nb_tiers;
+    int tier;                 // 0 for the full quality
+    int nb_switches;
+    double loss;              // Smoothed loss ratio
+    long long rtt;            // Smoothed round-trip time in us, 0 if unknown
+    long long min_rtt;
+    // Counters of the last digest read
+    uint64_t heartbeats;
+    uint32_t received;
+    uint32_t lost;
+    long long last_switch;    // Time of the last change of tier
+    int last_step;            // 1 if it was a step up, -1 if down
+    long long good_since;     // Time the link got good, 0 if it is not
+    // Delay of a good link before stepping up from each tier
+    long long probes[ABR_NB_TIERS];
+    // Send time of each packet of the history, by packet number
+    uint32_t packets[ABR_HISTORY];
+    long long sent[ABR_HISTORY];
+};
+
+void abr_init(struct abr*, int, long long);
+void abr_sent(struct abr*, uint32_t, long long);
+int abr_update(struct abr*, const struct heartbeat_digest*, long long);
+int abr_reduction(struct abr*);
+
+#endif
@@ -22,34 +22,564 @@ void term(int signum) {
 
 
 void print_errmess(unsigned char* raw_msg) {
-    int errcode
+    struct error_message error;
+
+    protocol_decode_error(raw_msg, &error);
+    printf("Error 0x%x, server said: %s\n", error.code, error.message);
+}
+
+
+/**
+ * Ask the server for the catalog entries matching pattern, starting at the
+ * given offset, and print them.
+ *
+ * mode is either CATALOG_PREFIX or CATALOG_SUBSTRING.
+ *
+ * Return 0 on success, -1 otherwise.
+ */
+int browse_catalog(int sock, struct sockaddr_in* server_addr, int mode,
+                   char* pattern, unsigned long offset)
+{
+    unsigned char msg_buffer[MSG_LENGTH];
+    struct catalog_response response;
+    struct catalog_record record;
+    unsigned long duration;
+    int msg_len
+      , type
+      , pos
       , i;
-    char message[MESSERR_LENGTH];
+    socklen_t flen;
+    fd_set read_set;
+    struct timeval timeout;
+
+    assert(server_addr != NULL);
+    assert(pattern != NULL);
+
+    protocol_encode_catalog_request(msg_buffer, mode, offset, pattern);
+    if (send_message(sock, server_addr, msg_buffer) < 0) {
+        return -1;
+    }
+
+    FD_ZERO(&read_set);
+    FD_SET(sock, &read_set);
+    timeout.tv_sec = 5;
+    timeout.tv_usec = 0;
+    if (select(sock+1, &read_set, NULL, NULL, &timeout) <= 0) {
+        fprintf(stderr, "Server connection timeout.\n");
+        return -1;
+    }
+
+    flen = sizeof(struct sockaddr_in);
+    msg_len = recvfrom(sock, msg_buffer, MSG_LENGTH, 0,
+                       (struct sockaddr*) server_addr, &flen);
+    if (msg_len < 0) {
+        perror("Message reception failed");
+        return -1;
+    }
+    type = protocol_type(msg_buffer, msg_len);
+    if (type < 0) {
+        fprintf(stderr, "Bad formated message received\n");
+        return -1;
+    }
+    if (type == RESP_ERROR) {
+        print_errmess(msg_buffer);
+        return -1;
+    }
+    if (type != RESP_CATALOG) {
+        fprintf(stderr, "Unhandled response code: %x\n", type);
+        return -1;
+    }
+
+    protocol_decode_catalog_response(msg_buffer, &response);
+
+    pos = CATALOG_RESP_HEADER_LENGTH;
+    for (i = 0; i < response.nb_entries; i++) {
+        pos = protocol_next_catalog_record(msg_buffer, pos, &record);
+        if (pos < 0) {
+            break;
+        }
+        duration = record.duration / 1000;
+        printf("%.*s  %lu:%02lu  %uHz %dbit %dch\n", record.name_length,
+               record.name, duration / 60, duration % 60, record.sample_rate,
+               record.sample_size, record.channels);
+    }
+
+    if (response.nb_entries == 0) {
+        printf("No match (%u found)\n", response.nb_matches);
+    }
+    else {
+        printf("Entries %u-%u of %u\n", response.offset + 1,
+               response.offset + response.nb_entries, response.nb_matches);
+    }
+
+    return 0;
+}
+
 
-    errcode = 0;
-    for (i = 0; i < 4; i++) {
-        errcode += (raw_msg[1+i] << (8*i));
+/**
+ * Print a record of a stats response, see deadbeef.h.
+ */
+static void print_stats_record(struct stats_record* record) {
+    const struct heartbeat_digest* digest;
+    unsigned long count;
+    int i;
+
+    printf("  sent %lu, send errors %lu (EAGAIN %lu), heartbeats %lu, "
+           "timeouts %lu\n", (unsigned long) record->packets_sent,
+           (unsigned long) record->send_errors,
+           (unsigned long) record->send_eagain,
+           (unsigned long) record->heartbeats,
+           (unsigned long) record->timeouts);
+    printf("  lateness:");
+    for (i = 0; i < record->nb_buckets; i++) {
+        count = record->lateness[i];
+        if (count == 0) {
+            continue;
+        }
+        if (i == 0) {
+            printf(" <1us %lu", count);
+        }
+        else if (i < record->nb_buckets - 1) {
+            printf(" <%luus %lu", 1UL << i, count);
+        }
+        else {
+            printf(" >=%luus %lu", 1UL << (i-1), count);
+        }
+    }
+    printf("\n");
+
+    digest = &record->digest;
+    if (digest->valid) {
+        printf("  client: received %u, lost %u, reordered %u, "
+               "duplicates %u, jitter %.3fms, buffer %ums, underruns %u\n",
+               digest->received, digest->lost, digest->reordered,
+               digest->duplicates, digest->jitter_us / 1000.0,
+               digest->buffer_ms, digest->underruns);
     }
-    strncpy(message, (char*) raw_msg+5, MESSERR_LENGTH);
-    message[MESSERR_LENGTH-1] = '\0';
-    printf("Error 0x%x, server said: %s\n", errcode, message);
+}
+
+
+/**
+ * Ask the server for its statistics and print them.
+ *
+ * Return 0 on success, -1 otherwise.
+ */
+int print_stats(int sock, struct sockaddr_in* server_addr) {
+    unsigned char msg_buffer[MSG_LENGTH];
+    struct stats_header header;
+    struct stats_record record;
+    struct in_addr addr;
+    int msg_len
+      , type
+      , pos
+      , i;
+    socklen_t flen;
+    fd_set read_set;
+    struct timeval timeout;
+
+    assert(server_addr != NULL);
+
+    protocol_encode_request(msg_buffer, REQ_STATS);
+    if (send_message(sock, server_addr, msg_buffer) < 0) {
+        return -1;
+    }
+
+    FD_ZERO(&read_set);
+    FD_SET(sock, &read_set);
+    timeout.tv_sec = 5;
+    timeout.tv_usec = 0;
+    if (select(sock+1, &read_set, NULL, NULL, &timeout) <= 0) {
+        fprintf(stderr, "Server connection timeout.\n");
+        return -1;
+    }
+
+    flen = sizeof(struct sockaddr_in);
+    msg_len = recvfrom(sock, msg_buffer, MSG_LENGTH, 0,
+                       (struct sockaddr*) server_addr, &flen);
+    if (msg_len < 0) {
+        perror("Message reception failed");
+        return -1;
+    }
+    type = protocol_type(msg_buffer, msg_len);
+    if (type < 0) {
+        fprintf(stderr, "Bad formated message received\n");
+        return -1;
+    }
+    if (type == RESP_ERROR) {
+        print_errmess(msg_buffer);
+        return -1;
+    }
+    if (type != RESP_STATS) {
+        fprintf(stderr, "Unhandled response code: %x\n", type);
+        return -1;
+    }
+
+    protocol_decode_stats(msg_buffer, &header);
+    record.nb_buckets = header.nb_buckets;
+    pos = protocol_decode_stats_record(msg_buffer, STATS_RESP_HEADER_LENGTH,
+                                       &record);
+    if (pos < 0) {
+        fprintf(stderr, "Corrupted stats response.\n");
+        return -1;
+    }
+    printf("Up for %us, %d active sessions, %u sessions, %lu rejected\n",
+           header.uptime, record.active, record.nb_sessions,
+           (unsigned long) record.rejections);
+    print_stats_record(&record);
+
+    for (i = 0; i < header.nb_slots; i++) {
+        pos = protocol_decode_stats_record(msg_buffer, pos, &record);
+        if (pos < 0) {
+            break;
+        }
+        if (record.nb_sessions == 0) {
+            continue;
+        }
+        addr.s_addr = htonl(record.addr);
+        printf("Slot %d, %s session with %s:%d\n", i,
+               record.active ? "current" : "last", inet_ntoa(addr),
+               record.port);
+        print_stats_record(&record);
+    }
+
+    return 0;
+}
+
+
+/**
+ * Store the data carried by a RESP_DATA or RESP_PACKED message in the data
+ * buffer, decompressing it if needed. The buffer holds the nb_packets packets
+ * of a track, numbered from first_packet on in the session. Packets whose
+ * number is out of range are ignored. Reduced blocks, see codec.h, are
+ * decoded to the format of the track, so that the quality of the stream may
+ * change at any packet without reopening the audio output.
+ *
+ * channels is the number of channels of the stream, needed to decompress.
+ *
+ * Return the number of stored blocks, see codec.h, a raw packet counting as
+ * CODEC_BLOCKS blocks, or -1 if the message is corrupted.
+ */
+int unpack_data(unsigned char* msg_buffer, unsigned char* data_buffer,
+                uint32_t first_packet, int nb_packets, int channels)
+{
+    struct packed_header header;
+    const unsigned char* block;
+    unsigned long id;
+    int block_length
+      , pos
+      , i;
+
+    if (msg_buffer[0] == RESP_DATA) {
+        // Packets of other tracks wrap around to out of range numbers.
+        id = (uint32_t) (protocol_decode_data(msg_buffer) - first_packet);
+        if (id >= nb_packets) {
+            return 0;
+        }
+        memcpy(data_buffer + id*DATA_LENGTH, msg_buffer + DATA_HEADER_LENGTH,
+               DATA_LENGTH);
+        return CODEC_BLOCKS;
+    }
+
+    // Blocks are decoded with their number in the track.
+    protocol_decode_packed(msg_buffer, &header);
+    id = (uint32_t) (header.first_block - first_packet * CODEC_BLOCKS);
+    pos = PACKED_HEADER_LENGTH;
+    for (i = 0; i < header.nb_blocks; i++, id++) {
+        if (id >= (unsigned long) nb_packets * CODEC_BLOCKS) {
+            return -1;
+        }
+        pos = protocol_next_block(msg_buffer, pos, &block, &block_length);
+        if (pos < 0 ||
+            codec_decode(block, block_length, channels, id,
+                         data_buffer + id*CODEC_BLOCK_LENGTH,
+                         CODEC_BLOCK_LENGTH) < 0)
+        {
+            return -1;
+        }
+    }
+
+    return header.nb_blocks;
+}
+
+
+/**
+ * Send a heartbeat to the server, carrying the digest of the telemetry of
+ * the stream.
+ */
+static void send_heartbeat(int sock, struct sockaddr_in* server_addr,
+                           struct qos* qos, int blocks_received)
+{
+    unsigned char msg_buffer[MSG_LENGTH];
+    struct heartbeat_digest digest;
+
+    qos_digest(qos, &digest);
+    protocol_encode_heartbeat(msg_buffer, &digest);
+    TRACE(TRACE_HEARTBEAT, blocks_received, 1);
+    send_message(sock, server_addr, msg_buffer);
+}
+
+
+/**
+ * Copy a packet of a live stream to its slot of the ring, or clear the slot
+ * if packet is NULL. The first slot is mirrored after the end of the ring,
+ * see playback.h.
+ */
+static void store_live(unsigned char* ring, uint32_t id,
+                       const unsigned char* packet)
+{
+    unsigned char* slot;
+    int k;
+
+    for (k = 0; k < (id % LIVE_RING_PACKETS == 0 ? 2 : 1); k++) {
+        slot = ring + (id % LIVE_RING_PACKETS + k * LIVE_RING_PACKETS)
+                      * DATA_LENGTH;
+        if (packet != NULL) {
+            memcpy(slot, packet, DATA_LENGTH);
+        }
+        else {
+            memset(slot, 0, DATA_LENGTH);
+        }
+    }
+}
+
+
+/**
+ * Store the data carried by a RESP_DATA message of a live stream, which is
+ * raw, in the ring of its track. Packets numbered before the stream, taking
+ * the wraparound of the numbers into account, or that the ring moved past
+ * already, are ignored. The slots of the packets skipped over are cleared,
+ * so that lost packets play as silence rather than as the previous turn of
+ * the ring.
+ *
+ * Return the number of stored blocks, see codec.h, and the number of the
+ * packet in the stream to id.
+ */
+static int unpack_live(unsigned char* msg_buffer, unsigned char* ring,
+                       struct client_track* track, uint32_t* id)
+{
+    uint32_t next
+           , skipped;
+
+    if (msg_buffer[0] != RESP_DATA) {
+        return 0;
+    }
+    *id = protocol_decode_data(msg_buffer) - track->info.first_packet;
+    next = track->received;
+    if (*id >= 0x80000000U || *id + LIVE_RING_PACKETS <= next) {
+        return 0;
+    }
+
+    // Only the last turn of the ring is cleared.
+    skipped = next;
+    if (*id > next && *id - next >= LIVE_RING_PACKETS) {
+        skipped = *id - LIVE_RING_PACKETS + 1;
+    }
+    for (; skipped < *id; skipped++) {
+        store_live(ring, skipped, NULL);
+    }
+    store_live(ring, *id, msg_buffer + DATA_HEADER_LENGTH);
+    if (*id >= next) {
+        // The packet is published once stored.
+        __sync_synchronize();
+        track->received = *id + 1;
+    }
+
+    return CODEC_BLOCKS;
+}
+
+
+/**
+ * Return the track of the session the packet of the given number belongs
+ * to, among those whose stream information was received, or -1.
+ */
+static int find_track(struct playlist* playlist, uint32_t packet) {
+    struct streaminfo* info;
+    int k;
+
+    for (k = 0; k < playlist->nb_known; k++) {
+        info = &playlist->tracks[k].info;
+        if (packet - info->first_packet < info->nb_packets) {
+            return k;
+        }
+    }
+
+    return -1;
+}
+
+
+/**
+ * Record the stream information of the next track of the session and create
+ * the shared memory its data is received to. A server that predates
+ * playlists sends a single track, whose missing fields are filled in. A live
+ * stream is received to a ring, followed by the mirror of its first packet.
+ *
+ * Return the data buffer of the track, attached, or NULL on error.
+ */
+unsigned char* add_track(struct playlist* playlist, struct streaminfo* info) {
+    struct client_track* track;
+    unsigned char* data_buffer;
+
+    assert(playlist != NULL);
+    assert(info != NULL);
+
+    if (info->nb_tracks == 0) {
+        info->nb_tracks = 1;
+        info->first_packet = 0;
+        info->total_packets = info->nb_packets;
+        info->length = info->nb_packets * DATA_LENGTH;
+    }
+    if (playlist->nb_known >= PLAYLIST_MAX_TRACKS) {
+        return NULL;
+    }
+
+    track = &playlist->tracks[playlist->nb_known];
+    track->info = *info;
+    track->received = 0;
+    // Never empty, so that a track without samples is a track as well
+    track->shmid = shmget(IPC_PRIVATE,
+                          (info->flags & STREAMINFO_LIVE
+                           ? LIVE_RING_PACKETS + 1 : info->nb_packets)
+                          * DATA_LENGTH * sizeof(unsigned char) + 1,
+                          0600);
+    if (track->shmid == -1) {
+        perror("Unable to allocate shared memory");
+        return NULL;
+    }
+    data_buffer = (unsigned char*) shmat(track->shmid, NULL, 0);
+    if (data_buffer == (void*) -1) {
+        perror("Shared memory attachment failed");
+        shmctl(track->shmid, IPC_RMID, NULL);
+        return NULL;
+    }
+
+    // The track is published once complete.
+    __sync_synchronize();
+    playlist->nb_known++;
+
+    return data_buffer;
+}
+
+
+/**
+ * Print the stream information of a track and check that it can be played.
+ *
+ * Return the sample format of the stream, see convert.h, or -1 if it is not
+ * supported.
+ */
+static int check_streaminfo(const struct streaminfo* info) {
+    int in_format;
+
+    printf("sample_rate=%d, sample_size=%d, channels=%d, nb_packets=%d, "
+           "encoding=%d, format=%d", info->sample_rate, info->sample_size,
+           info->channels, info->nb_packets, info->encoding, info->format);
+    if (info->nb_tracks > 1) {
+        printf(", track=%d/%d", info->track + 1, info->nb_tracks);
+    }
+    if (info->flags & STREAMINFO_LIVE) {
+        printf(", live");
+    }
+    printf("\n");
+    fflush(stdout);
+
+    // Samples are converted to what the audio output plays.
+    in_format = convert_format(info->format, info->sample_size);
+    if (in_format < 0) {
+        fprintf(stderr, "Unsupported sample format.\n");
+        return -1;
+    }
+    if (info->encoding != CODEC_RAW &&
+        (info->encoding != CODEC_RICE ||
+         !codec_supports(info->sample_size, info->channels)))
+    {
+        fprintf(stderr, "Unsupported stream encoding.\n");
+        return -1;
+    }
+
+    return in_format;
+}
+
+
+/**
+ * Open the audio output for a stream of the given format and set the
+ * playback to convert the stream to what the output plays. The prebuffer
+ * and latency are in milliseconds, the default latency being used if
+ * latency is 0.
+ *
+ * Return 0, or -1 if the audio output could not be opened.
+ */
+static int open_output(struct playback* playback, struct sink* sink,
+                       const char* sink_spec, const struct streaminfo* info,
+                       int in_format, int force_mono, int latency,
+                       int prebuffer)
+{
+    int out_format
+      , dev_rate
+      , dev_size
+      , dev_channels;
+
+    dev_rate = info->sample_rate;
+    dev_size = convert_device_size(in_format);
+    dev_channels = force_mono != 0 ? 1 : info->channels;
+    if (sink_open(sink, sink_spec, &dev_rate, &dev_size, &dev_channels,
+                  latency > 0 ? &latency : NULL) < 0)
+    {
+        perror("Error while attempting to play the audio file");
+        return -1;
+    }
+    out_format = convert_device_format(dev_size);
+    if (out_format < 0) {
+        fprintf(stderr, "Unsupported audio output sample size: %d\n",
+                dev_size);
+        sink_close(sink);
+        return -1;
+    }
+
+    playback->in_format = in_format;
+    playback->out_format = out_format;
+    playback->channels = dev_channels;
+    playback->bytes_per_second = dev_rate * dev_channels
+                               * convert_sample_length(out_format);
+    playback->prebuffer = (size_t) prebuffer * info->sample_rate
+                        * info->channels * convert_sample_length(in_format)
+                        / 1000;
+    playback->low_latency = latency > 0;
+    playback->started = 0;
+
+    return 0;
 }
 
 
 int main(int argc, char** argv) {
     int sock
       , msg_len
-      , nb_packets
-      , channels
-      , sample_size
-      , sample_rate
-      , audout_fd
+      , type
       , shmid
       , sel
       , i
-      , packet_id
-      , packets_received
-      , force_mono;
+      , k
+      , nb_unpacked
+      , blocks_received
+      , total_blocks
+      , next_heartbeat
+      , in_format
+      , latency
+      , prebuffer
+      , compensate
+      , capabilities
+      , variant
+      , force_mono
+      , nb_tracks
+      , first_filter
+      , opened
+      , live
+      , heartbeat_blocks;
+    int track_blocks[PLAYLIST_MAX_TRACKS];
+    int removed[PLAYLIST_MAX_TRACKS];
+    int gains[MIX_MAX_INPUTS];
+    double gain;
+    long first_block
+       , block_period;
+    uint32_t live_id;
     socklen_t flen;
     pid_t pid;
     fd_set read_set;
@@ -57,6 +587,21 @@ int main(int argc, char** argv) {
     struct sockaddr_in server_addr;
     unsigned char msg_buffer[MSG_LENGTH];
     unsigned char* data_buffer;
+    unsigned char* buffers[PLAYLIST_MAX_TRACKS];
+    struct streaminfo info;
+    struct streaminfo* previous;
+    struct packed_header packed;
+    struct playlist* playlist;
+    struct client_track* track;
+    struct playback playback;
+    struct sink sink;
+    struct qos* qos;
+    char** filenames;
+    char* gain_spec;
+    char* end;
+    char* sink_spec;
+    char* port;
+    FILE* qos_output;
     struct sigaction action;
 
     // Print notice
@@ -70,15 +615,115 @@ int main(int argc, char** argv) {
     if (argc < 3) {
         fprintf(stderr, "Usage: audioclient <server_host_name> <file_name>\n");
         fprintf(stderr, "       [filter [param ...] ...]\n");
+        fprintf(stderr, "       audioclient <server_host_name> -p <file_name> "
+                        "[file_name ...]\n");
+        fprintf(stderr, "       [-- filter [param ...] ...]\n");
+        fprintf(stderr, "       audioclient <server_host_name> -m "
+                        "<file_name>[@gain] [file_name[@gain] ...]\n");
+        fprintf(stderr, "       [-- filter [param ...] ...]\n");
+        fprintf(stderr, "       audioclient <server_host_name> -l|-s "
+                        "[pattern [offset]]\n");
+        fprintf(stderr, "       audioclient <server_host_name> -i\n");
         exit(EXIT_FAILURE);
     }
 
+    // The tracks of a playlist or the inputs of a mix are followed by the
+    // filters after "--".
+    filenames = argv + 2;
+    nb_tracks = 1;
+    first_filter = 3;
+    if (strcmp(argv[2], "-p") == 0 || strcmp(argv[2], "-m") == 0) {
+        filenames = argv + 3;
+        for (i = 3; i < argc && strcmp(argv[i], "--") != 0; i++);
+        nb_tracks = i - 3;
+        first_filter = i + 1;
+        if (argv[2][1] == 'p' &&
+            (nb_tracks == 0 || nb_tracks > PLAYLIST_MAX_TRACKS))
+        {
+            fprintf(stderr, "A playlist holds 1 to %d tracks.\n",
+                    PLAYLIST_MAX_TRACKS);
+            exit(EXIT_FAILURE);
+        }
+        if (argv[2][1] == 'm' &&
+            (nb_tracks == 0 || nb_tracks > MIX_MAX_INPUTS))
+        {
+            fprintf(stderr, "A mix holds 1 to %d files.\n", MIX_MAX_INPUTS);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    // Each input of a mix may be followed by its gain, 1 by default, as in
+    // bed.wav@0.5.
+    for (i = 0; strcmp(argv[2], "-m") == 0 && i < nb_tracks; i++) {
+        gains[i] = MIX_UNITY;
+        gain_spec = strrchr(filenames[i], '@');
+        if (gain_spec == NULL) {
+            continue;
+        }
+        gain = strtod(gain_spec + 1, &end);
+        if (end == gain_spec + 1 || *end != '\0') {
+            continue;
+        }
+        if (gain < 0 || gain * MIX_UNITY > MIX_MAX_GAIN) {
+            fprintf(stderr, "Gains range from 0 to %d.\n",
+                    MIX_MAX_GAIN / MIX_UNITY);
+            exit(EXIT_FAILURE);
+        }
+        *gain_spec = '\0';
+        gains[i] = gain * MIX_UNITY + 0.5;
+    }
+
     force_mono = 0;
+    capabilities = CAP_RICE | CAP_REDUCED;
+    variant = 0;
+    latency = 0;
+    prebuffer = PLAYBACK_PREBUFFER;
+    compensate = 0;
+    sink_spec = NULL;
+    qos_output = NULL;
 
     // Parse filters
-    for (i = 3; i < argc; i++) {
+    // The server is asked to downmix or downsample the stream itself, so that
+    // less data is sent. Audio output is still forced to mono if it does not.
+    for (i = first_filter; i < argc; i++) {
         if (strcmp(argv[i], "force_mono") == 0) {
             force_mono = 1;
+            variant |= VARIANT_MONO;
+        }
+        else if (strcmp(argv[i], "half_rate") == 0) {
+            variant |= VARIANT_HALF_RATE;
+        }
+        else if (strcmp(argv[i], "no_compression") == 0) {
+            capabilities &= ~(CAP_RICE | CAP_REDUCED);
+        }
+        // The server keeps the full quality even if the link is poor.
+        else if (strcmp(argv[i], "full_quality") == 0) {
+            capabilities &= ~CAP_REDUCED;
+        }
+        else if (strcmp(argv[i], "s16") == 0) {
+            variant |= VARIANT_S16;
+        }
+        else if (strcmp(argv[i], "drift") == 0) {
+            compensate = 1;
+        }
+        else if (strncmp(argv[i], "sink=", 5) == 0) {
+            sink_spec = argv[i] + 5;
+        }
+        // Audio output latency and prebuffer in milliseconds
+        else if (strncmp(argv[i], "latency=", 8) == 0) {
+            latency = atoi(argv[i] + 8);
+        }
+        else if (strncmp(argv[i], "prebuffer=", 10) == 0) {
+            prebuffer = atoi(argv[i] + 10);
+        }
+        // Telemetry of the stream, as JSON lines, "-" for stdout
+        else if (strncmp(argv[i], "qos=", 4) == 0 && qos_output == NULL) {
+            qos_output = strcmp(argv[i] + 4, "-") == 0
+                       ? stdout : fopen(argv[i] + 4, "w");
+            if (qos_output == NULL) {
+                perror("Unable to open the telemetry output");
+                exit(EXIT_FAILURE);
+            }
         }
     }
 
@@ -87,10 +732,16 @@ int main(int argc, char** argv) {
     action.sa_handler = term;
     sigaction(SIGTERM, &action, NULL);
     sigaction(SIGINT, &action, NULL);
+    TRACE_INIT();
 
-    // Open connection to the server
+    // Open connection to the server, on another port for relays, see netem.h
     server_addr.sin_family = AF_INET;
     server_addr.sin_port = htons(1664);
+    port = strchr(argv[1], ':');
+    if (port != NULL) {
+        *port++ = '\0';
+        server_addr.sin_port = htons(atoi(port));
+    }
     server_addr.sin_addr.s_addr = inet_addr(argv[1]);
     sock = socket(AF_INET, SOCK_DGRAM, 0);
     if (sock < 0) {
@@ -98,126 +749,210 @@ int main(int argc, char** argv) {
         exit(EXIT_FAILURE);
     }
 
+    // Browse the catalog instead of streaming if asked to
+    if (strcmp(argv[2], "-l") == 0 || strcmp(argv[2], "-s") == 0) {
+        i = browse_catalog(sock, &server_addr,
+                           argv[2][1] == 'l' ? CATALOG_PREFIX
+                                             : CATALOG_SUBSTRING,
+                           argc > 3 ? argv[3] : "",
+                           argc > 4 ? strtoul(argv[4], NULL, 10) : 0);
+        close(sock);
+        exit(i < 0 ? EXIT_FAILURE : EXIT_SUCCESS);
+    }
+
+    // Print the statistics of the server instead of streaming if asked to
+    if (strcmp(argv[2], "-i") == 0) {
+        i = print_stats(sock, &server_addr);
+        close(sock);
+        exit(i < 0 ? EXIT_FAILURE : EXIT_SUCCESS);
+    }
+
     // Send the request
-    msg_buffer[0] = REQ_STREAMING;
-    for (i = 1; i < MSG_LENGTH-2; i++) {
-        if (i-1 < strlen(argv[2])) {
-            msg_buffer[i] = argv[2][i-1];
+    if (strcmp(argv[2], "-p") == 0) {
+        if (protocol_encode_playlist(msg_buffer, (const char**) filenames,
+                                     nb_tracks, variant, capabilities) < 0)
+        {
+            fprintf(stderr, "The names of the tracks are too long.\n");
+            close(sock);
+            exit(EXIT_FAILURE);
         }
-        else {
-            msg_buffer[i] = '\0';
+    }
+    else if (strcmp(argv[2], "-m") == 0) {
+        if (protocol_encode_mix(msg_buffer, (const char**) filenames, gains,
+                                nb_tracks, variant, capabilities) < 0)
+        {
+            fprintf(stderr, "The names of the files are too long.\n");
+            close(sock);
+            exit(EXIT_FAILURE);
         }
     }
-    msg_buffer[MSG_LENGTH-2] = '\0';
-    msg_buffer[MSG_LENGTH-1] = REQ_STREAMING;
+    else {
+        protocol_encode_streaming(msg_buffer, argv[2], variant, capabilities);
+    }
     msg_len = send_message(sock, &server_addr, msg_buffer);
     if (msg_len < 0) {
         close(sock);
         exit(EXIT_FAILURE);
     }
 
-    // Wait for the answer
-    flen = sizeof(struct sockaddr_in);
-    msg_len = recvfrom(sock, msg_buffer, MSG_LENGTH, 0,
-                       (struct sockaddr*) &server_addr, &flen);
-    if (msg_len < 0) {
-        perror("Message reception failed");
-        close(sock);
-        exit(EXIT_FAILURE);
-    }
-    if (msg_buffer[0] != msg_buffer[MSG_LENGTH-1]) {
+    // Wait for the answer. Data overtaking it on the network is dropped.
+    do {
+        flen = sizeof(struct sockaddr_in);
+        msg_len = recvfrom(sock, msg_buffer, MSG_LENGTH, 0,
+                           (struct sockaddr*) &server_addr, &flen);
+        if (msg_len < 0) {
+            perror("Message reception failed");
+            close(sock);
+            exit(EXIT_FAILURE);
+        }
+        type = protocol_type(msg_buffer, msg_len);
+    } while (type == RESP_DATA || type == RESP_PACKED);
+    if (type < 0) {
         fprintf(stderr, "Bad formated message received");
         close(sock);
         exit(EXIT_FAILURE);
     }
 
     // Parse answer
-    sample_rate = 0;
-    sample_size = 0;
-    channels = 0;
-    nb_packets = 0;
-    switch (msg_buffer[0]) {
+    switch (type) {
         case RESP_ERROR:
             print_errmess(msg_buffer);
             close(sock);
             exit(EXIT_FAILURE);
             break;
         case RESP_STREAMINFO:
-            for (i = 0; i < 4; i++) {
-                sample_rate += (msg_buffer[1+i] << (8*i));
-                sample_size += (msg_buffer[5+i] << (8*i));
-                channels += (msg_buffer[9+i] << (8*i));
-                nb_packets += (msg_buffer[13+i] << (8*i));
-            }
-            printf("sample_rate=%d, sample_size=%d, channels=%d, "
-                    "nb_packets=%d\n", sample_rate, sample_size, channels,
-                    nb_packets);
-
+            protocol_decode_streaminfo(msg_buffer, &info);
             break;
         default:
-            fprintf(stderr, "Unhandled response code: %x\n",
-                    msg_buffer[0] & 0xff);
+            fprintf(stderr, "Unhandled response code: %x\n", type);
             close(sock);
             exit(EXIT_FAILURE);
     }
 
-    if (force_mono != 0) {
-        channels = 1;
+    // The tracks of the session are shared by the receiver and the player.
+    shmid = shmget(IPC_PRIVATE, sizeof(struct playlist), 0600);
+    if (shmid == -1) {
+        perror("Unable to allocate shared memory");
+        close(sock);
+        exit(EXIT_FAILURE);
+    }
+    playlist = (struct playlist*) shmat(shmid, NULL, 0);
+    shmctl(shmid, IPC_RMID, NULL);
+    if (playlist == (void*) -1) {
+        perror("Shared memory attachment failed");
+        close(sock);
+        exit(EXIT_FAILURE);
     }
+    playlist->nb_known = 0;
+    playlist->over = 0;
 
-    // Init audio file descriptor
-    audout_fd = aud_writeinit(sample_rate, sample_size, channels);
-    if (audout_fd < 0) {
-        perror("Error while attempting to play the audio file");
+    // Create a buffer to store the received data of the first track
+    memset(buffers, 0, sizeof(buffers));
+    buffers[0] = add_track(playlist, &info);
+    if (buffers[0] == NULL) {
+        shmdt((void*) playlist);
         close(sock);
         exit(EXIT_FAILURE);
     }
+    track = &playlist->tracks[0];
+    playlist->nb_tracks = track->info.nb_tracks;
+    if (playlist->nb_tracks > PLAYLIST_MAX_TRACKS) {
+        playlist->nb_tracks = PLAYLIST_MAX_TRACKS;
+    }
 
-    // Create a buffer to store received data
-    shmid = shmget(IPC_PRIVATE,
-                   nb_packets * DATA_LENGTH * sizeof(unsigned char),
-                   0600);
-    if (shmid == -1) {
-        perror("Unable to allocate shared memory");
+    // Init audio file descriptor
+    live = (track->info.flags & STREAMINFO_LIVE) != 0;
+    in_format = check_streaminfo(&track->info);
+    playback_init(&playback, &sink, buffers[0], track->info.nb_packets,
+                  &track->received);
+    playback.length = track->info.length;
+    if (in_format < 0 ||
+        open_output(&playback, &sink, sink_spec, &track->info, in_format,
+                    force_mono, latency, prebuffer) < 0)
+    {
+        shmdt((void*) buffers[0]);
+        shmctl(track->shmid, IPC_RMID, NULL);
+        shmdt((void*) playlist);
         close(sock);
         exit(EXIT_FAILURE);
     }
-    data_buffer = (unsigned char*) shmat(shmid, NULL, 0);
-    if (data_buffer == NULL) {
-        perror("Shared memory attachment failed");
-        shmctl(shmid, IPC_RMID, NULL);
+    playback.compensate = compensate;
+    opened = 1;
+    // A live stream is played from its ring until it is over.
+    if (live) {
+        playback.nb_packets = INT_MAX;
+        playback.ring = LIVE_RING_PACKETS * DATA_LENGTH;
+        if (playback.prebuffer > playback.ring / 2) {
+            playback.prebuffer = playback.ring / 2;
+        }
+    }
+
+    // The server sends a block every SENDER_PERIOD / CODEC_BLOCKS, or as
+    // soon as it is captured if live. Heartbeats are sent at the nominal
+    // rate of HEARTBEAT_FREQUENCY packets every SENDER_PERIOD either way.
+    total_blocks = track->info.total_packets * CODEC_BLOCKS;
+    block_period = SENDER_PERIOD / CODEC_BLOCKS;
+    if (live) {
+        block_period = (long long) DATA_LENGTH * 1000000 / CODEC_BLOCKS
+                     / (track->info.sample_rate * track->info.channels
+                        * (track->info.sample_size / 8));
+    }
+    heartbeat_blocks = HEARTBEAT_FREQUENCY * SENDER_PERIOD
+                     / (block_period > 0 ? block_period : 1);
+    qos = qos_create(total_blocks, block_period, qos_output);
+    if (qos == NULL) {
+        perror("Unable to allocate the telemetry");
+        sink_close(&sink);
+        shmdt((void*) buffers[0]);
+        shmctl(track->shmid, IPC_RMID, NULL);
+        shmdt((void*) playlist);
         close(sock);
         exit(EXIT_FAILURE);
     }
 
-    // Create a subprocess to read the buffer and write it to the audio fd.
-    // The parent handles messages reception from the server.
+    // Create a subprocess to receive the messages from the server. The parent
+    // reads the buffers and writes them to the audio fd.
     pid = fork();
     if (pid == -1) {
         perror("Fork failed");
-        shmdt((void*) data_buffer);
-        shmctl(shmid, IPC_RMID, NULL);
+        sink_close(&sink);
+        shmdt((void*) buffers[0]);
+        shmctl(track->shmid, IPC_RMID, NULL);
+        shmdt((void*) playlist);
         close(sock);
         exit(EXIT_FAILURE);
     }
     else if (pid == 0) {
-        packet_id = -1;
-        for (packets_received = 0; packets_received < nb_packets && done == 0;
-             packets_received++)
-        {
+        // Reception is counted in blocks, see codec.h.
+        memset(track_blocks, 0, sizeof(track_blocks));
+        blocks_received = 0;
+        next_heartbeat = 0;
+        live_id = 0;
+        while ((live || blocks_received < total_blocks) && done == 0) {
             FD_ZERO(&read_set);
             FD_SET(sock, &read_set);
             timeout.tv_sec = 5;
             timeout.tv_usec = 0;
+            // A live source may go quiet for a while, during which the
+            // session is kept alive.
+            if (live) {
+                timeout.tv_sec = 0;
+                timeout.tv_usec = HEARTBEAT_FREQUENCY * SENDER_PERIOD;
+            }
             sel = select(sock+1, &read_set, NULL, NULL, &timeout);
             if (sel < 0) {
                 perror("Timeout error");
                 continue;
             }
+            if (sel == 0 && live) {
+                send_heartbeat(sock, &server_addr, qos, blocks_received);
+                continue;
+            }
             if (sel == 0) {
                 fprintf(stderr, "Server connection timeout.\n"
-                                "Received %d/%d packets\n", packets_received,
-                        nb_packets);
+                                "Received %d/%d packets\n",
+                        blocks_received / CODEC_BLOCKS,
+                        total_blocks / CODEC_BLOCKS);
                 break;
             }
             msg_len = recvfrom(sock, msg_buffer, MSG_LENGTH, 0,
@@ -226,46 +961,180 @@ int main(int argc, char** argv) {
                 perror("Message reception failed");
                 continue;
             }
-            if (msg_buffer[0] != msg_buffer[MSG_LENGTH-1]) {
-                perror("Bad formed response");
+            type = protocol_type(msg_buffer, msg_len);
+            if (type < 0) {
+                fprintf(stderr, "Bad formed response.\n");
                 continue;
             }
-            if (msg_buffer[0] == RESP_ERROR) {
+            if (type == RESP_ERROR) {
                 print_errmess(msg_buffer);
                 break;
             }
-            if (msg_buffer[0] != RESP_DATA) {
+            // The next track is announced ahead of time, and again when it
+            // starts.
+            if (type == RESP_STREAMINFO) {
+                protocol_decode_streaminfo(msg_buffer, &info);
+                k = playlist->nb_known;
+                if (info.track != k || k >= playlist->nb_tracks) {
+                    continue;
+                }
+                buffers[k] = add_track(playlist, &info);
+                if (buffers[k] == NULL) {
+                    break;
+                }
+                // The server sends two tracks at most at once, so the one
+                // before the previous is over.
+                if (k >= 2 && buffers[k-2] != NULL) {
+                    shmdt((void*) buffers[k-2]);
+                    buffers[k-2] = NULL;
+                }
+                continue;
+            }
+            if (type != RESP_DATA && type != RESP_PACKED) {
                 fprintf(stderr, "Unexpected response.\n");
                 continue;
             }
-            packet_id = 0;
-            for (i = 0; i < 4; i++) {
-                packet_id += (msg_buffer[1+i] << (8*i));
+            // Blocks of a live stream are numbered from its first packet.
+            // Its data is raw: a packed message, or a packet the ring moved
+            // past already, carries nothing to count.
+            if (live) {
+                k = 0;
+                nb_unpacked = unpack_live(msg_buffer, buffers[0],
+                                          &playlist->tracks[0], &live_id);
+                if (nb_unpacked == 0) {
+                    continue;
+                }
+                first_block = (long) live_id * CODEC_BLOCKS;
+            }
+            else {
+                if (type == RESP_DATA) {
+                    first_block = (long) protocol_decode_data(msg_buffer)
+                                * CODEC_BLOCKS;
+                }
+                else {
+                    protocol_decode_packed(msg_buffer, &packed);
+                    first_block = packed.first_block;
+                }
+                k = find_track(playlist, first_block / CODEC_BLOCKS);
+                if (k < 0 || buffers[k] == NULL) {
+                    continue;
+                }
+                nb_unpacked = unpack_data(msg_buffer, buffers[k],
+                                          playlist->tracks[k].info
+                                                          .first_packet,
+                                          playlist->tracks[k].info.nb_packets,
+                                          playlist->tracks[k].info.channels);
+            }
+            if (nb_unpacked < 0) {
+                fprintf(stderr, "Corrupted packed data.\n");
+                continue;
+            }
+            // Duplicate blocks are only counted once.
+            nb_unpacked = qos_receive(qos, first_block, nb_unpacked);
+            TRACE(TRACE_RECEIVE, first_block, nb_unpacked);
+            blocks_received += nb_unpacked;
+            if (!live) {
+                track_blocks[k] += nb_unpacked;
+                playlist->tracks[k].received = track_blocks[k] / CODEC_BLOCKS;
             }
-            for (i = 0; i < DATA_LENGTH; i++) {
-                data_buffer[(packet_id*DATA_LENGTH)+i] = msg_buffer[5+i];
+            if (blocks_received >= next_heartbeat) {
+                send_heartbeat(sock, &server_addr, qos, blocks_received);
+                next_heartbeat = blocks_received + heartbeat_blocks;
+            }
+        }
+        // Nothing more will be received: what is missing is played as
+        // silence. A live stream has no end to play up to, so its playback
+        // is stopped instead.
+        for (k = 0; k < playlist->nb_known; k++) {
+            if (!live) {
+                playlist->tracks[k].received =
+                    playlist->tracks[k].info.nb_packets;
             }
-            if (packets_received % HEARTBEAT_FREQUENCY == 0) {
-                msg_buffer[0] = REQ_HEARTBEAT;
-                msg_buffer[MSG_LENGTH-1] = REQ_HEARTBEAT;
-                send_message(sock, &server_addr, msg_buffer);
+            if (buffers[k] != NULL) {
+                shmdt((void*) buffers[k]);
             }
         }
+        playlist->over = 1;
+        if (live) {
+            kill(getppid(), SIGTERM);
+        }
     }
     else {
-        for (i = 0; i < nb_packets && done == 0; i++) {
-            write(audout_fd, data_buffer+(i*DATA_LENGTH),
-                  DATA_LENGTH * sizeof(unsigned char));
+        // The buffer of each track is freed once both processes detach it.
+        memset(removed, 0, sizeof(removed));
+        data_buffer = buffers[0];
+        for (k = 0; k < playlist->nb_tracks && !done; k++) {
+            while (playlist->nb_known <= k && !playlist->over && !done) {
+                usleep(PLAYBACK_POLL_PERIOD);
+            }
+            if (playlist->nb_known <= k) {
+                break;
+            }
+            __sync_synchronize();
+            track = &playlist->tracks[k];
+            if (k > 0) {
+                data_buffer = (unsigned char*) shmat(track->shmid, NULL, 0);
+                if (data_buffer == (void*) -1) {
+                    perror("Shared memory attachment failed");
+                    break;
+                }
+            }
+            shmctl(track->shmid, IPC_RMID, NULL);
+            removed[k] = 1;
+
+            if (k > 0) {
+                previous = &playlist->tracks[k-1].info;
+                in_format = check_streaminfo(&track->info);
+                if (in_format < 0) {
+                    shmdt((void*) data_buffer);
+                    break;
+                }
+                // The audio output is kept across tracks of the same format,
+                // otherwise it is reopened, which is not gapless.
+                if (track->info.sample_rate != previous->sample_rate ||
+                    track->info.channels != previous->channels ||
+                    in_format != playback.in_format)
+                {
+                    sink_close(&sink);
+                    opened = open_output(&playback, &sink, sink_spec,
+                                         &track->info, in_format,
+                                         force_mono, latency, prebuffer) == 0;
+                    if (!opened) {
+                        shmdt((void*) data_buffer);
+                        break;
+                    }
+                }
+                playback_next(&playback, data_buffer, track->info.nb_packets,
+                              track->info.length, &track->received);
+            }
+
+            if (playback_run(&playback, &done) < 0) {
+                perror("Error while writing to the audio output");
+                shmdt((void*) data_buffer);
+                break;
+            }
+            shmdt((void*) data_buffer);
+        }
+        playback_report(&playback);
+        qos_summary(qos);
+        if (opened && sink_close(&sink) < 0) {
+            perror("Error while closing the audio output");
+        }
+
+        // The receiver stops as well if playback ended early, and the tracks
+        // that were not played are freed.
+        kill(pid, SIGTERM);
+        waitpid(pid, NULL, 0);
+        for (k = 0; k < playlist->nb_known; k++) {
+            if (!removed[k]) {
+                shmctl(playlist->tracks[k].shmid, IPC_RMID, NULL);
+            }
         }
     }
 
-    shmdt((void*)data_buffer);
+    shmdt((void*) playlist);
+    qos_destroy(qos);
     close(sock);
 
-    if (pid == 0) {
-        wait(NULL);
-        shmctl(shmid, IPC_RMID, NULL);
-    }
-
     return EXIT_SUCCESS;
 }
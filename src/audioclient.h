@@ -6,6 +6,19 @@
  * The client sends the name of the file it whishes to play to the server. It
  * receives the data stream from the server and plays the sound while receiving
  * the data.
+ *
+ * With -p, the client sends a playlist instead, whose tracks the server
+ * streams one after another. Each track is received to a buffer of its own,
+ * created when its stream information arrives, and played for its exact
+ * length, so that tracks of the same format follow one another on the audio
+ * output without a gap.
+ *
+ * With -m, the client sends several files to be mixed by the server, each
+ * one with its gain, and receives their mix as a single track.
+ *
+ * A live stream, see live.h, has no end: it is received to a ring of
+ * LIVE_RING_PACKETS packets, played as it fills, until the server tells the
+ * live source is over or the client is interrupted.
  * ----------------------------------------------------------------------------
  * Antoine Pinsard
  * Mar. 17, 2015
@@ -14,8 +27,39 @@
 #define _AUDIOCLIENT_H_
 
 #include <arpa/inet.h>
+#include <limits.h>
+#include "catalog.h"
+#include "codec.h"
+#include "convert.h"
 #include "deadbeef.h"
+#include "live.h"
+#include "playback.h"
+#include "protocol.h"
+#include "qos.h"
+#include "sender.h"
+#include "trace.h"
+#include "variant.h"
+
+// Track of the session, as received
+struct client_track {
+    struct streaminfo info;
+    int shmid;             // Shared memory of the data of the track
+    // Number of packets received so far, or up to the latest one if live
+    volatile int received;
+};
+
+// Tracks of the session, shared by the receiving and the playing processes
+struct playlist {
+    int nb_tracks;
+    volatile int nb_known; // Tracks whose stream information was received
+    volatile int over;     // Nothing more will be received
+    struct client_track tracks[PLAYLIST_MAX_TRACKS];
+};
 
 void print_errmess(unsigned char*);
+int browse_catalog(int, struct sockaddr_in*, int, char*, unsigned long);
+int print_stats(int, struct sockaddr_in*);
+int unpack_data(unsigned char*, unsigned char*, uint32_t, int, int);
+unsigned char* add_track(struct playlist*, struct streaminfo*);
 
 #endif
@@ -16,6 +16,22 @@
 
 
 volatile sig_atomic_t done = 0;
+int sender_backend = SENDER_BLOCKING;
+// Serve each session in a process of its own rather than in the streamer
+int fork_sessions = 0;
+long cache_max_length = VARIANT_CACHE_MAX_LENGTH;
+struct stats* server_stats = NULL;
+// Live sources given with -L, see live.h
+struct live_source live_sources[LIVE_MAX_SOURCES];
+int nb_live_sources = 0;
+// Index of the catalog, out of the library if the library is read-only
+char index_path[PATH_MAX] = CATALOG_INDEX;
+// Latest catalog mapped by the streamer, see start_session()
+struct catalog* streamer_catalog = NULL;
+// Write end of the pipe to the cache builder, see run_builder()
+int builder_pipe = -1;
+// Messages of the sessions of the streamer, sent at the end of each tick
+struct sender_batch* streamer_batch = NULL;
 
 
 void term(int signum) {
@@ -69,6 +85,7 @@ void destroy_client_list(struct client_list* list, int sock) {
         if (addr != NULL) {
             send_error_message(sock, addr, 0xDEADDEAD,
                                "Sorry, I gotta go. My mum's shouting at me.");
+            free(addr);
         }
     }
     list->nb_clients = 0;
@@ -102,7 +119,7 @@ int append_client(struct client_list* list, struct sockaddr_in* addr) {
     for (client_id = 0; client_id < MAX_NB_CLIENTS; client_id++) {
         if (list->clients[client_id] != NULL &&
             list->clients[client_id]->handler == -1) {
-            remove_client(list, client_id, 0);
+            free(remove_client(list, client_id, 0));
         }
     }
 
@@ -118,7 +135,8 @@ int append_client(struct client_list* list, struct sockaddr_in* addr) {
     }
     assert(client_id < MAX_NB_CLIENTS);
 
-    // Create the new client
+    // Create the new client. Its address is copied, since addr is reused for
+    // the next requests. Handlers inherit the copy when forked.
     shmid = shmget(IPC_PRIVATE, sizeof(struct client), 0600);
     if (shmid == -1) {
         perror("Shared memory allocation failed");
@@ -127,12 +145,21 @@ int append_client(struct client_list* list, struct sockaddr_in* addr) {
     client = (struct client*) shmat(shmid, NULL, 0);
     if (client == NULL) {
         perror("Dynamic allocation failed");
+        shmctl(shmid, IPC_RMID, NULL);
+        return -2;
+    }
+    client->addr = malloc(sizeof(struct sockaddr_in));
+    if (client->addr == NULL) {
+        perror("Dynamic allocation failed");
+        shmdt((void*) client);
+        shmctl(shmid, IPC_RMID, NULL);
         return -2;
     }
+    memcpy(client->addr, addr, sizeof(struct sockaddr_in));
     client->shmid = shmid;
-    client->addr = addr;
     client->handler = -1;
-    client->heartbeat_counter = HEARTBEAT_THRESHOLD;
+    client->last_heartbeat = deadbeef_now_us();
+    client->expired = 0;
 
     // Store then new client
     list->clients[client_id] = client;
@@ -147,210 +174,1314 @@ int append_client(struct client_list* list, struct sockaddr_in* addr) {
  *
  * Kill the process handler if kill_handler is set;
  *
- * Return the removed client address.
- * Return NULL if there was no client with the given identifier.
+ * Return the removed client address, to be freed by the caller.
+ * Return NULL if there was no client with the given identifier.
+ */
+struct sockaddr_in* remove_client(struct client_list* list, int client_id,
+                                  int kill_handler)
+{
+    int shmid;
+    struct sockaddr_in* addr;
+    pid_t handler;
+
+    assert(list != NULL);
+    assert(client_id >= 0);
+    assert(client_id < MAX_NB_CLIENTS);
+
+    if (list->clients[client_id] == NULL) {
+        return NULL;
+    }
+
+    handler = list->clients[client_id]->handler;
+
+    addr = list->clients[client_id]->addr;
+    shmid = list->clients[client_id]->shmid;
+    shmdt((void*) list->clients[client_id]);
+    shmctl(shmid, IPC_RMID, NULL);
+    list->clients[client_id] = NULL;
+    list->nb_clients--;
+
+    if (kill_handler && handler > 0) {
+        kill(handler, SIGKILL);
+    }
+
+    return addr;
+}
+
+
+/**
+ * Set the time of the last heartbeat of the client matching the given addr to
+ * now.
+ *
+ * Return -1 if no client matched.
+ * Return the client_id otherwise.
+ */
+int notify_heartbeat(struct client_list* list, struct sockaddr_in* addr) {
+    int client_id;
+    struct sockaddr_in* client_addr;
+
+    assert(list != NULL);
+    assert(addr != NULL);
+
+    // Search the client that has the given addr.
+    for (client_id = 0; client_id < MAX_NB_CLIENTS; client_id++) {
+        if (list->clients[client_id] == NULL) {
+            continue;
+        }
+        client_addr = list->clients[client_id]->addr;
+        if (client_addr->sin_port == addr->sin_port &&
+            client_addr->sin_addr.s_addr == addr->sin_addr.s_addr)
+        {
+            break;
+        }
+    }
+    if (client_id == MAX_NB_CLIENTS) {
+        return -1;
+    }
+
+    list->clients[client_id]->last_heartbeat = deadbeef_now_us();
+
+    return client_id;
+}
+
+
+/**
+ * Sweep the clients being streamed to and drop those whose last heartbeat is
+ * older than timeout us. Each one is sent a last error message, and its
+ * handler is killed, or its session closed by the streamer.
+ *
+ * Streams cost nothing per packet to watch, and a dead client is dropped
+ * within timeout and the delay between two sweeps.
+ *
+ * Return the number of clients dropped.
+ */
+int expire_clients(struct client_list* list, int sock, long long timeout,
+                   int pipe_fd, pid_t streamer)
+{
+    struct client* client;
+    struct session_request request;
+    long long now;
+    int client_id
+      , nb_expired;
+
+    assert(list != NULL);
+
+    now = deadbeef_now_us();
+    nb_expired = 0;
+    for (client_id = 0; client_id < MAX_NB_CLIENTS; client_id++) {
+        client = list->clients[client_id];
+        if (client == NULL || client->handler == -1 || client->expired ||
+            now - client->last_heartbeat < timeout)
+        {
+            continue;
+        }
+
+        TRACE(TRACE_TIMEOUT, client_id, (now - client->last_heartbeat) / 1000);
+        printf("Client timeout.\n");
+        // Not to be printed again by the next forked handler
+        fflush(stdout);
+        server_stats->slots[client_id].timeouts++;
+        if (client->handler == streamer) {
+            memset(&request, 0, sizeof(struct session_request));
+            request.close = 1;
+            request.client_id = client_id;
+            request.shmid = client->shmid;
+            // A broken pipe is noticed by the next sweep, see main().
+            if (write(pipe_fd, &request, sizeof(struct session_request))
+                != sizeof(struct session_request) && errno != EPIPE)
+            {
+                perror("Session request failed");
+            }
+            // The slot stays taken until the streamer drops the session,
+            // which it may still count until its next message is due.
+            client->expired = 1;
+        }
+        else {
+            kill(client->handler, SIGKILL);
+            waitpid(client->handler, NULL, 0);
+            client->handler = -1;
+        }
+        send_error_message(sock, client->addr, 0xDEADBEA7,
+                           "Bist du tot oder was ?");
+        nb_expired++;
+    }
+
+    return nb_expired;
+}
+
+
+/**
+ * Fill info with the format of the stream of a catalog entry, converted to
+ * the requested variant if the format of the file allows it, and compressed
+ * if the client advertised it supports it in its capabilities and if the
+ * format of the file allows it.
+ *
+ * Return the variant of the stream.
+ */
+static int stream_format(struct catalog_entry* entry, int requested_variant,
+                         int capabilities, struct streaminfo* info)
+{
+    unsigned long stream_length;
+    int format
+      , sample_rate
+      , sample_size
+      , channels
+      , variant;
+
+    format = entry->format;
+    sample_rate = entry->sample_rate;
+    sample_size = entry->sample_size;
+    channels = entry->channels;
+    variant = variant_select(entry, requested_variant);
+    variant_format(variant, &format, &sample_rate, &sample_size, &channels);
+
+    // Only the samples are sent, not the header of the file.
+    stream_length = entry->data_length;
+    if (variant != 0) {
+        stream_length = variant_length(entry->data_length,
+                                       convert_format(entry->format,
+                                                      entry->sample_size),
+                                       entry->channels, variant);
+    }
+
+    info->sample_rate = sample_rate;
+    info->sample_size = sample_size;
+    info->channels = channels;
+    info->nb_packets = stream_length / DATA_LENGTH;
+    if (stream_length % DATA_LENGTH != 0)
+        info->nb_packets++;
+    info->encoding = CODEC_RAW;
+    if ((capabilities & CAP_RICE) && codec_supports(sample_size, channels)) {
+        info->encoding = CODEC_RICE;
+    }
+    info->format = format;
+    info->length = stream_length;
+    info->flags = 0;
+
+    return variant;
+}
+
+
+/**
+ * Fill info with the format of the mix of a session: 16-bit samples at the
+ * sample rate and on the channels of its first entry converted to the
+ * requested variant, as long as its longest entry, and compressed as by
+ * stream_format(). variants is filled with the variant converting each entry
+ * to the mix, see mixer_variant().
+ *
+ * Return 0, or -1 if an entry cannot be converted to the mix.
+ */
+static int mix_format(struct session* session, int* variants,
+                      struct streaminfo* info)
+{
+    struct catalog_entry* entry;
+    off_t stream_length
+        , length;
+    int format
+      , sample_rate
+      , sample_size
+      , channels
+      , i;
+
+    // The variant of the mix is the one of its first entry.
+    entry = session->entries[0];
+    format = entry->format;
+    sample_rate = entry->sample_rate;
+    sample_size = entry->sample_size;
+    channels = entry->channels;
+    variant_format(variant_select(entry, session->variant | VARIANT_S16),
+                   &format, &sample_rate, &sample_size, &channels);
+    if (sample_size != 16 || channels > CODEC_MAX_CHANNELS) {
+        return -1;
+    }
+
+    stream_length = 0;
+    for (i = 0; i < session->nb_inputs; i++) {
+        variants[i] = mixer_variant(session->entries[i], sample_rate,
+                                    channels);
+        if (variants[i] < 0) {
+            return -1;
+        }
+        length = mixer_input_length(session->entries[i], variants[i],
+                                    channels);
+        if (length > stream_length) {
+            stream_length = length;
+        }
+    }
+
+    info->sample_rate = sample_rate;
+    info->sample_size = 16;
+    info->channels = channels;
+    info->nb_packets = stream_length / DATA_LENGTH;
+    if (stream_length % DATA_LENGTH != 0)
+        info->nb_packets++;
+    info->encoding = CODEC_RAW;
+    if ((session->capabilities & CAP_RICE) && codec_supports(16, channels)) {
+        info->encoding = CODEC_RICE;
+    }
+    info->format = AUD_FORMAT_PCM;
+    info->length = stream_length;
+    info->flags = 0;
+
+    return 0;
+}
+
+
+/**
+ * Sender callback of the tracks of an adaptive session: remember when the
+ * packet was sent, read the digest of the last heartbeat of the client if it
+ * is new, and apply the quality tier it leads to, see abr.h, from the next
+ * packet on. The digest is written by the main process, see stats.h.
+ *
+ * Return 0, so that sending goes on.
+ */
+static int adapt_session(int packet, void* data) {
+    struct session* session;
+    struct stats_slot* slot;
+    struct heartbeat_digest digest;
+    uint64_t heartbeats;
+    long long time;
+
+    session = (struct session*) data;
+    abr_sent(&session->abr, packet, deadbeef_now_us());
+
+    slot = &server_stats->slots[session->client_id];
+    heartbeats = slot->heartbeats;
+    if (heartbeats != session->abr.heartbeats) {
+        __sync_synchronize();
+        digest = slot->digest;
+        time = slot->heartbeat_time;
+        session->abr.heartbeats = heartbeats;
+        if (digest.valid && abr_update(&session->abr, &digest, time)) {
+            TRACE(TRACE_TIER, session->client_id, session->abr.tier);
+        }
+    }
+    session->tracks[session->current % 2].sender.reduction =
+        abr_reduction(&session->abr);
+
+    return 0;
+}
+
+
+/**
+ * Open the files of a mix session, the track of the session, and send its
+ * stream information to the client. The mix is computed while it is sent,
+ * and never cached.
+ *
+ * Return 0, or -1 if a file could not be opened.
+ */
+static int open_mix(struct session* session, struct track* track) {
+    struct catalog_entry* entry;
+    struct aud_source* source;
+    struct mix* mix;
+    unsigned char msg_buffer[MSG_LENGTH];
+    int variants[MIX_MAX_INPUTS];
+    int i;
+
+    if (mix_format(session, variants, &track->info) < 0) {
+        return -1;
+    }
+    track->info.track = 0;
+    track->info.nb_tracks = 1;
+    track->info.first_packet = session->next_packet;
+    track->info.total_packets = session->total_packets;
+    protocol_encode_streaminfo(msg_buffer, &track->info);
+
+    send_message(session->sock, &session->addr, msg_buffer);
+
+    mix = malloc(sizeof(struct mix));
+    if (mix == NULL) {
+        perror("Dynamic allocation failed");
+        return -1;
+    }
+    mixer_init(&mix->mixer, track->info.channels);
+    for (i = 0; i < session->nb_inputs; i++) {
+        entry = session->entries[i];
+        source = &mix->sources[i];
+        if (aud_open(catalog_name(session->catalog, entry), source) < 0) {
+            fprintf(stderr,
+                    "An error happened while attempting to open %s for "
+                    "reading", catalog_name(session->catalog, entry));
+            perror("");
+            break;
+        }
+        // The file is read instead if it changed since it was cataloged.
+        if (mixer_add(&mix->mixer, source->fd, entry->data_offset,
+                      entry->data_length,
+                      source->info.data_offset == entry->data_offset &&
+                      source->length == entry->data_length
+                      ? source->data : NULL,
+                      convert_format(entry->format, entry->sample_size),
+                      entry->channels, variants[i], session->gains[i]) < 0)
+        {
+            aud_close(source);
+            break;
+        }
+        posix_fadvise(source->fd, entry->data_offset, TRACK_PREFETCH,
+                      POSIX_FADV_WILLNEED);
+    }
+    if (i < session->nb_inputs) {
+        mixer_destroy(&mix->mixer);
+        while (i-- > 0) {
+            aud_close(&mix->sources[i]);
+        }
+        free(mix);
+        return -1;
+    }
+
+    track->mix = mix;
+    track->cached = 0;
+    // Open as long as the files of the mix are.
+    track->fd = mix->sources[0].fd;
+    sender_init(&track->sender, session->sock, &session->addr, -1, 0,
+                track->info.length);
+    track->sender.mixer = &mix->mixer;
+    track->sender.nb_packets = track->info.nb_packets;
+    track->sender.first_packet = session->next_packet;
+    track->sender.encoding = track->info.encoding;
+    track->sender.channels = track->info.channels;
+    track->sender.stats = &server_stats->slots[session->client_id].current;
+    if (session->abr.nb_tiers > 1) {
+        track->sender.on_sent = adapt_session;
+        track->sender.data = session;
+    }
+    session->next_packet += track->info.nb_packets;
+
+    return 0;
+}
+
+
+/**
+ * Ask the cache builder to build a stream to the cache at path, see
+ * variant_build() for the other parameters. The request is dropped if the
+ * builder is busy with too many requests already, or gone: the stream is
+ * then requested again the next time it is missed.
+ */
+static void request_build(const char* path, const char* filename,
+                          off_t offset, off_t length, int format,
+                          int channels, int variant, int encoding)
+{
+    struct build_request request;
+
+    if (builder_pipe < 0 || strlen(path) >= BUILD_PATH_LENGTH ||
+        strlen(filename) >= sizeof(request.filename))
+    {
+        return;
+    }
+
+    memset(&request, 0, sizeof(struct build_request));
+    strcpy(request.path, path);
+    strcpy(request.filename, filename);
+    request.offset = offset;
+    request.length = length;
+    request.format = format;
+    request.channels = channels;
+    request.variant = variant;
+    request.encoding = encoding;
+    // The pipe does not block, so that the streams are never delayed.
+    if (write(builder_pipe, &request, sizeof(struct build_request)) < 0 &&
+        errno != EAGAIN && errno != EPIPE)
+    {
+        perror("Build request failed");
+    }
+}
+
+
+/**
+ * Open track k of a session and send its stream information to the client.
+ * The packets of the track are numbered after those of the tracks before it.
+ *
+ * The stream information is taken from the catalog entry, so that it can be
+ * sent before the file is even opened. The first pages of the file are then
+ * read ahead, so that the track starts without delay when the previous one
+ * is over.
+ *
+ * Converted and compressed streams are served from the variant cache. On a
+ * cache miss, the stream is converted live while the cache builder builds it,
+ * see run_builder().
+ *
+ * The track of a mix session is opened by open_mix() instead.
+ *
+ * Return 0, or -1 if the file could not be opened.
+ */
+static int open_track(struct session* session, int k) {
+    const char* filename;
+    char cache_path[PATH_MAX];
+    struct stat st;
+    struct catalog_entry* entry;
+    struct track* track;
+    unsigned char msg_buffer[MSG_LENGTH];
+    unsigned long offset
+                , length;
+    int file_format
+      , variant;
+
+    track = &session->tracks[k % 2];
+    track->mix = NULL;
+    if (session->nb_inputs > 0) {
+        return open_mix(session, track);
+    }
+    entry = session->entries[k];
+    filename = catalog_name(session->catalog, entry);
+    file_format = convert_format(entry->format, entry->sample_size);
+    offset = entry->data_offset;
+    length = entry->data_length;
+
+    // Build the stream info packet
+    variant = stream_format(entry, session->variant, session->capabilities,
+                            &track->info);
+    track->info.track = k;
+    track->info.nb_tracks = session->nb_tracks;
+    track->info.first_packet = session->next_packet;
+    track->info.total_packets = session->total_packets;
+    protocol_encode_streaminfo(msg_buffer, &track->info);
+
+    send_message(session->sock, &session->addr, msg_buffer);
+
+    track->fd = -1;
+    track->cached = 0;
+    if ((variant != 0 || track->info.encoding != CODEC_RAW) &&
+        variant_cache_path(cache_path, PATH_MAX, session->catalog, entry,
+                           variant, track->info.encoding) == 0)
+    {
+        track->fd = variant_cache_open(cache_path);
+        track->cached = track->fd >= 0 && fstat(track->fd, &st) == 0;
+        if (track->fd >= 0 && !track->cached) {
+            close(track->fd);
+            track->fd = -1;
+        }
+        if (!track->cached) {
+            request_build(cache_path, filename, offset, length, file_format,
+                          entry->channels, variant, track->info.encoding);
+        }
+    }
+
+    // The file is read progressively, so that the first packet is sent as
+    // soon as possible and memory usage does not depend on the file size.
+    // Its samples are mapped rather than copied to a read window.
+    if (!track->cached && aud_open(filename, &track->source) == 0) {
+        track->fd = track->source.fd;
+    }
+    if (track->fd < 0) {
+        fprintf(stderr,
+                "An error happened while attempting to open %s for reading",
+                filename);
+        perror("");
+        return -1;
+    }
+    posix_fadvise(track->fd, track->cached ? 0 : offset, TRACK_PREFETCH,
+                  POSIX_FADV_WILLNEED);
+
+    if (track->cached) {
+        sender_init(&track->sender, session->sock, &session->addr, track->fd,
+                    0, st.st_size);
+        track->sender.preencoded = track->info.encoding != CODEC_RAW;
+    }
+    else {
+        sender_init(&track->sender, session->sock, &session->addr, track->fd,
+                    offset, length);
+        // The file is read instead if it changed since it was cataloged.
+        if (track->source.info.data_offset == offset &&
+            track->source.length == length &&
+            track->source.data != NULL)
+        {
+            track->sender.map = track->source.data;
+        }
+        track->sender.variant = variant;
+        track->sender.file_format = file_format;
+        track->sender.file_channels = entry->channels;
+    }
+    track->sender.nb_packets = track->info.nb_packets;
+    track->sender.first_packet = session->next_packet;
+    track->sender.encoding = track->info.encoding;
+    track->sender.channels = track->info.channels;
+    track->sender.stats = &server_stats->slots[session->client_id].current;
+    if (session->abr.nb_tiers > 1) {
+        track->sender.on_sent = adapt_session;
+        track->sender.data = session;
+    }
+    session->next_packet += track->info.nb_packets;
+
+    return 0;
+}
+
+
+/**
+ * Close the file of a track, or the files of its mix, if open, and release
+ * its sender.
+ */
+static void close_track(struct track* track) {
+    int i;
+
+    if (track->fd < 0) {
+        return;
+    }
+    sender_close(&track->sender);
+    if (track->mix != NULL) {
+        for (i = 0; i < track->mix->mixer.nb_inputs; i++) {
+            aud_close(&track->mix->sources[i]);
+        }
+        mixer_destroy(&track->mix->mixer);
+        free(track->mix);
+        track->mix = NULL;
+    }
+    else if (track->cached) {
+        close(track->fd);
+    }
+    else {
+        aud_close(&track->source);
+    }
+    track->fd = -1;
+}
+
+
+/**
+ * Open a session streaming the nb_tracks given catalog entries to a client,
+ * one after another, see open_track(). A streaming request is a session of a
+ * single track. The track after the current one is always opened ahead of
+ * time, see next_track().
+ *
+ * If gains is not NULL, the entries are rather mixed into a single track
+ * with these gains, see open_mix().
+ *
+ * Return the session, whose sender of the current track is ready to run, to
+ * be closed with close_session().
+ * Return NULL if the first file could not be opened, in which case the client
+ * has been sent an error message and is released as by close_session().
+ */
+struct session* open_session(struct catalog* catalog,
+                             struct catalog_entry** entries, int nb_tracks,
+                             const int* gains, struct client* client,
+                             struct sockaddr_in* addr, int client_id,
+                             int requested_variant, int capabilities, int sock)
+{
+    struct session* session;
+    struct streaminfo info;
+    int variants[MIX_MAX_INPUTS];
+    int k;
+
+    assert(catalog != NULL);
+    assert(entries != NULL);
+    assert(nb_tracks > 0 && nb_tracks <= PLAYLIST_MAX_TRACKS);
+    assert(gains == NULL || nb_tracks <= MIX_MAX_INPUTS);
+    assert(client != NULL);
+    assert(addr != NULL);
+
+    session = malloc(sizeof(struct session));
+    if (session == NULL) {
+        perror("Dynamic allocation failed");
+        send_error_message(sock, addr, 0x00C0FFEE,
+                           "I'm really sorry, but I'm swamped right now!");
+        client->handler = -1;
+        shmdt((void*) client);
+        return NULL;
+    }
+    session->catalog = catalog;
+    session->client_id = client_id;
+    session->client = client;
+    session->addr = *addr;
+    session->sock = sock;
+    memcpy(session->entries, entries,
+           nb_tracks * sizeof(struct catalog_entry*));
+    session->nb_tracks = nb_tracks;
+    session->nb_inputs = 0;
+    if (gains != NULL) {
+        session->nb_tracks = 1;
+        session->nb_inputs = nb_tracks;
+        memcpy(session->gains, gains, nb_tracks * sizeof(int));
+    }
+    session->variant = requested_variant;
+    session->capabilities = capabilities;
+    session->current = 0;
+    session->next_packet = 0;
+    session->failed = 0;
+    session->expired = 0;
+    session->tracks[0].fd = -1;
+    session->tracks[1].fd = -1;
+    session->live = NULL;
+    // Clients that decode reduced blocks get the quality their link allows.
+    abr_init(&session->abr,
+             (capabilities & CAP_RICE) && (capabilities & CAP_REDUCED)
+             ? ABR_NB_TIERS : 1, deadbeef_now_us());
+
+    // The client sizes its buffers from the length of the whole session.
+    session->total_packets = 0;
+    for (k = 0; gains == NULL && k < nb_tracks; k++) {
+        stream_format(entries[k], requested_variant, capabilities, &info);
+        session->total_packets += info.nb_packets;
+    }
+    if (gains != NULL && mix_format(session, variants, &info) < 0) {
+        send_error_message(sock, addr, 0x0BADC0DE,
+                           "The files to mix have incompatible formats.");
+        free(session);
+        client->handler = -1;
+        shmdt((void*) client);
+        return NULL;
+    }
+    if (gains != NULL) {
+        session->total_packets = info.nb_packets;
+    }
+
+    if (open_track(session, 0) < 0) {
+        send_error_message(sock, addr, 0xDEADF11E,
+                           "An error occured while attempting to read the "
+                           "requested file.");
+        free(session);
+        client->handler = -1;
+        shmdt((void*) client);
+        return NULL;
+    }
+    // The session ends with an error after the tracks before the missing one.
+    if (nb_tracks > 1 && open_track(session, 1) < 0) {
+        session->nb_tracks = 1;
+        session->failed = 1;
+    }
+
+    return session;
+}
+
+
+/**
+ * Open a session streaming a live source to a client, from the packet being
+ * captured on. Its stream information is flagged STREAMINFO_LIVE, with no
+ * number of packets, and its packets are raw, whatever the capabilities of
+ * the client.
+ *
+ * Return the session, to be closed with close_session(), or NULL if it could
+ * not be allocated, in which case the client has been sent an error message
+ * and is released as by close_session().
+ */
+struct session* open_live_session(struct live_source* live,
+                                  struct client* client,
+                                  struct sockaddr_in* addr, int client_id,
+                                  int sock)
+{
+    struct session* session;
+    struct streaminfo* info;
+    unsigned char msg_buffer[MSG_LENGTH];
+
+    assert(live != NULL);
+    assert(client != NULL);
+    assert(addr != NULL);
+
+    session = malloc(sizeof(struct session));
+    if (session == NULL) {
+        perror("Dynamic allocation failed");
+        send_error_message(sock, addr, 0x00C0FFEE,
+                           "I'm really sorry, but I'm swamped right now!");
+        client->handler = -1;
+        shmdt((void*) client);
+        return NULL;
+    }
+    memset(session, 0, sizeof(struct session));
+    session->client_id = client_id;
+    session->client = client;
+    session->addr = *addr;
+    session->sock = sock;
+    session->nb_tracks = 1;
+    session->tracks[0].fd = -1;
+    session->tracks[1].fd = -1;
+    session->live = live;
+    session->next_packet = live_join(live);
+
+    info = &session->tracks[0].info;
+    info->sample_rate = live->sample_rate;
+    info->sample_size = live->sample_size;
+    info->channels = live->channels;
+    info->encoding = CODEC_RAW;
+    info->format = AUD_FORMAT_PCM;
+    info->nb_tracks = 1;
+    info->first_packet = session->next_packet;
+    info->flags = STREAMINFO_LIVE;
+    protocol_encode_streaminfo(msg_buffer, info);
+    send_message(sock, addr, msg_buffer);
+
+    return session;
+}
+
+
+/**
+ * Send the next packet of a live session, if it is captured already. The
+ * capture to send latency of the packet is counted as its lateness.
+ *
+ * flags are those of sendto(): with MSG_DONTWAIT, the packet is sent again
+ * by the next call if the socket would block.
+ *
+ * Return 1 if the packet was sent.
+ * Return 0 if it is not captured yet, or if the socket would block.
+ * Return -1 if the live source ended.
+ */
+static int send_live(struct session* session, int flags) {
+    struct stats_counters* stats;
+    unsigned char msg_buffer[MSG_LENGTH];
+    long long stamp;
+    int ret;
+
+    stats = &server_stats->slots[session->client_id].current;
+    ret = live_read(session->live->ring, &session->next_packet,
+                    msg_buffer + DATA_HEADER_LENGTH, &stamp);
+    if (ret <= 0) {
+        return ret;
+    }
+    protocol_encode_data(msg_buffer, session->next_packet, DATA_LENGTH);
+
+    TRACE(TRACE_SEND, session->next_packet * CODEC_BLOCKS, CODEC_BLOCKS);
+    ret = sendto(session->sock, msg_buffer, MSG_LENGTH, flags,
+                 (struct sockaddr *) &session->addr,
+                 sizeof(struct sockaddr_in));
+    stats_count_send(stats, ret);
+    if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        return 0;
+    }
+    if (ret < 0) {
+        perror("Message sending failed");
+    }
+    stats_count_lateness(stats, deadbeef_now_us() - stamp);
+    session->next_packet++;
+
+    return 1;
+}
+
+
+/**
+ * Move a session on to its next track once the current one is over. The
+ * next track, opened ahead of time, takes over the pacing where the current
+ * one left it, so that the client receives the tracks without a gap, and its
+ * stream information is sent again in case it was lost. The track after it
+ * is then opened ahead of time in turn.
+ *
+ * Return 0 if the session goes on with the next track.
+ * Return SENDER_OVER if the session is over.
+ * Return -1 if the session is over because a track could not be opened.
+ */
+int next_track(struct session* session) {
+    struct track* track;
+    struct track* next;
+    unsigned char msg_buffer[MSG_LENGTH];
+
+    assert(session != NULL);
+
+    track = &session->tracks[session->current % 2];
+    next = &session->tracks[(session->current + 1) % 2];
+    next->sender.deadline = track->sender.deadline;
+    next->sender.nonblocking = track->sender.nonblocking;
+    next->sender.batch = track->sender.batch;
+    next->sender.reduction = track->sender.reduction;
+    close_track(track);
+
+    session->current++;
+    if (session->current >= session->nb_tracks) {
+        return session->failed ? -1 : SENDER_OVER;
+    }
+
+    protocol_encode_streaminfo(msg_buffer, &next->info);
+    send_message(session->sock, &session->addr, msg_buffer);
+    if (session->current + 1 < session->nb_tracks &&
+        open_track(session, session->current + 1) < 0)
+    {
+        session->nb_tracks = session->current + 1;
+        session->failed = 1;
+    }
+
+    return 0;
+}
+
+
+/**
+ * Close the files of a session, given the result of its sender, mark its
+ * client as no longer handled and free the session. The client is told if
+ * its live source ended.
+ */
+void close_session(struct session* session, int ret) {
+    struct client* client;
+
+    assert(session != NULL);
+
+    client = session->client;
+    if (ret < 0) {
+        perror("Error while reading the audio file");
+        send_error_message(session->sock, &session->addr, 0xDEADF11E,
+                           "An error occured while attempting to read the "
+                           "requested file.");
+    }
+    // The listeners of a live source are told when it ends.
+    else if (session->live != NULL && !session->expired) {
+        send_error_message(session->sock, &session->addr, 0xDEADF11E,
+                           "The live source is over.");
+    }
+
+    close_track(&session->tracks[0]);
+    close_track(&session->tracks[1]);
+    free(session);
+
+    client->handler = -1;
+    shmdt((void*) client);
+}
+
+
+/**
+ * Handle file sending to a single client in a process of its own, see
+ * open_session().
+ */
+void send_file_to_client(struct client_list* list, int client_id,
+                         struct catalog* catalog,
+                         struct catalog_entry** entries, int nb_tracks,
+                         const int* gains, int requested_variant,
+                         int capabilities, int sock)
+{
+    struct session* session;
+    int ret;
+
+    assert(list != NULL);
+    assert(list->clients[client_id] != NULL);
+
+    session = open_session(catalog, entries, nb_tracks, gains,
+                           list->clients[client_id],
+                           list->clients[client_id]->addr, client_id,
+                           requested_variant, capabilities, sock);
+    if (session == NULL) {
+        shmdt((void*) list);
+        exit(EXIT_FAILURE);
+    }
+
+    do {
+        ret = sender_run(&session->tracks[session->current % 2].sender,
+                         sender_backend);
+    } while (ret == 0 && (ret = next_track(session)) == 0);
+    close_session(session, ret == SENDER_OVER ? 0 : ret);
+    shmdt((void*) list);
+
+    exit(EXIT_SUCCESS);
+}
+
+
+/**
+ * Handle live streaming to a single client in a process of its own, see
+ * open_live_session(), until the live source ends.
+ */
+void send_live_to_client(struct client_list* list, int client_id,
+                         struct live_source* live, int sock)
+{
+    struct session* session;
+    int ret;
+
+    assert(list != NULL);
+    assert(list->clients[client_id] != NULL);
+
+    session = open_live_session(live, list->clients[client_id],
+                                list->clients[client_id]->addr, client_id,
+                                sock);
+    if (session == NULL) {
+        shmdt((void*) list);
+        exit(EXIT_FAILURE);
+    }
+
+    while ((ret = send_live(session, 0)) >= 0) {
+        if (ret == 0) {
+            usleep(LIVE_POLL);
+        }
+    }
+    close_session(session, 0);
+    shmdt((void*) list);
+
+    exit(EXIT_SUCCESS);
+}
+
+
+/**
+ * Ask the streamer to open a session streaming the nb_tracks given entries of
+ * the catalog, or the given live source if not NULL, to the given client.
+ * The entries are sent by index, along with the generation of the catalog,
+ * as the streamer maps the index on its own. The client is marked as handled
+ * by the streamer beforehand, so that the streamer may release it as soon as
+ * it is done.
+ *
+ * Return the pid of the streamer, or -1 if the request could not be sent.
+ */
+pid_t request_session(int pipe_fd, pid_t streamer, struct client* client,
+                      int client_id, struct sockaddr_in* addr,
+                      struct catalog* catalog,
+                      struct catalog_entry** entries,
+                      struct playlist_request* request,
+                      struct live_source* live)
+{
+    struct session_request session_request;
+    int i;
+
+    assert(client != NULL);
+    assert(addr != NULL);
+    assert(entries != NULL);
+    assert(request != NULL);
+
+    session_request.close = 0;
+    session_request.client_id = client_id;
+    session_request.shmid = client->shmid;
+    session_request.addr = *addr;
+    session_request.generation = catalog->header->generation;
+    for (i = 0; live == NULL && i < request->nb_tracks; i++) {
+        session_request.entries[i] = entries[i] - catalog->entries;
+    }
+    session_request.nb_tracks = request->nb_tracks;
+    session_request.mixed = request->mixed;
+    if (request->mixed) {
+        memcpy(session_request.gains, request->gains,
+               request->nb_tracks * sizeof(int));
+    }
+    session_request.variant = request->variant;
+    session_request.capabilities = request->capabilities;
+    session_request.live = live;
+
+    client->handler = streamer;
+    if (write(pipe_fd, &session_request, sizeof(struct session_request))
+        != sizeof(struct session_request))
+    {
+        // A broken pipe is left to the caller, see stop_streamer().
+        if (errno != EPIPE) {
+            perror("Session request failed");
+        }
+        client->handler = -1;
+        return -1;
+    }
+
+    return streamer;
+}
+
+
+/**
+ * Build the streams requested by the sessions through pipe_fd to the variant
+ * cache, one at a time and at a low priority, so that builds neither compete
+ * with the streams nor with each other, until every session and the main
+ * process closed the pipe.
+ *
+ * A stream missed by several sessions meanwhile is requested as many times,
+ * but built once: the requests of a stream built already are skipped.
+ */
+void run_builder(int pipe_fd) {
+    struct build_request request;
+    struct stat st;
+
+    if (nice(10) < 0) {
+        perror("Unable to lower the build priority");
+    }
+    while (!done && read(pipe_fd, &request, sizeof(struct build_request))
+                    == sizeof(struct build_request))
+    {
+        if (stat(request.path, &st) == 0) {
+            continue;
+        }
+        if (variant_build(request.path, request.filename, request.offset,
+                          request.length, request.format, request.channels,
+                          request.variant, request.encoding,
+                          cache_max_length) < 0)
+        {
+            fprintf(stderr, "Unable to build %s to the cache: ",
+                    request.filename);
+            perror("");
+        }
+    }
+
+    close(pipe_fd);
+    // Not to run the exit handlers of the main process, see TRACE_INIT().
+    _exit(EXIT_SUCCESS);
+}
+
+
+/**
+ * Give up the streamer once it is gone, which a broken pipe to it or its
+ * exit tells. The clients of its sessions are told that their stream is
+ * aborted, and dropped. Sessions are served by forked handlers from then on.
+ *
+ * Return -1, the pid of the streamer from then on.
  */
-struct sockaddr_in* remove_client(struct client_list* list, int client_id,
-                                  int kill_handler)
+pid_t stop_streamer(struct client_list* list, int sock, int pipe_fd,
+                    pid_t streamer)
 {
-    int shmid;
-    struct sockaddr_in* addr;
-    pid_t handler;
+    struct client* client;
+    int client_id;
 
     assert(list != NULL);
-    assert(client_id >= 0);
-    assert(client_id < MAX_NB_CLIENTS);
 
-    if (list->clients[client_id] == NULL) {
-        return NULL;
+    fprintf(stderr, "The streamer is gone, sessions are forked from now "
+                    "on.\n");
+    close(pipe_fd);
+    kill(streamer, SIGKILL);
+    waitpid(streamer, NULL, 0);
+    for (client_id = 0; client_id < MAX_NB_CLIENTS; client_id++) {
+        client = list->clients[client_id];
+        if (client != NULL && client->handler == streamer) {
+            client->handler = -1;
+            send_error_message(sock, client->addr, 0x00C0FFEE,
+                               "I am currently facing some issues and I "
+                               "can't satisfy you request right now. So "
+                               "sorry for that.");
+        }
     }
+    fork_sessions = 1;
 
-    handler = list->clients[client_id]->handler;
+    return -1;
+}
 
-    addr = list->clients[client_id]->addr;
-    shmid = list->clients[client_id]->shmid;
-    shmdt((void*) list->clients[client_id]);
-    shmctl(shmid, IPC_RMID, NULL);
-    list->clients[client_id] = NULL;
-    list->nb_clients--;
 
-    if (kill_handler && handler > 0) {
-        kill(handler, SIGKILL);
+/**
+ * Release the catalog read by a session of the streamer, if any. A catalog
+ * replaced by a newer one is unmapped once no session reads it any longer.
+ */
+static void release_catalog(struct catalog* catalog) {
+    if (catalog != NULL && --catalog->users == 0 &&
+        catalog != streamer_catalog)
+    {
+        catalog_close(catalog);
     }
-
-    return addr;
 }
 
 
 /**
- * Reset the heartbeat counter of the client matching the given addr to
- * HEARTBEAT_THRESHOLD.
+ * Map the catalog of the given generation for the streamer, if it is not the
+ * latest it mapped already. The main process scans the library again when
+ * files are added to it, see lookup_tracks().
  *
- * Return -1 if no client matched.
- * Return the client_id otherwise.
+ * Return the catalog, or NULL if the index was replaced again meanwhile.
  */
-int notify_heartbeat(struct client_list* list, struct sockaddr_in* addr) {
-    int client_id;
-    struct sockaddr_in* client_addr;
+static struct catalog* streamer_reload(int64_t generation) {
+    struct catalog* catalog;
 
-    assert(list != NULL);
-    assert(addr != NULL);
+    if (streamer_catalog->header->generation == generation) {
+        return streamer_catalog;
+    }
 
-    // Search the client that has the given addr.
-    for (client_id = 0; client_id < MAX_NB_CLIENTS; client_id++) {
-        client_addr = list->clients[client_id]->addr;
-        if (client_addr->sin_port == addr->sin_port &&
-            client_addr->sin_addr.s_addr == addr->sin_addr.s_addr)
-        {
-            break;
+    catalog = catalog_open(index_path);
+    if (catalog == NULL || catalog->header->generation != generation) {
+        if (catalog != NULL) {
+            catalog_close(catalog);
         }
+        return NULL;
     }
-    if (client_id == MAX_NB_CLIENTS) {
-        return -1;
+    // Sessions still reading the previous one release it, see above.
+    if (streamer_catalog->users == 0) {
+        catalog_close(streamer_catalog);
     }
+    streamer_catalog = catalog;
 
-    // Reset the heartbeat counter to HEARTBEAT_THRESHOLD
-    list->clients[client_id]->heartbeat_counter = HEARTBEAT_THRESHOLD;
-
-    return client_id;
+    return catalog;
 }
 
 
 /**
- * Handle file sending to a single client.
+ * Scheduler callback of the streamer: send the next message of a session,
+ * unless its client timed out. A track over is followed at once by the next
+ * one. A live session sends its packets as soon as they are captured, and
+ * polls the source every LIVE_POLL us once it caught up.
  */
-void send_file_to_client(struct client_list* list, int client_id,
-                         char* filename, int sock, int semid)
+static int send_session(struct sched* sched, struct sched_entry* entry,
+                        long long now)
 {
-    FILE* file;
-    unsigned long file_length;
-    int sample_rate
-      , sample_size
-      , channels
-      , nb_packets
-      , last_packet_nb_bytes
-      , i
-      , j;
-    struct client* my_client;
-    unsigned char msg_buffer[MSG_LENGTH];
-    char* file_buffer;
-    struct sembuf up = {0, 1, 0};
-    struct sembuf down = {0, -1, 0};
+    struct session** sessions;
+    struct session* session;
+    struct catalog* catalog;
+    struct sender* sender;
+    int ret;
+
+    sessions = (struct session**) sched->data;
+    session = (struct session*) entry;
+    sender = &session->tracks[session->current % 2].sender;
+    if (session->expired) {
+        ret = SENDER_OVER;
+    }
+    else if (session->live != NULL) {
+        ret = send_live(session, MSG_DONTWAIT);
+        // Caught up with the capturer: the source is polled again later.
+        if (ret == 0 &&
+            (int32_t) (session->live->ring->head - session->next_packet) <= 0)
+        {
+            entry->deadline = now + LIVE_POLL;
+        }
+        if (ret > 0) {
+            entry->deadline = now;
+        }
+        ret = ret > 0 ? SENDER_SENT : ret == 0 ? SENDER_BLOCKED : SENDER_OVER;
+    }
+    else {
+        ret = sender_step(sender);
+        while (ret == SENDER_OVER && (ret = next_track(session)) == 0)
+        {
+            sender = &session->tracks[session->current % 2].sender;
+            ret = sender_open(sender) < 0 ? -1 : sender_step(sender);
+        }
+        if (ret == SENDER_SENT) {
+            entry->deadline = sender->deadline;
+        }
+    }
+    switch (ret) {
+        case SENDER_SENT:
+            return MSG_LENGTH;
+        case SENDER_BLOCKED:
+            return 0;
+        default:
+            // The client may be streamed to again already.
+            if (sessions[session->client_id] == session) {
+                sessions[session->client_id] = NULL;
+            }
+            // Its slot is released with it, once its messages are counted.
+            sender_flush(streamer_batch);
+            sender_batch_forget(streamer_batch,
+                                &server_stats->slots[session->client_id]
+                                             .current);
+            catalog = session->catalog;
+            close_session(session, ret == SENDER_OVER ? 0 : ret);
+            release_catalog(catalog);
+            return -1;
+    }
+}
 
-    assert(list != NULL);
-    assert(list->clients[client_id] != NULL);
-    assert(filename != NULL);
 
-    my_client = list->clients[client_id];
+/**
+ * Scheduler callback: send the messages the sessions batched during a tick.
+ */
+static int flush_sessions(struct sched* sched) {
+    return sender_flush(streamer_batch);
+}
 
-    // Retrieve audio information
-    if (aud_readinit(filename, &sample_rate, &sample_size, &channels) < 0) {
-        send_error_message(sock, my_client->addr, 0xDEADF11E,
-                           "An error occured while attempting to read the "
-                           "requested file.");
-        perror("Error while attempting to read the audio file");
-        my_client->handler = -1;
-        shmdt((void*) my_client);
-        shmdt((void*) list);
-        free(filename);
-        exit(EXIT_FAILURE);
-    }
 
-    file = fopen(filename, "rb");
-    if (file == NULL) {
-        send_error_message(sock, my_client->addr, 0xDEADF11E,
-                           "An error occured while attempting to read the "
-                           "requested file.");
-        fprintf(stderr,
-                "An error happened while attempting to open %s for reading",
-                filename);
-        perror("");
-        my_client->handler = -1;
-        shmdt((void*) my_client);
-        shmdt((void*) list);
-        free(filename);
-        exit(EXIT_FAILURE);
+/**
+ * Open the session requested by the main process and schedule it, or mark
+ * the session of the client as expired if the client timed out.
+ */
+static void start_session(struct sched* sched,
+                          struct session_request* request, int sock)
+{
+    struct session** sessions;
+    struct client* client;
+    struct session* session;
+    struct catalog* catalog;
+    struct catalog_entry* entries[PLAYLIST_MAX_TRACKS];
+    int i;
+
+    sessions = (struct session**) sched->data;
+    if (request->close) {
+        session = sessions[request->client_id];
+        if (session != NULL && session->client->shmid == request->shmid) {
+            session->expired = 1;
+            sessions[request->client_id] = NULL;
+        }
+        return;
     }
-    free(filename);
-
-    // Get file length
-    fseek(file, 0, SEEK_END);
-    file_length = ftell(file);
-    fseek(file, 0, SEEK_SET);
 
-    // Allocate buffer
-    file_buffer = (char*) malloc(file_length+1);
-    if (file_buffer == NULL) {
-        perror("Memory error");
-        my_client->handler = -1;
-        shmdt((void*) my_client);
-        shmdt((void*) list);
-        free(filename);
-        exit(EXIT_FAILURE);
+    client = (struct client*) shmat(request->shmid, NULL, 0);
+    if (client == (void*) -1) {
+        perror("Shared memory attachment failed");
+        return;
     }
 
-    // Read file into buffer
-    fread(file_buffer, file_length, 1, file);
+    if (request->live != NULL) {
+        session = open_live_session(request->live, client, &request->addr,
+                                    request->client_id, sock);
+    }
+    else {
+        catalog = streamer_reload(request->generation);
+        if (catalog == NULL) {
+            send_error_message(sock, &request->addr, 0xDEADF11E,
+                               "The library changed meanwhile, please try "
+                               "again.");
+            client->handler = -1;
+            shmdt((void*) client);
+            return;
+        }
+        for (i = 0; i < request->nb_tracks; i++) {
+            entries[i] = &catalog->entries[request->entries[i]];
+        }
+        session = open_session(catalog, entries, request->nb_tracks,
+                               request->mixed ? request->gains : NULL, client,
+                               &request->addr, request->client_id,
+                               request->variant, request->capabilities,
+                               sock);
+        if (session != NULL) {
+            catalog->users++;
+        }
+    }
+    if (session == NULL) {
+        return;
+    }
+    session->tracks[0].sender.nonblocking = 1;
+    session->tracks[0].sender.batch = streamer_batch;
+    if (session->live == NULL &&
+        sender_open(&session->tracks[0].sender) < 0)
+    {
+        catalog = session->catalog;
+        close_session(session, -1);
+        release_catalog(catalog);
+        return;
+    }
 
-    fclose(file);
+    session->entry.deadline = deadbeef_now_us();
+    session->entry.weight = 1;
+    sched_add(sched, &session->entry);
+    sessions[request->client_id] = session;
+}
 
-    nb_packets = file_length / DATA_LENGTH;
-    last_packet_nb_bytes = file_length % DATA_LENGTH;
-    if (file_length % DATA_LENGTH != 0)
-        nb_packets++;
 
-    // Build the stream info packet
-    bzero(msg_buffer, MSG_LENGTH * sizeof(unsigned char));
-    msg_buffer[0] = RESP_STREAMINFO;
-    for (i = 0; i < 4; i++) {
-        msg_buffer[1+i] = (sample_rate >> (8*i)) & 0xFF;
-        msg_buffer[5+i] = (sample_size >> (8*i)) & 0xFF;
-        msg_buffer[9+i] = (channels >> (8*i)) & 0xFF;
-        msg_buffer[13+i] = (nb_packets >> (8*i)) & 0xFF;
-    }
-    msg_buffer[MSG_LENGTH-1] = RESP_STREAMINFO;
-
-    send_message(sock, my_client->addr, msg_buffer);
-
-    for (i = 0; i < nb_packets; i++) {
-        bzero(msg_buffer, MSG_LENGTH * sizeof(unsigned char));
-        msg_buffer[0] = RESP_DATA;
-        for (j = 0; j < 4; j++) {
-            msg_buffer[1+j] = (i >> (8*j)) & 0xFF;
-        }
-        for (j = 0; j < DATA_LENGTH &&
-                    (i+1 < nb_packets || j < last_packet_nb_bytes); j++)
-        {
-            msg_buffer[5+j] = file_buffer[(i*DATA_LENGTH)+j];
-        }
-        msg_buffer[MSG_LENGTH-1] = RESP_DATA;
-        send_message(sock, my_client->addr, msg_buffer);
-        usleep(5000);
-        if (semop(semid, &down, 1) < 0) {
-            perror("Sem down failed");
-            continue;
-        }
-        my_client->heartbeat_counter--;
-        if (my_client->heartbeat_counter <= 0) {
-            if (semop(semid, &up, 1) < 0) {
-                perror("Sem up failed");
+/**
+ * Streamer process: serve every session in a single process, each message
+ * being sent when its deadline is due, see sched.h. Sessions are requested by
+ * the main process through pipe_fd, until it closes it.
+ *
+ * budget is the number of bytes that may be sent per tick, 0 if unlimited.
+ */
+void run_streamer(int pipe_fd, struct catalog* catalog, int sock, long budget)
+{
+    struct session* sessions[MAX_NB_CLIENTS];
+    struct sched sched;
+    struct session_request request;
+    struct timeval timeout;
+    fd_set fds;
+    long long next
+            , delay;
+    int ret;
+
+    streamer_catalog = catalog;
+    memset(sessions, 0, sizeof(sessions));
+    sched_init(&sched, send_session, budget, deadbeef_now_us());
+    sched.data = sessions;
+    // Without a batch, each message is sent on its own.
+    streamer_batch = sender_batch_create(sock);
+    if (streamer_batch != NULL) {
+        sched.flush = flush_sessions;
+    }
+    next = -1;
+    while (!done) {
+        FD_ZERO(&fds);
+        FD_SET(pipe_fd, &fds);
+        if (next >= 0) {
+            delay = next - deadbeef_now_us();
+            if (delay < 0) {
+                delay = 0;
             }
-            printf("Client timeout.\n");
-            send_error_message(sock, my_client->addr, 0xDEADBEA7,
-                               "Bist du tot oder was ?");
+            timeout.tv_sec = delay / 1000000;
+            timeout.tv_usec = delay % 1000000;
+        }
+        ret = select(pipe_fd + 1, &fds, NULL, NULL,
+                     next >= 0 ? &timeout : NULL);
+        if (ret < 0 && errno != EINTR) {
+            perror("Select failed");
             break;
         }
-        if (semop(semid, &up, 1) < 0) {
-            perror("Sem up failed");
+        if (ret > 0) {
+            ret = read(pipe_fd, &request, sizeof(struct session_request));
+            if (ret <= 0) {
+                // The main process is exiting.
+                break;
+            }
+            if (ret == sizeof(struct session_request)) {
+                start_session(&sched, &request, sock);
+            }
         }
+        next = sched_run(&sched, deadbeef_now_us());
     }
 
-    free(file_buffer);
-
-    my_client->handler = -1;
-    shmdt((void*) my_client);
-    shmdt((void*) list);
-
+    if (streamer_batch != NULL) {
+        sender_flush(streamer_batch);
+        sender_batch_destroy(streamer_batch);
+    }
+    close(pipe_fd);
     exit(EXIT_SUCCESS);
 }
 
@@ -362,7 +1493,7 @@ void send_file_to_client(struct client_list* list, int client_id,
  * Valid error codes are:
  *  - 0xDEADBEA7: Heartbeat waiting timeout
  *  - 0xDEADDEAD: Server received a SIGTERM or SIGINT
- *  - 0xDEADF11E: File not found
+ *  - 0xDEADF11E: File not found, or live source over
  *  - 0x0BADC0DE: Bad request not processed (nor processable).
  *  - 0x00C0FFEE: Maximum simultaneous served clients reached.
  *
@@ -372,34 +1503,9 @@ void send_file_to_client(struct client_list* list, int client_id,
 void gen_error_message(unsigned char* output, unsigned int code,
                        const char* message)
 {
-    int i
-      , msg_len;
-
     assert(output != NULL);
 
-    if (message == NULL) {
-        msg_len = 0;
-    }
-    else {
-        msg_len = strlen(message);
-    }
-
-    // First and foremost, store the instruction "RESP_ERROR".
-    bzero(output, MSG_LENGTH * sizeof(unsigned char));
-    output[0] = RESP_ERROR;
-
-    // Copy the error code to the next 4 bytes
-    for (i = 0; i < 4; i++) {
-        output[1+i] = (code >> (8*i)) & 0xFF;
-    }
-
-    // Then copy the human-readable message to the remaining bytes.
-    for (i = 5; i < (MSG_LENGTH-2) && i-5 < msg_len; i++) {
-        output[i] = message[i-5];
-    }
-
-    // Eventually, say that this was an error message again.
-    output[MSG_LENGTH-1] = RESP_ERROR;
+    protocol_encode_error(output, code, message);
 }
 
 
@@ -421,95 +1527,203 @@ int send_error_message(int sock, struct sockaddr_in* dest, unsigned int code,
 
 
 /**
- * Retrieve the filename part from a client streaming request.
+ * Generate the answer to a catalog request with respect to the protocol.
+ * The generated message is written to output.
  *
- * Return a pointer to the filename or NULL if malloc failed.
+ * As many matching entries as fit in a single message are written, starting
+ * from the offset given in the request. The client is expected to ask for the
+ * next page starting at offset + nb_entries.
+ *
+ * The request is answered from the mapped catalog, without allocation nor
+ * file I/O.
  */
-char* retrieve_filename(unsigned char* request) {
-    char* filename;
-    int len
-      , i;
+void gen_catalog_message(unsigned char* output, struct catalog* catalog,
+                         unsigned char* request)
+{
+    struct catalog_entry* results[CATALOG_PAGE_MAX];
+    struct catalog_entry* entry;
+    struct catalog_request query;
+    struct catalog_response response;
+    struct catalog_record record;
+    int nb_results
+      , pos
+      , next;
 
+    assert(output != NULL);
+    assert(catalog != NULL);
     assert(request != NULL);
 
-    // Calculate the length of the filename
-    for (len = 1; (len < MSG_LENGTH-1) && (request[len] != '\0'); len++);
-    filename = malloc(len * sizeof(char));
-    if (filename == NULL) {
-        return NULL;
+    protocol_decode_catalog_request(request, &query);
+    nb_results = catalog_search(catalog, query.pattern, query.mode,
+                                query.offset, results, CATALOG_PAGE_MAX,
+                                &response.nb_matches);
+
+    pos = CATALOG_RESP_HEADER_LENGTH;
+    for (response.nb_entries = 0; response.nb_entries < nb_results;
+         response.nb_entries++)
+    {
+        entry = results[response.nb_entries];
+        record.format = entry->format;
+        record.channels = entry->channels;
+        record.sample_size = entry->sample_size;
+        record.sample_rate = entry->sample_rate;
+        record.duration = entry->duration;
+        record.name_length = entry->name_length;
+        record.name = catalog_name(catalog, entry);
+        next = protocol_put_catalog_record(output, pos, &record);
+        if (next < 0) {
+            break;
+        }
+        pos = next;
     }
 
-    // Fill the filename.
-    for (i = 0; i < len-1; i++) {
-        filename[i] = request[i+1];
+    response.offset = query.offset;
+    protocol_encode_catalog_response(output, &response, pos);
+}
+
+
+/**
+ * Generate the answer to a stats request with respect to the protocol.
+ * The generated message is written to output.
+ */
+void gen_stats_message(unsigned char* output, struct stats* stats,
+                       struct client_list* list)
+{
+    int active[MAX_NB_CLIENTS];
+    int i;
+
+    assert(list != NULL);
+
+    for (i = 0; i < MAX_NB_CLIENTS; i++) {
+        active[i] = list->clients[i] != NULL &&
+                    list->clients[i]->handler != -1;
     }
-    // Make sure the last character is an EOS marker.
-    filename[len-1] = '\0';
 
-    return filename;
+    stats_gen_message(output, stats, active);
 }
 
 
 /**
- * Return the list of wave files in the current directory, terminated by a NULL
- * marker.
- * Return NULL if an error occured or if the current directory does not contain
- * any wave file.
+ * Scan the library in the current directory into the index at index_path.
+ * If the library is read-only, it is scanned into a private index of the
+ * temporary directory instead, so that the index is still mapped shared and
+ * writable, see catalog_open().
+ *
+ * Return the number of indexed files, or -1 if an error occured.
  */
-char** get_available_files_list() {
-    char** filelist;
-    int i
-      , glob_res;
-    glob_t pglob;
-
-    // Search wave files
-    glob_res = glob("*.wav", GLOB_ERR, NULL, &pglob);
-    if (glob_res != 0) {
-        return NULL;
+static int scan_library() {
+    int nb_files;
+
+    nb_files = catalog_scan(".", index_path);
+    if (nb_files < 0 && strcmp(index_path, CATALOG_INDEX) == 0) {
+        snprintf(index_path, PATH_MAX, "%s/deadbeef-%d.idx", P_tmpdir,
+                 getpid());
+        fprintf(stderr, "The library is read-only, it is indexed into %s.\n",
+                index_path);
+        nb_files = catalog_scan(".", index_path);
     }
 
-    // Copy found file names to the filelist.
-    filelist = malloc((pglob.gl_pathc+1) * sizeof(char*));
-    if (filelist == NULL) {
-        globfree(&pglob);
-        return NULL;
+    return nb_files;
+}
+
+
+/**
+ * Map the catalog of the wave files available in the current directory and
+ * its subdirectories.
+ *
+ * The index is built first if it does not exist yet, is not valid or not
+ * writable, if the library directory was modified since it was built, or if
+ * rescan is set.
+ *
+ * Return NULL if an error occured or if the library does not contain any wave
+ * file.
+ */
+struct catalog* load_catalog(int rescan) {
+    struct catalog* catalog;
+
+    catalog = NULL;
+    if (!rescan) {
+        catalog = catalog_open(index_path);
+    }
+    if (catalog != NULL && catalog_outdated(catalog, ".", NULL)) {
+        catalog_close(catalog);
+        catalog = NULL;
     }
-    for (i = 0; i <= pglob.gl_pathc; i++) {
-        if (pglob.gl_pathv[i] == NULL) {
-            filelist[i] = NULL;
+    if (catalog == NULL) {
+        if (scan_library() < 0) {
+            return NULL;
         }
-        else {
-            filelist[i] = strdup(pglob.gl_pathv[i]);
-            if (filelist[i] == NULL) {
-                globfree(&pglob);
-                return NULL;
-            }
+        catalog = catalog_open(index_path);
+        if (catalog == NULL) {
+            return NULL;
         }
     }
 
-    globfree(&pglob);
-    return filelist;
+    if (catalog->header->nb_entries == 0) {
+        catalog_close(catalog);
+        return NULL;
+    }
+
+    return catalog;
 }
 
 
 /**
- * Determine if a file is available in a list of filenames.
+ * Scan the library again into a new catalog, which replaces the given one.
+ * Entries of the given catalog are no longer valid afterwards, but the
+ * streamer and the handlers keep their own mappings.
  *
- * Assume that the list available_files is terminated by a NULL marker.
+ * Return the new catalog, or the given one if the scan failed.
+ */
+struct catalog* reload_catalog(struct catalog* catalog) {
+    struct catalog* fresh;
+
+    assert(catalog != NULL);
+
+    if (scan_library() < 0 || (fresh = catalog_open(index_path)) == NULL) {
+        perror("Library scan failed");
+        return catalog;
+    }
+    catalog_close(catalog);
+
+    return fresh;
+}
+
+
+/**
+ * Find the catalog entries of the tracks of a playlist. If a track is not
+ * found and its directory was modified since the index was built, the
+ * library is scanned again once and catalog is replaced, see
+ * reload_catalog().
  *
- * Return 1 if it exists, 0 otherwise.
+ * Return 0 if every track was found, -1 otherwise.
  */
-int file_is_available(char* filename, char** available_files) {
-    char* name;
+int lookup_tracks(struct catalog** catalog, struct playlist_request* playlist,
+                  struct catalog_entry** entries)
+{
+    int rescanned
+      , i;
 
-    assert(filename != NULL);
+    assert(catalog != NULL);
+    assert(playlist != NULL);
+    assert(entries != NULL);
 
-    for (name = available_files[0]; name != NULL; name++) {
-        if (strlen(name) == strlen(filename)) {
-            if (strcmp(name, filename) == 0) {
-                return 1;
-            }
+    rescanned = 0;
+    for (i = 0; i < playlist->nb_tracks; i++) {
+        entries[i] = catalog_lookup(*catalog, playlist->filenames[i]);
+        if (entries[i] != NULL) {
+            continue;
+        }
+        if (rescanned ||
+            !catalog_outdated(*catalog, ".", playlist->filenames[i]))
+        {
+            return -1;
         }
+        // The tracks are looked up again, as the entries found so far
+        // belong to the previous catalog.
+        *catalog = reload_catalog(*catalog);
+        rescanned = 1;
+        i = -1;
     }
 
     return 0;
@@ -521,19 +1735,33 @@ int main(int argc, char** argv) {
       , bind_err
       , msg_len
       , client_id
-      , semid
+      , timer
+      , rescan
+      , type
+      , streamer_pipe[2]
+      , build_pipe[2]
       , i;
+    long budget;
+    long long timeout;
+    uint64_t expirations;
     socklen_t flen;
-    pid_t pid;
+    pid_t pid
+        , streamer
+        , builder;
     struct sockaddr_in server_addr;
     struct sockaddr_in client_addr;
     struct client_list* cur_served_clients;
     unsigned char msg_buffer[MSG_LENGTH];
-    char* filename;
-    char** available_files;
+    unsigned char reply_buffer[MSG_LENGTH];
+    struct streaming_request request;
+    struct playlist_request playlist;
+    struct catalog* catalog;
+    struct catalog_entry* entries[PLAYLIST_MAX_TRACKS];
+    struct live_source* live;
     struct sigaction action;
-    struct sembuf up = {0, 1, 0};
-    struct sembuf down = {0, -1, 0};
+    struct itimerspec sweep;
+    struct pollfd fds[2];
+    siginfo_t exited;
 
     // Print notice
     printf("SYR2/DeaDBeeF server, Copyright (C) 2015 Antoine Pinsard\n");
@@ -547,11 +1775,66 @@ int main(int argc, char** argv) {
     action.sa_handler = term;
     sigaction(SIGTERM, &action, NULL);
     sigaction(SIGINT, &action, NULL);
+    // A write to a dead streamer fails with EPIPE rather than killing the
+    // server, see stop_streamer().
+    action.sa_handler = SIG_IGN;
+    sigaction(SIGPIPE, &action, NULL);
+    TRACE_INIT();
+
+    // Parse options
+    rescan = 0;
+    budget = 0;
+    timeout = HEARTBEAT_TIMEOUT * 1000LL;
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-r") == 0) {
+            rescan = 1;
+        }
+        else if (strcmp(argv[i], "-c") == 0 && i+1 < argc) {
+            cache_max_length = strtol(argv[++i], NULL, 10) << 20;
+        }
+        else if (strcmp(argv[i], "-b") == 0 && i+1 < argc) {
+            // Mbit/s to bytes per tick
+            budget = strtol(argv[++i], NULL, 10) * SCHED_TICK / 8;
+        }
+        else if (strcmp(argv[i], "-t") == 0 && i+1 < argc) {
+            timeout = strtol(argv[++i], NULL, 10) * 1000LL;
+            if (timeout <= 0) {
+                timeout = HEARTBEAT_TIMEOUT * 1000LL;
+            }
+        }
+        else if (strcmp(argv[i], "-f") == 0) {
+            fork_sessions = 1;
+        }
+        else if (strcmp(argv[i], "-L") == 0 && i+1 < argc &&
+                 nb_live_sources < LIVE_MAX_SOURCES &&
+                 live_parse(&live_sources[nb_live_sources], argv[i+1]) == 0)
+        {
+            nb_live_sources++;
+            i++;
+        }
+#ifdef DEADBEEF_URING
+        else if (strcmp(argv[i], "-u") == 0) {
+            // The io_uring backend sends a whole stream at once.
+            sender_backend = SENDER_URING;
+            fork_sessions = 1;
+        }
+#endif
+        else {
+            fprintf(stderr, "Usage: audioserver [-r] [-c cache_size_mb] "
+                            "[-b budget_mbps] [-t timeout_ms] [-f]"
+#ifdef DEADBEEF_URING
+                            " [-u]"
+#endif
+                            "\n                   "
+                            "[-L name=path[:rate[:size[:channels]]]]...\n");
+            exit(EXIT_FAILURE);
+        }
+    }
 
-    // List files in the local directory
-    // If the list is empty, exit with error.
-    available_files = get_available_files_list();
-    if (available_files == NULL) {
+    // Map the catalog of the files in the local directory
+    // If the catalog is empty, exit with error.
+    catalog = load_catalog(rescan);
+    if (catalog == NULL) {
         perror("No wave files found in the current directory");
         exit(EXIT_FAILURE);
     }
@@ -583,25 +1866,134 @@ int main(int argc, char** argv) {
         exit(EXIT_FAILURE);
     }
 
-    semid = semget(IPC_PRIVATE, 1, 0600);
-    if (semid < 0) {
-        perror("Semaphore creation failed");
-        semctl(semid, 0, IPC_RMID);
+    server_stats = stats_create(MAX_NB_CLIENTS);
+    if (server_stats == NULL) {
+        perror("Failed to create statistics");
         destroy_client_list(cur_served_clients, sock);
         close(sock);
         exit(EXIT_FAILURE);
     }
-    if (semop(semid, &up, 1) < 0) {
-        perror("Sem up failed");
+
+    // Clients are swept HEARTBEAT_SWEEPS times per timeout, so that a dead
+    // client is dropped within 1 + 1/HEARTBEAT_SWEEPS timeouts.
+    timer = timerfd_create(CLOCK_MONOTONIC, 0);
+    sweep.it_interval.tv_sec = timeout / HEARTBEAT_SWEEPS / 1000000;
+    sweep.it_interval.tv_nsec = timeout / HEARTBEAT_SWEEPS % 1000000 * 1000;
+    sweep.it_value = sweep.it_interval;
+    if (timer < 0 || timerfd_settime(timer, 0, &sweep, NULL) < 0) {
+        perror("Heartbeat timer creation failed");
+        stats_destroy(server_stats);
         destroy_client_list(cur_served_clients, sock);
         close(sock);
         exit(EXIT_FAILURE);
     }
-    
+
+    // Start capturing the live sources, whose rings the handlers inherit.
+    for (i = 0; i < nb_live_sources; i++) {
+        if (live_start(&live_sources[i]) < 0) {
+            fprintf(stderr, "Live source %s is not available.\n",
+                    live_sources[i].name);
+        }
+    }
+
+    // Start the cache builder, whose pipe the streamer and the handlers
+    // inherit, see request_build().
+    builder = -1;
+    if (variant_cache_init(".") < 0) {
+        fprintf(stderr, "No variant cache, streams are converted live.\n");
+    }
+    else if (pipe(build_pipe) < 0) {
+        perror("Pipe creation failed");
+    }
+    else {
+        fflush(stdout);
+        builder = fork();
+        if (builder == 0) {
+            close(build_pipe[1]);
+            close(timer);
+            close(sock);
+            run_builder(build_pipe[0]);
+        }
+        close(build_pipe[0]);
+        if (builder < 0) {
+            perror("Cache builder creation failed");
+            close(build_pipe[1]);
+        }
+        else {
+            builder_pipe = build_pipe[1];
+            fcntl(builder_pipe, F_SETFL, O_NONBLOCK);
+        }
+    }
+
+    // Start the streamer, which inherits the catalog, the socket and the
+    // statistics.
+    streamer = -1;
+    if (!fork_sessions) {
+        if (pipe(streamer_pipe) < 0) {
+            perror("Pipe creation failed");
+            fork_sessions = 1;
+        }
+        else {
+            fflush(stdout);
+            streamer = fork();
+            if (streamer < 0) {
+                perror("Streamer creation failed");
+                close(streamer_pipe[0]);
+                close(streamer_pipe[1]);
+                fork_sessions = 1;
+            }
+            else if (streamer == 0) {
+                close(streamer_pipe[1]);
+                close(timer);
+                run_streamer(streamer_pipe[0], catalog, sock, budget);
+            }
+            else {
+                close(streamer_pipe[0]);
+            }
+        }
+    }
 
     // Client requests handling loop
+    fds[0].fd = sock;
+    fds[0].events = POLLIN;
+    fds[1].fd = timer;
+    fds[1].events = POLLIN;
     while (!done) {
-        // Wait for a client request
+        // Wait for a client request or for the next sweep
+        if (poll(fds, 2, -1) < 0) {
+            if (errno != EINTR) {
+                perror("Poll failed");
+            }
+            continue;
+        }
+        if (fds[1].revents & POLLIN) {
+            if (builder > 0 && waitpid(builder, NULL, WNOHANG) == builder) {
+                fprintf(stderr, "The cache builder is gone, streams are "
+                                "converted live from now on.\n");
+                close(builder_pipe);
+                builder_pipe = -1;
+                builder = -1;
+            }
+            // The streamer is left to be reaped by stop_streamer().
+            exited.si_pid = 0;
+            if (streamer > 0 &&
+                waitid(P_PID, streamer, &exited,
+                       WEXITED | WNOHANG | WNOWAIT) == 0 &&
+                exited.si_pid == streamer)
+            {
+                streamer = stop_streamer(cur_served_clients, sock,
+                                         streamer_pipe[1], streamer);
+            }
+            if (read(timer, &expirations, sizeof(uint64_t)) > 0) {
+                expire_clients(cur_served_clients, sock, timeout,
+                               streamer > 0 ? streamer_pipe[1] : -1,
+                               streamer);
+            }
+        }
+        if (!(fds[0].revents & POLLIN)) {
+            continue;
+        }
+
         flen = sizeof(struct sockaddr_in);
         bzero(&client_addr, sizeof(struct sockaddr_in));
         msg_len = recvfrom(sock, &msg_buffer, MSG_LENGTH, 0,
@@ -612,68 +2004,122 @@ int main(int argc, char** argv) {
         }
 
         // Check the form of the request
-        if (msg_buffer[0] != msg_buffer[MSG_LENGTH-1]) {
+        type = protocol_type(msg_buffer, msg_len);
+        if (type < 0) {
             send_error_message(sock, &client_addr, 0x0BADC0DE,
                                "I can has cheezburger?");
             continue;
         }
 
         // Determine client request
-        switch (msg_buffer[0]) {
+        switch (type) {
             case REQ_STREAMING:
+            case REQ_PLAYLIST:
+            case REQ_MIX:
+                // A streaming request is a playlist of a single track, and a
+                // mix request a playlist whose tracks are mixed.
+                if (type == REQ_STREAMING) {
+                    protocol_decode_streaming(msg_buffer, &request);
+                    playlist.variant = request.variant;
+                    playlist.capabilities = request.capabilities;
+                    playlist.nb_tracks = 1;
+                    playlist.filenames[0] = request.filename;
+                    playlist.mixed = 0;
+                }
+                else if ((type == REQ_PLAYLIST
+                          ? protocol_decode_playlist(msg_buffer, &playlist)
+                          : protocol_decode_mix(msg_buffer, &playlist)) < 0)
+                {
+                    send_error_message(sock, &client_addr, 0x0BADC0DE,
+                                       "I can has cheezburger?");
+                    break;
+                }
                 client_id = append_client(cur_served_clients, &client_addr);
                 if (client_id < 0) {
+                    server_stats->rejections++;
                     send_error_message(sock, &client_addr, 0x00C0FFEE,
                                        "I'm really sorry, but I'm swamped "
                                        "right now!");
+                    break;
                 }
-                else {
-                    filename = retrieve_filename(msg_buffer);
-                    if (filename == NULL) {
-                        perror("Dynamic allocation failed");
-                        break;
-                    }
-                    if (file_is_available(filename, available_files) == 0) {
-                        send_error_message(sock, &client_addr, 0xDEADF11E,
-                                           "Sorry but the requested file is "
-                                           "not available.");
-                    }
-                    else {
-                        pid = fork();
-                        if (pid < 0) {
-                            send_error_message(sock, &client_addr, 0x00C0FFEE,
-                                               "I am currently facing some "
-                                               "issues and I can't satisfy "
-                                               "you request right now. So "
-                                               "sorry for that.");
-                            remove_client(cur_served_clients, client_id, 0);
-                        }
-                        else if (pid == 0) {
-                            for (i=0; available_files[i] != NULL; i++) {
-                                free(available_files[i]);
-                            }
-                            free(available_files);
-                            send_file_to_client(cur_served_clients, client_id,
-                                                filename, sock, semid);
-                        }
-                        else {
-                            cur_served_clients->clients[client_id]
-                                ->handler = pid;
-                        }
+                // A live source is requested by its name, alone.
+                live = NULL;
+                if (playlist.nb_tracks == 1 && !playlist.mixed) {
+                    live = live_lookup(live_sources, nb_live_sources,
+                                       playlist.filenames[0]);
+                }
+                if (live == NULL &&
+                    lookup_tracks(&catalog, &playlist, entries) < 0)
+                {
+                    send_error_message(sock, &client_addr, 0xDEADF11E,
+                                       "Sorry but the requested file is "
+                                       "not available.");
+                    break;
+                }
+                stats_begin_session(server_stats, client_id, &client_addr);
+                pid = -1;
+                if (streamer > 0) {
+                    pid = request_session(streamer_pipe[1], streamer,
+                                          cur_served_clients
+                                          ->clients[client_id],
+                                          client_id, &client_addr, catalog,
+                                          entries, &playlist, live);
+                    if (pid < 0 && errno == EPIPE) {
+                        streamer = stop_streamer(cur_served_clients, sock,
+                                                 streamer_pipe[1], streamer);
                     }
-                    free(filename);
+                }
+                if (streamer <= 0) {
+                    pid = fork();
+                }
+                if (pid < 0) {
+                    server_stats->rejections++;
+                    send_error_message(sock, &client_addr, 0x00C0FFEE,
+                                       "I am currently facing some issues "
+                                       "and I can't satisfy you request "
+                                       "right now. So sorry for that.");
+                    free(remove_client(cur_served_clients, client_id, 0));
+                }
+                else if (pid == 0 && live != NULL) {
+                    send_live_to_client(cur_served_clients, client_id, live,
+                                        sock);
+                }
+                else if (pid == 0) {
+                    send_file_to_client(cur_served_clients, client_id,
+                                        catalog, entries, playlist.nb_tracks,
+                                        playlist.mixed ? playlist.gains
+                                                       : NULL,
+                                        playlist.variant,
+                                        playlist.capabilities, sock);
+                }
+                else if (streamer <= 0) {
+                    cur_served_clients->clients[client_id]->handler = pid;
                 }
                 break;
-            case REQ_HEARTBEAT:
-                if (semop(semid, &down, 1) < 0) {
-                    perror("Sem down failed");
-                    break;
+            case REQ_CATALOG:
+                if (catalog_outdated(catalog, ".", NULL)) {
+                    catalog = reload_catalog(catalog);
                 }
+                gen_catalog_message(reply_buffer, catalog, msg_buffer);
+                send_message(sock, &client_addr, reply_buffer);
+                break;
+            case REQ_STATS:
+                gen_stats_message(reply_buffer, server_stats,
+                                  cur_served_clients);
+                send_message(sock, &client_addr, reply_buffer);
+                break;
+            case REQ_HEARTBEAT:
                 client_id = notify_heartbeat(cur_served_clients, &client_addr);
-                if (semop(semid, &up, 1) < 0) {
-                    perror("Sem up failed");
+                TRACE(TRACE_HEARTBEAT, client_id, 0);
+                if (client_id >= 0) {
+                    stats_count_heartbeat(server_stats, client_id,
+                                          msg_buffer,
+                                          cur_served_clients
+                                              ->clients[client_id]
+                                              ->last_heartbeat);
                 }
-                if (client_id < 0) {
+                else {
+                    server_stats->unknown_heartbeats++;
                     send_error_message(sock, &client_addr, 0xDEADBEA7,
                                        "Undead alert, undead alert class! "
                                        "You too believe in the flying "
@@ -686,12 +2132,33 @@ int main(int argc, char** argv) {
         }
     }
 
-    for (i=0; available_files[i] != NULL; i++) {
-        free(available_files[i]);
+    // The streamer exits once the pipe is closed, ending its sessions.
+    if (streamer > 0) {
+        close(streamer_pipe[1]);
+        waitpid(streamer, NULL, 0);
+        for (i = 0; i < MAX_NB_CLIENTS; i++) {
+            if (cur_served_clients->clients[i] != NULL &&
+                cur_served_clients->clients[i]->handler == streamer)
+            {
+                cur_served_clients->clients[i]->handler = -1;
+            }
+        }
+    }
+
+    for (i = 0; i < nb_live_sources; i++) {
+        live_stop(&live_sources[i]);
+    }
+    // The builder ends with its build at hand, once the handlers are gone.
+    if (builder_pipe >= 0) {
+        close(builder_pipe);
+    }
+    catalog_close(catalog);
+    if (strcmp(index_path, CATALOG_INDEX) != 0) {
+        unlink(index_path);
     }
-    free(available_files);
     destroy_client_list(cur_served_clients, sock);
-    semctl(semid, 0, IPC_RMID);
+    stats_destroy(server_stats);
+    close(timer);
     close(sock);
 
     return EXIT_SUCCESS;
@@ -8,6 +8,21 @@
  * request, it opens the underlying file and start its transfert to the client.
  * When the file is entirely read, the server closes the file and waits for the
  * next request.
+ *
+ * Sessions are served by a single streamer process, forked at startup, which
+ * the main process hands each new session through a pipe. The streamer sends
+ * the messages of all sessions as they are due with a scheduler, see sched.h,
+ * which shares the egress budget fairly among them. With -f, or with the
+ * io_uring backend, each session is served by a process of its own instead.
+ *
+ * A session streams a single file, or the tracks of a playlist one after
+ * another without a gap, see next_track(), or several files mixed into a
+ * single track, see open_mix(), or a live source given with -L for as long as
+ * it lasts, see open_live_session().
+ *
+ * The stream of a session is sent at the quality tier the link to its client
+ * allows, see abr.h, which changes as its heartbeats tell, see
+ * adapt_session().
  * ----------------------------------------------------------------------------
  * Antoine Pinsard
  * Mar. 17, 2015
@@ -15,24 +30,50 @@
 #ifndef _AUDIOSERVER_H_
 #define _AUDIOSERVER_H_
 
+#include <fcntl.h>
 #include <glob.h>
+#include <limits.h>
 #include <math.h>
-#include <sys/sem.h>
+#include <poll.h>
+#include <sys/stat.h>
+#include <sys/timerfd.h>
+#include "abr.h"
+#include "catalog.h"
 #include "deadbeef.h"
+#include "live.h"
+#include "mixer.h"
+#include "protocol.h"
+#include "sched.h"
+#include "sender.h"
+#include "stats.h"
+#include "trace.h"
+#include "variant.h"
 
 #define MAX_NB_CLIENTS 5
-#define HEARTBEAT_THRESHOLD (5 * HEARTBEAT_FREQUENCY)
+// Maximum number of catalog entries looked up for a single catalog response.
+#define CATALOG_PAGE_MAX 256
+// Default delay in milliseconds after which a client that sent no heartbeat
+// is dropped, 5 heartbeats at the nominal rate
+#define HEARTBEAT_TIMEOUT (5 * HEARTBEAT_FREQUENCY * SENDER_PERIOD / 1000)
+// Sweeps of the clients per timeout
+#define HEARTBEAT_SWEEPS 4
+// Bytes of a track read ahead when it is opened, see open_track()
+#define TRACK_PREFETCH (64 * DATA_LENGTH)
 
 struct client {
     int shmid; // Share memory identifier
     struct sockaddr_in* addr;
     pid_t handler;
-    int heartbeat_counter;
-    // Each message from the client causes the counter to be reset to
-    // HEARTBEAT_THRESHOLD.
-    // Each message sent to the client causes the counter to be decreased by 1.
-    // Whenever the counter reaches 0, the communication is aborted and a last
-    // error message is sent with code 0xDEADBEA7.
+    long long last_heartbeat;
+    // Each heartbeat from the client sets last_heartbeat to the current time,
+    // see deadbeef_now_us().
+    // The main process sweeps the clients HEARTBEAT_SWEEPS times per timeout.
+    // A client streamed to whose last heartbeat is older than the timeout is
+    // sent a last error message with code 0xDEADBEA7 and its stream is
+    // aborted. Only the main process reads or writes it.
+    int expired;
+    // Set by the main process once it asked the streamer to close the session
+    // of the client, which is handled until the streamer did so.
 };
 
 struct client_list {
@@ -41,6 +82,90 @@ struct client_list {
     struct client* clients[MAX_NB_CLIENTS];
 };
 
+// Files of a mix and their mixer, see open_mix()
+struct mix {
+    struct aud_source sources[MIX_MAX_INPUTS];
+    struct mixer mixer;
+};
+
+// Stream of a track of a session, see open_track()
+struct track {
+    struct streaminfo info;
+    struct sender sender;
+    struct aud_source source;
+    int fd;     // -1 once closed
+    int cached; // The stream is read from the variant cache
+    struct mix* mix; // The track is a mix, or NULL
+};
+
+// Tracks being sent to a client, see open_session().
+struct session {
+    struct sched_entry entry; // First, so that entries are sessions
+    struct catalog* catalog;
+    int client_id;
+    struct client* client;
+    // Copy of the address of the client, whose own copy lives in the heap of
+    // the main process
+    struct sockaddr_in addr;
+    int sock;
+    struct catalog_entry* entries[PLAYLIST_MAX_TRACKS];
+    int nb_tracks;
+    // The entries are mixed into a single track with these gains, if any.
+    int nb_inputs;
+    int gains[MIX_MAX_INPUTS];
+    int variant;      // Requested variant
+    int capabilities;
+    int current;      // Track being sent
+    uint32_t next_packet;   // First packet of the next track to open
+    uint32_t total_packets; // Packets of all the tracks
+    // The current track and the next one, opened ahead of time, indexed by
+    // the parity of the track
+    struct track tracks[2];
+    struct abr abr; // Quality tier of the stream
+    int failed;  // A track could not be opened, the session ends before it
+    int expired; // The client timed out, see expire_clients()
+    // Live source listened to instead of the tracks, whose next packet to
+    // send is next_packet
+    struct live_source* live;
+};
+
+// Request of the main process to the streamer to open a session, or to close
+// the session of a client that timed out. The streamer attaches the client by
+// its shmid and finds the catalog entries by index in its own mapping of the
+// index, mapped again when the library is scanned again. It is written to the
+// pipe at once, being shorter than PIPE_BUF.
+struct session_request {
+    int close;
+    int client_id;
+    int shmid;
+    struct sockaddr_in addr;
+    int64_t generation; // Of the catalog of the entries
+    uint32_t entries[PLAYLIST_MAX_TRACKS];
+    int nb_tracks;
+    int mixed;
+    int gains[MIX_MAX_INPUTS];
+    int variant;
+    int capabilities;
+    struct live_source* live; // Instead of the entries, if not NULL
+};
+
+// Request of a session to the cache builder to build a stream missing from
+// the variant cache, see run_builder(). It is written to the pipe at once,
+// being no longer than PIPE_BUF, which bounds the name of the file: the
+// streams of longer names are always converted live.
+#define BUILD_PATH_LENGTH 256
+struct build_request {
+    char path[BUILD_PATH_LENGTH]; // Of the stream in the cache
+    int64_t offset;
+    int64_t length;
+    int format;
+    int channels;
+    int variant;
+    int encoding;
+    char filename[PIPE_BUF - BUILD_PATH_LENGTH - 2 * sizeof(int64_t)
+                  - 4 * sizeof(int)];
+};
+
 void term(int);
 
 struct client_list* create_client_list();
@@ -48,13 +173,35 @@ void destroy_client_list(struct client_list*, int);
 int append_client(struct client_list*, struct sockaddr_in*);
 struct sockaddr_in* remove_client(struct client_list*, int, int);
 int notify_heartbeat(struct client_list*, struct sockaddr_in*);
-void send_file_to_client(struct client_list*, int, char*, int, int);
+int expire_clients(struct client_list*, int, long long, int, pid_t);
+struct session* open_session(struct catalog*, struct catalog_entry**, int,
+                             const int*, struct client*, struct sockaddr_in*,
+                             int, int, int, int);
+struct session* open_live_session(struct live_source*, struct client*,
+                                  struct sockaddr_in*, int, int);
+int next_track(struct session*);
+void close_session(struct session*, int);
+void send_file_to_client(struct client_list*, int, struct catalog*,
+                         struct catalog_entry**, int, const int*, int, int,
+                         int);
+void send_live_to_client(struct client_list*, int, struct live_source*,
+                         int);
+pid_t request_session(int, pid_t, struct client*, int, struct sockaddr_in*,
+                      struct catalog*, struct catalog_entry**,
+                      struct playlist_request*, struct live_source*);
+pid_t stop_streamer(struct client_list*, int, int, pid_t);
+void run_builder(int);
+void run_streamer(int, struct catalog*, int, long);
 
 void gen_error_message(unsigned char*, unsigned int, const char*);
 int send_error_message(int, struct sockaddr_in*, unsigned int, const char*);
 
-char* retrieve_filename(unsigned char*);
-char** get_available_files_list();
-int file_is_available(char*, char**);
+void gen_catalog_message(unsigned char*, struct catalog*, unsigned char*);
+void gen_stats_message(unsigned char*, struct stats*, struct client_list*);
+
+struct catalog* load_catalog(int);
+struct catalog* reload_catalog(struct catalog*);
+int lookup_tracks(struct catalog**, struct playlist_request*,
+                  struct catalog_entry**);
 
 #endif
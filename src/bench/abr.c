@@ -0,0 +1,292 @@
+/* Distributed under the terms of the GNU General Public License v2 */
+/* L3info - SYR2 Project - SYR DeaDBeeF
+ * ============================================================================
+ * Adaptive Bitrate Benchmark
+ * ----------------------------------------------------------------------------
+ * First encode a synthetic 16-bit stereo stream at 44.1 kHz with the
+ * reduction of each quality tier, see abr.h, pack its blocks into messages
+ * as a sender does, and report for each tier:
+ *
+ *  - the number of messages sent per second at the pacing of SENDER_PERIOD
+ *    and the share of them against the full quality;
+ *  - whether the decoded stream is exactly the expected one: the stream
+ *    itself at the full quality, the means of the samples otherwise.
+ *
+ * Then simulate sessions on links whose capacity, in messages per second,
+ * and random loss change over time, with a heartbeat every
+ * HEARTBEAT_FREQUENCY packets. A link queues the messages it cannot carry
+ * at once, up to LINK_QUEUE of delay, then drops them. Each scenario reports
+ * the number of tier switches, the share of time spent in each tier and the
+ * share of the blocks lost.
+ *
+ * Usage: bench_abr [seconds]
+ *
+ * Each scenario lasts 300 seconds by default.
+ * ----------------------------------------------------------------------------
+ * Antoine Pinsard
+ * Oct. 19, 2026
+ */
+#include <math.h>
+#include "../abr.h"
+#include "../sender.h"
+
+#define SAMPLE_RATE 44100
+#define CHANNELS 2
+#define NB_PACKETS 1000
+// Delays of the simulated links in microseconds
+#define LINK_RTT 20000
+#define LINK_QUEUE 200000
+
+// Link of a scenario, whose capacity and loss change at half of it
+struct scenario {
+    const char* name;
+    double capacity[2]; // Share of the messages of the full quality carried
+    double loss[2];     // Random loss ratio
+};
+
+static const struct scenario scenarios[] = {
+    {"clean", {2, 2}, {0, 0}},
+    {"noisy", {2, 2}, {0.005, 0.005}},
+    {"drop", {2, 0.6}, {0, 0}},
+    {"recover", {0.6, 2}, {0, 0}},
+    {"narrow", {0.3, 0.3}, {0, 0}},
+    {"lossy", {2, 2}, {0.1, 0.1}}
+};
+
+
+/**
+ * Return the expected sample at index i of the stream of nb_samples samples
+ * once its block is reduced, the mean of the samples of the same block with
+ * the same pair of frames or frame, and the same channel unless mono.
+ */
+static int expected(const int16_t* samples, long i, int reduction) {
+    long block_start
+       , block_end
+       , span
+       , sum
+       , count
+       , j;
+
+    if (reduction == 0) {
+        return samples[i];
+    }
+    span = reduction & CODEC_HALF_RATE ? 2 * CHANNELS : CHANNELS;
+    block_start = i / (CODEC_BLOCK_LENGTH / 2) * (CODEC_BLOCK_LENGTH / 2);
+    block_end = block_start + CODEC_BLOCK_LENGTH / 2;
+    sum = 0;
+    count = 0;
+    for (j = i / span * span; j < i / span * span + span; j++) {
+        if (j < block_start || j >= block_end ||
+            (!(reduction & CODEC_MONO) && j % CHANNELS != i % CHANNELS))
+        {
+            continue;
+        }
+        sum += samples[j];
+        count++;
+    }
+
+    return sum / count;
+}
+
+
+/**
+ * Encode the stream with the reduction of a tier, decode it back and count
+ * the messages it takes.
+ *
+ * Return the number of messages, or -1 if it is not decoded as expected.
+ */
+static long encode_tier(const int16_t* samples, int reduction) {
+    unsigned char packet[DATA_LENGTH];
+    unsigned char decoded[CODEC_BLOCK_LENGTH];
+    long nb_messages
+       , i;
+    int packet_length
+      , block_length
+      , pos
+      , msg_pos
+      , nb_blocks
+      , p
+      , k;
+
+    nb_messages = 0;
+    msg_pos = PACKED_HEADER_LENGTH;
+    nb_blocks = 0;
+    for (p = 0; p < NB_PACKETS; p++) {
+        packet_length = codec_encode_packet(
+            (const unsigned char*) (samples + (long) p * DATA_LENGTH / 2),
+            DATA_LENGTH, CHANNELS, p, reduction, packet);
+        if (packet_length < 0) {
+            nb_messages++;
+            continue;
+        }
+        for (pos = 0, k = 0; pos < packet_length;
+             pos += 2 + block_length, k++)
+        {
+            block_length = packet[pos] | (packet[pos+1] << 8);
+            if (codec_decode(packet + pos + 2, block_length, CHANNELS,
+                             p * CODEC_BLOCKS + k, decoded,
+                             CODEC_BLOCK_LENGTH) != CODEC_BLOCK_LENGTH)
+            {
+                return -1;
+            }
+            for (i = 0; i < CODEC_BLOCK_LENGTH / 2; i++) {
+                if ((int16_t) (decoded[2*i] | (decoded[2*i+1] << 8)) !=
+                    expected(samples, ((long) p * CODEC_BLOCKS + k)
+                                      * (CODEC_BLOCK_LENGTH / 2) + i,
+                             reduction))
+                {
+                    return -1;
+                }
+            }
+
+            // Packed as by sender_step().
+            if (msg_pos + 2 + block_length > MSG_LENGTH - 1 ||
+                nb_blocks == PACKED_MAX_BLOCKS)
+            {
+                nb_messages++;
+                msg_pos = PACKED_HEADER_LENGTH;
+                nb_blocks = 0;
+            }
+            msg_pos += 2 + block_length;
+            nb_blocks++;
+        }
+    }
+
+    return nb_messages + (nb_blocks > 0);
+}
+
+
+/**
+ * Simulate a session on the link of a scenario for the given duration in
+ * seconds, the tiers sending rates[tier] messages per second.
+ */
+static void simulate(const struct scenario* scenario, const double* rates,
+                     int seconds)
+{
+    struct abr abr;
+    struct heartbeat_digest digest;
+    double tier_time[ABR_NB_TIERS]
+         , queue
+         , capacity
+         , loss
+         , carried;
+    long long now
+            , end
+            , heartbeat_period
+            , period;
+    uint32_t packet;
+    int half
+      , k;
+
+    memset(&digest, 0, sizeof(struct heartbeat_digest));
+    memset(tier_time, 0, sizeof(tier_time));
+    abr_init(&abr, ABR_NB_TIERS, 0);
+    queue = 0;
+    packet = 0;
+    heartbeat_period = (long long) HEARTBEAT_FREQUENCY * SENDER_PERIOD;
+    end = seconds * 1000000LL;
+
+    for (now = heartbeat_period; now <= end; now += heartbeat_period) {
+        half = now > end / 2;
+        capacity = scenario->capacity[half] * rates[0];
+        loss = scenario->loss[half];
+
+        // The link queues what it cannot carry, and drops what overflows.
+        queue += (rates[abr.tier] - capacity) / capacity
+               * heartbeat_period;
+        if (queue < 0) {
+            queue = 0;
+        }
+        carried = 1;
+        if (queue > LINK_QUEUE) {
+            queue = LINK_QUEUE;
+            carried = capacity / rates[abr.tier];
+        }
+        carried *= 1 - loss;
+
+        for (k = 0; k < HEARTBEAT_FREQUENCY; k++, packet++) {
+            abr_sent(&abr, packet,
+                     now - heartbeat_period + (long long) k * SENDER_PERIOD);
+        }
+        digest.valid = 1;
+        digest.received += HEARTBEAT_FREQUENCY * CODEC_BLOCKS * carried;
+        digest.lost += HEARTBEAT_FREQUENCY * CODEC_BLOCKS * (1 - carried);
+        // The heartbeat answers the latest packet received.
+        digest.highest = (packet - 1 - (LINK_RTT + (long long) queue)
+                                       / SENDER_PERIOD) * CODEC_BLOCKS
+                       + CODEC_BLOCKS - 1;
+        tier_time[abr.tier] += heartbeat_period;
+        abr_update(&abr, &digest, now);
+    }
+
+    period = end / heartbeat_period * heartbeat_period;
+    printf("scenario=%s switches=%d", scenario->name, abr.nb_switches);
+    for (k = 0; k < ABR_NB_TIERS; k++) {
+        printf(" tier%d_pct=%.1f", k, 100.0 * tier_time[k] / period);
+    }
+    printf(" loss_pct=%.2f\n",
+           100.0 * digest.lost / (digest.received + digest.lost));
+}
+
+
+int main(int argc, char** argv) {
+    struct abr abr;
+    int16_t* samples;
+    double rates[ABR_NB_TIERS];
+    long nb_samples
+       , nb_messages
+       , i;
+    int seconds
+      , tier
+      , failed;
+
+    seconds = argc > 1 ? atoi(argv[1]) : 300;
+    if (seconds <= 0) {
+        fprintf(stderr, "Usage: bench_abr [seconds]\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // Chords with a little noise, differing between channels
+    nb_samples = (long) NB_PACKETS * DATA_LENGTH / 2;
+    samples = malloc(nb_samples * sizeof(int16_t));
+    if (samples == NULL) {
+        perror("Allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    srand(1664);
+    for (i = 0; i < nb_samples; i++) {
+        samples[i] = 6000 * sin(2 * M_PI * 220 * (i / CHANNELS)
+                                / SAMPLE_RATE)
+                   + 4000 * sin(2 * M_PI * (330 + 110 * (i % CHANNELS))
+                                * (i / CHANNELS) / SAMPLE_RATE)
+                   + rand() % 64 - 32;
+    }
+
+    failed = 0;
+    for (tier = 0; tier < ABR_NB_TIERS; tier++) {
+        abr_init(&abr, ABR_NB_TIERS, 0);
+        abr.tier = tier;
+        nb_messages = encode_tier(samples, abr_reduction(&abr));
+        if (nb_messages < 0) {
+            failed = 1;
+            printf("tier=%d exact=no\n", tier);
+            continue;
+        }
+        rates[tier] = nb_messages * 1e6 / ((double) NB_PACKETS
+                                           * SENDER_PERIOD);
+        printf("tier=%d reduction=0x%04x messages_per_s=%.1f "
+               "share_pct=%.1f exact=yes\n", tier, abr_reduction(&abr),
+               rates[tier], 100.0 * rates[tier] / rates[0]);
+    }
+    free(samples);
+    if (failed) {
+        fprintf(stderr, "Reduced blocks are not decoded as expected.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    for (i = 0; i < sizeof(scenarios) / sizeof(struct scenario); i++) {
+        simulate(&scenarios[i], rates, seconds);
+    }
+
+    return EXIT_SUCCESS;
+}
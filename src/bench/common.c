@@ -0,0 +1,168 @@
+/* Distributed under the terms of the GNU General Public License v2 */
+/* L3info - SYR2 Project - SYR DeaDBeeF
+ * ============================================================================
+ * Benchmark Helpers
+ * ----------------------------------------------------------------------------
+ * Helpers shared by the benchmarks.
+ * ----------------------------------------------------------------------------
+ * Antoine Pinsard
+ * Oct. 19, 2026
+ */
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <ftw.h>
+#include <math.h>
+#include <poll.h>
+#include "common.h"
+
+
+/**
+ * Write a WAV file of the given number of seconds of 16-bit stereo at
+ * 44.1 kHz: two tones with a little noise, so that compression behaves as
+ * with music rather than silence.
+ *
+ * Return 0 on success, -1 on failure.
+ */
+int bench_write_fixture(const char* path, int seconds) {
+    int16_t frames[2 * 4410];
+    long nb_frames
+       , i
+       , j;
+    int fd;
+
+    nb_frames = 44100L * seconds;
+    fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return -1;
+    }
+
+    if (aud_writeheader(fd, 44100, 16, 2, nb_frames * 4) < 0 ||
+        lseek(fd, AUD_HEADER_LENGTH, SEEK_SET) < 0)
+    {
+        close(fd);
+        return -1;
+    }
+
+    srand(1664);
+    for (i = 0; i < nb_frames; i += 4410) {
+        for (j = 0; j < 4410; j++) {
+            frames[2*j] = 8000 * sin(2 * M_PI * 440 * (i+j) / 44100)
+                        + rand() % 64 - 32;
+            frames[2*j+1] = 8000 * sin(2 * M_PI * 660 * (i+j) / 44100)
+                          + rand() % 64 - 32;
+        }
+        if (write(fd, frames, sizeof(frames)) != sizeof(frames)) {
+            close(fd);
+            return -1;
+        }
+    }
+
+    return close(fd);
+}
+
+
+static int remove_entry(const char* path, const struct stat* st, int flag,
+                        struct FTW* ftw)
+{
+    return remove(path);
+}
+
+
+/**
+ * Remove the fixture directory dir and everything in it.
+ *
+ * Return 0 on success, -1 on failure.
+ */
+int bench_remove_fixtures(const char* dir) {
+    return nftw(dir, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+}
+
+
+/**
+ * Send a request of the given type to the server. A streaming request asks
+ * for the entry name with the given capabilities.
+ */
+void bench_send_request(int sock, struct sockaddr_in* server, int type,
+                        const char* name, int capabilities)
+{
+    unsigned char msg[MSG_LENGTH];
+
+    if (type == REQ_STREAMING) {
+        protocol_encode_streaming(msg, name, 0, capabilities);
+    }
+    else {
+        protocol_encode_request(msg, type);
+    }
+    sendto(sock, msg, MSG_LENGTH, 0, (struct sockaddr*) server,
+           sizeof(struct sockaddr_in));
+}
+
+
+/**
+ * Wait until the server answers catalog requests.
+ *
+ * Return 0 once it does, -1 after a few seconds.
+ */
+int bench_wait_server(struct sockaddr_in* server) {
+    unsigned char msg[MSG_LENGTH];
+    struct pollfd pfd;
+    int attempt
+      , ret;
+
+    pfd.fd = socket(AF_INET, SOCK_DGRAM, 0);
+    pfd.events = POLLIN;
+    ret = -1;
+    for (attempt = 0; attempt < 50 && ret < 0; attempt++) {
+        bench_send_request(pfd.fd, server, REQ_CATALOG, NULL, 0);
+        if (poll(&pfd, 1, 100) == 1 &&
+            recv(pfd.fd, msg, MSG_LENGTH, 0) == MSG_LENGTH &&
+            msg[0] == RESP_CATALOG)
+        {
+            ret = 0;
+        }
+    }
+    close(pfd.fd);
+
+    return ret;
+}
+
+
+/**
+ * Count a latency in microseconds in the histogram, negative ones as 0.
+ */
+void bench_record(struct bench_histogram* histogram, long latency) {
+    if (latency < 0) {
+        latency = 0;
+    }
+    if (latency > histogram->max) {
+        histogram->max = latency;
+    }
+    histogram->counts[latency < BENCH_MAX_LATENCY
+                      ? latency : BENCH_MAX_LATENCY]++;
+    histogram->nb_values++;
+}
+
+
+/**
+ * Return the latency in microseconds under which the given ratio of the
+ * values of the histogram are, 0 if it is empty.
+ */
+long bench_percentile(const struct bench_histogram* histogram,
+                      double ratio)
+{
+    unsigned long count;
+    long i;
+
+    if (histogram->nb_values == 0) {
+        return 0;
+    }
+    count = 0;
+    for (i = 0; i < BENCH_MAX_LATENCY; i++) {
+        count += histogram->counts[i];
+        if (count >= ratio * histogram->nb_values) {
+            return i;
+        }
+    }
+
+    return histogram->max;
+}
@@ -0,0 +1,38 @@
+/* Distributed under the terms of the GNU General Public License v2 */
+/* L3info - SYR2 Project - SYR DeaDBeeF
+ * ============================================================================
+ * Benchmark Helpers
+ * ----------------------------------------------------------------------------
+ * Helpers shared by the benchmarks: the WAV fixture the server catalogs, the
+ * requests a synthetic client sends, and a histogram of latencies in
+ * microseconds to report percentiles of.
+ * ----------------------------------------------------------------------------
+ * Antoine Pinsard
+ * Oct. 19, 2026
+ */
+#ifndef _BENCH_COMMON_H_
+#define _BENCH_COMMON_H_
+
+#include "../deadbeef.h"
+#include "../protocol.h"
+
+// Port of the server the benchmarks start
+#define BENCH_SERVER_PORT 1664
+// Latencies of the histogram are counted to the microsecond up to this bound,
+// and together above it.
+#define BENCH_MAX_LATENCY 100000
+
+struct bench_histogram {
+    unsigned long counts[BENCH_MAX_LATENCY + 1];
+    unsigned long nb_values;
+    long max;
+};
+
+int bench_write_fixture(const char*, int);
+int bench_remove_fixtures(const char*);
+void bench_send_request(int, struct sockaddr_in*, int, const char*, int);
+int bench_wait_server(struct sockaddr_in*);
+void bench_record(struct bench_histogram*, long);
+long bench_percentile(const struct bench_histogram*, double);
+
+#endif
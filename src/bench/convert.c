@@ -0,0 +1,124 @@
+/* Distributed under the terms of the GNU General Public License v2 */
+/* L3info - SYR2 Project - SYR DeaDBeeF
+ * ============================================================================
+ * Convert Benchmark
+ * ----------------------------------------------------------------------------
+ * Convert random samples of each format to 16-bit and 32-bit with the kernels
+ * of each instruction set supported by the CPU, check the output against the
+ * scalar reference and report the throughput.
+ *
+ * Usage: bench_convert [nb_samples [nb_rounds]]
+ * ----------------------------------------------------------------------------
+ * Antoine Pinsard
+ * Oct. 19, 2026
+ */
+#include "../convert.h"
+
+
+static const char* format_names[CONVERT_NB_FORMATS] = {
+    "u8", "s16", "s24", "s32", "f32"
+};
+static const char* isa_names[] = {"scalar", "sse2", "avx2"};
+
+
+/**
+ * Fill input with n random samples of the given format. Float samples go a
+ * little beyond [-1, 1] to exercise clamping.
+ */
+static void generate(unsigned char* input, int format, size_t n) {
+    float v;
+    size_t i;
+
+    if (format != CONVERT_F32) {
+        for (i = 0; i < n * convert_sample_length(format); i++) {
+            input[i] = rand() & 0xFF;
+        }
+        return;
+    }
+    for (i = 0; i < n; i++) {
+        v = 2.2f * rand() / RAND_MAX - 1.1f;
+        memcpy(input + 4*i, &v, sizeof(float));
+    }
+}
+
+
+int main(int argc, char** argv) {
+    unsigned char* input;
+    unsigned char* output;
+    unsigned char* reference;
+    struct dither dither;
+    size_t nb_samples
+         , length;
+    double start
+         , elapsed;
+    int nb_rounds
+      , in_format
+      , out_format
+      , isa
+      , round
+      , exact
+      , failed;
+
+    nb_samples = argc > 1 ? strtoul(argv[1], NULL, 10) : 1000003;
+    nb_rounds = argc > 2 ? atoi(argv[2]) : 20;
+
+    input = malloc(nb_samples * 4);
+    output = malloc(nb_samples * 4);
+    reference = malloc(nb_samples * 4);
+    if (input == NULL || output == NULL || reference == NULL) {
+        perror("Allocation failed");
+        exit(EXIT_FAILURE);
+    }
+
+    failed = 0;
+    srand(1664);
+    for (in_format = 0; in_format < CONVERT_NB_FORMATS; in_format++) {
+        generate(input, in_format, nb_samples);
+        for (out_format = CONVERT_S16; out_format <= CONVERT_S32;
+             out_format += CONVERT_S32 - CONVERT_S16)
+        {
+            length = nb_samples * convert_sample_length(out_format);
+            for (isa = CONVERT_SCALAR; isa <= CONVERT_AVX2; isa++) {
+                if (convert_set_isa(isa) != isa) {
+                    continue;
+                }
+
+                dither_init(&dither, 42);
+                convert(input, in_format, output, out_format, nb_samples,
+                        &dither);
+                exact = 1;
+                if (isa == CONVERT_SCALAR) {
+                    memcpy(reference, output, length);
+                }
+                else if (memcmp(reference, output, length) != 0) {
+                    exact = 0;
+                    failed = 1;
+                }
+
+                start = deadbeef_now_us() / 1e6;
+                for (round = 0; round < nb_rounds; round++) {
+                    convert(input, in_format, output, out_format, nb_samples,
+                            &dither);
+                }
+                elapsed = deadbeef_now_us() / 1e6 - start;
+
+                printf("%s->%s isa=%s msamples_per_s=%.1f exact=%s\n",
+                       format_names[in_format], format_names[out_format],
+                       isa_names[isa],
+                       nb_samples * nb_rounds / elapsed / 1e6,
+                       exact ? "yes" : "no");
+            }
+        }
+    }
+
+    free(input);
+    free(output);
+    free(reference);
+
+    if (failed) {
+        fprintf(stderr, "Kernels disagree with the scalar reference.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    return EXIT_SUCCESS;
+}
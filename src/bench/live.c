@@ -0,0 +1,294 @@
+/* Distributed under the terms of the GNU General Public License v2 */
+/* L3info - SYR2 Project - SYR DeaDBeeF
+ * ============================================================================
+ * Live Source Benchmark
+ * ----------------------------------------------------------------------------
+ * Start an audio server with a live source fed through a FIFO, see live.h,
+ * write 16-bit stereo at 44.1 kHz to the FIFO at its nominal pace, listen to
+ * the source with nb_listeners clients over loopback and report:
+ *
+ *  - the capture to receive latency, the delay between the time samples are
+ *    written to the FIFO and the time a listener receives them, as
+ *    percentiles in microseconds;
+ *  - the packets lost by the listeners, from the one each started with.
+ *
+ * Each 8 bytes of the stream are a record of a magic number and of the time
+ * the record was written, so that a listener tells the latency of a packet
+ * from its last record.
+ *
+ * Usage: bench_live [nb_listeners [seconds [server]]]
+ *
+ * There are 4 listeners for 10 seconds by default. server is the path of the
+ * server binary, bin/audioserver by default. The server listens on its usual
+ * port, which must be free.
+ * ----------------------------------------------------------------------------
+ * Antoine Pinsard
+ * Oct. 19, 2026
+ */
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <sys/stat.h>
+#include "../sender.h"
+#include "common.h"
+
+#define SOURCE_NAME "live"
+#define FIXTURE_NAME "fixture.wav"
+#define RECORD_MAGIC 0x5EC0DE55U
+#define RECORD_LENGTH 8
+// Bytes written to the FIFO at once, 10 ms of 16-bit stereo at 44.1 kHz
+// rounded down to whole records
+#define WRITE_LENGTH (441 * 4 / RECORD_LENGTH * RECORD_LENGTH)
+#define WRITE_PERIOD (WRITE_LENGTH * 1000000LL / (44100 * 4))
+#define MAX_LISTENERS 5
+
+struct listener {
+    int sock;
+    int started;           // The stream info was received
+    uint32_t first_packet;
+    uint32_t highest;      // Latest packet received, from first_packet
+    long nb_received;
+};
+
+
+/**
+ * Write the records of the stream due by now to the FIFO, stamped with the
+ * current time.
+ *
+ * Return the time of the next write in us.
+ */
+static long long write_due(int fifo, long long next) {
+    unsigned char buffer[WRITE_LENGTH];
+    long long now;
+    int i;
+
+    now = deadbeef_now_us();
+    while (next <= now) {
+        for (i = 0; i < WRITE_LENGTH; i += RECORD_LENGTH) {
+            protocol_put_le(buffer + i, RECORD_MAGIC, 4);
+            protocol_put_le(buffer + i + 4, (uint32_t) now, 4);
+        }
+        if (write(fifo, buffer, WRITE_LENGTH) != WRITE_LENGTH) {
+            perror("FIFO write failed");
+        }
+        next += WRITE_PERIOD;
+    }
+
+    return next;
+}
+
+
+/**
+ * Return the time the last whole record of a packet was written, or -1 if
+ * the packet holds none.
+ */
+static long long last_record(const unsigned char* data) {
+    int pos;
+
+    for (pos = DATA_LENGTH - RECORD_LENGTH; pos >= 0; pos--) {
+        if (protocol_get_le(data + pos, 4) == RECORD_MAGIC &&
+            (pos < RECORD_LENGTH ||
+             protocol_get_le(data + pos - RECORD_LENGTH, 4) == RECORD_MAGIC))
+        {
+            return protocol_get_le(data + pos + 4, 4);
+        }
+    }
+
+    return -1;
+}
+
+
+static void receive(struct listener* listener,
+                    struct bench_histogram* latencies, unsigned char* msg)
+{
+    struct streaminfo info;
+    long long stamp;
+    uint32_t id;
+
+    if (msg[0] == RESP_STREAMINFO && !listener->started) {
+        protocol_decode_streaminfo(msg, &info);
+        listener->started = 1;
+        listener->first_packet = info.first_packet;
+        return;
+    }
+    if (msg[0] != RESP_DATA || !listener->started) {
+        return;
+    }
+
+    // Numbers wrap around: they are taken from the first packet.
+    id = protocol_decode_data(msg) - listener->first_packet;
+    if (id >= 0x80000000U) {
+        return;
+    }
+    if (listener->nb_received == 0 || id > listener->highest) {
+        listener->highest = id;
+    }
+    listener->nb_received++;
+
+    stamp = last_record(msg + DATA_HEADER_LENGTH);
+    if (stamp >= 0) {
+        bench_record(latencies,
+                     (uint32_t) ((uint32_t) deadbeef_now_us() - stamp));
+    }
+}
+
+
+int main(int argc, char** argv) {
+    char dir[] = "/tmp/deadbeef-live-XXXXXX";
+    char path[PATH_MAX];
+    char spec[PATH_MAX + 64];
+    const char* server_path;
+    unsigned char msg[MSG_LENGTH];
+    struct sockaddr_in server;
+    struct listener listeners[MAX_LISTENERS];
+    struct pollfd pfds[MAX_LISTENERS];
+    struct bench_histogram* latencies;
+    pid_t pid;
+    long long start
+            , end
+            , next_write
+            , next_heartbeat
+            , delay;
+    long expected
+       , received;
+    int nb_listeners
+      , seconds
+      , fifo
+      , len
+      , i;
+
+    nb_listeners = argc > 1 ? atoi(argv[1]) : 4;
+    seconds = argc > 2 ? atoi(argv[2]) : 10;
+    server_path = argc > 3 ? argv[3] : "bin/audioserver";
+    if (nb_listeners <= 0 || nb_listeners > MAX_LISTENERS || seconds <= 0) {
+        fprintf(stderr, "Usage: bench_live [nb_listeners (1-%d) [seconds "
+                        "[server]]]\n", MAX_LISTENERS);
+        exit(EXIT_FAILURE);
+    }
+    if (realpath(server_path, path) == NULL) {
+        perror("Unable to find the server");
+        exit(EXIT_FAILURE);
+    }
+
+    if (mkdtemp(dir) == NULL) {
+        perror("Unable to create the fixture directory");
+        exit(EXIT_FAILURE);
+    }
+    snprintf(spec, sizeof(spec), "%s=%s/live.fifo", SOURCE_NAME, dir);
+    if (chdir(dir) < 0 || bench_write_fixture(FIXTURE_NAME, 1) < 0 ||
+        mkfifo("live.fifo", 0600) < 0)
+    {
+        perror("Unable to write the fixtures");
+        bench_remove_fixtures(dir);
+        exit(EXIT_FAILURE);
+    }
+
+    // The output of the server is dropped.
+    pid = fork();
+    if (pid == 0) {
+        i = open("/dev/null", O_WRONLY);
+        dup2(i, STDOUT_FILENO);
+        dup2(i, STDERR_FILENO);
+        execl(path, path, "-r", "-L", spec, (char*) NULL);
+        exit(EXIT_FAILURE);
+    }
+
+    memset(&server, 0, sizeof(server));
+    server.sin_family = AF_INET;
+    server.sin_port = htons(BENCH_SERVER_PORT);
+    server.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (pid < 0 || bench_wait_server(&server) < 0) {
+        fprintf(stderr, "The server did not start.\n");
+        if (pid > 0) {
+            kill(pid, SIGTERM);
+            waitpid(pid, NULL, 0);
+        }
+        bench_remove_fixtures(dir);
+        exit(EXIT_FAILURE);
+    }
+    // Opened once the capturer of the server opens it for reading
+    fifo = open("live.fifo", O_WRONLY);
+    if (fifo < 0) {
+        perror("Unable to open the FIFO");
+        kill(pid, SIGTERM);
+        waitpid(pid, NULL, 0);
+        bench_remove_fixtures(dir);
+        exit(EXIT_FAILURE);
+    }
+
+    latencies = calloc(1, sizeof(struct bench_histogram));
+    if (latencies == NULL) {
+        perror("Allocation failed");
+        exit(EXIT_FAILURE);
+    }
+
+    memset(listeners, 0, sizeof(listeners));
+    for (i = 0; i < nb_listeners; i++) {
+        listeners[i].sock = socket(AF_INET, SOCK_DGRAM, 0);
+        if (listeners[i].sock < 0) {
+            perror("Socket creation failed");
+            exit(EXIT_FAILURE);
+        }
+        pfds[i].fd = listeners[i].sock;
+        pfds[i].events = POLLIN;
+        bench_send_request(listeners[i].sock, &server, REQ_STREAMING,
+                           SOURCE_NAME, 0);
+    }
+
+    start = deadbeef_now_us();
+    end = start + seconds * 1000000LL;
+    next_write = start;
+    next_heartbeat = start;
+    while (deadbeef_now_us() < end) {
+        next_write = write_due(fifo, next_write);
+        // Heartbeats at the nominal rate, whatever the rate of the stream
+        if (deadbeef_now_us() >= next_heartbeat) {
+            for (i = 0; i < nb_listeners; i++) {
+                bench_send_request(listeners[i].sock, &server, REQ_HEARTBEAT,
+                                   NULL, 0);
+            }
+            next_heartbeat += HEARTBEAT_FREQUENCY * SENDER_PERIOD;
+        }
+
+        delay = (next_write - deadbeef_now_us()) / 1000;
+        poll(pfds, nb_listeners, delay > 0 ? delay : 0);
+        for (i = 0; i < nb_listeners; i++) {
+            while ((len = recv(listeners[i].sock, msg, MSG_LENGTH,
+                               MSG_DONTWAIT)) > 0)
+            {
+                if (protocol_type(msg, len) >= 0) {
+                    receive(&listeners[i], latencies, msg);
+                }
+            }
+        }
+    }
+
+    close(fifo);
+    kill(pid, SIGTERM);
+    waitpid(pid, NULL, 0);
+    bench_remove_fixtures(dir);
+
+    expected = 0;
+    received = 0;
+    for (i = 0; i < nb_listeners; i++) {
+        if (listeners[i].nb_received > 0) {
+            expected += (long) listeners[i].highest + 1;
+        }
+        received += listeners[i].nb_received;
+        close(listeners[i].sock);
+    }
+
+    printf("listeners=%d seconds=%d packets=%ld lost=%ld loss=%.6f\n",
+           nb_listeners, seconds, received,
+           expected > received ? expected - received : 0,
+           expected > 0 && expected > received
+           ? (double) (expected - received) / expected : 0.0);
+    printf("latency_p50_us=%ld latency_p99_us=%ld latency_max_us=%ld\n",
+           bench_percentile(latencies, 0.5),
+           bench_percentile(latencies, 0.99), latencies->max);
+
+    free(latencies);
+
+    return received > 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,426 @@
+/* Distributed under the terms of the GNU General Public License v2 */
+/* L3info - SYR2 Project - SYR DeaDBeeF
+ * ============================================================================
+ * Load Generator
+ * ----------------------------------------------------------------------------
+ * Start an audio server on a generated WAV file, stream it to nb_clients
+ * synthetic clients at once over loopback and report, as a JSON object on
+ * the standard output:
+ *
+ *  - the pacing ratio, the seconds of audio streamed per second, and the
+ *    number of real-time streams the load amounts to, as the server sends
+ *    a stream faster than it plays, see SENDER_PERIOD;
+ *  - the aggregate throughput and number of datagrams per second;
+ *  - the loss and the inter-packet jitter, the standard deviation of the
+ *    delay between two datagrams, of each stream;
+ *  - the CPU time used by the server per stream.
+ *
+ * Clients speak REQ_STREAMING and REQ_HEARTBEAT like audioclient, and count
+ * the received blocks, see codec.h, without decoding them. The exit status is
+ * a failure if any stream is rejected or incomplete.
+ *
+ * Usage: bench_loadgen [nb_clients [seconds [caps [server]]]]
+ *
+ * The file holds seconds of 16-bit stereo at 44.1 kHz. caps are the
+ * capabilities announced in the requests, CAP_RICE by default. server is the
+ * path of the server binary, bin/audioserver by default. The server listens
+ * on its usual port, which must be free.
+ * ----------------------------------------------------------------------------
+ * Antoine Pinsard
+ * Oct. 19, 2026
+ */
+#define _GNU_SOURCE
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <math.h>
+#include <poll.h>
+#include <arpa/inet.h>
+#include "../codec.h"
+#include "common.h"
+
+// A stream receiving nothing for this delay in seconds is over.
+#define IDLE_TIMEOUT 2.0
+#define FIXTURE_NAME "bench.wav"
+
+struct stream {
+    int sock;
+    int nb_packets;       // -1 until the stream info is received
+    int rejected;
+    int over;
+    unsigned char* blocks;
+    long nb_blocks;       // Distinct blocks received
+    long nb_datagrams;
+    long long nb_bytes;
+    long next_heartbeat;
+    double last;          // Arrival of the last datagram
+    // Inter-arrival delays, Welford's algorithm
+    long nb_delays;
+    double mean_delay;
+    double m2_delay;
+};
+
+
+/**
+ * Return the CPU time in seconds used by the process pid, and by its
+ * children, reaped or not, if children is not zero.
+ */
+static double cpu_time(pid_t pid, int children) {
+    char path[300];
+    char stat[1024];
+    char* fields;
+    unsigned long utime
+                , stime;
+    long cutime
+       , cstime;
+    int ppid
+      , fd
+      , len;
+    DIR* proc;
+    struct dirent* entry;
+    double total;
+
+    total = 0;
+    proc = children ? opendir("/proc") : NULL;
+    do {
+        if (proc != NULL) {
+            entry = readdir(proc);
+            if (entry == NULL) {
+                break;
+            }
+            snprintf(path, sizeof(path), "/proc/%s/stat", entry->d_name);
+        }
+        else {
+            snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+        }
+        fd = open(path, O_RDONLY);
+        if (fd < 0) {
+            continue;
+        }
+        len = read(fd, stat, sizeof(stat) - 1);
+        close(fd);
+        if (len <= 0) {
+            continue;
+        }
+        stat[len] = '\0';
+        // The command name may hold spaces, the fields follow its ')'.
+        fields = strrchr(stat, ')');
+        if (fields == NULL ||
+            sscanf(fields + 2, "%*c %d %*d %*d %*d %*d %*u %*u %*u %*u %*u "
+                   "%lu %lu %ld %ld", &ppid, &utime, &stime, &cutime,
+                   &cstime) != 5)
+        {
+            continue;
+        }
+        if (proc == NULL) {
+            total += utime + stime + (children ? cutime + cstime : 0);
+        }
+        else if (ppid == pid) {
+            total += utime + stime;
+        }
+    } while (proc != NULL);
+    if (proc != NULL) {
+        closedir(proc);
+        total += cpu_time(pid, 0);
+    }
+
+    return total / sysconf(_SC_CLK_TCK);
+}
+
+
+/**
+ * Account for a datagram received by a stream.
+ */
+static void receive(struct stream* stream, struct sockaddr_in* server,
+                    unsigned char* msg, double t)
+{
+    struct streaminfo info;
+    struct packed_header header;
+    const unsigned char* data;
+    double delay
+         , delta;
+    long first
+       , block;
+    int nb
+      , length
+      , pos
+      , i;
+
+    stream->nb_datagrams++;
+    stream->nb_bytes += MSG_LENGTH;
+    if (stream->nb_datagrams > 1) {
+        delay = t - stream->last;
+        stream->nb_delays++;
+        delta = delay - stream->mean_delay;
+        stream->mean_delay += delta / stream->nb_delays;
+        stream->m2_delay += delta * (delay - stream->mean_delay);
+    }
+    stream->last = t;
+
+    switch (msg[0]) {
+        case RESP_STREAMINFO:
+            if (stream->nb_packets < 0) {
+                protocol_decode_streaminfo(msg, &info);
+                stream->nb_packets = info.nb_packets;
+                stream->blocks = calloc((size_t) stream->nb_packets
+                                        * CODEC_BLOCKS, 1);
+                if (stream->blocks == NULL || stream->nb_packets == 0) {
+                    stream->over = 1;
+                }
+            }
+            return;
+        case RESP_ERROR:
+            if (stream->nb_packets < 0) {
+                stream->rejected = 1;
+            }
+            stream->over = 1;
+            return;
+        case RESP_DATA:
+            first = (long) protocol_decode_data(msg) * CODEC_BLOCKS;
+            nb = CODEC_BLOCKS;
+            break;
+        case RESP_PACKED:
+            protocol_decode_packed(msg, &header);
+            first = header.first_block;
+            nb = header.nb_blocks;
+            break;
+        default:
+            return;
+    }
+    if (stream->blocks == NULL) {
+        return;
+    }
+
+    pos = PACKED_HEADER_LENGTH;
+    for (i = 0; i < nb; i++) {
+        block = first + i;
+        if (block < (long) stream->nb_packets * CODEC_BLOCKS &&
+            !stream->blocks[block])
+        {
+            stream->blocks[block] = 1;
+            stream->nb_blocks++;
+        }
+        // Packed blocks are only counted, but their lengths are checked.
+        if (msg[0] == RESP_PACKED) {
+            pos = protocol_next_block(msg, pos, &data, &length);
+            if (pos < 0) {
+                break;
+            }
+        }
+    }
+
+    if (stream->nb_blocks >= stream->next_heartbeat) {
+        bench_send_request(stream->sock, server, REQ_HEARTBEAT, NULL, 0);
+        stream->next_heartbeat = stream->nb_blocks
+                               + HEARTBEAT_FREQUENCY * CODEC_BLOCKS;
+    }
+    if (stream->nb_blocks == (long) stream->nb_packets * CODEC_BLOCKS) {
+        stream->over = 1;
+    }
+}
+
+
+int main(int argc, char** argv) {
+    char dir[] = "/tmp/deadbeef-loadgen-XXXXXX";
+    char path[PATH_MAX];
+    const char* server_path;
+    unsigned char msg[MSG_LENGTH];
+    struct sockaddr_in server;
+    struct stream* streams;
+    struct stream* stream;
+    struct pollfd* pfds;
+    pid_t pid;
+    double start
+         , end
+         , t
+         , pacing
+         , cpu_start
+         , cpu
+         , loss
+         , jitter
+         , total_loss
+         , max_loss
+         , total_jitter
+         , max_jitter;
+    long long nb_bytes;
+    long nb_datagrams;
+    int nb_clients
+      , seconds
+      , capabilities
+      , nb_over
+      , nb_rejected
+      , nb_incomplete
+      , size
+      , len
+      , i;
+
+    nb_clients = argc > 1 ? atoi(argv[1]) : 4;
+    seconds = argc > 2 ? atoi(argv[2]) : 10;
+    capabilities = argc > 3 ? atoi(argv[3]) : CAP_RICE;
+    server_path = argc > 4 ? argv[4] : "bin/audioserver";
+    if (nb_clients <= 0 || seconds <= 0) {
+        fprintf(stderr, "Usage: bench_loadgen [nb_clients [seconds [caps "
+                        "[server]]]]\n");
+        exit(EXIT_FAILURE);
+    }
+    if (realpath(server_path, path) == NULL) {
+        perror("Unable to find the server");
+        exit(EXIT_FAILURE);
+    }
+
+    if (mkdtemp(dir) == NULL) {
+        perror("Unable to create the fixture directory");
+        exit(EXIT_FAILURE);
+    }
+    if (chdir(dir) < 0 || bench_write_fixture(FIXTURE_NAME, seconds) < 0) {
+        perror("Unable to write the fixture");
+        bench_remove_fixtures(dir);
+        exit(EXIT_FAILURE);
+    }
+
+    // The server catalogs the fixture directory, its output is dropped.
+    pid = fork();
+    if (pid == 0) {
+        i = open("/dev/null", O_WRONLY);
+        dup2(i, STDOUT_FILENO);
+        dup2(i, STDERR_FILENO);
+        execl(path, path, "-r", (char*) NULL);
+        exit(EXIT_FAILURE);
+    }
+
+    memset(&server, 0, sizeof(server));
+    server.sin_family = AF_INET;
+    server.sin_port = htons(BENCH_SERVER_PORT);
+    server.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (pid < 0 || bench_wait_server(&server) < 0) {
+        fprintf(stderr, "The server did not start.\n");
+        if (pid > 0) {
+            kill(pid, SIGTERM);
+            waitpid(pid, NULL, 0);
+        }
+        bench_remove_fixtures(dir);
+        exit(EXIT_FAILURE);
+    }
+
+    streams = calloc(nb_clients, sizeof(struct stream));
+    pfds = calloc(nb_clients, sizeof(struct pollfd));
+    if (streams == NULL || pfds == NULL) {
+        perror("Allocation failed");
+        exit(EXIT_FAILURE);
+    }
+
+    cpu_start = cpu_time(pid, 1);
+    start = deadbeef_now_us() / 1e6;
+    for (i = 0; i < nb_clients; i++) {
+        stream = &streams[i];
+        stream->sock = socket(AF_INET, SOCK_DGRAM, 0);
+        if (stream->sock < 0) {
+            perror("Socket creation failed");
+            exit(EXIT_FAILURE);
+        }
+        size = 4 << 20;
+        setsockopt(stream->sock, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+        stream->nb_packets = -1;
+        stream->last = start;
+        pfds[i].fd = stream->sock;
+        pfds[i].events = POLLIN;
+        bench_send_request(stream->sock, &server, REQ_STREAMING, FIXTURE_NAME,
+                           capabilities);
+    }
+
+    nb_over = 0;
+    while (nb_over < nb_clients) {
+        poll(pfds, nb_clients, 100);
+        t = deadbeef_now_us() / 1e6;
+        nb_over = 0;
+        for (i = 0; i < nb_clients; i++) {
+            stream = &streams[i];
+            while (!stream->over &&
+                   (len = recv(stream->sock, msg, MSG_LENGTH, MSG_DONTWAIT))
+                   > 0)
+            {
+                if (protocol_type(msg, len) >= 0) {
+                    receive(stream, &server, msg, t);
+                }
+            }
+            if (!stream->over && t - stream->last > IDLE_TIMEOUT) {
+                stream->over = 1;
+            }
+            nb_over += stream->over;
+        }
+    }
+    // The run ends with the last datagram, idle timeouts excluded.
+    end = start;
+    for (i = 0; i < nb_clients; i++) {
+        if (streams[i].last > end) {
+            end = streams[i].last;
+        }
+    }
+    if (end <= start) {
+        end = deadbeef_now_us() / 1e6;
+    }
+
+    // Handlers are still children of the server, reaped or not.
+    cpu = cpu_time(pid, 1) - cpu_start;
+    kill(pid, SIGTERM);
+    waitpid(pid, NULL, 0);
+    bench_remove_fixtures(dir);
+
+    nb_bytes = 0;
+    nb_datagrams = 0;
+    nb_rejected = 0;
+    nb_incomplete = 0;
+    total_loss = 0;
+    max_loss = 0;
+    total_jitter = 0;
+    max_jitter = 0;
+    pacing = seconds / (end - start);
+    printf("{\"clients\": %d, \"seconds\": %d, \"pacing_ratio\": %.2f, "
+           "\"realtime_streams\": %.1f, \"capabilities\": %d, "
+           "\"streams\": [", nb_clients, seconds, pacing,
+           nb_clients * pacing, capabilities);
+    for (i = 0; i < nb_clients; i++) {
+        stream = &streams[i];
+        loss = 1;
+        if (stream->nb_packets > 0) {
+            loss = 1 - (double) stream->nb_blocks
+                     / ((double) stream->nb_packets * CODEC_BLOCKS);
+        }
+        jitter = stream->nb_delays > 1
+               ? sqrt(stream->m2_delay / (stream->nb_delays - 1)) * 1e6 : 0;
+        nb_bytes += stream->nb_bytes;
+        nb_datagrams += stream->nb_datagrams;
+        nb_rejected += stream->rejected;
+        nb_incomplete += !stream->rejected && loss > 0;
+        total_loss += loss;
+        total_jitter += jitter;
+        if (loss > max_loss) {
+            max_loss = loss;
+        }
+        if (jitter > max_jitter) {
+            max_jitter = jitter;
+        }
+        printf("%s{\"packets\": %d, \"datagrams\": %ld, \"loss\": %.6f, "
+               "\"jitter_us\": %.1f, \"rejected\": %s}", i > 0 ? ", " : "",
+               stream->nb_packets, stream->nb_datagrams, loss, jitter,
+               stream->rejected ? "true" : "false");
+        close(stream->sock);
+        free(stream->blocks);
+    }
+    printf("], \"duration_s\": %.3f, \"throughput_mbps\": %.2f, "
+           "\"datagrams_per_s\": %.1f, \"loss_avg\": %.6f, "
+           "\"loss_max\": %.6f, \"jitter_us_avg\": %.1f, "
+           "\"jitter_us_max\": %.1f, \"server_cpu_ms_per_stream\": %.2f, "
+           "\"rejected\": %d, \"incomplete\": %d}\n",
+           end - start, nb_bytes * 8 / (end - start) / 1e6,
+           nb_datagrams / (end - start), total_loss / nb_clients, max_loss,
+           total_jitter / nb_clients, max_jitter, cpu * 1000 / nb_clients,
+           nb_rejected, nb_incomplete);
+
+    free(streams);
+    free(pfds);
+
+    return nb_rejected == 0 && nb_incomplete == 0 ? EXIT_SUCCESS
+                                                   : EXIT_FAILURE;
+}
@@ -0,0 +1,171 @@
+/* Distributed under the terms of the GNU General Public License v2 */
+/* L3info - SYR2 Project - SYR DeaDBeeF
+ * ============================================================================
+ * Mixer Benchmark
+ * ----------------------------------------------------------------------------
+ * Mix 1 to MIX_MAX_INPUTS inputs of random 16-bit stereo samples at 44.1 kHz,
+ * mapped from a temporary file as the server maps its files, with the
+ * kernels of each instruction set supported by the CPU, see mixer.h. The mix
+ * is read packet by packet, as a sender does. Each mix is checked against
+ * the scalar reference and the report gives:
+ *
+ *  - the throughput of the mix in millions of samples per second;
+ *  - the cost of an input in nanoseconds per sample;
+ *  - the share of a CPU that an input of a stream being sent takes, in
+ *    percent.
+ *
+ * Usage: bench_mix [seconds [nb_rounds]]
+ *
+ * Each input lasts 10 seconds of audio by default.
+ * ----------------------------------------------------------------------------
+ * Antoine Pinsard
+ * Oct. 19, 2026
+ */
+#include <sys/mman.h>
+#include "../mixer.h"
+
+#define SAMPLE_RATE 44100
+#define CHANNELS 2
+
+
+static const char* isa_names[] = {"scalar", "sse2", "avx2"};
+
+
+/**
+ * Mix the first nb_inputs regions of length bytes of the file to output.
+ *
+ * Return the length of the mix, or -1 on error.
+ */
+static ssize_t mix(int fd, const unsigned char* map, size_t length,
+                   int nb_inputs, unsigned char* output)
+{
+    struct mixer* mixer;
+    ssize_t done
+          , len;
+    int i;
+
+    mixer = malloc(sizeof(struct mixer));
+    if (mixer == NULL) {
+        return -1;
+    }
+    mixer_init(mixer, CHANNELS);
+    for (i = 0; i < nb_inputs; i++) {
+        // Gains below unity, so that few samples saturate.
+        if (mixer_add(mixer, fd, i * length, length, map + i * length,
+                      CONVERT_S16, CHANNELS, 0,
+                      MIX_UNITY * 3 / (2 * nb_inputs) + 1) < 0)
+        {
+            mixer_destroy(mixer);
+            free(mixer);
+            return -1;
+        }
+    }
+
+    done = 0;
+    while ((len = mixer_read(mixer, output + done, DATA_LENGTH)) > 0) {
+        done += len;
+    }
+    mixer_destroy(mixer);
+    free(mixer);
+
+    return len < 0 ? -1 : done;
+}
+
+
+int main(int argc, char** argv) {
+    unsigned char* input;
+    unsigned char* output;
+    unsigned char* reference;
+    FILE* file;
+    size_t length
+         , nb_samples
+         , i;
+    ssize_t mixed;
+    double start
+         , elapsed;
+    int seconds
+      , nb_rounds
+      , nb_inputs
+      , isa
+      , round
+      , exact
+      , failed;
+
+    seconds = argc > 1 ? atoi(argv[1]) : 10;
+    nb_rounds = argc > 2 ? atoi(argv[2]) : 5;
+    if (seconds <= 0 || nb_rounds <= 0) {
+        fprintf(stderr, "Usage: bench_mix [seconds [nb_rounds]]\n");
+        exit(EXIT_FAILURE);
+    }
+    nb_samples = (size_t) seconds * SAMPLE_RATE * CHANNELS;
+    length = nb_samples * 2;
+
+    // The inputs are regions of a file one after another.
+    file = tmpfile();
+    output = malloc(length);
+    reference = malloc(length);
+    if (file == NULL || output == NULL || reference == NULL) {
+        perror("Allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    srand(1664);
+    for (i = 0; i < MIX_MAX_INPUTS * length; i++) {
+        fputc(rand() & 0xFF, file);
+    }
+    fflush(file);
+    input = mmap(NULL, MIX_MAX_INPUTS * length, PROT_READ, MAP_SHARED,
+                 fileno(file), 0);
+    if (input == MAP_FAILED) {
+        perror("Unable to map the inputs");
+        exit(EXIT_FAILURE);
+    }
+
+    failed = 0;
+    for (nb_inputs = 1; nb_inputs <= MIX_MAX_INPUTS; nb_inputs *= 2) {
+        for (isa = CONVERT_SCALAR; isa <= CONVERT_AVX2; isa++) {
+            if (mixer_set_isa(isa) != isa) {
+                continue;
+            }
+
+            mixed = mix(fileno(file), input, length, nb_inputs, output);
+            if (mixed != length) {
+                fprintf(stderr, "Mixing failed.\n");
+                exit(EXIT_FAILURE);
+            }
+            exact = 1;
+            if (isa == CONVERT_SCALAR) {
+                memcpy(reference, output, length);
+            }
+            else if (memcmp(reference, output, length) != 0) {
+                exact = 0;
+                failed = 1;
+            }
+
+            start = deadbeef_now_us() / 1e6;
+            for (round = 0; round < nb_rounds; round++) {
+                mix(fileno(file), input, length, nb_inputs, output);
+            }
+            elapsed = deadbeef_now_us() / 1e6 - start;
+
+            printf("inputs=%d isa=%s msamples_per_s=%.1f "
+                   "ns_per_input_sample=%.3f cpu_pct_per_input=%.4f "
+                   "exact=%s\n", nb_inputs, isa_names[isa],
+                   nb_samples * nb_rounds / elapsed / 1e6,
+                   elapsed * 1e9 / nb_rounds / nb_samples / nb_inputs,
+                   100.0 * elapsed / nb_rounds / seconds / nb_inputs,
+                   exact ? "yes" : "no");
+        }
+    }
+
+    munmap(input, MIX_MAX_INPUTS * length);
+    fclose(file);
+    free(output);
+    free(reference);
+
+    if (failed) {
+        fprintf(stderr, "Kernels disagree with the scalar reference.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    return EXIT_SUCCESS;
+}
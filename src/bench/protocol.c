@@ -0,0 +1,330 @@
+/* Distributed under the terms of the GNU General Public License v2 */
+/* L3info - SYR2 Project - SYR DeaDBeeF
+ * ============================================================================
+ * Protocol Benchmark
+ * ----------------------------------------------------------------------------
+ * Encode and decode messages of each type with the protocol module, see
+ * protocol.h, check that the decoded fields match the encoded ones and report
+ * the number of messages encoded and decoded per second.
+ *
+ * Usage: bench_protocol [nb_messages]
+ * ----------------------------------------------------------------------------
+ * Antoine Pinsard
+ * Oct. 19, 2026
+ */
+#include "../codec.h"
+#include "../protocol.h"
+
+#define NB_CATALOG_ENTRIES 100
+#define NB_PACKED_BLOCKS 20
+#define NB_STATS_RECORDS 6
+
+struct codec_bench {
+    int type;
+    void (*encode)(unsigned char*, uint32_t);
+    // Return the value given to encode, or -1 if the message is corrupted.
+    long (*decode)(unsigned char*);
+};
+
+
+static void encode_streaming(unsigned char* msg, uint32_t i) {
+    protocol_encode_streaming(msg, "music/album/track.wav", i & 0xFF,
+                              CAP_RICE);
+}
+
+static long decode_streaming(unsigned char* msg) {
+    struct streaming_request request;
+
+    protocol_decode_streaming(msg, &request);
+    if (strcmp(request.filename, "music/album/track.wav") != 0) {
+        return -1;
+    }
+    return request.variant;
+}
+
+
+static const char* playlist[] = {"music/album/01.wav", "music/album/02.wav",
+                                 "music/album/03.wav", "music/album/04.wav"};
+
+static void encode_playlist(unsigned char* msg, uint32_t i) {
+    protocol_encode_playlist(msg, playlist, 4, i & 0xFF, CAP_RICE);
+}
+
+static long decode_playlist(unsigned char* msg) {
+    struct playlist_request request;
+
+    if (protocol_decode_playlist(msg, &request) < 0 ||
+        strcmp(request.filenames[3], playlist[3]) != 0)
+    {
+        return -1;
+    }
+    return request.variant;
+}
+
+
+static const int gains[] = {MIX_UNITY, MIX_UNITY / 2, MIX_MAX_GAIN};
+
+static void encode_mix(unsigned char* msg, uint32_t i) {
+    protocol_encode_mix(msg, playlist, gains, 3, i & 0xFF, CAP_RICE);
+}
+
+static long decode_mix(unsigned char* msg) {
+    struct playlist_request request;
+
+    if (protocol_decode_mix(msg, &request) < 0 ||
+        strcmp(request.filenames[2], playlist[2]) != 0 ||
+        request.gains[2] != MIX_MAX_GAIN)
+    {
+        return -1;
+    }
+    return request.variant;
+}
+
+
+static void encode_heartbeat(unsigned char* msg, uint32_t i) {
+    struct heartbeat_digest digest = {1, i, 2, 3, 4, 5, 6, 7, 8};
+
+    protocol_encode_heartbeat(msg, &digest);
+}
+
+static long decode_heartbeat(unsigned char* msg) {
+    struct heartbeat_digest digest;
+
+    protocol_decode_heartbeat(msg, &digest);
+    return digest.valid ? digest.received : -1;
+}
+
+
+static void encode_catalog_request(unsigned char* msg, uint32_t i) {
+    protocol_encode_catalog_request(msg, 0, i, "music/");
+}
+
+static long decode_catalog_request(unsigned char* msg) {
+    struct catalog_request request;
+
+    protocol_decode_catalog_request(msg, &request);
+    return strcmp(request.pattern, "music/") == 0 ? request.offset : -1;
+}
+
+
+static void encode_stats_request(unsigned char* msg, uint32_t i) {
+    protocol_encode_request(msg, REQ_STATS);
+    msg[1] = i & 0xFF;
+}
+
+static long decode_stats_request(unsigned char* msg) {
+    return msg[1];
+}
+
+
+static void encode_streaminfo(unsigned char* msg, uint32_t i) {
+    struct streaminfo info = {44100, 16, 2, i, CODEC_RICE, AUD_FORMAT_PCM,
+                              1, 4, 2048, 8192, 8386560, 0};
+
+    protocol_encode_streaminfo(msg, &info);
+}
+
+static long decode_streaminfo(unsigned char* msg) {
+    struct streaminfo info;
+
+    protocol_decode_streaminfo(msg, &info);
+    return info.nb_packets;
+}
+
+
+static void encode_data(unsigned char* msg, uint32_t i) {
+    protocol_encode_data(msg, i, DATA_LENGTH);
+}
+
+static long decode_data(unsigned char* msg) {
+    return protocol_decode_data(msg);
+}
+
+
+static void encode_error(unsigned char* msg, uint32_t i) {
+    protocol_encode_error(msg, i, "Sorry but the requested file is not "
+                                  "available.");
+}
+
+static long decode_error(unsigned char* msg) {
+    struct error_message error;
+
+    protocol_decode_error(msg, &error);
+    return error.message[0] == 'S' ? error.code : -1;
+}
+
+
+static void encode_catalog(unsigned char* msg, uint32_t i) {
+    struct catalog_response response;
+    struct catalog_record record = {AUD_FORMAT_PCM, 2, 16, 44100, 180000,
+                                    21, "music/album/track.wav"};
+    int pos;
+
+    pos = CATALOG_RESP_HEADER_LENGTH;
+    for (response.nb_entries = 0;
+         response.nb_entries < NB_CATALOG_ENTRIES; response.nb_entries++)
+    {
+        pos = protocol_put_catalog_record(msg, pos, &record);
+    }
+    response.nb_matches = i;
+    response.offset = 0;
+    protocol_encode_catalog_response(msg, &response, pos);
+}
+
+static long decode_catalog(unsigned char* msg) {
+    struct catalog_response response;
+    struct catalog_record record;
+    int pos
+      , i;
+
+    protocol_decode_catalog_response(msg, &response);
+    pos = CATALOG_RESP_HEADER_LENGTH;
+    for (i = 0; i < response.nb_entries; i++) {
+        pos = protocol_next_catalog_record(msg, pos, &record);
+        if (pos < 0 || record.sample_rate != 44100) {
+            return -1;
+        }
+    }
+    return response.nb_matches;
+}
+
+
+static void encode_packed(unsigned char* msg, uint32_t i) {
+    struct packed_header header;
+    int pos;
+
+    pos = PACKED_HEADER_LENGTH;
+    for (header.nb_blocks = 0; header.nb_blocks < NB_PACKED_BLOCKS;
+         header.nb_blocks++)
+    {
+        protocol_put_le(msg+pos, 150, 2);
+        pos += 2 + 150;
+    }
+    header.first_block = i;
+    protocol_encode_packed(msg, &header, pos);
+}
+
+static long decode_packed(unsigned char* msg) {
+    struct packed_header header;
+    const unsigned char* block;
+    int block_length
+      , pos
+      , i;
+
+    protocol_decode_packed(msg, &header);
+    pos = PACKED_HEADER_LENGTH;
+    for (i = 0; i < header.nb_blocks; i++) {
+        pos = protocol_next_block(msg, pos, &block, &block_length);
+        if (pos < 0) {
+            return -1;
+        }
+    }
+    return header.first_block;
+}
+
+
+static void encode_stats(unsigned char* msg, uint32_t i) {
+    struct stats_header header = {i, NB_STATS_RECORDS - 1, 16};
+    struct stats_record record;
+    int pos
+      , r;
+
+    memset(&record, 0, sizeof(struct stats_record));
+    record.nb_buckets = header.nb_buckets;
+    record.packets_sent = 123456789;
+    pos = STATS_RESP_HEADER_LENGTH;
+    for (r = 0; r < NB_STATS_RECORDS; r++) {
+        pos = protocol_encode_stats_record(msg, pos, &record);
+    }
+    protocol_encode_stats(msg, &header, pos);
+}
+
+static long decode_stats(unsigned char* msg) {
+    struct stats_header header;
+    struct stats_record record;
+    int pos
+      , r;
+
+    protocol_decode_stats(msg, &header);
+    record.nb_buckets = header.nb_buckets;
+    pos = STATS_RESP_HEADER_LENGTH;
+    for (r = 0; r <= header.nb_slots; r++) {
+        pos = protocol_decode_stats_record(msg, pos, &record);
+        if (pos < 0 || record.packets_sent != 123456789) {
+            return -1;
+        }
+    }
+    return header.uptime;
+}
+
+
+static const struct codec_bench benches[] = {
+    {REQ_STREAMING, encode_streaming, decode_streaming},
+    {REQ_PLAYLIST, encode_playlist, decode_playlist},
+    {REQ_MIX, encode_mix, decode_mix},
+    {REQ_HEARTBEAT, encode_heartbeat, decode_heartbeat},
+    {REQ_CATALOG, encode_catalog_request, decode_catalog_request},
+    {REQ_STATS, encode_stats_request, decode_stats_request},
+    {RESP_STREAMINFO, encode_streaminfo, decode_streaminfo},
+    {RESP_DATA, encode_data, decode_data},
+    {RESP_ERROR, encode_error, decode_error},
+    {RESP_CATALOG, encode_catalog, decode_catalog},
+    {RESP_PACKED, encode_packed, decode_packed},
+    {RESP_STATS, encode_stats, decode_stats}
+};
+
+
+int main(int argc, char** argv) {
+    unsigned char msg[MSG_LENGTH];
+    const struct codec_bench* bench;
+    unsigned long nb_messages
+                , i;
+    double start
+         , encode_time
+         , decode_time;
+    long checksum;
+    int b
+      , exact
+      , failed;
+
+    nb_messages = argc > 1 ? strtoul(argv[1], NULL, 10) : 1000000;
+
+    failed = 0;
+    memset(msg, 0, MSG_LENGTH);
+    for (b = 0; b < sizeof(benches) / sizeof(benches[0]); b++) {
+        bench = &benches[b];
+
+        // The variant of the streaming, playlist and mix requests and the
+        // stats request only keep a byte of the value.
+        bench->encode(msg, 200);
+        exact = protocol_type(msg, MSG_LENGTH) == bench->type &&
+                bench->decode(msg) == 200;
+        failed |= !exact;
+
+        start = deadbeef_now_us() / 1e6;
+        for (i = 0; i < nb_messages; i++) {
+            bench->encode(msg, i);
+        }
+        encode_time = deadbeef_now_us() / 1e6 - start;
+
+        checksum = 0;
+        start = deadbeef_now_us() / 1e6;
+        for (i = 0; i < nb_messages; i++) {
+            checksum += bench->decode(msg);
+        }
+        decode_time = deadbeef_now_us() / 1e6 - start;
+
+        printf("type=%s encode_mmsg_per_s=%.2f decode_mmsg_per_s=%.2f "
+               "exact=%s\n", protocol_type_name(bench->type),
+               nb_messages / encode_time / 1e6,
+               nb_messages / decode_time / 1e6,
+               exact && checksum >= 0 ? "yes" : "no");
+    }
+
+    if (failed) {
+        fprintf(stderr, "Decoded messages differ from the encoded ones.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    return EXIT_SUCCESS;
+}
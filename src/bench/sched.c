@@ -0,0 +1,253 @@
+/* Distributed under the terms of the GNU General Public License v2 */
+/* L3info - SYR2 Project - SYR DeaDBeeF
+ * ============================================================================
+ * Scheduler Benchmark
+ * ----------------------------------------------------------------------------
+ * Drive nb_sessions synthetic sessions with the scheduler of the streamer,
+ * see sched.h, each sending a message to a loopback receiver every 1 to 4
+ * SENDER_PERIOD, and report:
+ *
+ *  - the scheduling jitter, the lateness of the messages against their
+ *    deadline, as percentiles in microseconds;
+ *  - the number of ticks, of ticks that ended with egress saturated, and the
+ *    CPU time used per second;
+ *  - the share of its messages each session could send and its rate of
+ *    messages per second: sessions share a limited budget fairly when they
+ *    all send at the same rate, unless they need less.
+ *
+ * Usage: bench_sched [nb_sessions [seconds [budget_mbps]]]
+ *
+ * There are 1000 sessions for 5 seconds by default. The budget is unlimited
+ * unless given.
+ * ----------------------------------------------------------------------------
+ * Antoine Pinsard
+ * Oct. 19, 2026
+ */
+#include <pthread.h>
+#include <time.h>
+#include <sys/resource.h>
+#include "../sched.h"
+#include "../sender.h"
+#include "common.h"
+
+struct session {
+    struct sched_entry entry; // First, so that entries are sessions
+    long period;
+    unsigned long nb_sent;
+};
+
+struct receiver {
+    int sock;
+    volatile int stop;
+    unsigned long nb_received;
+};
+
+struct bench {
+    int sock;
+    struct sockaddr_in addr;
+    unsigned char msg_buffer[MSG_LENGTH];
+    struct bench_histogram lateness;
+};
+
+
+static void* receive(void* data) {
+    struct receiver* receiver;
+    unsigned char buffer[MSG_LENGTH];
+
+    receiver = (struct receiver*) data;
+    while (!receiver->stop) {
+        if (recv(receiver->sock, buffer, MSG_LENGTH, 0) == MSG_LENGTH) {
+            receiver->nb_received++;
+        }
+    }
+
+    return NULL;
+}
+
+
+/**
+ * Scheduler callback: send a message of the session and count its lateness.
+ */
+static int send_session(struct sched* sched, struct sched_entry* entry,
+                        long long now)
+{
+    struct bench* bench;
+    struct session* session;
+
+    bench = (struct bench*) sched->data;
+    session = (struct session*) entry;
+
+    if (sendto(bench->sock, bench->msg_buffer, MSG_LENGTH, MSG_DONTWAIT,
+               (struct sockaddr *) &bench->addr,
+               sizeof(struct sockaddr_in)) < 0)
+    {
+        return 0;
+    }
+
+    bench_record(&bench->lateness, deadbeef_now_us() - entry->deadline);
+    session->nb_sent++;
+
+    // Same pacing as the sender: no burst to catch up.
+    if (now > entry->deadline + session->period) {
+        entry->deadline = now;
+    }
+    entry->deadline += session->period;
+
+    return MSG_LENGTH;
+}
+
+
+static double cpu_seconds() {
+    struct rusage usage;
+
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6
+         + usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+}
+
+
+int main(int argc, char** argv) {
+    struct bench* bench;
+    struct session* sessions;
+    struct receiver receiver;
+    struct sched* sched;
+    struct timeval timeout;
+    struct timespec deadline;
+    socklen_t addr_len;
+    pthread_t thread;
+    long long start
+            , end
+            , next;
+    double cpu
+         , served
+         , served_min
+         , served_max
+         , rate
+         , rate_min
+         , rate_max;
+    long budget;
+    int nb_sessions
+      , seconds
+      , size
+      , s;
+
+    nb_sessions = argc > 1 ? atoi(argv[1]) : 1000;
+    seconds = argc > 2 ? atoi(argv[2]) : 5;
+    // Mbit/s to bytes per tick
+    budget = argc > 3 ? atol(argv[3]) * SCHED_TICK / 8 : 0;
+    if (nb_sessions <= 0 || seconds <= 0) {
+        fprintf(stderr, "Usage: bench_sched [nb_sessions [seconds "
+                        "[budget_mbps]]]\n");
+        exit(EXIT_FAILURE);
+    }
+
+    bench = calloc(1, sizeof(struct bench));
+    sessions = calloc(nb_sessions, sizeof(struct session));
+    sched = malloc(sizeof(struct sched));
+    if (bench == NULL || sessions == NULL || sched == NULL) {
+        perror("Dynamic allocation failed");
+        exit(EXIT_FAILURE);
+    }
+
+    receiver.sock = socket(AF_INET, SOCK_DGRAM, 0);
+    bench->sock = socket(AF_INET, SOCK_DGRAM, 0);
+    if (receiver.sock < 0 || bench->sock < 0) {
+        perror("Socket creation failed");
+        exit(EXIT_FAILURE);
+    }
+    size = 8 << 20;
+    setsockopt(receiver.sock, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+    timeout.tv_sec = 0;
+    timeout.tv_usec = 100000;
+    setsockopt(receiver.sock, SOL_SOCKET, SO_RCVTIMEO, &timeout,
+               sizeof(timeout));
+
+    memset(&bench->addr, 0, sizeof(struct sockaddr_in));
+    bench->addr.sin_family = AF_INET;
+    bench->addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    bench->addr.sin_port = 0;
+    addr_len = sizeof(struct sockaddr_in);
+    if (bind(receiver.sock, (struct sockaddr*) &bench->addr,
+             sizeof(struct sockaddr_in)) < 0 ||
+        getsockname(receiver.sock, (struct sockaddr*) &bench->addr,
+                    &addr_len) < 0)
+    {
+        perror("Failed to bind socket");
+        exit(EXIT_FAILURE);
+    }
+    protocol_encode_data(bench->msg_buffer, 0, DATA_LENGTH);
+
+    receiver.stop = 0;
+    receiver.nb_received = 0;
+    pthread_create(&thread, NULL, receive, &receiver);
+
+    // Sessions start evenly spread over their period.
+    start = deadbeef_now_us();
+    sched_init(sched, send_session, budget, start);
+    sched->data = bench;
+    for (s = 0; s < nb_sessions; s++) {
+        sessions[s].period = SENDER_PERIOD * (1 + s % 4);
+        sessions[s].entry.deadline = start + sessions[s].period * s
+                                           / nb_sessions;
+        sessions[s].entry.weight = 1;
+        sched_add(sched, &sessions[s].entry);
+    }
+
+    cpu = cpu_seconds();
+    end = start + seconds * 1000000LL;
+    next = start;
+    while (next >= 0 && next < end) {
+        deadline.tv_sec = next / 1000000;
+        deadline.tv_nsec = next % 1000000 * 1000;
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL);
+        next = sched_run(sched, deadbeef_now_us());
+    }
+    cpu = cpu_seconds() - cpu;
+
+    usleep(200000);
+    receiver.stop = 1;
+    pthread_join(thread, NULL);
+    close(receiver.sock);
+    close(bench->sock);
+
+    served_min = 1;
+    served_max = 0;
+    rate_min = 1e9;
+    rate_max = 0;
+    for (s = 0; s < nb_sessions; s++) {
+        rate = sessions[s].nb_sent / (double) seconds;
+        if (rate < rate_min) {
+            rate_min = rate;
+        }
+        if (rate > rate_max) {
+            rate_max = rate;
+        }
+        served = sessions[s].nb_sent * (double) sessions[s].period
+               / (seconds * 1000000.0);
+        if (served < served_min) {
+            served_min = served;
+        }
+        if (served > served_max) {
+            served_max = served;
+        }
+    }
+
+    printf("sessions=%d seconds=%d budget_mbps=%ld messages=%lu "
+           "delivered=%lu\n", nb_sessions, seconds, budget * 8 / SCHED_TICK,
+           bench->lateness.nb_values, receiver.nb_received);
+    printf("lateness_p50_us=%ld lateness_p99_us=%ld lateness_p999_us=%ld "
+           "lateness_max_us=%ld\n", bench_percentile(&bench->lateness, 0.5),
+           bench_percentile(&bench->lateness, 0.99),
+           bench_percentile(&bench->lateness, 0.999), bench->lateness.max);
+    printf("ticks=%lu saturated_ticks=%lu cpu_per_s=%.3f\n",
+           sched->nb_ticks, sched->nb_saturated, cpu / seconds);
+    printf("served_min=%.3f served_max=%.3f rate_min_per_s=%.1f "
+           "rate_max_per_s=%.1f\n", served_min, served_max, rate_min,
+           rate_max);
+
+    free(sched);
+    free(sessions);
+    free(bench);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,153 @@
+/* Distributed under the terms of the GNU General Public License v2 */
+/* L3info - SYR2 Project - SYR DeaDBeeF
+ * ============================================================================
+ * Sender Benchmark
+ * ----------------------------------------------------------------------------
+ * Stream a generated file to a loopback receiver with each sender backend and
+ * report the number of system calls issued by the sender per delivered MB.
+ *
+ * Usage: bench_sender [size_mb [period_us]]
+ *
+ * The io_uring backend is only measured when built with make URING=1.
+ * ----------------------------------------------------------------------------
+ * Antoine Pinsard
+ * Oct. 19, 2026
+ */
+#include <fcntl.h>
+#include <pthread.h>
+#include "../sender.h"
+
+
+struct receiver {
+    int sock;
+    volatile int stop;
+    unsigned long nb_bytes;
+};
+
+
+static void* receive(void* data) {
+    struct receiver* receiver;
+    unsigned char buffer[MSG_LENGTH];
+    ssize_t len;
+
+    receiver = (struct receiver*) data;
+    while (!receiver->stop) {
+        len = recv(receiver->sock, buffer, MSG_LENGTH, 0);
+        if (len == MSG_LENGTH) {
+            receiver->nb_bytes += DATA_LENGTH;
+        }
+    }
+
+    return NULL;
+}
+
+
+static int bench(const char* name, int backend, int fd, off_t length,
+                 long period)
+{
+    struct receiver receiver;
+    struct sockaddr_in addr;
+    struct timeval timeout;
+    socklen_t addr_len;
+    pthread_t thread;
+    struct sender sender;
+    double start
+         , elapsed
+         , delivered_mb;
+    int sock
+      , size;
+
+    receiver.sock = socket(AF_INET, SOCK_DGRAM, 0);
+    sock = socket(AF_INET, SOCK_DGRAM, 0);
+    if (receiver.sock < 0 || sock < 0) {
+        perror("Socket creation failed");
+        return -1;
+    }
+    size = 8 << 20;
+    setsockopt(receiver.sock, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+    timeout.tv_sec = 0;
+    timeout.tv_usec = 100000;
+    setsockopt(receiver.sock, SOL_SOCKET, SO_RCVTIMEO, &timeout,
+               sizeof(timeout));
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+    addr_len = sizeof(addr);
+    if (bind(receiver.sock, (struct sockaddr*) &addr, sizeof(addr)) < 0 ||
+        getsockname(receiver.sock, (struct sockaddr*) &addr, &addr_len) < 0)
+    {
+        perror("Failed to bind socket");
+        return -1;
+    }
+
+    receiver.stop = 0;
+    receiver.nb_bytes = 0;
+    pthread_create(&thread, NULL, receive, &receiver);
+
+    sender_init(&sender, sock, &addr, fd, 0, length);
+    sender.period = period;
+
+    start = deadbeef_now_us() / 1e6;
+    if (sender_run(&sender, backend) != 0) {
+        perror("Sending failed");
+    }
+    elapsed = deadbeef_now_us() / 1e6 - start;
+
+    usleep(200000);
+    receiver.stop = 1;
+    pthread_join(thread, NULL);
+    close(receiver.sock);
+    close(sock);
+
+    delivered_mb = receiver.nb_bytes / 1048576.0;
+    printf("backend=%s packets=%d sent_bytes=%lu delivered_bytes=%lu "
+           "seconds=%.3f syscalls=%lu syscalls_per_mb=%.1f\n",
+           name, sender.nb_packets, sender.nb_bytes, receiver.nb_bytes,
+           elapsed, sender.nb_syscalls,
+           delivered_mb > 0 ? sender.nb_syscalls / delivered_mb : 0.0);
+
+    return 0;
+}
+
+
+int main(int argc, char** argv) {
+    char path[] = "/tmp/deadbeef-bench-XXXXXX";
+    unsigned char block[65536];
+    off_t length
+        , written;
+    long period;
+    int fd
+      , i;
+
+    length = (argc > 1 ? atol(argv[1]) : 32) << 20;
+    period = argc > 2 ? atol(argv[2]) : 10;
+
+    fd = mkstemp(path);
+    if (fd < 0) {
+        perror("Unable to create the benchmark file");
+        exit(EXIT_FAILURE);
+    }
+    unlink(path);
+
+    srand(42);
+    for (written = 0; written < length; written += sizeof(block)) {
+        for (i = 0; i < sizeof(block); i++) {
+            block[i] = rand() & 0xFF;
+        }
+        if (write(fd, block, sizeof(block)) != sizeof(block)) {
+            perror("Unable to write the benchmark file");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    bench("blocking", SENDER_BLOCKING, fd, length, period);
+#ifdef DEADBEEF_URING
+    bench("uring", SENDER_URING, fd, length, period);
+#endif
+
+    close(fd);
+
+    return EXIT_SUCCESS;
+}
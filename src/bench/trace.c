@@ -0,0 +1,38 @@
+/* Distributed under the terms of the GNU General Public License v2 */
+/* L3info - SYR2 Project - SYR DeaDBeeF
+ * ============================================================================
+ * Trace Benchmark
+ * ----------------------------------------------------------------------------
+ * Record events to the trace ring of the calling thread, see trace.h, and
+ * report the cost of recording an event.
+ *
+ * Usage: bench_trace [nb_events]
+ * ----------------------------------------------------------------------------
+ * Antoine Pinsard
+ * Oct. 19, 2026
+ */
+#include "../trace.h"
+
+
+int main(int argc, char** argv) {
+    unsigned long nb_events
+                , i;
+    long long start
+            , elapsed;
+
+    nb_events = argc > 1 ? strtoul(argv[1], NULL, 10) : 10000000;
+
+    // The ring is allocated by the first event.
+    trace_event(TRACE_SEND, 0, 0);
+
+    start = deadbeef_now_us();
+    for (i = 0; i < nb_events; i++) {
+        trace_event(TRACE_SEND, i, i & 0xFFFF);
+    }
+    elapsed = deadbeef_now_us() - start;
+
+    printf("events=%lu ns_per_event=%.1f\n", nb_events,
+           elapsed * 1e3 / nb_events);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,654 @@
+/* Distributed under the terms of the GNU General Public License v2 */
+/* L3info - SYR2 Project - SYR DeaDBeeF
+ * ============================================================================
+ * Catalog
+ * ----------------------------------------------------------------------------
+ * Build, map and query the binary index of the served wave files.
+ * ----------------------------------------------------------------------------
+ * Antoine Pinsard
+ * Oct. 19, 2026
+ */
+#define _GNU_SOURCE
+#include <dirent.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "catalog.h"
+
+
+struct scan_item {
+    char* name;
+    struct catalog_entry entry;
+};
+
+struct scan_state {
+    struct scan_item* items;
+    int nb_items;
+    int capacity;
+    int64_t mtime; // Latest modification time of the directories scanned
+};
+
+
+/**
+ * Return the modification time of a file in nanoseconds.
+ */
+static int64_t mtime_ns(struct stat* st) {
+    return st->st_mtim.tv_sec * 1000000000LL + st->st_mtim.tv_nsec;
+}
+
+
+/**
+ * Fill the format fields of a catalog entry with the information of the wave
+ * file at the given path.
+ *
+ * Return 0 on success, -1 if the file is not a readable wave file.
+ */
+int catalog_probe(const char* path, struct catalog_entry* entry) {
+    int fd;
+    unsigned long frame_length;
+    struct aud_info info;
+    struct stat st;
+
+    assert(path != NULL);
+    assert(entry != NULL);
+
+    if (stat(path, &st) < 0) {
+        return -1;
+    }
+
+    fd = aud_readinfo((char*) path, &info);
+    if (fd < 0) {
+        return -1;
+    }
+    close(fd);
+
+    entry->format = info.format;
+    entry->sample_rate = info.sample_rate;
+    entry->sample_size = info.sample_size;
+    entry->channels = info.channels;
+    entry->data_offset = info.data_offset;
+    entry->data_length = info.data_length;
+    entry->mtime = st.st_mtime;
+    entry->flags = 0;
+
+    frame_length = (unsigned long) info.sample_rate * info.channels
+                 * info.sample_size / 8;
+    if (frame_length == 0) {
+        entry->duration = 0;
+    }
+    else {
+        entry->duration = entry->data_length * 1000 / frame_length;
+    }
+
+    return 0;
+}
+
+
+/**
+ * Return 1 if the given file name has the wave extension.
+ */
+static int is_wave_file(const char* name) {
+    size_t len;
+
+    len = strlen(name);
+    return len > 4 && strcmp(name + len - 4, ".wav") == 0;
+}
+
+
+/**
+ * Recursively add the wave files found under path to the scan state.
+ * Hidden files and directories are ignored, which notably excludes the index
+ * itself.
+ *
+ * Return 0 on success, -1 on allocation failure.
+ */
+static int scan_directory(struct scan_state* state, const char* path) {
+    DIR* dir;
+    struct dirent* dirent;
+    struct stat st;
+    struct scan_item* item;
+    char* child;
+    int err;
+
+    dir = opendir(path);
+    if (dir == NULL) {
+        return 0;
+    }
+    // Taken before reading, so that a file added meanwhile is noticed later.
+    if (fstat(dirfd(dir), &st) == 0 && mtime_ns(&st) > state->mtime) {
+        state->mtime = mtime_ns(&st);
+    }
+
+    err = 0;
+    while (err == 0 && (dirent = readdir(dir)) != NULL) {
+        if (dirent->d_name[0] == '.') {
+            continue;
+        }
+
+        if (strcmp(path, ".") == 0) {
+            child = strdup(dirent->d_name);
+        }
+        else {
+            child = malloc(strlen(path) + strlen(dirent->d_name) + 2);
+            if (child != NULL) {
+                sprintf(child, "%s/%s", path, dirent->d_name);
+            }
+        }
+        if (child == NULL) {
+            err = -1;
+            break;
+        }
+
+        if (stat(child, &st) < 0) {
+            free(child);
+            continue;
+        }
+
+        if (S_ISDIR(st.st_mode)) {
+            err = scan_directory(state, child);
+            free(child);
+            continue;
+        }
+
+        if (!S_ISREG(st.st_mode) || !is_wave_file(child) ||
+            strlen(child) > UINT16_MAX)
+        {
+            free(child);
+            continue;
+        }
+
+        if (state->nb_items == state->capacity) {
+            state->capacity = state->capacity ? 2 * state->capacity : 256;
+            item = realloc(state->items,
+                           state->capacity * sizeof(struct scan_item));
+            if (item == NULL) {
+                free(child);
+                err = -1;
+                break;
+            }
+            state->items = item;
+        }
+
+        item = &state->items[state->nb_items];
+        memset(&item->entry, 0, sizeof(struct catalog_entry));
+        if (catalog_probe(child, &item->entry) < 0) {
+            free(child);
+            continue;
+        }
+        item->name = child;
+        state->nb_items++;
+    }
+
+    closedir(dir);
+    return err;
+}
+
+
+static int compare_items(const void* a, const void* b) {
+    return strcmp(((struct scan_item*) a)->name,
+                  ((struct scan_item*) b)->name);
+}
+
+
+/**
+ * Recursively scan the root directory for wave files and write the
+ * corresponding index to index_path.
+ *
+ * The index is first written to a temporary file which is then renamed, so
+ * that a running server never maps a partially written index.
+ *
+ * Return the number of indexed files, or -1 if an error occured.
+ */
+int catalog_scan(const char* root, const char* index_path) {
+    struct scan_state state;
+    struct catalog_header header;
+    struct timespec ts;
+    struct stat st;
+    char* tmp_path;
+    FILE* file;
+    uint32_t name_offset;
+    int i
+      , err;
+
+    assert(root != NULL);
+    assert(index_path != NULL);
+
+    state.items = NULL;
+    state.nb_items = 0;
+    state.capacity = 0;
+    state.mtime = 0;
+    clock_gettime(CLOCK_REALTIME, &ts);
+
+    err = scan_directory(&state, root);
+
+    tmp_path = malloc(strlen(index_path) + 5);
+    if (tmp_path == NULL) {
+        err = -1;
+    }
+
+    file = NULL;
+    if (err == 0) {
+        qsort(state.items, state.nb_items, sizeof(struct scan_item),
+              compare_items);
+
+        name_offset = 0;
+        for (i = 0; i < state.nb_items; i++) {
+            state.items[i].entry.name_offset = name_offset;
+            state.items[i].entry.name_length = strlen(state.items[i].name);
+            name_offset += state.items[i].entry.name_length + 1;
+        }
+
+        header.magic = CATALOG_MAGIC;
+        header.version = CATALOG_VERSION;
+        header.nb_entries = state.nb_items;
+        header.names_length = name_offset;
+        header.generation = ts.tv_sec * 1000000000LL + ts.tv_nsec;
+        header.mtime = state.mtime;
+
+        sprintf(tmp_path, "%s.tmp", index_path);
+        file = fopen(tmp_path, "wb");
+        if (file == NULL) {
+            err = -1;
+        }
+    }
+
+    if (err == 0) {
+        if (fwrite(&header, sizeof(header), 1, file) != 1) {
+            err = -1;
+        }
+        for (i = 0; err == 0 && i < state.nb_items; i++) {
+            if (fwrite(&state.items[i].entry, sizeof(struct catalog_entry), 1,
+                       file) != 1)
+            {
+                err = -1;
+            }
+        }
+        for (i = 0; err == 0 && i < state.nb_items; i++) {
+            if (fwrite(state.items[i].name,
+                       state.items[i].entry.name_length + 1, 1, file) != 1)
+            {
+                err = -1;
+            }
+        }
+        if (fflush(file) != 0) {
+            err = -1;
+        }
+        if (err == 0 && rename(tmp_path, index_path) < 0) {
+            err = -1;
+        }
+        // Writing the index into the library modified the root: its time is
+        // taken once the index is renamed, so that catalog_outdated() does
+        // not take the index for an added file. A file added to the root
+        // during the scan is then only noticed with the next one.
+        if (err == 0 && stat(root, &st) == 0 &&
+            mtime_ns(&st) > header.mtime)
+        {
+            header.mtime = mtime_ns(&st);
+            if (fseek(file, 0, SEEK_SET) != 0 ||
+                fwrite(&header, sizeof(header), 1, file) != 1)
+            {
+                err = -1;
+            }
+        }
+        if (fclose(file) != 0) {
+            err = -1;
+        }
+        if (err != 0) {
+            unlink(tmp_path);
+        }
+    }
+
+    for (i = 0; i < state.nb_items; i++) {
+        free(state.items[i].name);
+    }
+    free(state.items);
+    free(tmp_path);
+
+    return err == 0 ? state.nb_items : -1;
+}
+
+
+/**
+ * Tell whether the entries of a mapped index refer to names within its names
+ * table, NUL-terminated and in the order of the entries, so that lookups and
+ * searches never read past the mapping.
+ *
+ * Return 1 if every entry is valid, 0 otherwise.
+ */
+static int entries_valid(struct catalog* catalog) {
+    struct catalog_entry* entry;
+    uint64_t end;
+    uint32_t i;
+
+    end = 0;
+    for (i = 0; i < catalog->header->nb_entries; i++) {
+        entry = &catalog->entries[i];
+        if (entry->name_offset < end ||
+            (uint64_t) entry->name_offset + entry->name_length
+            >= catalog->header->names_length ||
+            catalog->names[entry->name_offset + entry->name_length] != '\0')
+        {
+            return 0;
+        }
+        end = (uint64_t) entry->name_offset + entry->name_length + 1;
+    }
+
+    return 1;
+}
+
+
+/**
+ * Map the index file at index_path.
+ *
+ * The mapping is shared and writable, so that entries refreshed by
+ * catalog_lookup() are persisted and seen by the streamer and forked
+ * handlers. A private mapping would hide them, which is why an index that is
+ * not writable is not mapped at all.
+ *
+ * Return NULL if the index does not exist, is not writable or is not valid,
+ * truncated or with an entry out of its names table.
+ */
+struct catalog* catalog_open(const char* index_path) {
+    struct catalog* catalog;
+    struct stat st;
+    uint64_t expected;
+
+    assert(index_path != NULL);
+
+    catalog = malloc(sizeof(struct catalog));
+    if (catalog == NULL) {
+        return NULL;
+    }
+
+    catalog->fd = open(index_path, O_RDWR);
+    if (catalog->fd < 0) {
+        free(catalog);
+        return NULL;
+    }
+
+    if (fstat(catalog->fd, &st) < 0 ||
+        st.st_size < sizeof(struct catalog_header))
+    {
+        close(catalog->fd);
+        free(catalog);
+        return NULL;
+    }
+
+    catalog->map_length = st.st_size;
+    catalog->map = mmap(NULL, catalog->map_length, PROT_READ | PROT_WRITE,
+                        MAP_SHARED, catalog->fd, 0);
+    if (catalog->map == MAP_FAILED) {
+        close(catalog->fd);
+        free(catalog);
+        return NULL;
+    }
+
+    catalog->header = (struct catalog_header*) catalog->map;
+    catalog->entries = (struct catalog_entry*) (catalog->header + 1);
+    catalog->names = (char*) (catalog->entries
+                              + catalog->header->nb_entries);
+    catalog->users = 0;
+
+    expected = sizeof(struct catalog_header)
+             + (uint64_t) catalog->header->nb_entries
+               * sizeof(struct catalog_entry)
+             + catalog->header->names_length;
+    if (catalog->header->magic != CATALOG_MAGIC ||
+        catalog->header->version != CATALOG_VERSION ||
+        expected != catalog->map_length || !entries_valid(catalog))
+    {
+        catalog_close(catalog);
+        return NULL;
+    }
+
+    return catalog;
+}
+
+
+/**
+ * Unmap the index and free the catalog.
+ */
+void catalog_close(struct catalog* catalog) {
+    assert(catalog != NULL);
+
+    munmap(catalog->map, catalog->map_length);
+    close(catalog->fd);
+    free(catalog);
+}
+
+
+/**
+ * Search the catalog for the entry with the given name.
+ *
+ * The entry is lazily validated: if the file has been modified since it was
+ * indexed, its header is parsed again and the entry is updated in place.
+ *
+ * Return NULL if no valid entry matches.
+ */
+struct catalog_entry* catalog_lookup(struct catalog* catalog,
+                                     const char* name)
+{
+    struct catalog_entry* entry;
+    struct stat st;
+    int low
+      , high
+      , mid
+      , cmp;
+
+    assert(catalog != NULL);
+    assert(name != NULL);
+
+    entry = NULL;
+    low = 0;
+    high = catalog->header->nb_entries - 1;
+    while (low <= high) {
+        mid = low + (high - low) / 2;
+        cmp = strcmp(catalog_name(catalog, &catalog->entries[mid]), name);
+        if (cmp == 0) {
+            entry = &catalog->entries[mid];
+            break;
+        }
+        if (cmp < 0) {
+            low = mid + 1;
+        }
+        else {
+            high = mid - 1;
+        }
+    }
+    if (entry == NULL) {
+        return NULL;
+    }
+
+    if (stat(name, &st) < 0) {
+        entry->flags |= CATALOG_INVALID;
+        return NULL;
+    }
+    if (st.st_mtime != entry->mtime) {
+        if (catalog_probe(name, entry) < 0) {
+            entry->mtime = st.st_mtime;
+            entry->flags |= CATALOG_INVALID;
+        }
+    }
+
+    if (entry->flags & CATALOG_INVALID) {
+        return NULL;
+    }
+
+    return entry;
+}
+
+
+/**
+ * Tell whether files may have been added to the library at root since the
+ * index was built: whether root, or the directory of the file name relative
+ * to root if name is not NULL, was modified after the latest directory
+ * scanned. Only the directories themselves are checked, so that a miss costs
+ * a stat() or two rather than a scan.
+ *
+ * A directory that cannot have been scanned, being hidden or out of the
+ * library, is never checked.
+ *
+ * Return 1 if the library should be scanned again, 0 otherwise.
+ */
+int catalog_outdated(struct catalog* catalog, const char* root,
+                     const char* name)
+{
+    struct stat st;
+    char path[PATH_MAX];
+    const char* slash;
+
+    assert(catalog != NULL);
+    assert(root != NULL);
+
+    if (stat(root, &st) == 0 && mtime_ns(&st) > catalog->header->mtime) {
+        return 1;
+    }
+    if (name == NULL || (slash = strrchr(name, '/')) == NULL ||
+        name[0] == '.' || strstr(name, "/.") != NULL)
+    {
+        return 0;
+    }
+
+    if (snprintf(path, PATH_MAX, "%s/%.*s", root, (int) (slash - name),
+                 name) >= PATH_MAX)
+    {
+        return 0;
+    }
+
+    return stat(path, &st) == 0 && mtime_ns(&st) > catalog->header->mtime;
+}
+
+
+/**
+ * Return the index of the first entry whose name is not lower than name when
+ * comparing at most len characters, or greater if upper is set.
+ */
+static uint32_t bound(struct catalog* catalog, const char* name, size_t len,
+                      int upper)
+{
+    uint32_t low
+           , high
+           , mid;
+
+    low = 0;
+    high = catalog->header->nb_entries;
+    while (low < high) {
+        mid = low + (high - low) / 2;
+        if (strncmp(catalog_name(catalog, &catalog->entries[mid]), name,
+                    len) < upper)
+        {
+            low = mid + 1;
+        }
+        else {
+            high = mid;
+        }
+    }
+
+    return low;
+}
+
+
+/**
+ * Return the index of the entry whose name contains the given offset of the
+ * names table.
+ */
+static uint32_t entry_at(struct catalog* catalog, uint32_t name_offset) {
+    uint32_t low
+           , high
+           , mid;
+
+    low = 0;
+    high = catalog->header->nb_entries;
+    while (high - low > 1) {
+        mid = low + (high - low) / 2;
+        if (catalog->entries[mid].name_offset <= name_offset) {
+            low = mid;
+        }
+        else {
+            high = mid;
+        }
+    }
+
+    return low;
+}
+
+
+/**
+ * Search the catalog for the entries whose name starts with (CATALOG_PREFIX)
+ * or contains (CATALOG_SUBSTRING) the given pattern.
+ *
+ * Matching entries are skipped up to offset, then at most max_results
+ * pointers are stored into results. The total number of matches is stored in
+ * nb_matches. Invalid entries are never reported.
+ *
+ * Prefix searches are answered by binary search. Substring searches scan the
+ * names table at once, which is contiguous and ordered like the entries.
+ * Neither allocates memory.
+ *
+ * Return the number of entries stored into results.
+ */
+int catalog_search(struct catalog* catalog, const char* pattern, int mode,
+                   uint32_t offset, struct catalog_entry** results,
+                   int max_results, uint32_t* nb_matches)
+{
+    struct catalog_entry* entry;
+    size_t len;
+    uint32_t first
+           , last
+           , matches
+           , i;
+    char* names_end;
+    char* cursor;
+    int nb_results;
+
+    assert(catalog != NULL);
+    assert(pattern != NULL);
+    assert(results != NULL);
+    assert(nb_matches != NULL);
+
+    len = strlen(pattern);
+    matches = 0;
+    nb_results = 0;
+
+    if (mode == CATALOG_PREFIX) {
+        first = bound(catalog, pattern, len, 0);
+        last = bound(catalog, pattern, len, 1);
+        for (i = first; i < last; i++) {
+            entry = &catalog->entries[i];
+            if (entry->flags & CATALOG_INVALID) {
+                continue;
+            }
+            if (matches >= offset && nb_results < max_results) {
+                results[nb_results++] = entry;
+            }
+            matches++;
+        }
+    }
+    else if (catalog->header->nb_entries > 0) {
+        cursor = catalog->names;
+        names_end = catalog->names + catalog->header->names_length;
+        while (cursor < names_end) {
+            cursor = memmem(cursor, names_end - cursor, pattern, len);
+            if (cursor == NULL) {
+                break;
+            }
+            i = entry_at(catalog, cursor - catalog->names);
+            entry = &catalog->entries[i];
+            // Resume the search at the next name.
+            cursor = catalog->names + entry->name_offset
+                   + entry->name_length + 1;
+            if (entry->flags & CATALOG_INVALID) {
+                continue;
+            }
+            if (matches >= offset && nb_results < max_results) {
+                results[nb_results++] = entry;
+            }
+            matches++;
+        }
+    }
+
+    *nb_matches = matches;
+    return nb_results;
+}
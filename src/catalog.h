@@ -0,0 +1,93 @@
+/* Distributed under the terms of the GNU General Public License v2 */
+/* L3info - SYR2 Project - SYR DeaDBeeF
+ * ============================================================================
+ * Catalog
+ * ----------------------------------------------------------------------------
+ * The catalog is a compact binary index of the wave files served by the
+ * server. It is built once by recursively scanning the library directory and
+ * is then memory-mapped at boot, so that answering a request does not require
+ * to parse any wave header.
+ *
+ * The index file is laid out as follows:
+ *
+ *   struct catalog_header
+ *   struct catalog_entry[nb_entries]   (sorted by name)
+ *   char names[names_length]           (NUL-terminated names)
+ *
+ * The header records the latest modification time of the directories that
+ * were scanned, so that a file added since is noticed from the time of its
+ * directory alone, see catalog_outdated(), without scanning the library.
+ * ----------------------------------------------------------------------------
+ * Antoine Pinsard
+ * Oct. 19, 2026
+ */
+#ifndef _CATALOG_H_
+#define _CATALOG_H_
+
+#include <stdint.h>
+#include "deadbeef.h"
+
+#define CATALOG_INDEX ".deadbeef.idx"
+#define CATALOG_MAGIC 0xDBCA7A10
+#define CATALOG_VERSION 3
+
+struct catalog_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t nb_entries;
+    uint32_t names_length;
+    int64_t generation; // Time of the scan in nanoseconds, unique to it
+    int64_t mtime;      // Latest modification time of the scanned
+                        // directories in nanoseconds
+};
+
+struct catalog_entry {
+    uint32_t name_offset; // Offset of the name in the names table
+    uint16_t name_length; // Length of the name, without the EOS marker
+    uint16_t format;      // AUD_FORMAT_PCM or AUD_FORMAT_FLOAT
+    uint32_t sample_rate;
+    uint16_t sample_size;
+    uint16_t channels;
+    uint64_t data_offset; // Offset of the audio samples in the file
+    uint64_t data_length; // Length of the audio samples in bytes
+    uint32_t duration;    // Duration in milliseconds
+    uint32_t flags;
+    int64_t mtime;        // Modification time of the file when indexed
+};
+
+// The entry refers to a file that is no longer readable.
+#define CATALOG_INVALID 0x1
+
+// Search modes
+#define CATALOG_PREFIX 0
+#define CATALOG_SUBSTRING 1
+
+struct catalog {
+    int fd;
+    void* map;
+    size_t map_length;
+    struct catalog_header* header;
+    struct catalog_entry* entries;
+    char* names;
+    int users; // Sessions of the streamer reading the mapping
+};
+
+int catalog_scan(const char*, const char*);
+struct catalog* catalog_open(const char*);
+void catalog_close(struct catalog*);
+struct catalog_entry* catalog_lookup(struct catalog*, const char*);
+int catalog_outdated(struct catalog*, const char*, const char*);
+int catalog_probe(const char*, struct catalog_entry*);
+int catalog_search(struct catalog*, const char*, int, uint32_t,
+                   struct catalog_entry**, int, uint32_t*);
+
+/**
+ * Return the name of a catalog entry, relative to the library root.
+ */
+static inline const char* catalog_name(struct catalog* catalog,
+                                       struct catalog_entry* entry)
+{
+    return catalog->names + entry->name_offset;
+}
+
+#endif
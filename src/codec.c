@@ -0,0 +1,600 @@
+/* Distributed under the terms of the GNU General Public License v2 */
+/* L3info - SYR2 Project - SYR DeaDBeeF
+ * ============================================================================
+ * Codec
+ * ----------------------------------------------------------------------------
+ * Lossless compression of 16-bit PCM packets.
+ * ----------------------------------------------------------------------------
+ * Antoine Pinsard
+ * Oct. 19, 2026
+ */
+#include "codec.h"
+
+
+#define MAX_SAMPLES (CODEC_BLOCK_LENGTH / 2)
+
+struct bit_writer {
+    unsigned char* output;
+    int capacity;
+    int pos;
+    uint64_t acc;
+    int nb_bits;
+    int overflow;
+};
+
+struct bit_reader {
+    const unsigned char* input;
+    int length;
+    int pos;
+    uint64_t acc;
+    int nb_bits;
+    int overflow;
+};
+
+
+/**
+ * Append the n lowest bits of value (n <= 32) to the bit stream.
+ */
+static inline void put_bits(struct bit_writer* bw, uint32_t value, int n) {
+    bw->acc = (bw->acc << n) | (value & ((1ULL << n) - 1));
+    bw->nb_bits += n;
+    while (bw->nb_bits >= 8) {
+        bw->nb_bits -= 8;
+        if (bw->pos == bw->capacity) {
+            bw->overflow = 1;
+            return;
+        }
+        bw->output[bw->pos++] = bw->acc >> bw->nb_bits;
+    }
+}
+
+
+/**
+ * Pad the bit stream to the next byte boundary.
+ */
+static void flush_bits(struct bit_writer* bw) {
+    if (bw->nb_bits > 0) {
+        put_bits(bw, 0, 8 - bw->nb_bits);
+    }
+}
+
+
+/**
+ * Read n bits (n <= 32) from the bit stream. Reading past the end of the
+ * input sets the overflow flag and returns zeros.
+ */
+static inline uint32_t get_bits(struct bit_reader* br, int n) {
+    while (br->nb_bits < n) {
+        if (br->pos == br->length) {
+            br->overflow = 1;
+            return 0;
+        }
+        br->acc = (br->acc << 8) | br->input[br->pos++];
+        br->nb_bits += 8;
+    }
+    br->nb_bits -= n;
+    return (br->acc >> br->nb_bits) & ((1ULL << n) - 1);
+}
+
+
+/**
+ * Count the ones preceding the next zero, up to CODEC_ESCAPE. The zero is
+ * consumed, but not the bits following CODEC_ESCAPE ones.
+ */
+static inline int get_unary(struct bit_reader* br) {
+    uint64_t bits;
+    int q
+      , ones;
+
+    q = 0;
+    for (;;) {
+        while (br->nb_bits <= 56 && br->pos < br->length) {
+            br->acc = (br->acc << 8) | br->input[br->pos++];
+            br->nb_bits += 8;
+        }
+        if (br->nb_bits == 0) {
+            br->overflow = 1;
+            return q;
+        }
+        // Align the pending bits to the left and invert them, so that the
+        // leading ones become leading zeros.
+        bits = ~(br->acc << (64 - br->nb_bits));
+        ones = __builtin_clzll(bits);
+        if (q + ones >= CODEC_ESCAPE) {
+            br->nb_bits -= CODEC_ESCAPE - q;
+            return CODEC_ESCAPE;
+        }
+        if (ones < br->nb_bits) {
+            br->nb_bits -= ones + 1;
+            return q + ones;
+        }
+        q += ones;
+        br->nb_bits = 0;
+    }
+}
+
+
+/**
+ * Compute the residual of the fixed predictor of the given order at n.
+ */
+static inline int32_t residual(const int32_t* x, int n, int order) {
+    switch (order) {
+        case 0:
+            return x[n];
+        case 1:
+            return x[n] - x[n-1];
+        case 2:
+            return x[n] - 2*x[n-1] + x[n-2];
+        case 3:
+            return x[n] - 3*x[n-1] + 3*x[n-2] - x[n-3];
+        default:
+            return x[n] - 4*x[n-1] + 6*x[n-2] - 4*x[n-3] + x[n-4];
+    }
+}
+
+
+/**
+ * Select the fixed predictor order that minimizes the sum of the absolute
+ * residuals, computing all orders in a single pass.
+ */
+static int select_order(const int32_t* x, int n, uint64_t* best_sum) {
+    uint64_t sums[CODEC_MAX_ORDER+1] = {0, 0, 0, 0, 0};
+    int32_t e0
+          , e1
+          , e2
+          , e3
+          , e4;
+    int i
+      , order
+      , max_order;
+
+    max_order = n > CODEC_MAX_ORDER ? CODEC_MAX_ORDER : n;
+    for (i = CODEC_MAX_ORDER; i < n; i++) {
+        e0 = x[i];
+        e1 = e0 - x[i-1];
+        e2 = e1 - (x[i-1] - x[i-2]);
+        e3 = e2 - (x[i-1] - 2*x[i-2] + x[i-3]);
+        e4 = e3 - (x[i-1] - 3*x[i-2] + 3*x[i-3] - x[i-4]);
+        sums[0] += e0 < 0 ? -e0 : e0;
+        sums[1] += e1 < 0 ? -e1 : e1;
+        sums[2] += e2 < 0 ? -e2 : e2;
+        sums[3] += e3 < 0 ? -e3 : e3;
+        sums[4] += e4 < 0 ? -e4 : e4;
+    }
+
+    order = 0;
+    for (i = 1; i <= max_order; i++) {
+        if (sums[i] < sums[order]) {
+            order = i;
+        }
+    }
+    *best_sum = sums[order];
+
+    return order;
+}
+
+
+/**
+ * Select the Rice parameter for n residuals whose absolute values sum up to
+ * sum.
+ */
+static int select_rice_parameter(uint64_t sum, int n) {
+    int k;
+
+    for (k = 0; k < 20 && ((uint64_t) n << (k+1)) < 2*sum; k++);
+
+    return k;
+}
+
+
+static void encode_channel(struct bit_writer* bw, const int32_t* x, int n) {
+    uint64_t sum;
+    uint32_t u;
+    int32_t r;
+    int order
+      , k
+      , i
+      , q;
+
+    order = select_order(x, n, &sum);
+    k = select_rice_parameter(sum, n - CODEC_MAX_ORDER > 0
+                                   ? n - CODEC_MAX_ORDER : 1);
+
+    put_bits(bw, order, 3);
+    put_bits(bw, k, 5);
+    for (i = 0; i < order; i++) {
+        put_bits(bw, (uint16_t) x[i], 16);
+    }
+
+    for (i = order; i < n && !bw->overflow; i++) {
+        r = residual(x, i, order);
+        u = ((uint32_t) r << 1) ^ (uint32_t) (r >> 31);
+        q = u >> k;
+        if (q >= CODEC_ESCAPE) {
+            put_bits(bw, 0xFFFFFFFF, CODEC_ESCAPE);
+            put_bits(bw, u, CODEC_ESCAPE_BITS);
+            continue;
+        }
+        // q ones, a zero, then the k lowest bits of u
+        if (q + 1 + k <= 32) {
+            put_bits(bw, ((((uint64_t) 1 << q) - 1) << (k+1))
+                         | (u & ((1U << k) - 1)), q + 1 + k);
+        }
+        else {
+            put_bits(bw, (1U << q) - 1, q);
+            put_bits(bw, 0, 1);
+            put_bits(bw, u, k);
+        }
+    }
+}
+
+
+static int decode_channel(struct bit_reader* br, int32_t* x, int n) {
+    uint32_t u;
+    int order
+      , k
+      , i
+      , q;
+
+    order = get_bits(br, 3);
+    k = get_bits(br, 5);
+    if (order > CODEC_MAX_ORDER || order > n || k > 24) {
+        return -1;
+    }
+
+    for (i = 0; i < order; i++) {
+        x[i] = (int16_t) get_bits(br, 16);
+    }
+
+    for (i = order; i < n && !br->overflow; i++) {
+        q = get_unary(br);
+        if (q == CODEC_ESCAPE) {
+            u = get_bits(br, CODEC_ESCAPE_BITS);
+        }
+        else {
+            u = ((uint32_t) q << k) | get_bits(br, k);
+        }
+        x[i] = (int32_t) (u >> 1) ^ -(int32_t) (u & 1);
+        switch (order) {
+            case 0:
+                break;
+            case 1:
+                x[i] += x[i-1];
+                break;
+            case 2:
+                x[i] += 2*x[i-1] - x[i-2];
+                break;
+            case 3:
+                x[i] += 3*x[i-1] - 3*x[i-2] + x[i-3];
+                break;
+            default:
+                x[i] += 4*x[i-1] - 6*x[i-2] + 4*x[i-3] - x[i-4];
+        }
+        if (x[i] < INT16_MIN || x[i] > INT16_MAX) {
+            return -1;
+        }
+    }
+
+    return br->overflow ? -1 : 0;
+}
+
+
+/**
+ * Encode the length bytes (at most CODEC_BLOCK_LENGTH) of 16-bit little endian
+ * PCM at input, whose first sample belongs to the channel phase, into at most
+ * capacity bytes of output.
+ *
+ * Return the length of the encoded block, or -1 if it does not fit in
+ * capacity bytes.
+ */
+int codec_encode(const unsigned char* input, int length, int channels,
+                 int phase, unsigned char* output, int capacity)
+{
+    struct bit_writer bw;
+    int32_t x[MAX_SAMPLES];
+    int nb_samples
+      , channel
+      , n
+      , i;
+
+    assert(input != NULL);
+    assert(output != NULL);
+    assert(length <= CODEC_BLOCK_LENGTH);
+    assert(channels > 0 && channels <= CODEC_MAX_CHANNELS);
+
+    if (capacity < 3) {
+        return -1;
+    }
+
+    nb_samples = length / 2;
+    output[0] = length & 0xFF;
+    output[1] = (length >> 8) & 0xFF;
+    bw.pos = 2;
+    if (length % 2 != 0) {
+        output[bw.pos++] = input[length-1];
+    }
+    bw.output = output;
+    bw.capacity = capacity;
+    bw.acc = 0;
+    bw.nb_bits = 0;
+    bw.overflow = 0;
+
+    for (channel = 0; channel < channels && !bw.overflow; channel++) {
+        // Samples of this channel are found every channels samples, starting
+        // from the first sample that belongs to it.
+        n = 0;
+        for (i = (channel - phase + channels) % channels; i < nb_samples;
+             i += channels)
+        {
+            x[n++] = (int16_t) (input[2*i] | (input[2*i+1] << 8));
+        }
+        encode_channel(&bw, x, n);
+    }
+    flush_bits(&bw);
+
+    return bw.overflow ? -1 : bw.pos;
+}
+
+
+/**
+ * Map each sample of the block-th block, a full one, to the mean that replaces
+ * it once reduced: index[i] is the mean of the i-th sample. Means are ordered
+ * by pair of frames or by frame, then by channel unless reduced to mono, so
+ * that they are interleaved like samples; width is set to their number of
+ * channels and phase to the channel of the first one.
+ *
+ * Return the number of means.
+ */
+static int reduce_layout(uint32_t block, int channels, int reduction,
+                         int* index, int* width, int* phase)
+{
+    int64_t first
+          , sample
+          , group;
+    int span
+      , key
+      , last
+      , i;
+
+    span = reduction & CODEC_HALF_RATE ? 2 : 1;
+    *width = reduction & CODEC_MONO ? 1 : channels;
+    first = (int64_t) block * MAX_SAMPLES;
+    group = first / channels / span;
+
+    // The first and last groups of frames may only have some of their
+    // channels in the block, but a block spans enough frames for the means
+    // to be numbered without a gap from the lowest channel of the first one.
+    *phase = *width;
+    last = 0;
+    for (i = 0; i < MAX_SAMPLES; i++) {
+        sample = first + i;
+        key = (int) (sample / channels / span - group) * *width;
+        if (*width > 1) {
+            key += sample % channels;
+        }
+        index[i] = key;
+        if (key < *phase) {
+            *phase = key;
+        }
+        if (key > last) {
+            last = key;
+        }
+    }
+    for (i = 0; i < MAX_SAMPLES; i++) {
+        index[i] -= *phase;
+    }
+
+    return last - *phase + 1;
+}
+
+
+/**
+ * Reduce the block-th block, a full one at input, then encode its means into
+ * at most capacity bytes of output, see codec.h.
+ *
+ * Return the length of the encoded block, or -1 if it does not fit in
+ * capacity bytes.
+ */
+static int encode_reduced(const unsigned char* input, int channels,
+                          uint32_t block, int reduction,
+                          unsigned char* output, int capacity)
+{
+    unsigned char means[CODEC_BLOCK_LENGTH];
+    int32_t sums[MAX_SAMPLES];
+    int index[MAX_SAMPLES]
+      , counts[MAX_SAMPLES];
+    int nb_means
+      , width
+      , phase
+      , length
+      , mean
+      , i;
+
+    nb_means = reduce_layout(block, channels, reduction, index, &width,
+                             &phase);
+    memset(sums, 0, nb_means * sizeof(int32_t));
+    memset(counts, 0, nb_means * sizeof(int));
+    for (i = 0; i < MAX_SAMPLES; i++) {
+        sums[index[i]] += (int16_t) (input[2*i] | (input[2*i+1] << 8));
+        counts[index[i]]++;
+    }
+    for (i = 0; i < nb_means; i++) {
+        mean = sums[i] / counts[i];
+        means[2*i] = mean & 0xFF;
+        means[2*i+1] = (mean >> 8) & 0xFF;
+    }
+
+    length = codec_encode(means, 2 * nb_means, width, phase, output,
+                          capacity);
+    if (length >= 0) {
+        output[1] |= reduction >> 8;
+    }
+
+    return length;
+}
+
+
+/**
+ * Encode the packet_id-th packet, made of length bytes of 16-bit little
+ * endian PCM at input, to output, which must have room for DATA_LENGTH bytes.
+ * Its blocks are reduced as given by reduction, see codec.h, unless it is
+ * 0 or the packet is not full.
+ *
+ * Return the length of the encoded packet, or -1 if it would be larger than
+ * the raw packet.
+ */
+int codec_encode_packet(const unsigned char* input, int length, int channels,
+                        uint32_t packet_id, int reduction,
+                        unsigned char* output)
+{
+    uint32_t block_id;
+    int pos
+      , part_length
+      , block_length
+      , part;
+
+    assert(length <= DATA_LENGTH);
+    assert((reduction & CODEC_LENGTH_MASK) == 0);
+
+    if (length < DATA_LENGTH) {
+        reduction = 0;
+    }
+
+    pos = 0;
+    // The last blocks of the last packet may be empty.
+    for (part = 0; part < CODEC_BLOCKS; part++) {
+        block_id = packet_id * CODEC_BLOCKS + part;
+        part_length = length - part * CODEC_BLOCK_LENGTH;
+        if (part_length < 0) {
+            part_length = 0;
+        }
+        else if (part_length > CODEC_BLOCK_LENGTH) {
+            part_length = CODEC_BLOCK_LENGTH;
+        }
+        if (reduction != 0) {
+            block_length = encode_reduced(input + part * CODEC_BLOCK_LENGTH,
+                                          channels, block_id, reduction,
+                                          output + pos + 2,
+                                          DATA_LENGTH - pos - 2);
+        }
+        else {
+            block_length = codec_encode(input + part * CODEC_BLOCK_LENGTH,
+                                        part_length, channels,
+                                        codec_phase(block_id, channels),
+                                        output + pos + 2,
+                                        DATA_LENGTH - pos - 2);
+        }
+        if (block_length < 0) {
+            return -1;
+        }
+        output[pos] = block_length & 0xFF;
+        output[pos+1] = (block_length >> 8) & 0xFF;
+        pos += 2 + block_length;
+    }
+
+    return pos;
+}
+
+
+/**
+ * Decode the samples of an encoded block, or the means of a reduced one, of
+ * length bytes at input into at most capacity bytes of output.
+ *
+ * Return the length of the decoded samples, or -1 if the block is corrupted.
+ */
+static int decode_samples(const unsigned char* input, int length,
+                          int channels, int phase, unsigned char* output,
+                          int capacity)
+{
+    struct bit_reader br;
+    int32_t x[MAX_SAMPLES];
+    int raw_length
+      , nb_samples
+      , channel
+      , n
+      , i
+      , j;
+
+    raw_length = (input[0] | (input[1] << 8)) & CODEC_LENGTH_MASK;
+    if (raw_length > CODEC_BLOCK_LENGTH || raw_length > capacity) {
+        return -1;
+    }
+    nb_samples = raw_length / 2;
+
+    br.pos = 2;
+    if (raw_length % 2 != 0) {
+        if (length < 3) {
+            return -1;
+        }
+        output[raw_length-1] = input[br.pos++];
+    }
+    br.input = input;
+    br.length = length;
+    br.acc = 0;
+    br.nb_bits = 0;
+    br.overflow = 0;
+
+    for (channel = 0; channel < channels; channel++) {
+        i = (channel - phase + channels) % channels;
+        n = i < nb_samples ? (nb_samples - i + channels - 1) / channels : 0;
+        if (decode_channel(&br, x, n) < 0) {
+            return -1;
+        }
+        for (j = 0; j < n; j++, i += channels) {
+            output[2*i] = x[j] & 0xFF;
+            output[2*i+1] = (x[j] >> 8) & 0xFF;
+        }
+    }
+
+    return raw_length;
+}
+
+
+/**
+ * Decode the block-th block of length bytes at input into at most capacity
+ * bytes of output, using the same channels as for encoding. A reduced block
+ * is decoded to a full block, each sample being given its mean.
+ *
+ * Return the length of the decoded block, or -1 if the block is corrupted.
+ */
+int codec_decode(const unsigned char* input, int length, int channels,
+                 uint32_t block, unsigned char* output, int capacity)
+{
+    unsigned char means[CODEC_BLOCK_LENGTH];
+    int index[MAX_SAMPLES];
+    int reduction
+      , nb_means
+      , width
+      , phase
+      , i;
+
+    assert(input != NULL);
+    assert(output != NULL);
+
+    if (length < 2 || channels <= 0 || channels > CODEC_MAX_CHANNELS) {
+        return -1;
+    }
+
+    reduction = (input[1] << 8) & ~CODEC_LENGTH_MASK;
+    if (reduction == 0) {
+        return decode_samples(input, length, channels,
+                              codec_phase(block, channels), output, capacity);
+    }
+
+    if (capacity < CODEC_BLOCK_LENGTH) {
+        return -1;
+    }
+    nb_means = reduce_layout(block, channels, reduction, index, &width,
+                             &phase);
+    if (decode_samples(input, length, width, phase, means,
+                       CODEC_BLOCK_LENGTH) != 2 * nb_means)
+    {
+        return -1;
+    }
+    for (i = 0; i < MAX_SAMPLES; i++) {
+        output[2*i] = means[2*index[i]];
+        output[2*i+1] = means[2*index[i]+1];
+    }
+
+    return CODEC_BLOCK_LENGTH;
+}
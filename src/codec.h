@@ -0,0 +1,93 @@
+/* Distributed under the terms of the GNU General Public License v2 */
+/* L3info - SYR2 Project - SYR DeaDBeeF
+ * ============================================================================
+ * Codec
+ * ----------------------------------------------------------------------------
+ * Lossless compression of 16-bit PCM packets, in the fashion of FLAC: each
+ * channel of a packet is predicted with the best fixed polynomial predictor
+ * (order 0 to 4) and the residuals are Rice coded.
+ *
+ * Each data packet is split into CODEC_BLOCKS blocks which are compressed
+ * independently, so that compressed blocks can be packed tightly in messages.
+ * Blocks are numbered from the beginning of the stream: block b covers the
+ * bytes starting at b * CODEC_BLOCK_LENGTH. A block does not necessarily
+ * start on the first channel; the channel of its first sample is its phase,
+ * see codec_phase().
+ *
+ * An encoded packet is the sequence of its blocks, each one preceded by its
+ * length on 2 bytes, as in RESP_PACKED messages. Packets that would get
+ * larger are sent raw.
+ *
+ * Encoded block layout:
+ *
+ *   <length>(2) [<trailing byte>(1)] <channel>...
+ *
+ * where length is the number of bytes of the raw block, the trailing byte
+ * is present when length is odd, and each channel is the bit stream:
+ *
+ *   <order>(3) <k>(5) <warm-up sample>(16)... <rice coded residual>...
+ *
+ * To lower the bitrate of a stream on a poor link, the blocks of full packets
+ * may be reduced, see codec_encode_packet(): the samples of each pair of
+ * frames (CODEC_HALF_RATE), and of all the channels of a frame (CODEC_MONO),
+ * are replaced by their mean, and only the means are encoded, as a block of
+ * their own whose channels are those of the means. The reduction is carried
+ * by the highest bits of the length of the block, which is then the length
+ * of the means, so that a reduced block is decoded back to a full block of
+ * the format of the stream, and a stream can switch from a reduction to
+ * another at any packet. Only clients advertising CAP_REDUCED are sent
+ * reduced blocks.
+ * ----------------------------------------------------------------------------
+ * Antoine Pinsard
+ * Oct. 19, 2026
+ */
+#ifndef _CODEC_H_
+#define _CODEC_H_
+
+#include <stdint.h>
+#include "deadbeef.h"
+
+// Stream encodings, announced in RESP_STREAMINFO
+#define CODEC_RAW 0
+#define CODEC_RICE 1
+
+// Client capabilities, advertised in REQ_STREAMING
+#define CAP_RICE 0x01
+#define CAP_REDUCED 0x02
+
+#define CODEC_BLOCKS 5
+#define CODEC_BLOCK_LENGTH (DATA_LENGTH / CODEC_BLOCKS)
+
+#define CODEC_MAX_CHANNELS 8
+#define CODEC_MAX_ORDER 4
+// Residuals whose quotient reaches this value are escaped and stored raw on
+// CODEC_ESCAPE_BITS bits.
+#define CODEC_ESCAPE 32
+#define CODEC_ESCAPE_BITS 24
+
+// Reductions of a block, set in the length of the encoded block
+#define CODEC_HALF_RATE 0x8000
+#define CODEC_MONO 0x4000
+#define CODEC_LENGTH_MASK 0x3FFF
+
+int codec_encode(const unsigned char*, int, int, int, unsigned char*, int);
+int codec_encode_packet(const unsigned char*, int, int, uint32_t, int,
+                        unsigned char*);
+int codec_decode(const unsigned char*, int, int, uint32_t, unsigned char*,
+                 int);
+
+/**
+ * Return the channel of the first sample of the given block.
+ */
+static inline int codec_phase(uint32_t block, int channels) {
+    return (int) (((int64_t) block * (CODEC_BLOCK_LENGTH / 2)) % channels);
+}
+
+/**
+ * Return 1 if a stream with the given format can be compressed.
+ */
+static inline int codec_supports(int sample_size, int channels) {
+    return sample_size == 16 && channels > 0 && channels <= CODEC_MAX_CHANNELS;
+}
+
+#endif
@@ -0,0 +1,550 @@
+/* Distributed under the terms of the GNU General Public License v2 */
+/* L3info - SYR2 Project - SYR DeaDBeeF
+ * ============================================================================
+ * Convert
+ * ----------------------------------------------------------------------------
+ * Sample format conversion kernels.
+ *
+ * Every conversion goes through 32-bit integers, left justified: samples are
+ * first loaded to an intermediate buffer, then stored to the output format.
+ * ----------------------------------------------------------------------------
+ * Antoine Pinsard
+ * Oct. 19, 2026
+ */
+#include <math.h>
+#include "convert.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define CONVERT_X86
+#include <immintrin.h>
+#endif
+
+// Float samples are clamped to [-1, 1), as the largest float below 2^31.
+#define F32_MAX 2147483520.0f
+#define F32_MIN -2147483648.0f
+
+typedef void (*load_kernel)(const unsigned char*, int32_t*, size_t);
+typedef void (*dither_kernel)(const int32_t*, int16_t*, size_t,
+                              struct dither*);
+
+struct kernels {
+    load_kernel load[CONVERT_NB_FORMATS];
+    dither_kernel store_s16_dithered;
+};
+
+static struct kernels kernels;
+static int kernels_isa = -1;
+
+
+/**
+ * Return the format of samples described as in struct aud_info, or -1 if it
+ * is not supported.
+ */
+int convert_format(int format, int sample_size) {
+    if (format == AUD_FORMAT_FLOAT) {
+        return sample_size == 32 ? CONVERT_F32 : -1;
+    }
+    switch (sample_size) {
+        case 8:
+            return CONVERT_U8;
+        case 16:
+            return CONVERT_S16;
+        case 24:
+            return CONVERT_S24;
+        case 32:
+            return CONVERT_S32;
+        default:
+            return -1;
+    }
+}
+
+
+/**
+ * Return the sample size to ask the audio device for, to play samples of the
+ * given format: 16 bits for 8 and 16-bit samples, 32 bits otherwise.
+ */
+int convert_device_size(int format) {
+    return format == CONVERT_U8 || format == CONVERT_S16 ? 16 : 32;
+}
+
+
+/**
+ * Return the format to convert to for an audio device that accepted the given
+ * sample size, or -1 if it is not supported.
+ */
+int convert_device_format(int sample_size) {
+    switch (sample_size) {
+        case 16:
+            return CONVERT_S16;
+        case 32:
+            return CONVERT_S32;
+        default:
+            return -1;
+    }
+}
+
+
+/**
+ * Seed the dither generators.
+ */
+void dither_init(struct dither* dither, uint32_t seed) {
+    int i;
+
+    assert(dither != NULL);
+
+    for (i = 0; i < CONVERT_LANES; i++) {
+        // Xorshift generators must not be seeded with 0.
+        dither->lanes[i] = (seed + i) * 2654435761U | 1;
+    }
+}
+
+
+static inline uint32_t xorshift(uint32_t* state) {
+    uint32_t x;
+
+    x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+
+    return x;
+}
+
+
+/*
+ * Scalar reference kernels
+ */
+
+static void load_u8_scalar(const unsigned char* in, int32_t* out, size_t n) {
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+        out[i] = (uint32_t) (in[i] ^ 0x80) << 24;
+    }
+}
+
+
+static void load_s16_scalar(const unsigned char* in, int32_t* out, size_t n) {
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+        out[i] = (uint32_t) (in[2*i] | (in[2*i+1] << 8)) << 16;
+    }
+}
+
+
+static void load_s24_scalar(const unsigned char* in, int32_t* out, size_t n) {
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+        out[i] = (uint32_t) (in[3*i] | (in[3*i+1] << 8) | (in[3*i+2] << 16))
+               << 8;
+    }
+}
+
+
+static void load_s32_scalar(const unsigned char* in, int32_t* out, size_t n) {
+    memcpy(out, in, n * sizeof(int32_t));
+}
+
+
+static void load_f32_scalar(const unsigned char* in, int32_t* out, size_t n) {
+    float v;
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+        memcpy(&v, in + 4*i, sizeof(float));
+        v *= 2147483648.0f;
+        // NaN ends up at F32_MAX, as with the vector kernels.
+        if (!(v <= F32_MAX)) {
+            v = F32_MAX;
+        }
+        if (!(v >= F32_MIN)) {
+            v = F32_MIN;
+        }
+        out[i] = lrintf(v);
+    }
+}
+
+
+/**
+ * Narrow samples to 16 bits with TPDF dither of 1 LSB peak: the difference
+ * of two uniform variables is added to the samples, scaled to 24 bits, before
+ * rounding.
+ */
+static void store_s16_dithered_scalar(const int32_t* in, int16_t* out,
+                                      size_t n, struct dither* dither)
+{
+    uint32_t r;
+    int32_t t;
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+        r = xorshift(&dither->lanes[i % CONVERT_LANES]);
+        t = (in[i] >> 8) + (int32_t) (r & 0xFF) - (int32_t) ((r >> 8) & 0xFF)
+          + 128;
+        t >>= 8;
+        out[i] = t > INT16_MAX ? INT16_MAX : t < INT16_MIN ? INT16_MIN : t;
+    }
+}
+
+
+static void store_s16(const int32_t* in, int16_t* out, size_t n) {
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+        out[i] = in[i] >> 16;
+    }
+}
+
+
+#ifdef CONVERT_X86
+
+/*
+ * SSE2 kernels
+ */
+
+static void load_u8_sse2(const unsigned char* in, int32_t* out, size_t n) {
+    __m128i zero
+          , bias
+          , v
+          , w;
+    size_t i;
+
+    zero = _mm_setzero_si128();
+    bias = _mm_set1_epi16((short) 0x8000);
+    for (i = 0; i + 16 <= n; i += 16) {
+        v = _mm_loadu_si128((const __m128i*) (in + i));
+        w = _mm_xor_si128(_mm_unpacklo_epi8(zero, v), bias);
+        _mm_storeu_si128((__m128i*) (out + i), _mm_unpacklo_epi16(zero, w));
+        _mm_storeu_si128((__m128i*) (out + i + 4),
+                         _mm_unpackhi_epi16(zero, w));
+        w = _mm_xor_si128(_mm_unpackhi_epi8(zero, v), bias);
+        _mm_storeu_si128((__m128i*) (out + i + 8),
+                         _mm_unpacklo_epi16(zero, w));
+        _mm_storeu_si128((__m128i*) (out + i + 12),
+                         _mm_unpackhi_epi16(zero, w));
+    }
+    load_u8_scalar(in + i, out + i, n - i);
+}
+
+
+static void load_s16_sse2(const unsigned char* in, int32_t* out, size_t n) {
+    __m128i zero
+          , v;
+    size_t i;
+
+    zero = _mm_setzero_si128();
+    for (i = 0; i + 8 <= n; i += 8) {
+        v = _mm_loadu_si128((const __m128i*) (in + 2*i));
+        _mm_storeu_si128((__m128i*) (out + i), _mm_unpacklo_epi16(zero, v));
+        _mm_storeu_si128((__m128i*) (out + i + 4),
+                         _mm_unpackhi_epi16(zero, v));
+    }
+    load_s16_scalar(in + 2*i, out + i, n - i);
+}
+
+
+static void load_f32_sse2(const unsigned char* in, int32_t* out, size_t n) {
+    __m128 scale
+         , max
+         , min
+         , v;
+    size_t i;
+
+    scale = _mm_set1_ps(2147483648.0f);
+    max = _mm_set1_ps(F32_MAX);
+    min = _mm_set1_ps(F32_MIN);
+    for (i = 0; i + 4 <= n; i += 4) {
+        v = _mm_mul_ps(_mm_loadu_ps((const float*) (in + 4*i)), scale);
+        v = _mm_max_ps(_mm_min_ps(v, max), min);
+        _mm_storeu_si128((__m128i*) (out + i), _mm_cvtps_epi32(v));
+    }
+    load_f32_scalar(in + 4*i, out + i, n - i);
+}
+
+
+static inline __m128i xorshift_sse2(__m128i* state) {
+    __m128i x;
+
+    x = *state;
+    x = _mm_xor_si128(x, _mm_slli_epi32(x, 13));
+    x = _mm_xor_si128(x, _mm_srli_epi32(x, 17));
+    x = _mm_xor_si128(x, _mm_slli_epi32(x, 5));
+    *state = x;
+
+    return x;
+}
+
+
+static inline __m128i dither_sse2(__m128i v, __m128i r, __m128i mask,
+                                  __m128i half)
+{
+    v = _mm_add_epi32(_mm_srai_epi32(v, 8), _mm_and_si128(r, mask));
+    v = _mm_sub_epi32(v, _mm_and_si128(_mm_srli_epi32(r, 8), mask));
+
+    return _mm_srai_epi32(_mm_add_epi32(v, half), 8);
+}
+
+
+static void store_s16_dithered_sse2(const int32_t* in, int16_t* out,
+                                    size_t n, struct dither* dither)
+{
+    __m128i lo_state
+          , hi_state
+          , mask
+          , half
+          , lo
+          , hi;
+    size_t i;
+
+    lo_state = _mm_loadu_si128((const __m128i*) dither->lanes);
+    hi_state = _mm_loadu_si128((const __m128i*) (dither->lanes + 4));
+    mask = _mm_set1_epi32(0xFF);
+    half = _mm_set1_epi32(128);
+    for (i = 0; i + 8 <= n; i += 8) {
+        lo = dither_sse2(_mm_loadu_si128((const __m128i*) (in + i)),
+                         xorshift_sse2(&lo_state), mask, half);
+        hi = dither_sse2(_mm_loadu_si128((const __m128i*) (in + i + 4)),
+                         xorshift_sse2(&hi_state), mask, half);
+        // Saturating pack to 16 bits
+        _mm_storeu_si128((__m128i*) (out + i), _mm_packs_epi32(lo, hi));
+    }
+    _mm_storeu_si128((__m128i*) dither->lanes, lo_state);
+    _mm_storeu_si128((__m128i*) (dither->lanes + 4), hi_state);
+    store_s16_dithered_scalar(in + i, out + i, n - i, dither);
+}
+
+
+/*
+ * AVX2 kernels
+ */
+
+__attribute__((target("avx2")))
+static void load_u8_avx2(const unsigned char* in, int32_t* out, size_t n) {
+    __m256i bias
+          , v;
+    size_t i;
+
+    bias = _mm256_set1_epi32(128);
+    for (i = 0; i + 8 <= n; i += 8) {
+        v = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*) (in + i)));
+        v = _mm256_slli_epi32(_mm256_sub_epi32(v, bias), 24);
+        _mm256_storeu_si256((__m256i*) (out + i), v);
+    }
+    load_u8_scalar(in + i, out + i, n - i);
+}
+
+
+__attribute__((target("avx2")))
+static void load_s16_avx2(const unsigned char* in, int32_t* out, size_t n) {
+    __m256i v;
+    size_t i;
+
+    for (i = 0; i + 8 <= n; i += 8) {
+        v = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)
+                                                  (in + 2*i)));
+        _mm256_storeu_si256((__m256i*) (out + i), _mm256_slli_epi32(v, 16));
+    }
+    load_s16_scalar(in + 2*i, out + i, n - i);
+}
+
+
+/**
+ * Each iteration loads 32 bytes for 8 samples of 3 bytes, so the last 3
+ * samples are left to the scalar kernel to stay within the input.
+ */
+__attribute__((target("avx2")))
+static void load_s24_avx2(const unsigned char* in, int32_t* out, size_t n) {
+    __m256i spread
+          , shuffle
+          , v;
+    size_t i;
+
+    // Bring the bytes of samples 0-3 to the low lane and the bytes of samples
+    // 4-7 to the high lane.
+    spread = _mm256_setr_epi32(0, 1, 2, 0, 3, 4, 5, 0);
+    // Place the 3 bytes of each sample in the high bytes of a 32-bit word.
+    shuffle = _mm256_setr_epi8(-1, 0, 1, 2, -1, 3, 4, 5,
+                               -1, 6, 7, 8, -1, 9, 10, 11,
+                               -1, 0, 1, 2, -1, 3, 4, 5,
+                               -1, 6, 7, 8, -1, 9, 10, 11);
+    for (i = 0; i + 11 <= n; i += 8) {
+        v = _mm256_loadu_si256((const __m256i*) (in + 3*i));
+        v = _mm256_permutevar8x32_epi32(v, spread);
+        _mm256_storeu_si256((__m256i*) (out + i),
+                            _mm256_shuffle_epi8(v, shuffle));
+    }
+    load_s24_scalar(in + 3*i, out + i, n - i);
+}
+
+
+__attribute__((target("avx2")))
+static void load_f32_avx2(const unsigned char* in, int32_t* out, size_t n) {
+    __m256 scale
+         , max
+         , min
+         , v;
+    size_t i;
+
+    scale = _mm256_set1_ps(2147483648.0f);
+    max = _mm256_set1_ps(F32_MAX);
+    min = _mm256_set1_ps(F32_MIN);
+    for (i = 0; i + 8 <= n; i += 8) {
+        v = _mm256_mul_ps(_mm256_loadu_ps((const float*) (in + 4*i)), scale);
+        v = _mm256_max_ps(_mm256_min_ps(v, max), min);
+        _mm256_storeu_si256((__m256i*) (out + i), _mm256_cvtps_epi32(v));
+    }
+    load_f32_scalar(in + 4*i, out + i, n - i);
+}
+
+
+__attribute__((target("avx2")))
+static inline __m256i dither_avx2(__m256i v, __m256i* state, __m256i mask,
+                                  __m256i half)
+{
+    __m256i r;
+
+    r = *state;
+    r = _mm256_xor_si256(r, _mm256_slli_epi32(r, 13));
+    r = _mm256_xor_si256(r, _mm256_srli_epi32(r, 17));
+    r = _mm256_xor_si256(r, _mm256_slli_epi32(r, 5));
+    *state = r;
+
+    v = _mm256_add_epi32(_mm256_srai_epi32(v, 8), _mm256_and_si256(r, mask));
+    v = _mm256_sub_epi32(v, _mm256_and_si256(_mm256_srli_epi32(r, 8), mask));
+
+    return _mm256_srai_epi32(_mm256_add_epi32(v, half), 8);
+}
+
+
+/**
+ * Each iteration dithers two groups of 8 samples, so that each generator is
+ * used once per group as with the scalar kernel.
+ */
+__attribute__((target("avx2")))
+static void store_s16_dithered_avx2(const int32_t* in, int16_t* out,
+                                    size_t n, struct dither* dither)
+{
+    __m256i state
+          , mask
+          , half
+          , a
+          , b;
+    size_t i;
+
+    state = _mm256_loadu_si256((const __m256i*) dither->lanes);
+    mask = _mm256_set1_epi32(0xFF);
+    half = _mm256_set1_epi32(128);
+    for (i = 0; i + 16 <= n; i += 16) {
+        a = dither_avx2(_mm256_loadu_si256((const __m256i*) (in + i)),
+                        &state, mask, half);
+        b = dither_avx2(_mm256_loadu_si256((const __m256i*) (in + i + 8)),
+                        &state, mask, half);
+        // The pack works on each 128-bit lane, put the samples back in order.
+        a = _mm256_permute4x64_epi64(_mm256_packs_epi32(a, b), 0xD8);
+        _mm256_storeu_si256((__m256i*) (out + i), a);
+    }
+    _mm256_storeu_si256((__m256i*) dither->lanes, state);
+    store_s16_dithered_scalar(in + i, out + i, n - i, dither);
+}
+
+#endif
+
+
+/**
+ * Select the kernels of the given instruction set, or of the best one
+ * supported by the CPU if it is not.
+ *
+ * Return the selected instruction set.
+ */
+int convert_set_isa(int isa) {
+    kernels.load[CONVERT_U8] = load_u8_scalar;
+    kernels.load[CONVERT_S16] = load_s16_scalar;
+    kernels.load[CONVERT_S24] = load_s24_scalar;
+    kernels.load[CONVERT_S32] = load_s32_scalar;
+    kernels.load[CONVERT_F32] = load_f32_scalar;
+    kernels.store_s16_dithered = store_s16_dithered_scalar;
+    kernels_isa = CONVERT_SCALAR;
+
+#ifdef CONVERT_X86
+    __builtin_cpu_init();
+    if (isa >= CONVERT_SSE2 && __builtin_cpu_supports("sse2")) {
+        kernels.load[CONVERT_U8] = load_u8_sse2;
+        kernels.load[CONVERT_S16] = load_s16_sse2;
+        kernels.load[CONVERT_F32] = load_f32_sse2;
+        kernels.store_s16_dithered = store_s16_dithered_sse2;
+        kernels_isa = CONVERT_SSE2;
+    }
+    if (isa >= CONVERT_AVX2 && __builtin_cpu_supports("avx2")) {
+        kernels.load[CONVERT_U8] = load_u8_avx2;
+        kernels.load[CONVERT_S16] = load_s16_avx2;
+        kernels.load[CONVERT_S24] = load_s24_avx2;
+        kernels.load[CONVERT_F32] = load_f32_avx2;
+        kernels.store_s16_dithered = store_s16_dithered_avx2;
+        kernels_isa = CONVERT_AVX2;
+    }
+#endif
+
+    return kernels_isa;
+}
+
+
+/**
+ * Return the instruction set of the kernels in use.
+ */
+int convert_isa() {
+    if (kernels_isa < 0) {
+        convert_set_isa(CONVERT_AVX2);
+    }
+
+    return kernels_isa;
+}
+
+
+/**
+ * Convert n samples of in_format at input to out_format, CONVERT_S16 or
+ * CONVERT_S32, at output. dither is only used when narrowing to 16 bits and
+ * may be NULL otherwise.
+ */
+void convert(const void* input, int in_format, void* output, int out_format,
+             size_t n, struct dither* dither)
+{
+    int32_t buffer[CONVERT_CHUNK];
+    const unsigned char* in;
+    unsigned char* out;
+    size_t chunk;
+
+    assert(input != NULL);
+    assert(output != NULL);
+    assert(in_format >= 0 && in_format < CONVERT_NB_FORMATS);
+    assert(out_format == CONVERT_S16 || out_format == CONVERT_S32);
+
+    if (in_format == out_format) {
+        memcpy(output, input, n * convert_sample_length(out_format));
+        return;
+    }
+    convert_isa();
+
+    in = input;
+    out = output;
+    if (out_format == CONVERT_S32) {
+        kernels.load[in_format](in, (int32_t*) out, n);
+        return;
+    }
+
+    assert(dither != NULL || in_format == CONVERT_U8);
+    for (; n > 0; n -= chunk) {
+        chunk = n < CONVERT_CHUNK ? n : CONVERT_CHUNK;
+        kernels.load[in_format](in, buffer, chunk);
+        if (in_format == CONVERT_U8) {
+            store_s16(buffer, (int16_t*) out, chunk);
+        }
+        else {
+            kernels.store_s16_dithered(buffer, (int16_t*) out, chunk, dither);
+        }
+        in += chunk * convert_sample_length(in_format);
+        out += chunk * 2;
+    }
+}
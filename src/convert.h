@@ -0,0 +1,64 @@
+/* Distributed under the terms of the GNU General Public License v2 */
+/* L3info - SYR2 Project - SYR DeaDBeeF
+ * ============================================================================
+ * Convert
+ * ----------------------------------------------------------------------------
+ * Conversion of samples between the formats of wave files and the formats of
+ * audio devices. Samples of any supported format are converted to 16-bit or
+ * 32-bit little endian integers. Samples are narrowed to 16 bits with TPDF
+ * dither, so that the quantization error does not correlate with the signal.
+ *
+ * Kernels are vectorized with SSE2 and AVX2 on x86, and the best ones the CPU
+ * supports are selected at run time. The scalar kernels are the reference:
+ * every kernel gives exactly the same output, dither included.
+ * ----------------------------------------------------------------------------
+ * Antoine Pinsard
+ * Oct. 19, 2026
+ */
+#ifndef _CONVERT_H_
+#define _CONVERT_H_
+
+#include <stdint.h>
+#include "deadbeef.h"
+
+// Sample formats
+#define CONVERT_U8 0
+#define CONVERT_S16 1
+#define CONVERT_S24 2 // Packed on 3 bytes
+#define CONVERT_S32 3
+#define CONVERT_F32 4
+#define CONVERT_NB_FORMATS 5
+
+// Instruction sets
+#define CONVERT_SCALAR 0
+#define CONVERT_SSE2 1
+#define CONVERT_AVX2 2
+
+// Number of independent dither generators. Sample i of a conversion is
+// dithered by generator i % CONVERT_LANES.
+#define CONVERT_LANES 8
+// Number of samples converted at once through the intermediate buffer
+#define CONVERT_CHUNK 1024
+
+struct dither {
+    uint32_t lanes[CONVERT_LANES];
+};
+
+int convert_format(int, int);
+int convert_device_size(int);
+int convert_device_format(int);
+void dither_init(struct dither*, uint32_t);
+void convert(const void*, int, void*, int, size_t, struct dither*);
+int convert_set_isa(int);
+int convert_isa();
+
+/**
+ * Return the length in bytes of a sample of the given format.
+ */
+static inline int convert_sample_length(int format) {
+    static const int lengths[CONVERT_NB_FORMATS] = {1, 2, 3, 4, 4};
+
+    return lengths[format];
+}
+
+#endif
@@ -8,6 +8,7 @@
  * Antoine Pinsard
  * Mar. 17, 2015
  */
+#include <time.h>
 #include "deadbeef.h"
 
 /**
@@ -29,3 +30,15 @@ int send_message(int sock, struct sockaddr_in* dest, unsigned char* buffer) {
 
     return msg_len;
 }
+
+
+/**
+ * Return the current time of the monotonic clock in microseconds, the clock
+ * of every deadline and measurement of the server, the client and the tools.
+ */
+long long deadbeef_now_us() {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
@@ -32,12 +32,105 @@
 
 #define REQ_STREAMING 0xDE
 #define REQ_HEARTBEAT 0xDB
+#define REQ_CATALOG 0xCA
 #define RESP_STREAMINFO 0xEA
 #define RESP_DATA 0xAD
 #define RESP_ERROR 0xEF
+#define RESP_CATALOG 0xAC
+#define RESP_PACKED 0xCD
+#define REQ_STATS 0x57
+#define RESP_STATS 0x75
+#define REQ_PLAYLIST 0x91
+#define REQ_MIX 0x3A
 
+// Streaming request: 0xDE <filename>(4092) <variant>(1) <capabilities>(1)
+//                    0xDE
+#define STREAMING_VARIANT_POS (MSG_LENGTH-3)
+#define STREAMING_CAPS_POS (MSG_LENGTH-2)
+// Playlist request: 0x91 <variant>(1) <capabilities>(1) <nb_tracks>(1)
+//                   <filename>... 0x91
+// Filenames are terminated. The tracks are streamed one after another as a
+// single session.
+#define PLAYLIST_HEADER_LENGTH (1 + 1 + 1 + 1)
+#define PLAYLIST_MAX_TRACKS 32
+// Mix request: 0x3A <variant>(1) <capabilities>(1) <nb_inputs>(1)
+//              [<gain>(2) <filename>]... 0x3A
+// The files are mixed into a single stream of 16-bit samples, in the format
+// of the first one once converted to the variant, see mixer.h. Gains are
+// fixed point, MIX_UNITY being unity, and clamped to MIX_MAX_GAIN. Filenames
+// are terminated.
+#define MIX_HEADER_LENGTH (1 + 1 + 1 + 1)
+#define MIX_MAX_INPUTS 8
+#define MIX_UNITY 4096
+#define MIX_MAX_GAIN (2 * MIX_UNITY)
+// Stream info: 0xEA <samp_rate>(4) <samp_size>(4) <chans>(4) <nb_packets>(4)
+//              <encoding>(1) <format>(1) <track>(1) <nb_tracks>(1)
+//              <first_packet>(4) <total_packets>(4) <length>(4) <flags>(1)
+//              <null>(4061) 0xEA
+// The format is AUD_FORMAT_PCM or AUD_FORMAT_FLOAT.
+// A playlist session sends a stream info per track, the next one ahead of
+// time. Packets of a track are numbered from first_packet on, total_packets
+// is the number of packets of the whole session and length the exact number
+// of bytes of the track. These fields are zero for a single stream when the
+// server predates playlists.
+// A live stream, flagged STREAMINFO_LIVE, has no end: nb_packets,
+// total_packets and length are zero, and packet ids go on from first_packet,
+// wrapping around after 0xFFFFFFFF.
+#define STREAMINFO_ENCODING_POS 17
+#define STREAMINFO_FORMAT_POS 18
+#define STREAMINFO_TRACK_POS 19
+#define STREAMINFO_NB_TRACKS_POS 20
+#define STREAMINFO_FLAGS_POS 33
+#define STREAMINFO_HEADER_LENGTH (1 + 4*4 + 1 + 1 + 1 + 1 + 4*3 + 1)
+#define STREAMINFO_LIVE 0x01
+// Data: 0xAD <packet_id>(4) <data>(4090) 0xAD
+#define DATA_HEADER_LENGTH (1 + 4)
+// Error: 0xEF <code>(4) <message>(4090) 0xEF
+// The message is terminated unless it fills the field.
+#define ERROR_HEADER_LENGTH (1 + 4)
+// Packed data: 0xCD <first block>(4) <nb_blocks>(1)
+//              [<block_length>(2) <block>(block_length)]... 0xCD
+// Each block is a compressed part of a data packet, see codec.h. Blocks are
+// consecutive.
+#define PACKED_HEADER_LENGTH (1 + 4 + 1)
+#define PACKED_MAX_BLOCKS 255
+
+// Catalog request: 0xCA <mode>(1) <offset>(4) <pattern>(4089) 0xCA
+#define CATALOG_REQ_HEADER_LENGTH (1 + 1 + 4)
+// Catalog response: 0xAC <nb_matches>(4) <offset>(4) <nb_entries>(2)
+//                   <entry>... 0xAC
+// Each entry is: <format>(2) <channels>(2) <sample_size>(2) <sample_rate>(4)
+//                <duration>(4) <name_length>(2) <name>(name_length)
+#define CATALOG_RESP_HEADER_LENGTH (1 + 4 + 4 + 2)
+#define CATALOG_ENTRY_HEADER_LENGTH (2 + 2 + 2 + 4 + 4 + 2)
+
+// Stats request: 0x57 <null>(4094) 0x57
+// Stats response: 0x75 <uptime>(4) <nb_slots>(1) <nb_buckets>(1)
+//                 <record>... 0x75
+// Each record is: <active>(1) <addr>(4) <port>(2) <nb_sessions>(4)
+//                 <packets_sent>(8) <send_errors>(8) <send_eagain>(8)
+//                 <heartbeats>(8) <timeouts>(8) <rejections>(8)
+//                 <lateness>(8 * nb_buckets) <digest>(33)
+// The first record holds the global counters and the number of active
+// sessions, the next nb_slots ones the counters of the current or last session
+// of each client slot, with the last digest its client sent in a heartbeat.
+// See stats.h.
+#define STATS_RESP_HEADER_LENGTH (1 + 4 + 1 + 1)
+#define STATS_RECORD_LENGTH(nb_buckets) \
+    (1 + 4 + 2 + 4 + 6*8 + 8*(nb_buckets) + HEARTBEAT_DIGEST_LENGTH)
+
+// Heartbeat: 0xDB <digest>(1) <received>(4) <lost>(4) <reordered>(4)
+//            <duplicates>(4) <jitter_us>(4) <buffer_ms>(4) <underruns>(4)
+//            <highest>(4) <null>(4062) 0xDB
+// digest is 1 if the client sent the digest of the quality of its stream,
+// see qos.h, 0 otherwise. received and lost count blocks, see codec.h.
+// highest is the latest block received, whose send time gives the server
+// the round-trip time of the link, see abr.h.
+#define HEARTBEAT_DIGEST_POS 1
+#define HEARTBEAT_DIGEST_LENGTH (1 + 8*4)
 #define HEARTBEAT_FREQUENCY 100
 
 int send_message(int, struct sockaddr_in*, unsigned char*);
+long long deadbeef_now_us();
 
 #endif
@@ -0,0 +1,152 @@
+/* Distributed under the terms of the GNU General Public License v2 */
+/* L3info - SYR2 Project - SYR DeaDBeeF
+ * ============================================================================
+ * Drift
+ * ----------------------------------------------------------------------------
+ * Compensation of the drift between the stream and the audio output.
+ * ----------------------------------------------------------------------------
+ * Antoine Pinsard
+ * Oct. 19, 2026
+ */
+#include "drift.h"
+
+
+/**
+ * Initialize the compensation of a stream of samples of the given format on
+ * channels channels, holding target seconds of it in the buffer.
+ */
+void drift_init(struct drift* drift, int format, int channels,
+                double target)
+{
+    assert(drift != NULL);
+    assert(format == CONVERT_S16 || format == CONVERT_S32);
+    assert(channels > 0 && channels <= AUD_MAX_CHANNELS);
+
+    drift->format = format;
+    drift->channels = channels;
+    drift->target = target;
+    drift->start = deadbeef_now_us() / 1e6;
+    drift->depth_sum = 0;
+    drift->nb_depths = 0;
+    drift->integral = 0;
+    drift->ppm = 0;
+    drift->phase = 0;
+    drift->step = 1ULL << 32;
+    drift->primed = 0;
+}
+
+
+/**
+ * Account for the current depth of the buffer, in seconds. The playback
+ * ratio is updated at the end of each period.
+ */
+void drift_update(struct drift* drift, double depth) {
+    double t
+         , elapsed
+         , error;
+
+    assert(drift != NULL);
+
+    drift->depth_sum += depth;
+    drift->nb_depths++;
+
+    t = deadbeef_now_us() / 1e6;
+    elapsed = t - drift->start;
+    if (elapsed < DRIFT_PERIOD) {
+        return;
+    }
+
+    error = drift->depth_sum / drift->nb_depths - drift->target;
+    drift->ppm = DRIFT_KP * error + DRIFT_KI * (drift->integral
+                                                + error * elapsed);
+    // The integral does not wind up while the correction is saturated.
+    if (drift->ppm > DRIFT_MAX_PPM) {
+        drift->ppm = DRIFT_MAX_PPM;
+    }
+    else if (drift->ppm < -DRIFT_MAX_PPM) {
+        drift->ppm = -DRIFT_MAX_PPM;
+    }
+    else {
+        drift->integral += error * elapsed;
+    }
+    drift->step = (uint64_t) ((1.0 + drift->ppm / 1e6) * (1ULL << 32));
+
+    drift->start = t;
+    drift->depth_sum = 0;
+    drift->nb_depths = 0;
+}
+
+
+static inline int32_t sample(const void* input, int format, size_t i) {
+    if (format == CONVERT_S16) {
+        return ((const int16_t*) input)[i];
+    }
+    return ((const int32_t*) input)[i];
+}
+
+
+/**
+ * Resample nb_frames frames of input to output at the current playback
+ * ratio. output must hold DRIFT_MAX_LENGTH(nb_frames * channels) samples.
+ * The last input frame is held back until the next call.
+ *
+ * Return the number of output frames.
+ */
+size_t drift_resample(struct drift* drift, const void* input,
+                      size_t nb_frames, void* output)
+{
+    const int channels = drift->channels;
+    size_t nb_out
+         , index;
+    int64_t a
+          , b
+          , value;
+    uint32_t frac;
+    int c;
+
+    assert(drift != NULL);
+    assert(input != NULL);
+    assert(output != NULL);
+
+    if (nb_frames == 0) {
+        return 0;
+    }
+    if (!drift->primed) {
+        for (c = 0; c < channels; c++) {
+            drift->last[c] = sample(input, drift->format, c);
+        }
+        drift->primed = 1;
+        drift->phase = 1ULL << 32;
+    }
+
+    // Frame 0 is the last frame of the previous call, frame i + 1 is the
+    // input frame i.
+    nb_out = 0;
+    while ((index = drift->phase >> 32) < nb_frames) {
+        // The high bits of the fraction are enough, and keep the product
+        // within 64 bits.
+        frac = (drift->phase >> 16) & 0xFFFF;
+        for (c = 0; c < channels; c++) {
+            a = index == 0 ? drift->last[c]
+              : sample(input, drift->format, (index - 1) * channels + c);
+            b = sample(input, drift->format, index * channels + c);
+            value = a + (((b - a) * frac) >> 16);
+            if (drift->format == CONVERT_S16) {
+                ((int16_t*) output)[nb_out * channels + c] = value;
+            }
+            else {
+                ((int32_t*) output)[nb_out * channels + c] = value;
+            }
+        }
+        nb_out++;
+        drift->phase += drift->step;
+    }
+
+    drift->phase -= (uint64_t) nb_frames << 32;
+    for (c = 0; c < channels; c++) {
+        drift->last[c] = sample(input, drift->format,
+                                (nb_frames - 1) * channels + c);
+    }
+
+    return nb_out;
+}
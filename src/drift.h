@@ -0,0 +1,60 @@
+/* Distributed under the terms of the GNU General Public License v2 */
+/* L3info - SYR2 Project - SYR DeaDBeeF
+ * ============================================================================
+ * Drift
+ * ----------------------------------------------------------------------------
+ * Compensation of the drift between the clock that paces the stream and the
+ * clock of the audio output. Without it, the buffered part of a long stream
+ * slowly grows or drains.
+ *
+ * The depth of the buffer, received samples not written yet, is averaged over
+ * periods of DRIFT_PERIOD seconds. A PI controller turns its distance to the
+ * target depth into a playback ratio, slightly above 1 to drain the buffer or
+ * below 1 to fill it, bounded to DRIFT_MAX_PPM. Samples are then resampled to
+ * that ratio by linear interpolation, with a 32.32 fixed point phase so that
+ * ratios of a few ppm are honored exactly.
+ * ----------------------------------------------------------------------------
+ * Antoine Pinsard
+ * Oct. 19, 2026
+ */
+#ifndef _DRIFT_H_
+#define _DRIFT_H_
+
+#include <stdint.h>
+#include "convert.h"
+#include "deadbeef.h"
+
+// Period over which the depth of the buffer is averaged, in seconds
+#define DRIFT_PERIOD 0.5
+// Gains of the controller, in ppm per second of error and per second of
+// error integrated over a second
+#define DRIFT_KP 20000.0
+#define DRIFT_KI 200.0
+// Bound of the correction, in ppm
+#define DRIFT_MAX_PPM 1000.0
+
+struct drift {
+    int format;           // CONVERT_S16 or CONVERT_S32
+    int channels;
+    double target;        // Depth of the buffer to hold, in seconds
+    // Controller
+    double start;         // Start of the current period
+    double depth_sum;
+    int nb_depths;
+    double integral;
+    double ppm;           // Current correction
+    // Resampler
+    uint64_t phase;       // Position in the input, 32.32 fixed point
+    uint64_t step;
+    int primed;
+    int32_t last[AUD_MAX_CHANNELS]; // Last input frame of the previous call
+};
+
+// Maximum number of samples drift_resample() outputs for n input samples
+#define DRIFT_MAX_LENGTH(n) ((n) + (n) / 500 + 2 * AUD_MAX_CHANNELS)
+
+void drift_init(struct drift*, int, int, double);
+void drift_update(struct drift*, double);
+size_t drift_resample(struct drift*, const void*, size_t, void*);
+
+#endif
@@ -0,0 +1,341 @@
+/* Distributed under the terms of the GNU General Public License v2 */
+/* L3info - SYR2 Project - SYR DeaDBeeF
+ * ============================================================================
+ * Live Sources
+ * ----------------------------------------------------------------------------
+ * Capture of live sources to a ring in shared memory, and reading of the ring
+ * by its listeners.
+ * ----------------------------------------------------------------------------
+ * Antoine Pinsard
+ * Oct. 19, 2026
+ */
+#include "live.h"
+#include "sched.h"
+
+
+/**
+ * Parse a live source given as name=path[:rate[:size[:channels]]], where path
+ * is a FIFO, a capture device or "-" for the standard input. The samples are
+ * 44100 Hz 16 bits stereo unless given. spec is split in place.
+ *
+ * Return 0, or -1 if spec is malformed.
+ */
+int live_parse(struct live_source* source, char* spec) {
+    char* path;
+    char* format;
+
+    assert(source != NULL);
+    assert(spec != NULL);
+
+    memset(source, 0, sizeof(struct live_source));
+    source->sample_rate = 44100;
+    source->sample_size = 16;
+    source->channels = 2;
+    source->capturer = -1;
+    source->shmid = -1;
+
+    path = strchr(spec, '=');
+    if (path == NULL || path == spec || path[1] == '\0') {
+        return -1;
+    }
+    *path++ = '\0';
+    source->name = spec;
+    source->path = path;
+
+    format = strchr(path, ':');
+    if (format != NULL) {
+        *format++ = '\0';
+        sscanf(format, "%d:%d:%d", &source->sample_rate, &source->sample_size,
+               &source->channels);
+    }
+    if (source->sample_rate <= 0 || source->channels <= 0 ||
+        (source->sample_size != 8 && source->sample_size != 16))
+    {
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/**
+ * Read a whole packet from fd, reopening a FIFO whenever its writer closes
+ * it, so that the stream goes on with the next writer.
+ *
+ * Return the number of bytes read, less than DATA_LENGTH only if the source
+ * ended.
+ */
+static int read_packet(struct live_source* source, int* fd,
+                       unsigned char* output, int fifo)
+{
+    int length
+      , ret;
+
+    length = 0;
+    while (length < DATA_LENGTH) {
+        ret = read(*fd, output + length, DATA_LENGTH - length);
+        if (ret < 0 && errno == EINTR) {
+            continue;
+        }
+        if (ret < 0) {
+            perror("Live source reading failed");
+            break;
+        }
+        if (ret == 0 && fifo) {
+            close(*fd);
+            // Wait for the next writer.
+            *fd = open(source->path, O_RDONLY);
+            if (*fd < 0) {
+                perror("Live source reopening failed");
+                break;
+            }
+            continue;
+        }
+        if (ret == 0) {
+            break;
+        }
+        length += ret;
+    }
+
+    return length;
+}
+
+
+/**
+ * Capturer process: fill the ring with the packets of the source until it
+ * ends or until the server stops it.
+ */
+static void capture(struct live_source* source, int fd, int fifo) {
+    struct live_ring* ring;
+    struct sigaction action;
+    unsigned char* packet;
+    int length;
+
+    // Stopped by live_stop(), even while blocked reading.
+    memset(&action, 0, sizeof(struct sigaction));
+    action.sa_handler = SIG_DFL;
+    sigaction(SIGTERM, &action, NULL);
+    sigaction(SIGINT, &action, NULL);
+
+    ring = source->ring;
+    if (fifo) {
+        fd = open(source->path, O_RDONLY);
+        if (fd < 0) {
+            perror("Live source opening failed");
+        }
+    }
+    while (fd >= 0) {
+        packet = ring->packets[ring->head % LIVE_RING_PACKETS];
+        length = read_packet(source, &fd, packet, fifo);
+        if (length == 0) {
+            break;
+        }
+        // The last packet is padded with silence.
+        memset(packet + length, source->sample_size == 8 ? 0x80 : 0,
+               DATA_LENGTH - length);
+        ring->stamps[ring->head % LIVE_RING_PACKETS] = deadbeef_now_us();
+        // Publish the packet after its samples.
+        __sync_synchronize();
+        ring->head++;
+        if (length < DATA_LENGTH) {
+            break;
+        }
+    }
+
+    ring->over = 1;
+    shmdt((void*) ring);
+    exit(EXIT_SUCCESS);
+}
+
+
+/**
+ * Create the ring of a live source and fork its capturer. A capture device
+ * is opened beforehand, so that the format it accepted is known to the
+ * listeners. A FIFO is opened by the capturer, which waits for its writer.
+ *
+ * Return 0, or -1 if the source could not be started.
+ */
+int live_start(struct live_source* source) {
+    struct stat st;
+    int fd
+      , fifo;
+
+    assert(source != NULL);
+
+    fd = -1;
+    fifo = 0;
+    if (strcmp(source->path, "-") == 0) {
+        fd = STDIN_FILENO;
+    }
+    else if (stat(source->path, &st) < 0) {
+        perror("Live source not found");
+        return -1;
+    }
+    else if (S_ISFIFO(st.st_mode)) {
+        fifo = 1;
+    }
+    else if (S_ISCHR(st.st_mode)) {
+        fd = aud_captureopen(source->path, &source->sample_rate,
+                             &source->sample_size, &source->channels);
+        if (fd < 0) {
+            return -1;
+        }
+    }
+    else {
+        fprintf(stderr, "Live source %s is neither a FIFO nor a capture "
+                        "device.\n", source->path);
+        return -1;
+    }
+
+    source->shmid = shmget(IPC_PRIVATE, sizeof(struct live_ring), 0600);
+    if (source->shmid == -1) {
+        perror("Live ring creation failed");
+        if (fd > STDIN_FILENO) {
+            close(fd);
+        }
+        return -1;
+    }
+    source->ring = (struct live_ring*) shmat(source->shmid, NULL, 0);
+    if (source->ring == (void*) -1) {
+        perror("Shared memory attachment failed");
+        shmctl(source->shmid, IPC_RMID, NULL);
+        if (fd > STDIN_FILENO) {
+            close(fd);
+        }
+        return -1;
+    }
+    memset(source->ring, 0, sizeof(struct live_ring));
+    // Random first id, so that the listeners handle its wraparound
+    source->ring->first = (uint32_t) (deadbeef_now_us() ^ getpid())
+                        * 2654435761U;
+    source->ring->head = source->ring->first;
+    source->ring->frame = source->sample_size / 8 * source->channels;
+
+    fflush(stdout);
+    source->capturer = fork();
+    if (source->capturer == 0) {
+        capture(source, fd, fifo);
+    }
+    if (fd > STDIN_FILENO) {
+        close(fd);
+    }
+    if (source->capturer < 0) {
+        perror("Capturer creation failed");
+        live_stop(source);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/**
+ * Stop the capturer of a live source and release its ring, which is
+ * destroyed once its listeners detach.
+ */
+void live_stop(struct live_source* source) {
+    assert(source != NULL);
+
+    if (source->capturer > 0) {
+        kill(source->capturer, SIGTERM);
+        waitpid(source->capturer, NULL, 0);
+        source->capturer = -1;
+    }
+    if (source->shmid != -1) {
+        // Listeners still attached see the source end.
+        source->ring->over = 1;
+        shmdt((void*) source->ring);
+        shmctl(source->shmid, IPC_RMID, NULL);
+        source->shmid = -1;
+        source->ring = NULL;
+    }
+}
+
+
+/**
+ * Return the live source of the given name among nb_sources, or NULL if
+ * there is none.
+ */
+struct live_source* live_lookup(struct live_source* sources, int nb_sources,
+                                const char* name)
+{
+    int i;
+
+    for (i = 0; i < nb_sources; i++) {
+        if (sources[i].ring != NULL && strcmp(sources[i].name, name) == 0) {
+            return &sources[i];
+        }
+    }
+
+    return NULL;
+}
+
+
+/**
+ * Return whether packet id of a ring starts on a frame, packets not being
+ * made of whole frames.
+ */
+static int on_frame(struct live_ring* ring, uint32_t id) {
+    return (uint64_t) (uint32_t) (id - ring->first) * DATA_LENGTH
+           % ring->frame == 0;
+}
+
+
+/**
+ * Return the id of the packet a new listener of a live source starts with:
+ * the packet being captured, or the next one that starts on a frame.
+ */
+uint32_t live_join(struct live_source* source) {
+    uint32_t id;
+
+    assert(source != NULL);
+
+    for (id = source->ring->head; !on_frame(source->ring, id); id++);
+
+    return id;
+}
+
+
+/**
+ * Copy packet *id of a ring to output, DATA_LENGTH bytes, and its capture
+ * time to stamp. If the packet was already overwritten because the listener
+ * lags a whole ring behind, *id skips ahead to the last packet captured that
+ * starts on a frame.
+ *
+ * Return 1 if the packet was copied.
+ * Return 0 if it is not captured yet.
+ * Return -1 if the source ended before it.
+ */
+int live_read(struct live_ring* ring, uint32_t* id, unsigned char* output,
+              long long* stamp)
+{
+    uint32_t head;
+    int slot;
+
+    assert(ring != NULL);
+    assert(id != NULL);
+    assert(output != NULL);
+
+    for (;;) {
+        head = ring->head;
+        // Signed distances, so that ids may wrap around.
+        if ((int32_t) (head - *id) <= 0) {
+            return ring->over && ring->head == head ? -1 : 0;
+        }
+        if (head - *id >= LIVE_RING_PACKETS) {
+            for (*id = head - 1; !on_frame(ring, *id); (*id)--);
+        }
+        __sync_synchronize();
+        slot = *id % LIVE_RING_PACKETS;
+        memcpy(output, ring->packets[slot], DATA_LENGTH);
+        if (stamp != NULL) {
+            *stamp = ring->stamps[slot];
+        }
+        __sync_synchronize();
+        // The capturer overwrites the slot once it captures packet
+        // *id + LIVE_RING_PACKETS.
+        if (ring->head - *id < LIVE_RING_PACKETS) {
+            return 1;
+        }
+    }
+}
@@ -0,0 +1,73 @@
+/* Distributed under the terms of the GNU General Public License v2 */
+/* L3info - SYR2 Project - SYR DeaDBeeF
+ * ============================================================================
+ * Live Sources Header
+ * ----------------------------------------------------------------------------
+ * Unbounded sources of raw PCM samples, streamed to their listeners as they
+ * are captured: a FIFO, the standard input of the server or a capture device.
+ *
+ * A capturer process, forked by live_start(), reads the source packet by
+ * packet into a ring of LIVE_RING_PACKETS packets in shared memory, and
+ * stamps each packet with the time it was complete, see deadbeef_now_us().
+ * The capturer never waits for the listeners: each of them follows the ring at
+ * its own pace from the packet being captured when it joined, see
+ * live_join(), and skips ahead if it lags a whole ring behind, see
+ * live_read().
+ *
+ * Packets are numbered from a random id, as RTP does, and their id wraps
+ * around after 0xFFFFFFFF. The ring holds a power of 2 of packets, so that
+ * the slot of a packet does not change when its id wraps around.
+ *
+ * The ring is a seqlock of a single writer: the capturer fills the slot of
+ * packet head, then publishes it by incrementing head. A listener copies a
+ * packet, then checks that the capturer did not start overwriting it
+ * meanwhile.
+ * ----------------------------------------------------------------------------
+ * Antoine Pinsard
+ * Oct. 19, 2026
+ */
+#ifndef _LIVE_H_
+#define _LIVE_H_
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#include "deadbeef.h"
+
+#define LIVE_MAX_SOURCES 4
+#define LIVE_RING_PACKETS 256
+// Delay in microseconds before a listener that caught up with the capturer
+// looks for the next packet again
+#define LIVE_POLL 1000
+
+struct live_ring {
+    uint32_t first;          // Id of the first packet captured
+    int frame;               // Bytes of a frame
+    volatile uint32_t head;  // Id of the packet being captured
+    volatile int over;       // The source ended, no packet will follow head
+    // Capture time of each packet in us
+    volatile long long stamps[LIVE_RING_PACKETS];
+    unsigned char packets[LIVE_RING_PACKETS][DATA_LENGTH];
+};
+
+// Live source, given as name=path[:rate[:size[:channels]]], see live_parse()
+struct live_source {
+    const char* name;  // Requested by the clients instead of a file name
+    const char* path;  // "-" for the standard input
+    int sample_rate;
+    int sample_size;
+    int channels;
+    pid_t capturer;
+    int shmid;
+    struct live_ring* ring;
+};
+
+int live_parse(struct live_source*, char*);
+int live_start(struct live_source*);
+void live_stop(struct live_source*);
+struct live_source* live_lookup(struct live_source*, int, const char*);
+uint32_t live_join(struct live_source*);
+int live_read(struct live_ring*, uint32_t*, unsigned char*, long long*);
+
+#endif
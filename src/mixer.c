@@ -0,0 +1,421 @@
+/* Distributed under the terms of the GNU General Public License v2 */
+/* L3info - SYR2 Project - SYR DeaDBeeF
+ * ============================================================================
+ * Mixer
+ * ----------------------------------------------------------------------------
+ * Mix of regions of files and its kernels.
+ * ----------------------------------------------------------------------------
+ * Antoine Pinsard
+ * Oct. 19, 2026
+ */
+#include "mixer.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define MIXER_X86
+#include <immintrin.h>
+#endif
+
+// MIX_UNITY is 1 << GAIN_SHIFT.
+#define GAIN_SHIFT 12
+
+typedef void (*accumulate_kernel)(int32_t*, const int16_t*, int, size_t);
+typedef void (*store_kernel)(const int32_t*, int16_t*, size_t);
+
+struct kernels {
+    accumulate_kernel accumulate;
+    store_kernel store;
+};
+
+static struct kernels kernels;
+static int kernels_isa = -1;
+
+
+/**
+ * Return the variant that converts the samples of a catalog entry to 16 bits
+ * at the given sample rate, on the given number of channels or on a single
+ * one, which is then spread over them.
+ *
+ * Return -1 if there is none: the entry is not at the sample rate or at twice
+ * the sample rate, or has another number of channels than the mix and more
+ * than one.
+ */
+int mixer_variant(struct catalog_entry* entry, int sample_rate, int channels)
+{
+    int requested
+      , variant
+      , format
+      , rate
+      , size
+      , nb_channels;
+
+    assert(entry != NULL);
+
+    if (convert_format(entry->format, entry->sample_size) < 0 ||
+        entry->channels <= 0 || entry->channels > CODEC_MAX_CHANNELS)
+    {
+        return -1;
+    }
+
+    requested = VARIANT_S16;
+    if (entry->sample_rate == 2 * sample_rate) {
+        requested |= VARIANT_HALF_RATE;
+    }
+    if (channels == 1) {
+        requested |= VARIANT_MONO;
+    }
+    variant = variant_select(entry, requested);
+
+    format = entry->format;
+    rate = entry->sample_rate;
+    size = entry->sample_size;
+    nb_channels = entry->channels;
+    variant_format(variant, &format, &rate, &size, &nb_channels);
+    if (rate != sample_rate || size != 16 ||
+        (nb_channels != channels && nb_channels != 1))
+    {
+        return -1;
+    }
+
+    return variant;
+}
+
+
+/**
+ * Return the length in bytes of the mix on the given number of channels of a
+ * catalog entry converted to the given variant, see mixer_variant().
+ */
+off_t mixer_input_length(struct catalog_entry* entry, int variant,
+                         int channels)
+{
+    off_t length;
+
+    assert(entry != NULL);
+
+    length = variant_length(entry->data_length,
+                            convert_format(entry->format, entry->sample_size),
+                            entry->channels, variant);
+    if (entry->channels == 1 || (variant & VARIANT_MONO)) {
+        length *= channels;
+    }
+
+    return length;
+}
+
+
+/**
+ * Initialize a mixer of no input on the given number of channels.
+ */
+void mixer_init(struct mixer* mixer, int channels) {
+    assert(mixer != NULL);
+    assert(channels > 0 && channels <= CODEC_MAX_CHANNELS);
+
+    mixer->channels = channels;
+    mixer->nb_inputs = 0;
+    mixer->pending_start = 0;
+    mixer->pending_fill = 0;
+}
+
+
+/**
+ * Add the length bytes of samples of the given format (see convert.h) on
+ * channels channels starting at offset in fd to the mix, converted by the
+ * given variant, see mixer_variant(), and scaled by gain. map is the mapping
+ * of the region, or NULL to read it from fd. The caller keeps the ownership
+ * of fd and map.
+ *
+ * Return 0 on success, -1 on error.
+ */
+int mixer_add(struct mixer* mixer, int fd, off_t offset, off_t length,
+              const unsigned char* map, int format, int channels, int variant,
+              int gain)
+{
+    struct mixer_input* input;
+
+    assert(mixer != NULL);
+    assert(mixer->nb_inputs < MIX_MAX_INPUTS);
+    assert(gain >= 0 && gain <= MIX_MAX_GAIN);
+
+    input = &mixer->inputs[mixer->nb_inputs];
+    if (converter_init(&input->conv, fd, offset, length, format, channels,
+                       variant) < 0)
+    {
+        return -1;
+    }
+    if (map != NULL) {
+        reader_map(&input->conv.reader, map);
+    }
+    input->gain = gain;
+    input->spread = mixer->channels > 1 &&
+                    (channels == 1 || (variant & VARIANT_MONO));
+    mixer->nb_inputs++;
+
+    return 0;
+}
+
+
+void mixer_destroy(struct mixer* mixer) {
+    int i;
+
+    assert(mixer != NULL);
+
+    for (i = 0; i < mixer->nb_inputs; i++) {
+        converter_destroy(&mixer->inputs[i].conv);
+    }
+    mixer->nb_inputs = 0;
+}
+
+
+/*
+ * Scalar reference kernels
+ */
+
+static void accumulate_scalar(int32_t* sums, const int16_t* in, int gain,
+                              size_t n)
+{
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+        sums[i] += in[i] * gain;
+    }
+}
+
+
+static void store_scalar(const int32_t* sums, int16_t* out, size_t n) {
+    int32_t t;
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+        t = (sums[i] + (1 << (GAIN_SHIFT - 1))) >> GAIN_SHIFT;
+        out[i] = t > INT16_MAX ? INT16_MAX : t < INT16_MIN ? INT16_MIN : t;
+    }
+}
+
+
+#ifdef MIXER_X86
+
+/*
+ * SSE2 kernels
+ */
+
+/**
+ * The 32-bit products are rebuilt from their low and high halves, gains
+ * fitting in 16 bits.
+ */
+static void accumulate_sse2(int32_t* sums, const int16_t* in, int gain,
+                            size_t n)
+{
+    __m128i g
+          , v
+          , lo
+          , hi;
+    size_t i;
+
+    g = _mm_set1_epi16(gain);
+    for (i = 0; i + 8 <= n; i += 8) {
+        v = _mm_loadu_si128((const __m128i*) (in + i));
+        lo = _mm_mullo_epi16(v, g);
+        hi = _mm_mulhi_epi16(v, g);
+        _mm_storeu_si128((__m128i*) (sums + i),
+                         _mm_add_epi32(_mm_loadu_si128((__m128i*) (sums + i)),
+                                       _mm_unpacklo_epi16(lo, hi)));
+        _mm_storeu_si128((__m128i*) (sums + i + 4),
+                         _mm_add_epi32(_mm_loadu_si128((__m128i*)
+                                                       (sums + i + 4)),
+                                       _mm_unpackhi_epi16(lo, hi)));
+    }
+    accumulate_scalar(sums + i, in + i, gain, n - i);
+}
+
+
+static void store_sse2(const int32_t* sums, int16_t* out, size_t n) {
+    __m128i half
+          , lo
+          , hi;
+    size_t i;
+
+    half = _mm_set1_epi32(1 << (GAIN_SHIFT - 1));
+    for (i = 0; i + 8 <= n; i += 8) {
+        lo = _mm_loadu_si128((const __m128i*) (sums + i));
+        hi = _mm_loadu_si128((const __m128i*) (sums + i + 4));
+        lo = _mm_srai_epi32(_mm_add_epi32(lo, half), GAIN_SHIFT);
+        hi = _mm_srai_epi32(_mm_add_epi32(hi, half), GAIN_SHIFT);
+        // Saturating pack to 16 bits
+        _mm_storeu_si128((__m128i*) (out + i), _mm_packs_epi32(lo, hi));
+    }
+    store_scalar(sums + i, out + i, n - i);
+}
+
+
+/*
+ * AVX2 kernels
+ */
+
+__attribute__((target("avx2")))
+static void accumulate_avx2(int32_t* sums, const int16_t* in, int gain,
+                            size_t n)
+{
+    __m256i g
+          , v;
+    size_t i;
+
+    g = _mm256_set1_epi32(gain);
+    for (i = 0; i + 8 <= n; i += 8) {
+        v = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)
+                                                  (in + i)));
+        v = _mm256_add_epi32(_mm256_loadu_si256((__m256i*) (sums + i)),
+                             _mm256_mullo_epi32(v, g));
+        _mm256_storeu_si256((__m256i*) (sums + i), v);
+    }
+    accumulate_scalar(sums + i, in + i, gain, n - i);
+}
+
+
+__attribute__((target("avx2")))
+static void store_avx2(const int32_t* sums, int16_t* out, size_t n) {
+    __m256i half
+          , a
+          , b;
+    size_t i;
+
+    half = _mm256_set1_epi32(1 << (GAIN_SHIFT - 1));
+    for (i = 0; i + 16 <= n; i += 16) {
+        a = _mm256_loadu_si256((const __m256i*) (sums + i));
+        b = _mm256_loadu_si256((const __m256i*) (sums + i + 8));
+        a = _mm256_srai_epi32(_mm256_add_epi32(a, half), GAIN_SHIFT);
+        b = _mm256_srai_epi32(_mm256_add_epi32(b, half), GAIN_SHIFT);
+        // The pack works on each 128-bit lane, put the samples back in order.
+        a = _mm256_permute4x64_epi64(_mm256_packs_epi32(a, b), 0xD8);
+        _mm256_storeu_si256((__m256i*) (out + i), a);
+    }
+    store_scalar(sums + i, out + i, n - i);
+}
+
+#endif
+
+
+/**
+ * Select the kernels of the given instruction set, see convert.h, or of the
+ * best one supported by the CPU if it is not.
+ *
+ * Return the selected instruction set.
+ */
+int mixer_set_isa(int isa) {
+    kernels.accumulate = accumulate_scalar;
+    kernels.store = store_scalar;
+    kernels_isa = CONVERT_SCALAR;
+
+#ifdef MIXER_X86
+    __builtin_cpu_init();
+    if (isa >= CONVERT_SSE2 && __builtin_cpu_supports("sse2")) {
+        kernels.accumulate = accumulate_sse2;
+        kernels.store = store_sse2;
+        kernels_isa = CONVERT_SSE2;
+    }
+    if (isa >= CONVERT_AVX2 && __builtin_cpu_supports("avx2")) {
+        kernels.accumulate = accumulate_avx2;
+        kernels.store = store_avx2;
+        kernels_isa = CONVERT_AVX2;
+    }
+#endif
+
+    return kernels_isa;
+}
+
+
+/**
+ * Return the instruction set of the kernels in use.
+ */
+int mixer_isa() {
+    if (kernels_isa < 0) {
+        mixer_set_isa(CONVERT_AVX2);
+    }
+
+    return kernels_isa;
+}
+
+
+/**
+ * Mix the next chunk of frames of the inputs to the pending buffer.
+ */
+static int refill(struct mixer* mixer) {
+    struct mixer_input* input;
+    ssize_t len;
+    int channels
+      , nb_frames
+      , frames
+      , i
+      , j
+      , c;
+
+    mixer_isa();
+    memset(mixer->sums, 0, sizeof(mixer->sums));
+    nb_frames = 0;
+    for (i = 0; i < mixer->nb_inputs; i++) {
+        input = &mixer->inputs[i];
+        channels = input->spread ? 1 : mixer->channels;
+        len = converter_read(&input->conv, (unsigned char*) mixer->samples,
+                             MIXER_CHUNK_FRAMES * channels * 2);
+        if (len < 0) {
+            return -1;
+        }
+        frames = len / (channels * 2);
+        // In place, from the last frame, which moves the farthest.
+        if (input->spread) {
+            for (j = frames - 1; j >= 0; j--) {
+                for (c = mixer->channels - 1; c >= 0; c--) {
+                    mixer->samples[j * mixer->channels + c] =
+                        mixer->samples[j];
+                }
+            }
+        }
+        kernels.accumulate(mixer->sums, mixer->samples, input->gain,
+                           (size_t) frames * mixer->channels);
+        if (frames > nb_frames) {
+            nb_frames = frames;
+        }
+    }
+    kernels.store(mixer->sums, mixer->pending,
+                  (size_t) nb_frames * mixer->channels);
+
+    mixer->pending_start = 0;
+    mixer->pending_fill = nb_frames * mixer->channels * 2;
+
+    return 0;
+}
+
+
+/**
+ * Read the next n bytes of the mix to output.
+ *
+ * Return the number of bytes read, which is less than n only once every
+ * input ended, or -1 on error.
+ */
+ssize_t mixer_read(struct mixer* mixer, unsigned char* output, size_t n) {
+    size_t done
+         , chunk;
+
+    assert(mixer != NULL);
+    assert(output != NULL);
+
+    done = 0;
+    while (done < n) {
+        if (mixer->pending_start == mixer->pending_fill) {
+            if (refill(mixer) < 0) {
+                return -1;
+            }
+            if (mixer->pending_fill == 0) {
+                break;
+            }
+        }
+        chunk = mixer->pending_fill - mixer->pending_start;
+        if (chunk > n - done) {
+            chunk = n - done;
+        }
+        memcpy(output + done,
+               (unsigned char*) mixer->pending + mixer->pending_start, chunk);
+        mixer->pending_start += chunk;
+        done += chunk;
+    }
+
+    return done;
+}
@@ -0,0 +1,71 @@
+/* Distributed under the terms of the GNU General Public License v2 */
+/* L3info - SYR2 Project - SYR DeaDBeeF
+ * ============================================================================
+ * Mixer
+ * ----------------------------------------------------------------------------
+ * Sequential reader of the mix of several regions of files, such as a music
+ * bed and a voice-over, or the stems of a track.
+ *
+ * The mix is made of 16-bit samples. Each input is converted to the format of
+ * the mix by a converter, see variant.h: narrowed to 16 bits, downsampled to
+ * half its sample rate or downmixed to mono as needed, and a mono input is
+ * spread over every channel of the mix. Inputs of other sample rates are not
+ * resampled, see mixer_variant().
+ *
+ * The samples of each input are scaled by its gain, MIX_UNITY being unity,
+ * and summed to 32 bits, which holds the sum of MIX_MAX_INPUTS inputs at
+ * MIX_MAX_GAIN without overflow. The sum is narrowed back to 16 bits with
+ * saturation once all the inputs are summed, so that the mix does not depend
+ * on the order of its inputs. An input that ends is silent until the longest
+ * one ends.
+ *
+ * Kernels are vectorized with SSE2 and AVX2 on x86 and selected at run time,
+ * as those of convert.h. Every kernel gives exactly the same mix.
+ * ----------------------------------------------------------------------------
+ * Antoine Pinsard
+ * Oct. 19, 2026
+ */
+#ifndef _MIXER_H_
+#define _MIXER_H_
+
+#include <stdint.h>
+#include <sys/types.h>
+#include "catalog.h"
+#include "codec.h"
+#include "convert.h"
+#include "deadbeef.h"
+#include "variant.h"
+
+// Number of frames mixed at once
+#define MIXER_CHUNK_FRAMES 1024
+
+struct mixer_input {
+    struct converter conv;
+    int gain;
+    int spread; // Mono input spread over every channel of the mix
+};
+
+struct mixer {
+    int channels;
+    int nb_inputs;
+    size_t pending_start; // Mixed bytes not read yet
+    size_t pending_fill;
+    struct mixer_input inputs[MIX_MAX_INPUTS];
+    int32_t sums[MIXER_CHUNK_FRAMES * CODEC_MAX_CHANNELS];
+    int16_t samples[MIXER_CHUNK_FRAMES * CODEC_MAX_CHANNELS];
+    int16_t pending[MIXER_CHUNK_FRAMES * CODEC_MAX_CHANNELS];
+};
+
+int mixer_variant(struct catalog_entry*, int, int);
+off_t mixer_input_length(struct catalog_entry*, int, int);
+
+void mixer_init(struct mixer*, int);
+int mixer_add(struct mixer*, int, off_t, off_t, const unsigned char*, int,
+              int, int, int);
+void mixer_destroy(struct mixer*);
+ssize_t mixer_read(struct mixer*, unsigned char*, size_t);
+
+int mixer_set_isa(int);
+int mixer_isa();
+
+#endif
@@ -0,0 +1,478 @@
+/* Distributed under the terms of the GNU General Public License v2 */
+/* L3info - SYR2 Project - SYR DeaDBeeF
+ * ============================================================================
+ * Network Emulator
+ * ----------------------------------------------------------------------------
+ * A UDP relay that impairs the datagrams it forwards.
+ * ----------------------------------------------------------------------------
+ * Antoine Pinsard
+ * Oct. 19, 2026
+ */
+#include "netem.h"
+
+
+volatile sig_atomic_t done = 0;
+struct impairment impairments[2];
+struct session sessions[NETEM_MAX_SESSIONS];
+struct sockaddr_in server_addr;
+int listen_sock;
+// Datagrams waiting for their release, as a binary heap
+struct datagram* pending[NETEM_MAX_PENDING];
+int nb_pending = 0;
+unsigned long next_order = 0;
+uint64_t random_state = 1664;
+
+
+void term(int signum) {
+    done = 1;
+}
+
+
+/**
+ * Return a random number in [0, 1), from a xorshift64* generator, so that
+ * runs with the same seed repeat on any system.
+ */
+static double random_uniform() {
+    random_state ^= random_state >> 12;
+    random_state ^= random_state << 25;
+    random_state ^= random_state >> 27;
+    return ((random_state * 0x2545F4914F6CDD1DULL) >> 11) / 9007199254740992.0;
+}
+
+
+/**
+ * Apply an option of the command line to impairment.
+ *
+ * Return 0 on success, -1 if the option is unknown.
+ */
+int parse_option(const char* option, struct impairment* impairment) {
+    const char* value;
+    double v;
+
+    value = strchr(option, '=');
+    if (value == NULL) {
+        return -1;
+    }
+    v = atof(++value);
+    if (v < 0) {
+        return -1;
+    }
+
+    if (strncmp(option, "loss=", 5) == 0) {
+        impairment->loss = v / 100;
+    }
+    else if (strncmp(option, "burst=", 6) == 0) {
+        impairment->burst = v;
+    }
+    else if (strncmp(option, "delay=", 6) == 0) {
+        impairment->delay = v / 1000;
+    }
+    else if (strncmp(option, "jitter=", 7) == 0) {
+        impairment->jitter = v / 1000;
+    }
+    else if (strncmp(option, "reorder=", 8) == 0) {
+        impairment->reorder = v / 100;
+    }
+    else if (strncmp(option, "reorder_delay=", 14) == 0) {
+        impairment->reorder_delay = v / 1000;
+    }
+    else if (strncmp(option, "duplicate=", 10) == 0) {
+        impairment->duplicate = v / 100;
+    }
+    else if (strncmp(option, "rate=", 5) == 0) {
+        impairment->rate = v * 1000 / 8;
+    }
+    else {
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/**
+ * Tell whether the next datagram is lost. Losses are independent, unless
+ * bursts are asked for: the link then goes from a good state, where nothing
+ * is lost, to a bad state, where everything is, and back, with probabilities
+ * such that bursts last burst datagrams on average and the overall loss is
+ * the same.
+ */
+static int is_lost(struct impairment* impairment) {
+    double to_good
+         , to_bad;
+
+    if (impairment->burst < 1 || impairment->loss >= 1) {
+        return random_uniform() < impairment->loss;
+    }
+    to_good = 1 / impairment->burst;
+    to_bad = impairment->loss * to_good / (1 - impairment->loss);
+    if (impairment->bad) {
+        impairment->bad = random_uniform() >= to_good;
+    }
+    else {
+        impairment->bad = random_uniform() < to_bad;
+    }
+
+    return impairment->bad;
+}
+
+
+static int before(struct datagram* a, struct datagram* b) {
+    return a->release < b->release ||
+           (a->release == b->release && a->order < b->order);
+}
+
+
+static void push_pending(struct datagram* datagram) {
+    struct datagram* swap;
+    int i;
+
+    i = nb_pending++;
+    pending[i] = datagram;
+    while (i > 0 && before(pending[i], pending[(i-1) / 2])) {
+        swap = pending[i];
+        pending[i] = pending[(i-1) / 2];
+        pending[(i-1) / 2] = swap;
+        i = (i-1) / 2;
+    }
+}
+
+
+static struct datagram* pop_pending() {
+    struct datagram* first;
+    struct datagram* swap;
+    int i
+      , child;
+
+    first = pending[0];
+    pending[0] = pending[--nb_pending];
+    i = 0;
+    while ((child = 2*i + 1) < nb_pending) {
+        if (child + 1 < nb_pending && before(pending[child+1], pending[child])) {
+            child++;
+        }
+        if (!before(pending[child], pending[i])) {
+            break;
+        }
+        swap = pending[i];
+        pending[i] = pending[child];
+        pending[child] = swap;
+        i = child;
+    }
+
+    return first;
+}
+
+
+/**
+ * Impair a datagram received at time t, to be forwarded to dest through sock
+ * in the given direction: it is dropped, or delayed and maybe duplicated.
+ */
+void impair(struct impairment* impairment, double t, int sock,
+            struct sockaddr_in* dest, unsigned char* data, int length,
+            int direction)
+{
+    struct datagram* datagram;
+    int nb_copies
+      , copy;
+
+    impairment->nb_received++;
+    nb_copies = 1;
+    if (impairment->enabled) {
+        if (is_lost(impairment)) {
+            impairment->nb_lost++;
+            return;
+        }
+        if (random_uniform() < impairment->duplicate) {
+            impairment->nb_duplicated++;
+            nb_copies = 2;
+        }
+    }
+
+    for (copy = 0; copy < nb_copies; copy++) {
+        if (nb_pending == NETEM_MAX_PENDING) {
+            impairment->nb_overflows++;
+            continue;
+        }
+        datagram = malloc(sizeof(struct datagram));
+        if (datagram == NULL) {
+            perror("Dynamic allocation failed");
+            continue;
+        }
+        datagram->release = t;
+        datagram->order = next_order++;
+        datagram->direction = direction;
+        datagram->queued = 0;
+        datagram->sock = sock;
+        memcpy(&datagram->dest, dest, sizeof(struct sockaddr_in));
+        datagram->length = length;
+        memcpy(datagram->data, data, length);
+
+        if (impairment->enabled) {
+            datagram->release += impairment->delay
+                               + impairment->jitter
+                                 * (2 * random_uniform() - 1);
+            if (datagram->release < t) {
+                datagram->release = t;
+            }
+            if (random_uniform() < impairment->reorder) {
+                impairment->nb_reordered++;
+                datagram->release += impairment->reorder_delay;
+            }
+            // Datagrams leave the link one after the other.
+            if (impairment->rate > 0) {
+                if (impairment->queued == NETEM_MAX_QUEUE) {
+                    impairment->nb_overflows++;
+                    free(datagram);
+                    continue;
+                }
+                if (impairment->link_free < datagram->release) {
+                    impairment->link_free = datagram->release;
+                }
+                impairment->link_free += length / impairment->rate;
+                datagram->release = impairment->link_free;
+                datagram->queued = 1;
+                impairment->queued++;
+            }
+        }
+        push_pending(datagram);
+    }
+}
+
+
+/**
+ * Send the datagrams whose release time has come.
+ *
+ * Return the delay in milliseconds until the next release, or -1 if none is
+ * pending.
+ */
+int release_due(double t) {
+    struct datagram* datagram;
+    struct impairment* impairment;
+
+    while (nb_pending > 0 && pending[0]->release <= t) {
+        datagram = pop_pending();
+        impairment = &impairments[datagram->direction];
+        if (sendto(datagram->sock, datagram->data, datagram->length, 0,
+                   (struct sockaddr*) &datagram->dest,
+                   sizeof(struct sockaddr_in)) >= 0)
+        {
+            impairment->nb_sent++;
+        }
+        if (datagram->queued) {
+            impairment->queued--;
+        }
+        free(datagram);
+    }
+    if (nb_pending == 0) {
+        return -1;
+    }
+
+    return (int) ((pending[0]->release - t) * 1000) + 1;
+}
+
+
+/**
+ * Return the session of the client at addr, opening it if needed. Sessions
+ * idle for NETEM_SESSION_TIMEOUT are closed first.
+ *
+ * Return -1 if all sessions are busy.
+ */
+int open_session(struct sockaddr_in* addr, double t) {
+    int free_session
+      , i;
+
+    free_session = -1;
+    for (i = 0; i < NETEM_MAX_SESSIONS; i++) {
+        if (sessions[i].sock >= 0 &&
+            sessions[i].client.sin_port == addr->sin_port &&
+            sessions[i].client.sin_addr.s_addr == addr->sin_addr.s_addr)
+        {
+            sessions[i].last = t;
+            return i;
+        }
+        if (sessions[i].sock >= 0 &&
+            t - sessions[i].last > NETEM_SESSION_TIMEOUT)
+        {
+            close(sessions[i].sock);
+            sessions[i].sock = -1;
+        }
+        if (sessions[i].sock < 0 && free_session < 0) {
+            free_session = i;
+        }
+    }
+    if (free_session < 0) {
+        return -1;
+    }
+
+    sessions[free_session].sock = socket(AF_INET, SOCK_DGRAM, 0);
+    if (sessions[free_session].sock < 0) {
+        perror("Socket creation failed");
+        return -1;
+    }
+    memcpy(&sessions[free_session].client, addr, sizeof(struct sockaddr_in));
+    sessions[free_session].last = t;
+
+    return free_session;
+}
+
+
+static void print_impairment(const char* name, struct impairment* impairment)
+{
+    printf("%s: received %lu, sent %lu, lost %lu, overflows %lu, "
+           "reordered %lu, duplicated %lu\n", name, impairment->nb_received,
+           impairment->nb_sent, impairment->nb_lost, impairment->nb_overflows,
+           impairment->nb_reordered, impairment->nb_duplicated);
+}
+
+
+int main(int argc, char** argv) {
+    struct pollfd pfds[1 + NETEM_MAX_SESSIONS];
+    struct sockaddr_in listen_addr;
+    struct sockaddr_in from;
+    struct sigaction action;
+    unsigned char buffer[MSG_LENGTH];
+    struct impairment settings;
+    socklen_t flen;
+    char* port;
+    double t;
+    int timeout
+      , directions
+      , len
+      , session
+      , i;
+
+    if (argc < 3) {
+        fprintf(stderr, "Usage: netem <listen_port> <server_ip>[:<port>] "
+                        "[option ...]\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // Parse options, to apply to both directions by default
+    memset(&settings, 0, sizeof(struct impairment));
+    settings.reorder_delay = NETEM_DEFAULT_REORDER_DELAY / 1000;
+    directions = (1 << NETEM_DOWN) | (1 << NETEM_UP);
+    for (i = 3; i < argc; i++) {
+        if (strncmp(argv[i], "seed=", 5) == 0) {
+            random_state = strtoull(argv[i] + 5, NULL, 10);
+            if (random_state == 0) {
+                random_state = 1664;
+            }
+        }
+        else if (strcmp(argv[i], "dir=down") == 0) {
+            directions = 1 << NETEM_DOWN;
+        }
+        else if (strcmp(argv[i], "dir=up") == 0) {
+            directions = 1 << NETEM_UP;
+        }
+        else if (strcmp(argv[i], "dir=both") == 0) {
+            directions = (1 << NETEM_DOWN) | (1 << NETEM_UP);
+        }
+        else if (parse_option(argv[i], &settings) < 0) {
+            fprintf(stderr, "Unknown option: %s\n", argv[i]);
+            exit(EXIT_FAILURE);
+        }
+    }
+    for (i = NETEM_DOWN; i <= NETEM_UP; i++) {
+        memcpy(&impairments[i], &settings, sizeof(struct impairment));
+        impairments[i].enabled = (directions >> i) & 1;
+    }
+
+    // Handle signals
+    memset(&action, 0, sizeof(struct sigaction));
+    action.sa_handler = term;
+    sigaction(SIGTERM, &action, NULL);
+    sigaction(SIGINT, &action, NULL);
+
+    memset(&server_addr, 0, sizeof(struct sockaddr_in));
+    server_addr.sin_family = AF_INET;
+    server_addr.sin_port = htons(1664);
+    port = strchr(argv[2], ':');
+    if (port != NULL) {
+        *port++ = '\0';
+        server_addr.sin_port = htons(atoi(port));
+    }
+    if (inet_aton(argv[2], &server_addr.sin_addr) == 0) {
+        fprintf(stderr, "Invalid server address: %s\n", argv[2]);
+        exit(EXIT_FAILURE);
+    }
+
+    listen_sock = socket(AF_INET, SOCK_DGRAM, 0);
+    if (listen_sock < 0) {
+        perror("Socket creation failed");
+        exit(EXIT_FAILURE);
+    }
+    memset(&listen_addr, 0, sizeof(struct sockaddr_in));
+    listen_addr.sin_family = AF_INET;
+    listen_addr.sin_port = htons(atoi(argv[1]));
+    listen_addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    if (bind(listen_sock, (struct sockaddr*) &listen_addr,
+             sizeof(struct sockaddr_in)) < 0)
+    {
+        perror("Failed to bind socket");
+        close(listen_sock);
+        exit(EXIT_FAILURE);
+    }
+    for (i = 0; i < NETEM_MAX_SESSIONS; i++) {
+        sessions[i].sock = -1;
+    }
+
+    timeout = -1;
+    while (!done) {
+        pfds[0].fd = listen_sock;
+        pfds[0].events = POLLIN;
+        for (i = 0; i < NETEM_MAX_SESSIONS; i++) {
+            pfds[1+i].fd = sessions[i].sock;
+            pfds[1+i].events = POLLIN;
+        }
+        if (poll(pfds, 1 + NETEM_MAX_SESSIONS, timeout) < 0) {
+            continue;
+        }
+        t = deadbeef_now_us() / 1e6;
+
+        // From a client to the server
+        if (pfds[0].revents & POLLIN) {
+            flen = sizeof(struct sockaddr_in);
+            len = recvfrom(listen_sock, buffer, MSG_LENGTH, 0,
+                           (struct sockaddr*) &from, &flen);
+            session = len > 0 ? open_session(&from, t) : -1;
+            if (session >= 0) {
+                impair(&impairments[NETEM_UP], t, sessions[session].sock,
+                       &server_addr, buffer, len, NETEM_UP);
+            }
+            else if (len > 0) {
+                fprintf(stderr, "Too many clients, datagram dropped.\n");
+            }
+        }
+
+        // From the server to a client
+        for (i = 0; i < NETEM_MAX_SESSIONS; i++) {
+            if (sessions[i].sock < 0 || !(pfds[1+i].revents & POLLIN)) {
+                continue;
+            }
+            len = recv(sessions[i].sock, buffer, MSG_LENGTH, 0);
+            if (len > 0) {
+                sessions[i].last = t;
+                impair(&impairments[NETEM_DOWN], t, listen_sock,
+                       &sessions[i].client, buffer, len, NETEM_DOWN);
+            }
+        }
+
+        timeout = release_due(deadbeef_now_us() / 1e6);
+    }
+
+    print_impairment("down", &impairments[NETEM_DOWN]);
+    print_impairment("up", &impairments[NETEM_UP]);
+
+    while (nb_pending > 0) {
+        free(pop_pending());
+    }
+    for (i = 0; i < NETEM_MAX_SESSIONS; i++) {
+        if (sessions[i].sock >= 0) {
+            close(sessions[i].sock);
+        }
+    }
+    close(listen_sock);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,102 @@
+/* Distributed under the terms of the GNU General Public License v2 */
+/* L3info - SYR2 Project - SYR DeaDBeeF
+ * ============================================================================
+ * Network Emulator
+ * ----------------------------------------------------------------------------
+ * A UDP relay to put between clients and the server, that impairs the
+ * datagrams it forwards the way real networks do, without root privileges:
+ *
+ *  loss=<%>          drop datagrams at random
+ *  burst=<n>         drop them in bursts of n on average instead, following
+ *                    a Gilbert model with the same overall loss
+ *  delay=<ms>        delay every datagram
+ *  jitter=<ms>       add a random delay of up to jitter either way, which
+ *                    reorders datagrams closer than it
+ *  reorder=<%>       hold datagrams back for reorder_delay, so that the next
+ *                    ones overtake them
+ *  reorder_delay=<ms>
+ *  duplicate=<%>     send datagrams twice
+ *  rate=<kbit/s>     cap the bandwidth; datagrams queue behind each other and
+ *                    are dropped once NETEM_MAX_QUEUE are waiting
+ *  seed=<n>          seed of the random generator, so that runs repeat
+ *  dir=down|up|both  impair the datagrams from the server, from the clients,
+ *                    or both (default)
+ *
+ * Each client is given its own socket towards the server, so that the server
+ * tells them apart. The relay prints what it did when interrupted.
+ *
+ * Usage: netem <listen_port> <server_ip>[:<port>] [option ...]
+ *
+ * The client goes through the relay with: audioclient 127.0.0.1:<listen_port>
+ * ----------------------------------------------------------------------------
+ * Antoine Pinsard
+ * Oct. 19, 2026
+ */
+#ifndef _NETEM_H_
+#define _NETEM_H_
+
+#include <arpa/inet.h>
+#include <poll.h>
+#include <stdint.h>
+#include <time.h>
+#include "deadbeef.h"
+
+#define NETEM_MAX_SESSIONS 16
+// Delay in seconds after which an idle client is forgotten
+#define NETEM_SESSION_TIMEOUT 60.0
+// Number of datagrams waiting for the bandwidth of a direction
+#define NETEM_MAX_QUEUE 1024
+#define NETEM_MAX_PENDING (4 * NETEM_MAX_QUEUE)
+#define NETEM_DEFAULT_REORDER_DELAY 10.0
+
+#define NETEM_DOWN 0 // From the server to the clients
+#define NETEM_UP 1   // From the clients to the server
+
+struct impairment {
+    int enabled;
+    double loss;          // Probability
+    double burst;         // Mean length of the bursts of loss, 0 if random
+    double delay;         // Seconds
+    double jitter;
+    double reorder;       // Probability
+    double reorder_delay;
+    double duplicate;     // Probability
+    double rate;          // Bytes per second, 0 if unlimited
+    // State
+    int bad;              // Gilbert model: losing datagrams
+    double link_free;     // Time the link is done sending the queue
+    int queued;
+    // Statistics
+    unsigned long nb_received;
+    unsigned long nb_sent;
+    unsigned long nb_lost;
+    unsigned long nb_overflows;
+    unsigned long nb_reordered;
+    unsigned long nb_duplicated;
+};
+
+struct session {
+    struct sockaddr_in client;
+    int sock;             // Towards the server, -1 if unused
+    double last;          // Time of the last datagram
+};
+
+struct datagram {
+    double release;       // Time to send it
+    unsigned long order;  // Keeps datagrams released together in order
+    int direction;
+    int queued;           // Holds a place in the queue of the direction
+    int sock;
+    struct sockaddr_in dest;
+    int length;
+    unsigned char data[MSG_LENGTH];
+};
+
+void term(int);
+int parse_option(const char*, struct impairment*);
+void impair(struct impairment*, double, int, struct sockaddr_in*,
+            unsigned char*, int, int);
+int release_due(double);
+int open_session(struct sockaddr_in*, double);
+
+#endif
@@ -0,0 +1,337 @@
+/* Distributed under the terms of the GNU General Public License v2 */
+/* L3info - SYR2 Project - SYR DeaDBeeF
+ * ============================================================================
+ * Playback
+ * ----------------------------------------------------------------------------
+ * Playback of a stream while it is being received.
+ * ----------------------------------------------------------------------------
+ * Antoine Pinsard
+ * Oct. 19, 2026
+ */
+#include "playback.h"
+
+
+/**
+ * Initialize the playback of the nb_packets packets of data on the audio
+ * output sink. received is updated by the receiver of the stream, and must
+ * reach nb_packets once nothing more will be received.
+ *
+ * The stream defaults to 16-bit stereo at 44.1 kHz, played as is, without
+ * prebuffer and with blocking writes. The caller updates the fields of the
+ * playback to the actual stream and audio output.
+ */
+void playback_init(struct playback* playback, struct sink* sink,
+                   const unsigned char* data, int nb_packets,
+                   volatile int* received)
+{
+    assert(playback != NULL);
+    assert(sink != NULL);
+    assert(data != NULL);
+    assert(received != NULL);
+
+    playback->sink = sink;
+    playback->data = data;
+    playback->nb_packets = nb_packets;
+    playback->length = 0;
+    playback->ring = 0;
+    playback->received = received;
+    playback->in_format = CONVERT_S16;
+    playback->out_format = CONVERT_S16;
+    playback->channels = 2;
+    playback->bytes_per_second = 44100 * 2 * 2;
+    playback->prebuffer = 0;
+    playback->low_latency = 0;
+    playback->compensate = 0;
+    playback->qos = NULL;
+    playback->started = 0;
+    dither_init(&playback->dither, getpid());
+    playback->nb_underruns = 0;
+    playback->nb_rebuffers = 0;
+    playback->nb_overruns = 0;
+    playback->nb_delays = 0;
+    playback->total_delay = 0;
+    playback->max_delay = 0;
+}
+
+
+/**
+ * Move the playback on to the next stream, of the same format, whose length
+ * bytes are held by the nb_packets packets of data. The next stream is
+ * played right after the current one, without waiting for the prebuffer
+ * again, so that the transition is gapless. It is up to the caller to reset
+ * started if the audio output has been reopened in between.
+ */
+void playback_next(struct playback* playback, const unsigned char* data,
+                   int nb_packets, size_t length, volatile int* received)
+{
+    assert(playback != NULL);
+    assert(data != NULL);
+    assert(received != NULL);
+
+    playback->data = data;
+    playback->nb_packets = nb_packets;
+    playback->length = length;
+    playback->received = received;
+}
+
+
+/**
+ * Return the number of bytes of the stream received past position, as far
+ * as the count of received packets tells. All of them once reception is
+ * over.
+ */
+static size_t received_ahead(struct playback* playback, size_t position) {
+    size_t received;
+
+    received = (size_t) *playback->received * DATA_LENGTH;
+    return received > position ? received - position : 0;
+}
+
+
+/**
+ * Sample the occupancy of the jitter buffer to the telemetry of the stream.
+ */
+static void sample_buffer(struct playback* playback, size_t position) {
+    double bytes_per_ms;
+
+    if (playback->qos == NULL) {
+        return;
+    }
+    bytes_per_ms = (double) playback->bytes_per_second
+                 / convert_sample_length(playback->out_format)
+                 * convert_sample_length(playback->in_format) / 1000;
+    qos_playback(playback->qos,
+                 received_ahead(playback, position) / bytes_per_ms,
+                 playback->nb_underruns, playback->nb_rebuffers);
+}
+
+
+/**
+ * Wait until the prebuffer, and at least a frame, is received ahead of
+ * position, or until nothing more will be received.
+ *
+ * Return the number of bytes received ahead.
+ */
+static size_t wait_prebuffer(struct playback* playback, size_t position,
+                             volatile sig_atomic_t* done)
+{
+    size_t wanted
+         , ahead;
+
+    wanted = convert_sample_length(playback->in_format) * playback->channels;
+    if (wanted < playback->prebuffer) {
+        wanted = playback->prebuffer;
+    }
+    while ((ahead = received_ahead(playback, position)) < wanted &&
+           *playback->received < playback->nb_packets && !*done)
+    {
+        sample_buffer(playback, position);
+        usleep(PLAYBACK_POLL_PERIOD);
+    }
+
+    return ahead;
+}
+
+
+/**
+ * Skip the playback of a live stream ahead to the prebuffer if the receiver
+ * is about to overwrite the part of the ring not played yet.
+ *
+ * Return the number of bytes received ahead of the new position.
+ */
+static size_t skip_overrun(struct playback* playback, size_t* position) {
+    size_t ahead
+         , skip
+         , frame;
+
+    ahead = received_ahead(playback, *position);
+    if (ahead + 2 * DATA_LENGTH <= playback->ring) {
+        return ahead;
+    }
+    frame = convert_sample_length(playback->in_format) * playback->channels;
+    skip = ahead > playback->prebuffer ? ahead - playback->prebuffer : 0;
+    skip -= skip % frame;
+    *position += skip;
+    playback->nb_overruns++;
+
+    return ahead - skip;
+}
+
+
+/**
+ * Sample the delay of the audio output before a write, that is the latency
+ * of the samples about to be written. It ran dry if nothing is left to play
+ * while the stream is not over.
+ *
+ */
+static void sample_delay(struct playback* playback) {
+    int delay;
+
+    delay = sink_delay(playback->sink);
+    if (delay < 0) {
+        return;
+    }
+    if (delay == 0) {
+        playback->nb_underruns++;
+    }
+    playback->nb_delays++;
+    playback->total_delay += delay;
+    if (delay > playback->max_delay) {
+        playback->max_delay = delay;
+    }
+}
+
+
+/**
+ * Play the stream until its end or until done is set. Unless the audio
+ * output is playing a previous stream already, playback starts once the
+ * prebuffer is received.
+ *
+ * Return 0 on success, -1 if the audio output failed.
+ */
+int playback_run(struct playback* playback, volatile sig_atomic_t* done) {
+    const unsigned char* output;
+    unsigned char out_buffer[PLAYBACK_CHUNK * 4];
+    unsigned char resampled[DRIFT_MAX_LENGTH(PLAYBACK_CHUNK) * 4];
+    size_t length
+         , position
+         , ahead
+         , chunk
+         , room
+         , margin
+         , out_chunk;
+    double stream_bytes_per_second;
+    int in_length
+      , out_length
+      , space;
+
+    assert(playback != NULL);
+    assert(done != NULL);
+
+    in_length = convert_sample_length(playback->in_format);
+    out_length = convert_sample_length(playback->out_format);
+    length = (size_t) playback->nb_packets * DATA_LENGTH;
+    if (playback->length > 0 && playback->length < length) {
+        length = playback->length;
+    }
+    length -= length % (in_length * playback->channels);
+    stream_bytes_per_second = (double) playback->bytes_per_second
+                            / out_length * in_length;
+
+    position = 0;
+    if (playback->started) {
+        ahead = received_ahead(playback, position);
+    }
+    else {
+        if (playback->compensate) {
+            drift_init(&playback->drift, playback->out_format,
+                       playback->channels,
+                       playback->prebuffer / stream_bytes_per_second);
+        }
+        ahead = wait_prebuffer(playback, position, done);
+        playback->started = 1;
+    }
+    while (position < length && !*done) {
+        // Frames not received yet are not played.
+        if (ahead < (size_t) in_length * playback->channels) {
+            ahead = received_ahead(playback, position);
+            if (ahead < (size_t) in_length * playback->channels) {
+                playback->nb_rebuffers++;
+                ahead = wait_prebuffer(playback, position, done);
+                continue;
+            }
+        }
+
+        if (playback->ring > 0) {
+            ahead = skip_overrun(playback, &position);
+        }
+
+        chunk = PLAYBACK_CHUNK;
+        if (chunk > ahead / in_length) {
+            chunk = ahead / in_length;
+        }
+        if (chunk > (length - position) / in_length) {
+            chunk = (length - position) / in_length;
+        }
+        // A chunk ends within the mirror of the ring at most.
+        if (playback->ring > 0 &&
+            chunk > (playback->ring + DATA_LENGTH - position % playback->ring)
+                    / in_length)
+        {
+            chunk = (playback->ring + DATA_LENGTH - position % playback->ring)
+                  / in_length;
+        }
+        if (playback->low_latency &&
+            (space = sink_space(playback->sink)) >= 0)
+        {
+            room = space / out_length;
+            // Resampling may output a few more samples than it is given.
+            if (playback->compensate) {
+                margin = DRIFT_MAX_LENGTH(room) - room;
+                room = room > margin ? room - margin : 0;
+            }
+            if (room < (size_t) playback->channels) {
+                usleep(PLAYBACK_POLL_PERIOD);
+                continue;
+            }
+            if (chunk > room) {
+                chunk = room;
+            }
+        }
+        chunk -= chunk % playback->channels;
+
+        if (position > 0) {
+            sample_delay(playback);
+        }
+        sample_buffer(playback, position);
+        // The audio output holds a steady amount, so that only the received
+        // part of the buffer tells the drift.
+        if (playback->compensate) {
+            drift_update(&playback->drift, ahead / stream_bytes_per_second);
+        }
+        output = playback->data + (playback->ring > 0
+                                   ? position % playback->ring : position);
+        if (playback->in_format != playback->out_format) {
+            convert(output, playback->in_format, out_buffer,
+                    playback->out_format, chunk, &playback->dither);
+            output = out_buffer;
+        }
+        out_chunk = chunk;
+        if (playback->compensate) {
+            out_chunk = drift_resample(&playback->drift, output,
+                                       chunk / playback->channels, resampled)
+                      * playback->channels;
+            output = resampled;
+        }
+        if (sink_write(playback->sink, output, out_chunk * out_length) < 0) {
+            return -1;
+        }
+        position += chunk * in_length;
+        ahead -= chunk * in_length;
+    }
+
+    return 0;
+}
+
+
+/**
+ * Print the output latency and the underruns of the playback.
+ */
+void playback_report(struct playback* playback) {
+    assert(playback != NULL);
+
+    if (playback->nb_delays == 0) {
+        return;
+    }
+    printf("latency_avg_ms=%.1f latency_max_ms=%.1f underruns=%d "
+           "rebuffers=%d drift_ppm=%.1f",
+           1000.0 * playback->total_delay / playback->nb_delays
+                  / playback->bytes_per_second,
+           1000.0 * playback->max_delay / playback->bytes_per_second,
+           playback->nb_underruns, playback->nb_rebuffers,
+           playback->compensate ? playback->drift.ppm : 0.0);
+    if (playback->ring > 0) {
+        printf(" overruns=%d", playback->nb_overruns);
+    }
+    printf("\n");
+}
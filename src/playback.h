@@ -0,0 +1,93 @@
+/* Distributed under the terms of the GNU General Public License v2 */
+/* L3info - SYR2 Project - SYR DeaDBeeF
+ * ============================================================================
+ * Playback
+ * ----------------------------------------------------------------------------
+ * Playback of a stream while it is being received. The stream is played once
+ * enough of it is received ahead of the playback position: the prebuffer.
+ * Playback waits again for the prebuffer whenever it catches up with the
+ * reception. A deeper prebuffer means fewer of these rebufferings, but a
+ * later start.
+ *
+ * In low latency mode, the audio output holds a few fragments only, see
+ * sink_open(), and exactly what it can take is written, so that no write
+ * blocks. Otherwise, writes block until the audio output has room.
+ *
+ * The delay of the audio output is sampled before each write, and the times
+ * it ran dry are counted as underruns.
+ *
+ * The occupancy of the jitter buffer is sampled to the telemetry of the
+ * stream if any, see qos.h.
+ *
+ * Optionally, the drift between the pace of the stream and the clock of the
+ * audio output is compensated, so that the buffer holds the prebuffer, see
+ * drift.h.
+ *
+ * Streams of the same format can follow one another on the audio output
+ * without a gap, see playback_next(): the next stream starts as soon as a
+ * frame of it is received, and the statistics, the dither and the drift
+ * carry on.
+ *
+ * A live stream has no end and is received to a ring, see playback.ring: the
+ * receiver mirrors the first packet of the ring right after its end, so that
+ * a frame may straddle the end of the ring. Should the receiver come close to
+ * lapping the playback, the playback skips ahead to the prebuffer, which is
+ * counted as an overrun.
+ * ----------------------------------------------------------------------------
+ * Antoine Pinsard
+ * Oct. 19, 2026
+ */
+#ifndef _PLAYBACK_H_
+#define _PLAYBACK_H_
+
+#include "convert.h"
+#include "deadbeef.h"
+#include "drift.h"
+#include "qos.h"
+#include "sink.h"
+
+// Number of samples converted and written to the audio output at once
+#define PLAYBACK_CHUNK 4096
+// Default prebuffer in milliseconds
+#define PLAYBACK_PREBUFFER 100
+// Delay between two checks of the reception or of the audio output, in
+// microseconds, when there is nothing to play or no room to play it
+#define PLAYBACK_POLL_PERIOD 2000
+
+struct playback {
+    struct sink* sink;          // Audio output
+    const unsigned char* data;  // The stream, filled as it is received
+    int nb_packets;
+    size_t length;              // Bytes to play, 0 for the whole packets
+    // Bytes of the ring the stream wraps around in, followed by a mirror of
+    // its first DATA_LENGTH bytes, or 0 if the stream is not live
+    size_t ring;
+    volatile int* received;     // Number of packets received so far
+    int in_format;              // Sample format of the stream
+    int out_format;             // Sample format of the audio output
+    int channels;
+    int bytes_per_second;       // Of the audio output
+    size_t prebuffer;           // Bytes of the stream
+    int low_latency;
+    int compensate;             // Compensate the drift, see drift.h
+    struct dither dither;
+    struct drift drift;
+    struct qos* qos;            // Telemetry of the stream, or NULL
+    int started;                // The audio output is playing already
+    // Statistics
+    int nb_underruns;
+    int nb_rebuffers;
+    int nb_overruns;
+    int nb_delays;
+    long long total_delay;      // Bytes
+    int max_delay;
+};
+
+void playback_init(struct playback*, struct sink*, const unsigned char*, int,
+                   volatile int*);
+void playback_next(struct playback*, const unsigned char*, int, size_t,
+                   volatile int*);
+int playback_run(struct playback*, volatile sig_atomic_t*);
+void playback_report(struct playback*);
+
+#endif
@@ -10,21 +10,318 @@
  */
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <unistd.h>
 #include "player.h"
-#include "sysprog-audio/audio.h"
+
+
+/**
+ * Return sample i of samples of the given format, 16-bit or 32-bit.
+ */
+static inline int32_t get_sample(const unsigned char* data, int format,
+                                 size_t i)
+{
+    return format == CONVERT_S16 ? ((const int16_t*) data)[i]
+                                 : ((const int32_t*) data)[i];
+}
+
+
+/**
+ * Set sample i of samples of the given format, 16-bit or 32-bit.
+ */
+static inline void set_sample(unsigned char* data, int format, size_t i,
+                              int32_t sample)
+{
+    if (format == CONVERT_S16) {
+        ((int16_t*) data)[i] = sample;
+    }
+    else {
+        ((int32_t*) data)[i] = sample;
+    }
+}
+
+
+/**
+ * Remix in place nb_frames frames of samples of the given format from
+ * in_channels to out_channels channels. The channels are averaged into a
+ * mono output, extra ones are dropped, and missing ones repeat the input
+ * channels. data must hold the frames of either count of channels.
+ */
+static void remix(unsigned char* data, int format, size_t nb_frames,
+                  int in_channels, int out_channels)
+{
+    int64_t sum;
+    size_t frame;
+    int c;
+
+    if (out_channels == 1) {
+        for (frame = 0; frame < nb_frames; frame++) {
+            sum = 0;
+            for (c = 0; c < in_channels; c++) {
+                sum += get_sample(data, format, frame * in_channels + c);
+            }
+            set_sample(data, format, frame, sum / in_channels);
+        }
+    }
+    else if (out_channels < in_channels) {
+        for (frame = 0; frame < nb_frames; frame++) {
+            for (c = 0; c < out_channels; c++) {
+                set_sample(data, format, frame * out_channels + c,
+                           get_sample(data, format, frame * in_channels + c));
+            }
+        }
+    }
+    else {
+        // Frames are spread from the last one, not to overwrite the next.
+        for (frame = nb_frames; frame-- > 0;) {
+            for (c = out_channels - 1; c >= 0; c--) {
+                set_sample(data, format, frame * out_channels + c,
+                           get_sample(data, format, frame * in_channels
+                                                    + c % in_channels));
+            }
+        }
+    }
+}
+
+
+/**
+ * Reader thread: convert the samples of the file to the free periods of the
+ * ring, from the current position up to the end of the file, in the format
+ * the audio output accepted.
+ */
+void* read_periods(void* arg) {
+    struct player* player = arg;
+    struct period* period;
+    size_t position
+         , len
+         , nb_samples;
+    unsigned long seeks;
+    int in_channels;
+
+    in_channels = player->source.info.channels;
+
+    pthread_mutex_lock(&player->lock);
+    while (!player->done) {
+        if (player->count == PLAYER_NB_PERIODS ||
+            player->position >= player->source.length)
+        {
+            pthread_cond_wait(&player->changed, &player->lock);
+            continue;
+        }
+        period = &player->periods[(player->head + player->count)
+                                  % PLAYER_NB_PERIODS];
+        position = player->position;
+        seeks = player->seeks;
+        pthread_mutex_unlock(&player->lock);
+
+        // Free periods are not accessed by the writer.
+        len = player->source.length - position;
+        if (len > player->period_length) {
+            len = player->period_length;
+        }
+        nb_samples = len / convert_sample_length(player->in_format);
+        convert(player->source.data + position, player->in_format,
+                period->data, player->out_format, nb_samples,
+                &player->dither);
+        if (player->channels != in_channels) {
+            nb_samples = nb_samples / in_channels * player->channels;
+            remix(period->data, player->out_format,
+                  nb_samples / player->channels, in_channels,
+                  player->channels);
+        }
+        period->length = nb_samples * convert_sample_length(player->out_format);
+        period->position = position + len;
+
+        pthread_mutex_lock(&player->lock);
+        // The period is dropped if a seek happened meanwhile.
+        if (seeks == player->seeks) {
+            player->count++;
+            player->position = position + len;
+            pthread_cond_broadcast(&player->changed);
+        }
+    }
+    pthread_mutex_unlock(&player->lock);
+
+    return NULL;
+}
+
+
+/**
+ * Writer thread: write the ready periods to the audio output until the end
+ * of the file or until the player is stopped.
+ */
+void* write_periods(void* arg) {
+    struct player* player = arg;
+    struct period* period;
+    unsigned long seeks;
+    ssize_t ret;
+
+    pthread_mutex_lock(&player->lock);
+    while (!player->done) {
+        if (player->paused || player->count == 0) {
+            if (!player->paused &&
+                player->position >= player->source.length)
+            {
+                player->done = 1;
+                pthread_cond_broadcast(&player->changed);
+                break;
+            }
+            pthread_cond_wait(&player->changed, &player->lock);
+            continue;
+        }
+        // The head period stays in the ring while it is written, so that
+        // the reader does not reuse it, even after a seek.
+        period = &player->periods[player->head];
+        player->writing = 1;
+        seeks = player->seeks;
+        pthread_mutex_unlock(&player->lock);
+
+        ret = sink_write(&player->sink, period->data, period->length);
+
+        pthread_mutex_lock(&player->lock);
+        player->writing = 0;
+        if (ret < 0) {
+            perror("Error while writing to the audio output");
+            player->done = 1;
+            pthread_cond_broadcast(&player->changed);
+            break;
+        }
+        if (seeks == player->seeks) {
+            player->played = period->position;
+        }
+        player->head = (player->head + 1) % PLAYER_NB_PERIODS;
+        player->count--;
+        pthread_cond_broadcast(&player->changed);
+    }
+    pthread_mutex_unlock(&player->lock);
+
+    return NULL;
+}
+
+
+/**
+ * Drop the periods not written yet and what the audio output has not played
+ * yet, then restart reading at the given position. The lock must be held.
+ */
+static void restart(struct player* player, size_t position) {
+    size_t frame_length;
+
+    frame_length = player->source.info.channels
+                 * player->source.info.sample_size / 8;
+    position -= position % frame_length;
+    if (position > player->source.length) {
+        position = player->source.length;
+    }
+
+    sink_reset(&player->sink);
+    player->count = player->writing ? 1 : 0;
+    player->position = position;
+    player->played = position;
+    player->seeks++;
+    pthread_cond_broadcast(&player->changed);
+}
+
+
+/**
+ * Pause or resume the playback. Playback stops at once: the samples the
+ * audio output still holds are dropped and played again on resume.
+ */
+void player_pause(struct player* player) {
+    int delay;
+    size_t position;
+
+    pthread_mutex_lock(&player->lock);
+    if (!player->paused) {
+        position = player->played;
+        if ((delay = sink_delay(&player->sink)) > 0)
+        {
+            delay = delay / convert_sample_length(player->out_format)
+                  / player->channels * player->source.info.channels
+                  * convert_sample_length(player->in_format);
+            position = (size_t) delay < position ? position - delay : 0;
+        }
+        restart(player, position);
+    }
+    player->paused = !player->paused;
+    pthread_cond_broadcast(&player->changed);
+    pthread_mutex_unlock(&player->lock);
+}
+
+
+/**
+ * Seek to the given second of the file, or by the given number of seconds if
+ * relative is not zero.
+ */
+void player_seek(struct player* player, double seconds, int relative) {
+    double frame_length;
+    int rate;
+
+    // Positions are in the samples of the file, whatever the audio output
+    // plays.
+    frame_length = player->source.info.channels
+                 * player->source.info.sample_size / 8;
+    rate = player->source.info.sample_rate;
+
+    pthread_mutex_lock(&player->lock);
+    if (relative) {
+        seconds += player->played / frame_length / rate;
+    }
+    if (seconds < 0) {
+        seconds = 0;
+    }
+    restart(player, (size_t) (seconds * rate) * frame_length);
+    pthread_mutex_unlock(&player->lock);
+}
+
+
+/**
+ * Control thread: apply the commands read from the standard input, see
+ * player.h.
+ */
+void* control(void* arg) {
+    struct player* player = arg;
+    char line[64];
+    double seconds;
+
+    while (fgets(line, sizeof(line), stdin) != NULL) {
+        switch (line[0]) {
+            case 'p':
+                player_pause(player);
+                break;
+            case 's':
+                if (sscanf(line+1, "%lf", &seconds) == 1) {
+                    player_seek(player, seconds, 0);
+                }
+                break;
+            case '+':
+            case '-':
+                if (sscanf(line, "%lf", &seconds) == 1) {
+                    player_seek(player, seconds, 1);
+                }
+                break;
+            case 'q':
+                pthread_mutex_lock(&player->lock);
+                player->done = 1;
+                pthread_cond_broadcast(&player->changed);
+                pthread_mutex_unlock(&player->lock);
+                return NULL;
+        }
+    }
+
+    return NULL;
+}
 
 
 int main(int argc, char** argv) {
 
     char* filename;
-    FILE* file;
-    char* buffer;
-    unsigned long file_length;
-    int sample_rate;
-    int sample_size;
-    int channels;
-    int audout_fd;
+    struct player* player;
+    pthread_t reader
+            , writer
+            , controller;
+    int size
+      , frame_length
+      , nb_frames;
 
     if (argc != 2) {
         fprintf(stderr, "%s expects exactly one argument. %d found.\n",
@@ -34,46 +331,88 @@ int main(int argc, char** argv) {
 
     filename = argv[1];
 
-    if (aud_readinit(filename, &sample_rate, &sample_size, &channels) < 0) {
-        perror("Error while attempting to read the audio file");
+    player = calloc(1, sizeof(struct player));
+    if (player == NULL) {
+        perror("Allocation failed");
         exit(EXIT_FAILURE);
     }
 
-    audout_fd = aud_writeinit(sample_rate, sample_size, channels);
-    if (audout_fd < 0) {
-        perror("Error while attempting to play the audio file");
+    // The file is opened once and its samples are read from its mapping.
+    if (aud_open(filename, &player->source) < 0) {
+        perror("Error while attempting to read the audio file");
         exit(EXIT_FAILURE);
     }
 
-    file = fopen(filename, "rb");
-    if (file == NULL) {
-        fprintf(stderr,
-                "An error happend while attempting to open %s for reading.\n",
-                filename);
-        perror("");
+    player->in_format = convert_format(player->source.info.format,
+                                       player->source.info.sample_size);
+    if (player->in_format < 0) {
+        fprintf(stderr, "Unsupported sample format.\n");
         exit(EXIT_FAILURE);
     }
 
-    // Get file length
-    fseek(file, 0, SEEK_END);
-    file_length = ftell(file);
-    fseek(file, 0, SEEK_SET);
-
-    // Allocate buffer
-    buffer = (char*) malloc(file_length+1);
-    if (buffer == NULL) {
-        perror("Memory error");
+    // The audio output may play another sample size or another number of
+    // channels than the file's ones.
+    player->rate = player->source.info.sample_rate;
+    size = convert_device_size(player->in_format);
+    player->channels = player->source.info.channels;
+    if (sink_open(&player->sink, NULL, &player->rate, &size,
+                  &player->channels, NULL) < 0)
+    {
+        perror("Error while attempting to play the audio file");
+        exit(EXIT_FAILURE);
+    }
+    player->out_format = convert_device_format(size);
+    if (player->out_format < 0) {
+        fprintf(stderr, "Unsupported audio output sample size: %d\n", size);
+        exit(EXIT_FAILURE);
+    }
+    if (player->channels < 1) {
+        fprintf(stderr, "Unsupported audio output channels: %d\n",
+                player->channels);
         exit(EXIT_FAILURE);
     }
+    // Samples are not resampled.
+    if (player->rate != player->source.info.sample_rate) {
+        fprintf(stderr, "The audio output plays at %d Hz instead of %d Hz.\n",
+                player->rate, player->source.info.sample_rate);
+    }
 
-    // Read file into buffer
-    fread(buffer, file_length, 1, file);
+    // Periods hold whole frames, which take more room once spread over more
+    // channels.
+    frame_length = convert_sample_length(player->in_format)
+                 * player->source.info.channels;
+    nb_frames = PLAYER_PERIOD_LENGTH / frame_length;
+    if (player->channels > player->source.info.channels) {
+        nb_frames = nb_frames * player->source.info.channels
+                  / player->channels;
+    }
+    player->period_length = (nb_frames > 0 ? nb_frames : 1) * frame_length;
+    dither_init(&player->dither, getpid());
+    pthread_mutex_init(&player->lock, NULL);
+    pthread_cond_init(&player->changed, NULL);
 
-    fclose(file);
+    if (pthread_create(&reader, NULL, read_periods, player) != 0 ||
+        pthread_create(&writer, NULL, write_periods, player) != 0 ||
+        pthread_create(&controller, NULL, control, player) != 0)
+    {
+        fprintf(stderr, "Unable to start the playback threads.\n");
+        exit(EXIT_FAILURE);
+    }
+    // The controller may wait for a command forever.
+    pthread_detach(controller);
 
-    write(audout_fd, buffer, file_length * sizeof(char));
+    pthread_join(writer, NULL);
+    pthread_mutex_lock(&player->lock);
+    player->done = 1;
+    pthread_cond_broadcast(&player->changed);
+    pthread_mutex_unlock(&player->lock);
+    pthread_join(reader, NULL);
 
-    free(buffer);
+    pthread_cond_destroy(&player->changed);
+    pthread_mutex_destroy(&player->lock);
+    aud_close(&player->source);
+    sink_close(&player->sink);
+    free(player);
 
     return EXIT_SUCCESS;
 }
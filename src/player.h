@@ -4,6 +4,23 @@
  * Player Header
  * ----------------------------------------------------------------------------
  * The player reads a WAV file passed as argument.
+ *
+ * A reader thread converts the samples of the mapped file to a ring of
+ * periods, that a writer thread writes to the audio output. Playback starts
+ * as soon as the first period is ready, and memory usage does not depend on
+ * the size of the file.
+ *
+ * Playback is controlled by commands read from the standard input, one per
+ * line:
+ *
+ *  p           pause or resume
+ *  s <sec>     seek to the given second
+ *  +<sec>      seek forward
+ *  -<sec>      seek backward
+ *  q           quit
+ *
+ * The audio output is selected by the AUDIOSINK environment variable, see
+ * sink.h.
  * ----------------------------------------------------------------------------
  * Antoine Pinsard
  * Feb. 26, 2015
@@ -11,4 +28,49 @@
 #ifndef _PLAYER_H_
 #define _PLAYER_H_
 
+#include <pthread.h>
+#include "convert.h"
+#include "sink.h"
+#include "sysprog-audio/audio.h"
+
+// Number of bytes of the file played at once
+#define PLAYER_PERIOD_LENGTH 4096
+// Number of periods buffered between the reader and the writer
+#define PLAYER_NB_PERIODS 4
+
+struct period {
+    size_t length;      // Number of bytes to write
+    size_t position;    // Position in the samples of the file once played
+    unsigned char data[2 * PLAYER_PERIOD_LENGTH];
+};
+
+struct player {
+    struct aud_source source;
+    struct sink sink;
+    int in_format;
+    int out_format;
+    int rate;             // Sample rate of the audio output
+    int channels;         // Channels of the audio output
+    size_t period_length; // Bytes of the file per period, whole frames
+    struct dither dither;
+
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    struct period periods[PLAYER_NB_PERIODS];
+    int head;             // First ready period
+    int count;            // Number of ready periods
+    int writing;          // The head period is being written
+    size_t position;      // Position of the next period to read
+    size_t played;        // Position of the last written period
+    unsigned long seeks;  // Number of seeks, to drop outdated periods
+    int paused;
+    int done;
+};
+
+void* read_periods(void*);
+void* write_periods(void*);
+void* control(void*);
+void player_pause(struct player*);
+void player_seek(struct player*, double, int);
+
 #endif
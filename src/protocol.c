@@ -0,0 +1,283 @@
+/* Distributed under the terms of the GNU General Public License v2 */
+/* L3info - SYR2 Project - SYR DeaDBeeF
+ * ============================================================================
+ * Protocol
+ * ----------------------------------------------------------------------------
+ * Encoding and decoding of the messages of the protocol.
+ * ----------------------------------------------------------------------------
+ * Antoine Pinsard
+ * Oct. 19, 2026
+ */
+#include "protocol.h"
+
+
+/**
+ * Write a record of a stats response at pos, see deadbeef.h.
+ *
+ * Return the position of the next record, or -1 if it does not fit.
+ */
+int protocol_encode_stats_record(unsigned char* output, int pos,
+                                 const struct stats_record* record)
+{
+    int i;
+
+    assert(output != NULL);
+    assert(record != NULL);
+
+    if (pos + STATS_RECORD_LENGTH(record->nb_buckets) > MSG_LENGTH-1) {
+        return -1;
+    }
+    output[pos] = record->active;
+    protocol_put_le(output+pos+1, record->addr, 4);
+    protocol_put_le(output+pos+5, record->port, 2);
+    protocol_put_le(output+pos+7, record->nb_sessions, 4);
+    protocol_put_le(output+pos+11, record->packets_sent, 8);
+    protocol_put_le(output+pos+19, record->send_errors, 8);
+    protocol_put_le(output+pos+27, record->send_eagain, 8);
+    protocol_put_le(output+pos+35, record->heartbeats, 8);
+    protocol_put_le(output+pos+43, record->timeouts, 8);
+    protocol_put_le(output+pos+51, record->rejections, 8);
+    pos += 59;
+    for (i = 0; i < record->nb_buckets; i++) {
+        protocol_put_le(output+pos, record->lateness[i], 8);
+        pos += 8;
+    }
+    protocol_put_digest(output+pos, &record->digest);
+
+    return pos + HEARTBEAT_DIGEST_LENGTH;
+}
+
+
+/**
+ * Read the record of a stats response at pos, whose number of lateness
+ * buckets is set in record beforehand.
+ *
+ * Return the position of the next record, or -1 if the record overflows the
+ * message or has too many buckets.
+ */
+int protocol_decode_stats_record(const unsigned char* input, int pos,
+                                 struct stats_record* record)
+{
+    int i;
+
+    assert(input != NULL);
+    assert(record != NULL);
+
+    if (record->nb_buckets > PROTOCOL_MAX_BUCKETS ||
+        pos + STATS_RECORD_LENGTH(record->nb_buckets) > MSG_LENGTH-1)
+    {
+        return -1;
+    }
+    record->active = input[pos];
+    record->addr = protocol_get_le(input+pos+1, 4);
+    record->port = protocol_get_le(input+pos+5, 2);
+    record->nb_sessions = protocol_get_le(input+pos+7, 4);
+    record->packets_sent = protocol_get_le(input+pos+11, 8);
+    record->send_errors = protocol_get_le(input+pos+19, 8);
+    record->send_eagain = protocol_get_le(input+pos+27, 8);
+    record->heartbeats = protocol_get_le(input+pos+35, 8);
+    record->timeouts = protocol_get_le(input+pos+43, 8);
+    record->rejections = protocol_get_le(input+pos+51, 8);
+    pos += 59;
+    for (i = 0; i < record->nb_buckets; i++) {
+        record->lateness[i] = protocol_get_le(input+pos, 8);
+        pos += 8;
+    }
+    protocol_get_digest(input+pos, &record->digest);
+
+    return pos + HEARTBEAT_DIGEST_LENGTH;
+}
+
+
+/**
+ * Write a playlist request of the nb_tracks given filenames.
+ *
+ * Return 0, or -1 if there are too many tracks or their names do not fit.
+ */
+int protocol_encode_playlist(unsigned char* output, const char** filenames,
+                             int nb_tracks, int variant, int capabilities)
+{
+    int length
+      , pos
+      , i;
+
+    assert(output != NULL);
+    assert(filenames != NULL);
+
+    if (nb_tracks <= 0 || nb_tracks > PLAYLIST_MAX_TRACKS) {
+        return -1;
+    }
+    pos = PLAYLIST_HEADER_LENGTH;
+    for (i = 0; i < nb_tracks; i++) {
+        length = strlen(filenames[i]) + 1;
+        if (pos + length > MSG_LENGTH-1) {
+            return -1;
+        }
+        memcpy(output+pos, filenames[i], length);
+        pos += length;
+    }
+    output[1] = variant;
+    output[2] = capabilities;
+    output[3] = nb_tracks;
+    protocol_seal(output, REQ_PLAYLIST, pos);
+
+    return 0;
+}
+
+
+/**
+ * Read a playlist request, whose filenames are terminated within the message.
+ *
+ * Return 0, or -1 if the request has no track, too many tracks, or if its
+ * filenames overflow the message.
+ */
+int protocol_decode_playlist(unsigned char* input,
+                             struct playlist_request* request)
+{
+    const unsigned char* end;
+    int pos
+      , i;
+
+    assert(input != NULL);
+    assert(request != NULL);
+
+    request->variant = input[1];
+    request->capabilities = input[2];
+    request->nb_tracks = input[3];
+    request->mixed = 0;
+    if (request->nb_tracks == 0 || request->nb_tracks > PLAYLIST_MAX_TRACKS) {
+        return -1;
+    }
+    pos = PLAYLIST_HEADER_LENGTH;
+    for (i = 0; i < request->nb_tracks; i++) {
+        end = memchr(input+pos, '\0', MSG_LENGTH-1 - pos);
+        if (end == NULL) {
+            return -1;
+        }
+        request->filenames[i] = (const char*) input + pos;
+        pos = end - input + 1;
+    }
+
+    return 0;
+}
+
+
+/**
+ * Write a mix request of the nb_inputs given filenames, mixed with the given
+ * gains.
+ *
+ * Return 0, or -1 if there are too many inputs or their names do not fit.
+ */
+int protocol_encode_mix(unsigned char* output, const char** filenames,
+                        const int* gains, int nb_inputs, int variant,
+                        int capabilities)
+{
+    int length
+      , pos
+      , i;
+
+    assert(output != NULL);
+    assert(filenames != NULL);
+    assert(gains != NULL);
+
+    if (nb_inputs <= 0 || nb_inputs > MIX_MAX_INPUTS) {
+        return -1;
+    }
+    pos = MIX_HEADER_LENGTH;
+    for (i = 0; i < nb_inputs; i++) {
+        length = strlen(filenames[i]) + 1;
+        if (pos + 2 + length > MSG_LENGTH-1) {
+            return -1;
+        }
+        protocol_put_le(output+pos, gains[i], 2);
+        memcpy(output+pos+2, filenames[i], length);
+        pos += 2 + length;
+    }
+    output[1] = variant;
+    output[2] = capabilities;
+    output[3] = nb_inputs;
+    protocol_seal(output, REQ_MIX, pos);
+
+    return 0;
+}
+
+
+/**
+ * Read a mix request as a playlist whose tracks are mixed. Gains beyond
+ * MIX_MAX_GAIN are clamped.
+ *
+ * Return 0, or -1 if the request has no input, too many inputs, or if its
+ * inputs overflow the message.
+ */
+int protocol_decode_mix(unsigned char* input,
+                        struct playlist_request* request)
+{
+    const unsigned char* end;
+    int pos
+      , i;
+
+    assert(input != NULL);
+    assert(request != NULL);
+
+    request->variant = input[1];
+    request->capabilities = input[2];
+    request->nb_tracks = input[3];
+    request->mixed = 1;
+    if (request->nb_tracks == 0 || request->nb_tracks > MIX_MAX_INPUTS) {
+        return -1;
+    }
+    pos = MIX_HEADER_LENGTH;
+    for (i = 0; i < request->nb_tracks; i++) {
+        if (pos + 2 >= MSG_LENGTH-1) {
+            return -1;
+        }
+        request->gains[i] = protocol_get_le(input+pos, 2);
+        if (request->gains[i] > MIX_MAX_GAIN) {
+            request->gains[i] = MIX_MAX_GAIN;
+        }
+        pos += 2;
+        end = memchr(input+pos, '\0', MSG_LENGTH-1 - pos);
+        if (end == NULL) {
+            return -1;
+        }
+        request->filenames[i] = (const char*) input + pos;
+        pos = end - input + 1;
+    }
+
+    return 0;
+}
+
+
+/**
+ * Return the name of the given message type.
+ */
+const char* protocol_type_name(int type) {
+    switch (type) {
+        case REQ_STREAMING:
+            return "streaming";
+        case REQ_HEARTBEAT:
+            return "heartbeat";
+        case REQ_CATALOG:
+            return "catalog_request";
+        case REQ_STATS:
+            return "stats_request";
+        case REQ_PLAYLIST:
+            return "playlist";
+        case REQ_MIX:
+            return "mix";
+        case RESP_STREAMINFO:
+            return "streaminfo";
+        case RESP_DATA:
+            return "data";
+        case RESP_ERROR:
+            return "error";
+        case RESP_CATALOG:
+            return "catalog";
+        case RESP_PACKED:
+            return "packed";
+        case RESP_STATS:
+            return "stats";
+        default:
+            return "unknown";
+    }
+}
@@ -0,0 +1,525 @@
+/* Distributed under the terms of the GNU General Public License v2 */
+/* L3info - SYR2 Project - SYR DeaDBeeF
+ * ============================================================================
+ * Protocol Header
+ * ----------------------------------------------------------------------------
+ * Encoding and decoding of the messages of the protocol, see deadbeef.h for
+ * their layout.
+ *
+ * Each message type has a fixed-layout header struct, written to a message by
+ * protocol_encode_<type>() and read from one by protocol_decode_<type>().
+ * Integers are little endian on the wire. Encoders write the header, and the
+ * caller the payload if any, then protocol_seal() zeroes the rest of the
+ * message once and writes the trailing type byte: messages are never cleared
+ * beforehand.
+ *
+ * A received message is checked with protocol_type() first, which ensures it
+ * is MSG_LENGTH long, so that its fixed-layout header can be read. Decoders of
+ * variable parts, catalog entries, packed blocks and stats records, check
+ * their bounds and return -1 if the message is corrupted. Decoders of strings
+ * terminate them within the message, which is why they take it writable.
+ * ----------------------------------------------------------------------------
+ * Antoine Pinsard
+ * Oct. 19, 2026
+ */
+#ifndef _PROTOCOL_H_
+#define _PROTOCOL_H_
+
+#include <stdint.h>
+#include "deadbeef.h"
+
+// Largest number of lateness buckets of a stats record that is decoded
+#define PROTOCOL_MAX_BUCKETS 64
+
+struct streaming_request {
+    const char* filename; // Terminated, within the message
+    int variant;
+    int capabilities;
+};
+
+struct playlist_request {
+    int variant;
+    int capabilities;
+    int nb_tracks;
+    // Terminated, within the message
+    const char* filenames[PLAYLIST_MAX_TRACKS];
+    // The tracks are mixed with these gains into a single stream rather than
+    // streamed one after another, see REQ_MIX.
+    int mixed;
+    int gains[PLAYLIST_MAX_TRACKS];
+};
+
+struct streaminfo {
+    uint32_t sample_rate;
+    uint32_t sample_size;
+    uint32_t channels;
+    uint32_t nb_packets;
+    int encoding;
+    int format;
+    int track;
+    int nb_tracks;
+    uint32_t first_packet;
+    uint32_t total_packets;
+    uint32_t length;      // Bytes
+    int flags;            // STREAMINFO_LIVE
+};
+
+struct error_message {
+    uint32_t code;
+    const char* message;  // Terminated, within the message
+};
+
+struct catalog_request {
+    int mode;
+    uint32_t offset;
+    const char* pattern;  // Terminated, within the message
+};
+
+struct catalog_response {
+    uint32_t nb_matches;
+    uint32_t offset;
+    int nb_entries;
+};
+
+struct catalog_record {
+    int format;
+    int channels;
+    int sample_size;
+    uint32_t sample_rate;
+    uint32_t duration;    // Milliseconds
+    int name_length;
+    const char* name;     // Not terminated
+};
+
+struct packed_header {
+    uint32_t first_block;
+    int nb_blocks;
+};
+
+struct heartbeat_digest {
+    int valid;            // The client sent a digest
+    uint32_t received;
+    uint32_t lost;
+    uint32_t reordered;
+    uint32_t duplicates;
+    uint32_t jitter_us;
+    uint32_t buffer_ms;
+    uint32_t underruns;
+    uint32_t highest;     // Latest block received, for the round-trip time
+};
+
+struct stats_header {
+    uint32_t uptime;      // Seconds
+    int nb_slots;
+    int nb_buckets;
+};
+
+struct stats_record {
+    int active;
+    uint32_t addr;        // Host byte order
+    int port;
+    uint32_t nb_sessions;
+    uint64_t packets_sent;
+    uint64_t send_errors;
+    uint64_t send_eagain;
+    uint64_t heartbeats;
+    uint64_t timeouts;
+    uint64_t rejections;
+    int nb_buckets;
+    uint64_t lateness[PROTOCOL_MAX_BUCKETS];
+    struct heartbeat_digest digest;
+};
+
+int protocol_encode_stats_record(unsigned char*, int,
+                                 const struct stats_record*);
+int protocol_decode_stats_record(const unsigned char*, int,
+                                 struct stats_record*);
+int protocol_encode_playlist(unsigned char*, const char**, int, int, int);
+int protocol_decode_playlist(unsigned char*, struct playlist_request*);
+int protocol_encode_mix(unsigned char*, const char**, const int*, int, int,
+                        int);
+int protocol_decode_mix(unsigned char*, struct playlist_request*);
+const char* protocol_type_name(int);
+
+
+/**
+ * Write the n lowest bytes of value to output, least significant first.
+ */
+static inline void protocol_put_le(unsigned char* output, uint64_t value,
+                                   int n)
+{
+    int i;
+
+    for (i = 0; i < n; i++) {
+        output[i] = (value >> (8*i)) & 0xFF;
+    }
+}
+
+/**
+ * Read the n bytes at input as a little endian unsigned integer.
+ */
+static inline uint64_t protocol_get_le(const unsigned char* input, int n) {
+    uint64_t value;
+    int i;
+
+    value = 0;
+    for (i = 0; i < n; i++) {
+        value |= (uint64_t) input[i] << (8*i);
+    }
+
+    return value;
+}
+
+/**
+ * Finish the message of the given type whose first length bytes are written:
+ * the rest is zeroed and the type is written at both ends.
+ */
+static inline void protocol_seal(unsigned char* output, int type, int length)
+{
+    output[0] = type;
+    if (length < MSG_LENGTH-1) {
+        memset(output + length, 0, MSG_LENGTH-1 - length);
+    }
+    output[MSG_LENGTH-1] = type;
+}
+
+/**
+ * Return the type of the received message of the given length, or -1 if it
+ * is malformed.
+ */
+static inline int protocol_type(const unsigned char* input, int length) {
+    if (length != MSG_LENGTH || input[0] != input[MSG_LENGTH-1]) {
+        return -1;
+    }
+    return input[0];
+}
+
+/**
+ * Write a request that has no parameter, such as REQ_STATS.
+ */
+static inline void protocol_encode_request(unsigned char* output, int type) {
+    protocol_seal(output, type, 1);
+}
+
+static inline void protocol_encode_streaming(unsigned char* output,
+                                             const char* filename,
+                                             int variant, int capabilities)
+{
+    int length;
+
+    length = strlen(filename);
+    if (length > STREAMING_VARIANT_POS - 2) {
+        length = STREAMING_VARIANT_POS - 2;
+    }
+    memcpy(output+1, filename, length);
+    memset(output+1+length, 0, STREAMING_VARIANT_POS-1 - length);
+    output[STREAMING_VARIANT_POS] = variant;
+    output[STREAMING_CAPS_POS] = capabilities;
+    output[0] = REQ_STREAMING;
+    output[MSG_LENGTH-1] = REQ_STREAMING;
+}
+
+static inline void protocol_decode_streaming(unsigned char* input,
+                                             struct streaming_request* request)
+{
+    input[STREAMING_VARIANT_POS-1] = '\0';
+    request->filename = (const char*) input + 1;
+    request->variant = input[STREAMING_VARIANT_POS];
+    request->capabilities = input[STREAMING_CAPS_POS];
+}
+
+static inline void protocol_encode_streaminfo(unsigned char* output,
+                                              const struct streaminfo* info)
+{
+    protocol_put_le(output+1, info->sample_rate, 4);
+    protocol_put_le(output+5, info->sample_size, 4);
+    protocol_put_le(output+9, info->channels, 4);
+    protocol_put_le(output+13, info->nb_packets, 4);
+    output[STREAMINFO_ENCODING_POS] = info->encoding;
+    output[STREAMINFO_FORMAT_POS] = info->format;
+    output[STREAMINFO_TRACK_POS] = info->track;
+    output[STREAMINFO_NB_TRACKS_POS] = info->nb_tracks;
+    protocol_put_le(output+21, info->first_packet, 4);
+    protocol_put_le(output+25, info->total_packets, 4);
+    protocol_put_le(output+29, info->length, 4);
+    output[STREAMINFO_FLAGS_POS] = info->flags;
+    protocol_seal(output, RESP_STREAMINFO, STREAMINFO_HEADER_LENGTH);
+}
+
+static inline void protocol_decode_streaminfo(const unsigned char* input,
+                                              struct streaminfo* info)
+{
+    info->sample_rate = protocol_get_le(input+1, 4);
+    info->sample_size = protocol_get_le(input+5, 4);
+    info->channels = protocol_get_le(input+9, 4);
+    info->nb_packets = protocol_get_le(input+13, 4);
+    info->encoding = input[STREAMINFO_ENCODING_POS];
+    info->format = input[STREAMINFO_FORMAT_POS];
+    info->track = input[STREAMINFO_TRACK_POS];
+    info->nb_tracks = input[STREAMINFO_NB_TRACKS_POS];
+    info->first_packet = protocol_get_le(input+21, 4);
+    info->total_packets = protocol_get_le(input+25, 4);
+    info->length = protocol_get_le(input+29, 4);
+    info->flags = input[STREAMINFO_FLAGS_POS];
+}
+
+/**
+ * Write a data message, whose length bytes of data are already at
+ * output + DATA_HEADER_LENGTH.
+ */
+static inline void protocol_encode_data(unsigned char* output,
+                                        uint32_t packet_id, int length)
+{
+    protocol_put_le(output+1, packet_id, 4);
+    protocol_seal(output, RESP_DATA, DATA_HEADER_LENGTH + length);
+}
+
+/**
+ * Return the number of the packet carried by a data message.
+ */
+static inline uint32_t protocol_decode_data(const unsigned char* input) {
+    return protocol_get_le(input+1, 4);
+}
+
+/**
+ * Write a packed message, whose blocks are already written up to pos.
+ */
+static inline void protocol_encode_packed(unsigned char* output,
+                                          const struct packed_header* header,
+                                          int pos)
+{
+    protocol_put_le(output+1, header->first_block, 4);
+    output[5] = header->nb_blocks;
+    protocol_seal(output, RESP_PACKED, pos);
+}
+
+static inline void protocol_decode_packed(const unsigned char* input,
+                                          struct packed_header* header)
+{
+    header->first_block = protocol_get_le(input+1, 4);
+    header->nb_blocks = input[5];
+}
+
+/**
+ * Read the block of a packed message at pos: its data and length are stored
+ * to block and block_length.
+ *
+ * Return the position of the next block, or -1 if the block overflows the
+ * message.
+ */
+static inline int protocol_next_block(const unsigned char* input, int pos,
+                                      const unsigned char** block,
+                                      int* block_length)
+{
+    if (pos + 2 > MSG_LENGTH-1) {
+        return -1;
+    }
+    *block_length = protocol_get_le(input+pos, 2);
+    pos += 2;
+    if (pos + *block_length > MSG_LENGTH-1) {
+        return -1;
+    }
+    *block = input + pos;
+
+    return pos + *block_length;
+}
+
+/**
+ * Write an error message. The human-readable message is truncated if too
+ * long.
+ */
+static inline void protocol_encode_error(unsigned char* output, uint32_t code,
+                                         const char* message)
+{
+    int length;
+
+    length = message != NULL ? strlen(message) : 0;
+    if (length > MSG_LENGTH-2 - ERROR_HEADER_LENGTH) {
+        length = MSG_LENGTH-2 - ERROR_HEADER_LENGTH;
+    }
+    protocol_put_le(output+1, code, 4);
+    if (length > 0) {
+        memcpy(output + ERROR_HEADER_LENGTH, message, length);
+    }
+    protocol_seal(output, RESP_ERROR, ERROR_HEADER_LENGTH + length);
+}
+
+static inline void protocol_decode_error(unsigned char* input,
+                                         struct error_message* error)
+{
+    input[MSG_LENGTH-2] = '\0';
+    error->code = protocol_get_le(input+1, 4);
+    error->message = (const char*) input + ERROR_HEADER_LENGTH;
+}
+
+static inline void protocol_encode_catalog_request(unsigned char* output,
+                                                   int mode, uint32_t offset,
+                                                   const char* pattern)
+{
+    int length;
+
+    length = strlen(pattern);
+    if (length > MSG_LENGTH-2 - CATALOG_REQ_HEADER_LENGTH) {
+        length = MSG_LENGTH-2 - CATALOG_REQ_HEADER_LENGTH;
+    }
+    output[1] = mode;
+    protocol_put_le(output+2, offset, 4);
+    memcpy(output + CATALOG_REQ_HEADER_LENGTH, pattern, length);
+    protocol_seal(output, REQ_CATALOG, CATALOG_REQ_HEADER_LENGTH + length);
+}
+
+static inline void protocol_decode_catalog_request(
+        unsigned char* input, struct catalog_request* request)
+{
+    input[MSG_LENGTH-2] = '\0';
+    request->mode = input[1];
+    request->offset = protocol_get_le(input+2, 4);
+    request->pattern = (const char*) input + CATALOG_REQ_HEADER_LENGTH;
+}
+
+/**
+ * Write a catalog response, whose entries are already written up to pos.
+ */
+static inline void protocol_encode_catalog_response(
+        unsigned char* output, const struct catalog_response* response,
+        int pos)
+{
+    protocol_put_le(output+1, response->nb_matches, 4);
+    protocol_put_le(output+5, response->offset, 4);
+    protocol_put_le(output+9, response->nb_entries, 2);
+    protocol_seal(output, RESP_CATALOG, pos);
+}
+
+static inline void protocol_decode_catalog_response(
+        const unsigned char* input, struct catalog_response* response)
+{
+    response->nb_matches = protocol_get_le(input+1, 4);
+    response->offset = protocol_get_le(input+5, 4);
+    response->nb_entries = protocol_get_le(input+9, 2);
+}
+
+/**
+ * Write a catalog entry at pos.
+ *
+ * Return the position of the next entry, or -1 if it does not fit.
+ */
+static inline int protocol_put_catalog_record(unsigned char* output, int pos,
+                                              const struct catalog_record* r)
+{
+    if (pos + CATALOG_ENTRY_HEADER_LENGTH + r->name_length > MSG_LENGTH-1) {
+        return -1;
+    }
+    protocol_put_le(output+pos, r->format, 2);
+    protocol_put_le(output+pos+2, r->channels, 2);
+    protocol_put_le(output+pos+4, r->sample_size, 2);
+    protocol_put_le(output+pos+6, r->sample_rate, 4);
+    protocol_put_le(output+pos+10, r->duration, 4);
+    protocol_put_le(output+pos+14, r->name_length, 2);
+    pos += CATALOG_ENTRY_HEADER_LENGTH;
+    memcpy(output+pos, r->name, r->name_length);
+
+    return pos + r->name_length;
+}
+
+/**
+ * Read the catalog entry at pos.
+ *
+ * Return the position of the next entry, or -1 if the entry overflows the
+ * message.
+ */
+static inline int protocol_next_catalog_record(const unsigned char* input,
+                                               int pos,
+                                               struct catalog_record* r)
+{
+    if (pos + CATALOG_ENTRY_HEADER_LENGTH > MSG_LENGTH-1) {
+        return -1;
+    }
+    r->format = protocol_get_le(input+pos, 2);
+    r->channels = protocol_get_le(input+pos+2, 2);
+    r->sample_size = protocol_get_le(input+pos+4, 2);
+    r->sample_rate = protocol_get_le(input+pos+6, 4);
+    r->duration = protocol_get_le(input+pos+10, 4);
+    r->name_length = protocol_get_le(input+pos+14, 2);
+    pos += CATALOG_ENTRY_HEADER_LENGTH;
+    if (pos + r->name_length > MSG_LENGTH-1) {
+        return -1;
+    }
+    r->name = (const char*) input + pos;
+
+    return pos + r->name_length;
+}
+
+/**
+ * Write a heartbeat digest to output, HEARTBEAT_DIGEST_LENGTH long.
+ */
+static inline void protocol_put_digest(unsigned char* output,
+                                       const struct heartbeat_digest* digest)
+{
+    output[0] = digest->valid != 0;
+    protocol_put_le(output+1, digest->received, 4);
+    protocol_put_le(output+5, digest->lost, 4);
+    protocol_put_le(output+9, digest->reordered, 4);
+    protocol_put_le(output+13, digest->duplicates, 4);
+    protocol_put_le(output+17, digest->jitter_us, 4);
+    protocol_put_le(output+21, digest->buffer_ms, 4);
+    protocol_put_le(output+25, digest->underruns, 4);
+    protocol_put_le(output+29, digest->highest, 4);
+}
+
+static inline void protocol_get_digest(const unsigned char* input,
+                                       struct heartbeat_digest* digest)
+{
+    digest->valid = input[0] != 0;
+    digest->received = protocol_get_le(input+1, 4);
+    digest->lost = protocol_get_le(input+5, 4);
+    digest->reordered = protocol_get_le(input+9, 4);
+    digest->duplicates = protocol_get_le(input+13, 4);
+    digest->jitter_us = protocol_get_le(input+17, 4);
+    digest->buffer_ms = protocol_get_le(input+21, 4);
+    digest->underruns = protocol_get_le(input+25, 4);
+    digest->highest = protocol_get_le(input+29, 4);
+}
+
+/**
+ * Write a heartbeat, carrying digest unless it is NULL.
+ */
+static inline void protocol_encode_heartbeat(
+        unsigned char* output, const struct heartbeat_digest* digest)
+{
+    if (digest == NULL) {
+        protocol_seal(output, REQ_HEARTBEAT, HEARTBEAT_DIGEST_POS);
+        return;
+    }
+    protocol_put_digest(output + HEARTBEAT_DIGEST_POS, digest);
+    protocol_seal(output, REQ_HEARTBEAT,
+                  HEARTBEAT_DIGEST_POS + HEARTBEAT_DIGEST_LENGTH);
+}
+
+static inline void protocol_decode_heartbeat(const unsigned char* input,
+                                             struct heartbeat_digest* digest)
+{
+    protocol_get_digest(input + HEARTBEAT_DIGEST_POS, digest);
+}
+
+/**
+ * Write a stats response, whose records are already written up to pos.
+ */
+static inline void protocol_encode_stats(unsigned char* output,
+                                         const struct stats_header* header,
+                                         int pos)
+{
+    protocol_put_le(output+1, header->uptime, 4);
+    output[5] = header->nb_slots;
+    output[6] = header->nb_buckets;
+    protocol_seal(output, RESP_STATS, pos);
+}
+
+static inline void protocol_decode_stats(const unsigned char* input,
+                                         struct stats_header* header)
+{
+    header->uptime = protocol_get_le(input+1, 4);
+    header->nb_slots = input[5];
+    header->nb_buckets = input[6];
+}
+
+#endif
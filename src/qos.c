@@ -0,0 +1,267 @@
+/* Distributed under the terms of the GNU General Public License v2 */
+/* L3info - SYR2 Project - SYR DeaDBeeF
+ * ============================================================================
+ * Quality of Service
+ * ----------------------------------------------------------------------------
+ * Telemetry of a stream received by the client.
+ * ----------------------------------------------------------------------------
+ * Antoine Pinsard
+ * Oct. 19, 2026
+ */
+#include "qos.h"
+
+
+/**
+ * Create the telemetry of a stream of nb_blocks blocks, or of a live stream
+ * if nb_blocks is 0, sent every block_period microseconds. Samples are
+ * written to output unless it is NULL.
+ *
+ * The telemetry is shared with the processes forked afterwards, and freed
+ * once all of them called qos_destroy().
+ *
+ * Return NULL if the allocation failed.
+ */
+struct qos* qos_create(long nb_blocks, long block_period, FILE* output) {
+    struct qos* qos;
+    int shmid;
+
+    shmid = shmget(IPC_PRIVATE, sizeof(struct qos), 0600);
+    if (shmid == -1) {
+        return NULL;
+    }
+    qos = (struct qos*) shmat(shmid, NULL, 0);
+    // The segment is freed once detached by all the processes.
+    shmctl(shmid, IPC_RMID, NULL);
+    if (qos == (void*) -1) {
+        return NULL;
+    }
+    qos->seen = calloc((nb_blocks > 0 ? nb_blocks : QOS_WINDOW) / 8 + 1, 1);
+    if (qos->seen == NULL) {
+        shmdt((void*) qos);
+        return NULL;
+    }
+
+    qos->output = output;
+    qos->start = deadbeef_now_us() / 1e6;
+    qos->next_sample = qos->start + QOS_SAMPLE_PERIOD;
+    qos->nb_blocks = nb_blocks;
+    qos->block_period = block_period;
+    qos->nb_received = 0;
+    qos->nb_messages = 0;
+    qos->nb_duplicates = 0;
+    qos->nb_reordered = 0;
+    qos->max_reorder = 0;
+    qos->highest = -1;
+    qos->last_transit = 0;
+    qos->jitter = 0;
+    qos->buffer = 0;
+    qos->min_buffer = 0;
+    qos->max_buffer = 0;
+    qos->total_buffer = 0;
+    qos->nb_buffer_samples = 0;
+    qos->nb_underruns = 0;
+    qos->nb_rebuffers = 0;
+
+    return qos;
+}
+
+
+/**
+ * Detach the telemetry from the calling process.
+ */
+void qos_destroy(struct qos* qos) {
+    assert(qos != NULL);
+
+    free(qos->seen);
+    shmdt((void*) qos);
+}
+
+
+/**
+ * Forget the blocks of the window of a live stream that the given block,
+ * past the latest one, is about to reuse.
+ */
+static void slide_window(struct qos* qos, long block) {
+    long old;
+
+    old = qos->highest + 1;
+    if (old < block - QOS_WINDOW + 1) {
+        old = block - QOS_WINDOW + 1;
+    }
+    for (; old <= block; old++) {
+        qos->seen[old % QOS_WINDOW / 8] &= ~(1 << (old % 8));
+    }
+}
+
+
+/**
+ * Count a message holding the nb_blocks blocks starting at first, received
+ * now. Blocks out of the stream, or out of the window of a live stream, are
+ * ignored.
+ *
+ * Return the number of blocks received for the first time.
+ */
+int qos_receive(struct qos* qos, long first, int nb_blocks) {
+    long long transit
+            , delta;
+    long block
+       , latest
+       , bit;
+    int nb_new;
+
+    assert(qos != NULL);
+
+    transit = deadbeef_now_us() - (long long) first * qos->block_period;
+    if (qos->nb_messages > 0) {
+        delta = transit - qos->last_transit;
+        if (delta < 0) {
+            delta = -delta;
+        }
+        qos->jitter += (delta - qos->jitter) / 16;
+    }
+    qos->last_transit = transit;
+    qos->nb_messages++;
+
+    latest = qos->highest;
+    nb_new = 0;
+    for (block = first; block < first + nb_blocks; block++) {
+        if (block < 0 || (qos->nb_blocks > 0 && block >= qos->nb_blocks) ||
+            (qos->nb_blocks == 0 && block <= qos->highest - QOS_WINDOW))
+        {
+            continue;
+        }
+        bit = block;
+        if (qos->nb_blocks == 0) {
+            if (block > qos->highest) {
+                slide_window(qos, block);
+            }
+            bit = block % QOS_WINDOW;
+        }
+        if (qos->seen[bit / 8] & (1 << (bit % 8))) {
+            qos->nb_duplicates++;
+            continue;
+        }
+        qos->seen[bit / 8] |= 1 << (bit % 8);
+        nb_new++;
+        if (block > qos->highest) {
+            qos->highest = block;
+        }
+    }
+    qos->nb_received += nb_new;
+
+    // Duplicates of old messages are not late ones.
+    if (nb_new > 0 && first < latest) {
+        qos->nb_reordered++;
+        if ((latest - first) / CODEC_BLOCKS > qos->max_reorder) {
+            qos->max_reorder = (latest - first) / CODEC_BLOCKS;
+        }
+    }
+
+    return nb_new;
+}
+
+
+/**
+ * Return the number of blocks missing before the latest one received. Late
+ * blocks are counted as lost until they arrive.
+ */
+long qos_lost(struct qos* qos) {
+    assert(qos != NULL);
+
+    return qos->highest + 1 - qos->nb_received;
+}
+
+
+/**
+ * Fill the digest of the telemetry sent in heartbeats, see deadbeef.h.
+ */
+void qos_digest(struct qos* qos, struct heartbeat_digest* digest) {
+    assert(qos != NULL);
+    assert(digest != NULL);
+
+    digest->valid = 1;
+    digest->received = qos->nb_received;
+    digest->lost = qos_lost(qos);
+    digest->reordered = qos->nb_reordered;
+    digest->duplicates = qos->nb_duplicates;
+    digest->jitter_us = qos->jitter;
+    digest->buffer_ms = qos->buffer;
+    digest->underruns = qos->nb_underruns;
+    digest->highest = qos->highest;
+}
+
+
+/**
+ * Count a sample of the playback: the occupancy of the jitter buffer in
+ * milliseconds, and the underruns and rebufferings so far. The counters are
+ * written to the output if a sample is due.
+ */
+void qos_playback(struct qos* qos, double buffer, int nb_underruns,
+                  int nb_rebuffers)
+{
+    double t;
+
+    assert(qos != NULL);
+
+    qos->buffer = buffer;
+    if (qos->nb_buffer_samples == 0 || buffer < qos->min_buffer) {
+        qos->min_buffer = buffer;
+    }
+    if (buffer > qos->max_buffer) {
+        qos->max_buffer = buffer;
+    }
+    qos->total_buffer += buffer;
+    qos->nb_buffer_samples++;
+    qos->nb_underruns = nb_underruns;
+    qos->nb_rebuffers = nb_rebuffers;
+
+    t = deadbeef_now_us() / 1e6;
+    if (qos->output == NULL || t < qos->next_sample) {
+        return;
+    }
+    qos->next_sample += QOS_SAMPLE_PERIOD;
+    if (qos->next_sample < t) {
+        qos->next_sample = t + QOS_SAMPLE_PERIOD;
+    }
+    fprintf(qos->output, "{\"type\": \"sample\", \"t\": %.3f, "
+            "\"received\": %ld, \"lost\": %ld, \"reordered\": %ld, "
+            "\"duplicates\": %ld, \"jitter_ms\": %.3f, \"buffer_ms\": %.1f, "
+            "\"underruns\": %d, \"rebuffers\": %d}\n", t - qos->start,
+            qos->nb_received, qos_lost(qos), qos->nb_reordered,
+            qos->nb_duplicates, qos->jitter / 1000, buffer, nb_underruns,
+            nb_rebuffers);
+    fflush(qos->output);
+}
+
+
+/**
+ * Write the summary of the stream to the output. Every block not received is
+ * lost by then.
+ */
+void qos_summary(struct qos* qos) {
+    long nb_blocks;
+
+    assert(qos != NULL);
+
+    if (qos->output == NULL) {
+        return;
+    }
+    // A live stream ends with the latest block received.
+    nb_blocks = qos->nb_blocks > 0 ? qos->nb_blocks : qos->highest + 1;
+    fprintf(qos->output, "{\"type\": \"summary\", \"duration_s\": %.3f, "
+            "\"blocks\": %ld, \"received\": %ld, \"lost\": %ld, "
+            "\"loss\": %.6f, \"reordered\": %ld, \"max_reorder\": %ld, "
+            "\"duplicates\": %ld, \"jitter_ms\": %.3f, "
+            "\"buffer_ms_min\": %.1f, \"buffer_ms_avg\": %.1f, "
+            "\"buffer_ms_max\": %.1f, \"underruns\": %d, \"rebuffers\": %d}\n",
+            deadbeef_now_us() / 1e6 - qos->start, nb_blocks,
+            qos->nb_received,
+            nb_blocks - qos->nb_received,
+            nb_blocks > 0 ? 1 - (double) qos->nb_received / nb_blocks : 0.0,
+            qos->nb_reordered, qos->max_reorder, qos->nb_duplicates,
+            qos->jitter / 1000, qos->min_buffer,
+            qos->nb_buffer_samples > 0 ? qos->total_buffer
+                                         / qos->nb_buffer_samples : 0.0,
+            qos->max_buffer, qos->nb_underruns, qos->nb_rebuffers);
+    fflush(qos->output);
+}
@@ -0,0 +1,77 @@
+/* Distributed under the terms of the GNU General Public License v2 */
+/* L3info - SYR2 Project - SYR DeaDBeeF
+ * ============================================================================
+ * Quality of Service
+ * ----------------------------------------------------------------------------
+ * Telemetry of a stream received by the client, kept in shared memory so that
+ * both the receiver and the playback processes update it:
+ *
+ *  - the receiver counts the lost, reordered and duplicate blocks, see
+ *    codec.h, and estimates the inter-arrival jitter as in RFC 3550: the
+ *    transit of each message is its arrival time minus the time the server
+ *    was to send it, given the pacing of its first block, and the jitter is
+ *    the mean deviation of the difference between consecutive transits,
+ *    smoothed with a gain of 1/16;
+ *  - the playback samples the occupancy of the jitter buffer, that is the
+ *    duration of stream received ahead of the playback position, and counts
+ *    the underruns and rebufferings.
+ *
+ * A sample of the counters is written as a JSON line to the output every
+ * QOS_SAMPLE_PERIOD, and a summary once the stream is over.
+ *
+ * A live stream has no number of blocks: the blocks received are only
+ * remembered over the last QOS_WINDOW ones, older blocks being ignored, and
+ * the stream is as long as the latest block received. A digest is sent
+ * to the server with each heartbeat, see deadbeef.h.
+ * ----------------------------------------------------------------------------
+ * Antoine Pinsard
+ * Oct. 19, 2026
+ */
+#ifndef _QOS_H_
+#define _QOS_H_
+
+#include "codec.h"
+#include "deadbeef.h"
+#include "protocol.h"
+
+// Delay between two samples in seconds
+#define QOS_SAMPLE_PERIOD 1.0
+// Blocks remembered by the telemetry of a live stream, a multiple of 8
+#define QOS_WINDOW 8192
+
+struct qos {
+    FILE* output;                 // Where samples are written, or NULL
+    double start;                 // Time of the request in seconds
+    double next_sample;
+    // Written by the receiver
+    long nb_blocks;               // Blocks of the stream, 0 if live
+    long block_period;            // Delay between two blocks sent, in us
+    // One bit per block, or per block of the window if live, receiver only
+    unsigned char* seen;
+    long nb_received;             // Distinct blocks received
+    long nb_messages;
+    long nb_duplicates;           // Blocks
+    long nb_reordered;            // Messages older than the latest one
+    long max_reorder;             // Packets between a late one and the latest
+    long highest;                 // Latest block received, -1 if none
+    long long last_transit;       // us
+    double jitter;                // us
+    // Written by the playback
+    double buffer;                // Occupancy of the jitter buffer in ms
+    double min_buffer;
+    double max_buffer;
+    double total_buffer;
+    long nb_buffer_samples;
+    int nb_underruns;
+    int nb_rebuffers;
+};
+
+struct qos* qos_create(long, long, FILE*);
+void qos_destroy(struct qos*);
+int qos_receive(struct qos*, long, int);
+long qos_lost(struct qos*);
+void qos_digest(struct qos*, struct heartbeat_digest*);
+void qos_playback(struct qos*, double, int, int);
+void qos_summary(struct qos*);
+
+#endif
@@ -0,0 +1,174 @@
+/* Distributed under the terms of the GNU General Public License v2 */
+/* L3info - SYR2 Project - SYR DeaDBeeF
+ * ============================================================================
+ * Reader
+ * ----------------------------------------------------------------------------
+ * Streaming reader of a region of a file.
+ * ----------------------------------------------------------------------------
+ * Antoine Pinsard
+ * Oct. 19, 2026
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include "reader.h"
+
+
+/**
+ * Initialize a reader of the length bytes of the file fd starting at offset.
+ *
+ * The descriptor remains owned by the caller and must stay open until the
+ * reader is destroyed.
+ *
+ * Return 0 on success, -1 if the window could not be allocated.
+ */
+int reader_init(struct reader* reader, int fd, off_t offset, off_t length) {
+    assert(reader != NULL);
+    assert(fd >= 0);
+    assert(offset >= 0);
+    assert(length >= 0);
+
+    reader->window = malloc(READER_WINDOW_LENGTH);
+    if (reader->window == NULL) {
+        return -1;
+    }
+
+    reader->fd = fd;
+    reader->start = offset;
+    reader->end = offset + length;
+    reader->window_start = offset;
+    reader->window_fill = 0;
+    reader->cursor = 0;
+    reader->advised = offset;
+    reader->view = reader->window;
+    reader->map = NULL;
+    reader->nb_syscalls = 1;
+
+    posix_fadvise(fd, offset, length, POSIX_FADV_SEQUENTIAL);
+
+    return 0;
+}
+
+
+/**
+ * Read the region from its mapping in memory rather than with pread(). data
+ * points to the first byte of the region and must stay mapped until the
+ * reader is destroyed. Nothing must have been read yet.
+ */
+void reader_map(struct reader* reader, const unsigned char* data) {
+    assert(reader != NULL);
+    assert(data != NULL);
+    assert(reader->window_fill == 0);
+
+    free(reader->window);
+    reader->window = NULL;
+    reader->map = data;
+}
+
+
+/**
+ * Free the window of the reader.
+ */
+void reader_destroy(struct reader* reader) {
+    assert(reader != NULL);
+
+    free(reader->window);
+    reader->window = NULL;
+}
+
+
+/**
+ * Slide the exhausted window past the bytes already read and fill it again,
+ * then ask the kernel to prefetch the pages that will be read next.
+ *
+ * Return the number of valid bytes in the window, or -1 if pread() failed.
+ */
+static ssize_t refill(struct reader* reader) {
+    size_t wanted;
+    ssize_t len;
+
+    reader->window_start += reader->window_fill;
+    reader->cursor = 0;
+    reader->window_fill = 0;
+
+    wanted = READER_WINDOW_LENGTH;
+    if (reader->window_start + wanted > reader->end) {
+        wanted = reader->end - reader->window_start;
+    }
+
+    if (reader->map != NULL) {
+        reader->view = reader->map + (reader->window_start - reader->start);
+        reader->window_fill = wanted;
+        wanted = 0;
+    }
+    while (wanted > 0) {
+        reader->nb_syscalls++;
+        len = pread(reader->fd, reader->window + reader->window_fill, wanted,
+                    reader->window_start + reader->window_fill);
+        if (len < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        if (len == 0) {
+            // The file is shorter than expected.
+            reader->end = reader->window_start + reader->window_fill;
+            break;
+        }
+        reader->window_fill += len;
+        wanted -= len;
+    }
+
+    if (reader->advised < reader->window_start + reader->window_fill) {
+        reader->advised = reader->window_start + reader->window_fill;
+    }
+    if (reader->advised < reader->end &&
+        reader->advised - reader->window_start < READER_PREFETCH_LENGTH)
+    {
+        reader->nb_syscalls++;
+        posix_fadvise(reader->fd, reader->advised, READER_PREFETCH_LENGTH,
+                      POSIX_FADV_WILLNEED);
+        reader->advised += READER_PREFETCH_LENGTH;
+    }
+
+    return reader->window_fill;
+}
+
+
+/**
+ * Copy at most n bytes of the region to output, advancing the read cursor.
+ *
+ * Return the number of copied bytes, which is lower than n only at the end of
+ * the region, or -1 if the file could not be read.
+ */
+ssize_t reader_read(struct reader* reader, unsigned char* output, size_t n) {
+    size_t copied
+         , len;
+
+    assert(reader != NULL);
+    assert(output != NULL);
+
+    copied = 0;
+    while (copied < n) {
+        if (reader->cursor == reader->window_fill) {
+            if (reader_remaining(reader) == 0) {
+                break;
+            }
+            if (refill(reader) < 0) {
+                return -1;
+            }
+            if (reader->window_fill == 0) {
+                break;
+            }
+        }
+        len = reader->window_fill - reader->cursor;
+        if (len > n - copied) {
+            len = n - copied;
+        }
+        memcpy(output + copied, reader->view + reader->cursor, len);
+        reader->cursor += len;
+        copied += len;
+    }
+
+    return copied;
+}
@@ -0,0 +1,54 @@
+/* Distributed under the terms of the GNU General Public License v2 */
+/* L3info - SYR2 Project - SYR DeaDBeeF
+ * ============================================================================
+ * Reader
+ * ----------------------------------------------------------------------------
+ * Streaming reader of a region of a file. The region is read through a fixed
+ * size sliding window filled with pread(), while the kernel is asked to
+ * prefetch the pages ahead of the read cursor. The memory used by a reader
+ * does not depend on the size of the file.
+ *
+ * A region already mapped in memory, see aud_open(), is read from the
+ * mapping instead, without copying it to a window nor calling pread().
+ * ----------------------------------------------------------------------------
+ * Antoine Pinsard
+ * Oct. 19, 2026
+ */
+#ifndef _READER_H_
+#define _READER_H_
+
+#include <sys/types.h>
+#include "deadbeef.h"
+
+// Size of the sliding window
+#define READER_WINDOW_LENGTH (32 * DATA_LENGTH)
+// How far ahead of the read cursor the kernel is asked to prefetch
+#define READER_PREFETCH_LENGTH (4 * READER_WINDOW_LENGTH)
+
+struct reader {
+    int fd;
+    off_t start;        // Start of the region in the file
+    off_t end;          // End of the region in the file
+    off_t window_start; // File offset of the first byte of the window
+    size_t window_fill; // Number of valid bytes in the window
+    size_t cursor;      // Read position in the window
+    off_t advised;      // End of the prefetched part of the file
+    unsigned char* window;
+    const unsigned char* view; // Valid bytes of the window
+    const unsigned char* map;  // Mapping of the region, or NULL
+    unsigned long nb_syscalls;
+};
+
+int reader_init(struct reader*, int, off_t, off_t);
+void reader_map(struct reader*, const unsigned char*);
+void reader_destroy(struct reader*);
+ssize_t reader_read(struct reader*, unsigned char*, size_t);
+
+/**
+ * Return the number of bytes of the region that have not been read yet.
+ */
+static inline off_t reader_remaining(struct reader* reader) {
+    return reader->end - reader->window_start - reader->cursor;
+}
+
+#endif
@@ -0,0 +1,272 @@
+/* Distributed under the terms of the GNU General Public License v2 */
+/* L3info - SYR2 Project - SYR DeaDBeeF
+ * ============================================================================
+ * Scheduler
+ * ----------------------------------------------------------------------------
+ * Timer wheel and weighted deficit round-robin of the sessions of a process.
+ * ----------------------------------------------------------------------------
+ * Antoine Pinsard
+ * Oct. 19, 2026
+ */
+#include "sched.h"
+
+
+static void list_push(struct sched_list* list, struct sched_entry* entry) {
+    entry->next = NULL;
+    if (list->tail != NULL) {
+        list->tail->next = entry;
+    }
+    else {
+        list->head = entry;
+    }
+    list->tail = entry;
+}
+
+
+static void list_push_front(struct sched_list* list,
+                            struct sched_entry* entry)
+{
+    entry->next = list->head;
+    list->head = entry;
+    if (list->tail == NULL) {
+        list->tail = entry;
+    }
+}
+
+
+static struct sched_entry* list_pop(struct sched_list* list) {
+    struct sched_entry* entry;
+
+    entry = list->head;
+    if (entry != NULL) {
+        list->head = entry->next;
+        if (list->head == NULL) {
+            list->tail = NULL;
+        }
+    }
+
+    return entry;
+}
+
+
+/**
+ * Initialize a scheduler whose first tick starts at now. send is called for
+ * each message due, and budget bytes may be sent per tick on average, unless
+ * it is 0.
+ */
+void sched_init(struct sched* sched, sched_send send, long budget,
+                long long now)
+{
+    assert(sched != NULL);
+    assert(send != NULL);
+
+    memset(sched, 0, sizeof(struct sched));
+    sched->start = now;
+    sched->budget = budget;
+    sched->send = send;
+}
+
+
+/**
+ * Put entry in the wheel slot of its deadline, or in the active list if it
+ * is due already.
+ */
+static void insert(struct sched* sched, struct sched_entry* entry) {
+    uint64_t expires
+           , delta;
+    int level;
+
+    // An entry never expires before its deadline.
+    expires = 0;
+    if (entry->deadline > sched->start) {
+        expires = (entry->deadline - sched->start + SCHED_TICK - 1)
+                / SCHED_TICK;
+    }
+    if (expires < sched->tick) {
+        list_push(&sched->active, entry);
+        return;
+    }
+
+    delta = expires - sched->tick;
+    for (level = 0; level < SCHED_LEVELS - 1 &&
+                    delta >= 1ULL << (SCHED_WHEEL_BITS * (level+1));
+         level++);
+    if (delta >= 1ULL << (SCHED_WHEEL_BITS * SCHED_LEVELS)) {
+        expires = sched->tick
+                + (1ULL << (SCHED_WHEEL_BITS * SCHED_LEVELS)) - 1;
+    }
+    list_push(&sched->wheel[level][(expires >> (SCHED_WHEEL_BITS * level))
+                                   & (SCHED_WHEEL_SIZE - 1)],
+              entry);
+    sched->nb_waiting++;
+}
+
+
+/**
+ * Add entry to the scheduler, due at its deadline.
+ */
+void sched_add(struct sched* sched, struct sched_entry* entry) {
+    assert(sched != NULL);
+    assert(entry != NULL);
+
+    if (entry->weight <= 0) {
+        entry->weight = 1;
+    }
+    entry->deficit = 0;
+    sched->nb_entries++;
+    insert(sched, entry);
+}
+
+
+/**
+ * Move the entries of the current tick to the active list, after cascading
+ * the upper levels whose turn comes.
+ */
+static void expire(struct sched* sched) {
+    struct sched_list* slot;
+    struct sched_entry* entry;
+    struct sched_entry* next;
+    int level
+      , index;
+
+    for (level = 1; level < SCHED_LEVELS; level++) {
+        if ((sched->tick >> (SCHED_WHEEL_BITS * (level-1)))
+            & (SCHED_WHEEL_SIZE - 1))
+        {
+            break;
+        }
+    }
+    // Upper levels first, so that entries can fall down several levels.
+    for (level--; level > 0; level--) {
+        index = (sched->tick >> (SCHED_WHEEL_BITS * level))
+              & (SCHED_WHEEL_SIZE - 1);
+        slot = &sched->wheel[level][index];
+        entry = slot->head;
+        slot->head = NULL;
+        slot->tail = NULL;
+        while (entry != NULL) {
+            next = entry->next;
+            sched->nb_waiting--;
+            insert(sched, entry);
+            entry = next;
+        }
+    }
+
+    slot = &sched->wheel[0][sched->tick & (SCHED_WHEEL_SIZE - 1)];
+    while ((entry = list_pop(slot)) != NULL) {
+        sched->nb_waiting--;
+        list_push(&sched->active, entry);
+    }
+}
+
+
+/**
+ * Serve the active entries in weighted deficit round-robin until each is
+ * no longer due, or until egress is saturated, then send the messages
+ * batched meanwhile.
+ */
+static void serve(struct sched* sched, long long now) {
+    struct sched_entry* entry;
+    struct sched_entry* interrupted;
+    int saturated
+      , ret;
+
+    saturated = 0;
+    // The entry the previous tick stopped at keeps the credit of its round.
+    interrupted = sched->interrupted;
+    sched->interrupted = NULL;
+    while (!saturated && (entry = list_pop(&sched->active)) != NULL) {
+        if (entry != interrupted) {
+            entry->deficit += (long) SCHED_QUANTUM * entry->weight;
+        }
+        interrupted = NULL;
+        while (entry != NULL && entry->deficit >= MSG_LENGTH) {
+            if (sched->budget > 0 && sched->credit < MSG_LENGTH) {
+                saturated = 1;
+                break;
+            }
+            ret = sched->send(sched, entry, now);
+            if (ret < 0) {
+                sched->nb_entries--;
+                entry = NULL;
+                break;
+            }
+            // Nothing to send yet: the entry waits for its new deadline.
+            if (ret == 0 && entry->deadline > now) {
+                entry->deficit = 0;
+                insert(sched, entry);
+                entry = NULL;
+                break;
+            }
+            if (ret == 0) {
+                saturated = 1;
+                break;
+            }
+            sched->nb_sent++;
+            entry->deficit -= ret;
+            sched->credit -= ret;
+            if (entry->deadline > now) {
+                entry->deficit = 0;
+                insert(sched, entry);
+                entry = NULL;
+            }
+        }
+        if (entry == NULL) {
+            continue;
+        }
+        if (saturated) {
+            list_push_front(&sched->active, entry);
+            sched->interrupted = entry;
+        }
+        else {
+            list_push(&sched->active, entry);
+        }
+    }
+    if (sched->flush != NULL && sched->flush(sched) > 0) {
+        saturated = 1;
+    }
+    if (saturated) {
+        sched->nb_saturated++;
+    }
+}
+
+
+/**
+ * Expire the ticks elapsed until now and send the messages due.
+ *
+ * Return the time of the next tick in us, or -1 if the scheduler has no
+ * entry left.
+ */
+long long sched_run(struct sched* sched, long long now) {
+    uint64_t target;
+    long long credit;
+    long burst;
+
+    assert(sched != NULL);
+
+    target = now > sched->start ? (now - sched->start) / SCHED_TICK : 0;
+    // Unspent budget is kept, up to a tick worth or a message, so that a
+    // budget of less than a message per tick still lets messages through.
+    if (sched->budget > 0 && sched->tick <= target) {
+        burst = sched->budget > MSG_LENGTH ? sched->budget : MSG_LENGTH;
+        credit = sched->credit
+               + (long long) (target + 1 - sched->tick) * sched->budget;
+        sched->credit = credit < burst ? credit : burst;
+    }
+    // Nothing to cascade: idle ticks are skipped.
+    if (sched->nb_waiting == 0 && sched->tick <= target) {
+        sched->tick = target + 1;
+    }
+    while (sched->tick <= target) {
+        expire(sched);
+        sched->tick++;
+        sched->nb_ticks++;
+    }
+
+    serve(sched, now);
+
+    if (sched->nb_entries == 0) {
+        return -1;
+    }
+    return sched->start + (long long) sched->tick * SCHED_TICK;
+}
@@ -0,0 +1,96 @@
+/* Distributed under the terms of the GNU General Public License v2 */
+/* L3info - SYR2 Project - SYR DeaDBeeF
+ * ============================================================================
+ * Scheduler Header
+ * ----------------------------------------------------------------------------
+ * Central send scheduler of the sessions sharing a process.
+ *
+ * Each session is an entry holding the deadline of its next message. Entries
+ * wait in a hierarchical timer wheel of SCHED_LEVELS levels of
+ * SCHED_WHEEL_SIZE slots: level 0 has a slot per tick of SCHED_TICK us, each
+ * slot of level n spans a whole turn of level n-1, whose entries are cascaded
+ * down when level n-1 wraps around. Adding an entry is O(1), and so is each
+ * tick, whatever the number of entries.
+ *
+ * At each tick, the entries due are moved to the active list, which is served
+ * in weighted deficit round-robin: each round, an entry is credited weight
+ * times SCHED_QUANTUM bytes and sends messages while its credit allows it and
+ * it is still due. When egress is saturated, because the byte budget is spent
+ * or because the socket would block, the round stops and resumes at the next
+ * tick where it stopped, so that every session gets its share of the
+ * bandwidth in proportion to its weight, however fast the others are. An
+ * entry that is no longer due leaves the active list for the wheel and loses
+ * its credit.
+ *
+ * The scheduler does not know how messages are built: the send callback of
+ * the scheduler sends the next message of an entry and updates its deadline.
+ * It may rather build and batch the message, in which case the flush
+ * callback sends the messages batched at the end of each tick, see
+ * sender_flush().
+ * ----------------------------------------------------------------------------
+ * Antoine Pinsard
+ * Oct. 19, 2026
+ */
+#ifndef _SCHED_H_
+#define _SCHED_H_
+
+#include <stdint.h>
+#include "deadbeef.h"
+
+// Duration of a tick in microseconds
+#define SCHED_TICK 250
+#define SCHED_WHEEL_BITS 8
+#define SCHED_WHEEL_SIZE (1 << SCHED_WHEEL_BITS)
+#define SCHED_LEVELS 4
+// Credit of an entry of weight 1 per round, in bytes
+#define SCHED_QUANTUM MSG_LENGTH
+
+struct sched_entry {
+    struct sched_entry* next;
+    long long deadline;  // Time of the next message in us
+    int weight;
+    long deficit;        // Credit left in the current round
+};
+
+struct sched;
+
+// Send the next message of entry at time now and update its deadline.
+// Return the number of bytes sent, 0 if the socket would block, or -1 if the
+// entry is over, in which case the scheduler forgets it. An entry that has
+// nothing to send yet returns 0 after moving its deadline past now.
+typedef int (*sched_send)(struct sched*, struct sched_entry*, long long);
+// Send the messages batched by the send callback.
+// Return the number of messages left to send because egress is saturated.
+typedef int (*sched_flush)(struct sched*);
+
+// Singly linked list of entries, in insertion order
+struct sched_list {
+    struct sched_entry* head;
+    struct sched_entry* tail;
+};
+
+struct sched {
+    long long start;     // Time of tick 0 in us
+    uint64_t tick;       // Next tick to expire
+    long budget;         // Bytes that may be sent per tick, 0 if unlimited
+    long credit;         // Bytes that may be sent until the next tick
+    sched_send send;
+    sched_flush flush;   // Or NULL if messages are not batched
+    void* data;
+    int nb_entries;
+    int nb_waiting;      // Entries in the wheel
+    struct sched_list wheel[SCHED_LEVELS][SCHED_WHEEL_SIZE];
+    struct sched_list active;
+    // Active entry that was being served when egress saturated
+    struct sched_entry* interrupted;
+    // Statistics
+    unsigned long nb_ticks;
+    unsigned long nb_sent;
+    unsigned long nb_saturated; // Ticks that ended with egress saturated
+};
+
+void sched_init(struct sched*, sched_send, long, long long);
+void sched_add(struct sched*, struct sched_entry*);
+long long sched_run(struct sched*, long long);
+
+#endif
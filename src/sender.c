@@ -0,0 +1,882 @@
+/* Distributed under the terms of the GNU General Public License v2 */
+/* L3info - SYR2 Project - SYR DeaDBeeF
+ * ============================================================================
+ * Sender
+ * ----------------------------------------------------------------------------
+ * Send a region of a file to a client as paced RESP_DATA packets.
+ * ----------------------------------------------------------------------------
+ * Antoine Pinsard
+ * Oct. 19, 2026
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <time.h>
+#include "sender.h"
+#include "trace.h"
+
+
+/**
+ * Initialize a sender of the length bytes of fd starting at offset to dest.
+ */
+void sender_init(struct sender* sender, int sock, struct sockaddr_in* dest,
+                 int fd, off_t offset, off_t length)
+{
+    assert(sender != NULL);
+    assert(dest != NULL);
+
+    sender->sock = sock;
+    sender->dest = dest;
+    sender->fd = fd;
+    sender->offset = offset;
+    sender->length = length;
+    sender->map = NULL;
+    sender->nb_packets = length / DATA_LENGTH;
+    if (length % DATA_LENGTH != 0) {
+        sender->nb_packets++;
+    }
+    sender->first_packet = 0;
+    sender->period = SENDER_PERIOD;
+    sender->encoding = CODEC_RAW;
+    sender->channels = 0;
+    sender->reduction = 0;
+    sender->variant = 0;
+    sender->file_format = CONVERT_S16;
+    sender->file_channels = 0;
+    sender->preencoded = 0;
+    sender->mixer = NULL;
+    sender->on_sent = NULL;
+    sender->data = NULL;
+    sender->stats = NULL;
+    sender->nonblocking = 0;
+    sender->batch = NULL;
+    sender->state = NULL;
+    sender->deadline = 0;
+    sender->nb_syscalls = 0;
+    sender->nb_bytes = 0;
+    sender->nb_wire_bytes = 0;
+}
+
+
+// Progress of the blocking backend through the stream, see sender_open()
+struct sender_state {
+    struct converter conv;
+    unsigned char msg_buffer[MSG_LENGTH]; // Packed message being built
+    unsigned char raw_msg[MSG_LENGTH];
+    unsigned char raw[DATA_LENGTH];
+    unsigned char packet[DATA_LENGTH];    // Encoded packet being packed
+    ssize_t len;
+    uint32_t block_id   // Next block of the packet
+           , first;     // First block of the packed message
+    int nb_blocks       // Blocks of the packed message
+      , pos             // End of the packed message
+      , packet_length
+      , p               // Position of the next block in packet
+      , i;              // Next packet to read
+    // Message built but not sent yet, or NULL
+    unsigned char* pending;
+    uint32_t pending_first;
+    int pending_nb_blocks;
+};
+
+
+// Messages of several senders sharing a socket, sent at once
+struct sender_batch {
+    int sock;
+    int nb_messages;      // Added, not sent yet
+    struct sockaddr_in dests[SENDER_BATCH_SIZE];
+    // Server counters of the session of each message, or NULL
+    struct stats_counters* stats[SENDER_BATCH_SIZE];
+    struct iovec iovecs[SENDER_BATCH_SIZE];
+    struct mmsghdr headers[SENDER_BATCH_SIZE];
+    unsigned char messages[SENDER_BATCH_SIZE][MSG_LENGTH];
+};
+
+
+/**
+ * Create an empty batch of the messages of the senders sending to sock.
+ *
+ * Return NULL if the allocation failed.
+ */
+struct sender_batch* sender_batch_create(int sock) {
+    struct sender_batch* batch;
+
+    batch = malloc(sizeof(struct sender_batch));
+    if (batch == NULL) {
+        return NULL;
+    }
+    batch->sock = sock;
+    batch->nb_messages = 0;
+
+    return batch;
+}
+
+
+/**
+ * Free a batch. The messages it still holds are not sent.
+ */
+void sender_batch_destroy(struct sender_batch* batch) {
+    free(batch);
+}
+
+
+/**
+ * Send the messages of a batch with as few sendmmsg() calls as possible, in
+ * the order they were added. A message that fails for another reason than a
+ * full socket is dropped, like a message that sendto() fails to send.
+ *
+ * Return the number of messages still held because the socket is full, to
+ * be sent by the next flush.
+ */
+int sender_flush(struct sender_batch* batch) {
+    int nb_sent
+      , ret
+      , i;
+
+    assert(batch != NULL);
+
+    for (i = 0; i < batch->nb_messages; i++) {
+        batch->iovecs[i].iov_base = batch->messages[i];
+        batch->iovecs[i].iov_len = MSG_LENGTH;
+        memset(&batch->headers[i], 0, sizeof(struct mmsghdr));
+        batch->headers[i].msg_hdr.msg_name = &batch->dests[i];
+        batch->headers[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+        batch->headers[i].msg_hdr.msg_iov = &batch->iovecs[i];
+        batch->headers[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    nb_sent = 0;
+    while (nb_sent < batch->nb_messages) {
+        ret = sendmmsg(batch->sock, &batch->headers[nb_sent],
+                       batch->nb_messages - nb_sent, MSG_DONTWAIT);
+        if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            if (batch->stats[nb_sent] != NULL) {
+                stats_count_send(batch->stats[nb_sent], ret);
+            }
+            break;
+        }
+        if (ret < 0) {
+            perror("Message sending failed");
+            if (batch->stats[nb_sent] != NULL) {
+                stats_count_send(batch->stats[nb_sent], ret);
+            }
+            nb_sent++;
+            continue;
+        }
+        for (i = nb_sent; i < nb_sent + ret; i++) {
+            if (batch->stats[i] != NULL) {
+                stats_count_send(batch->stats[i], MSG_LENGTH);
+            }
+        }
+        nb_sent += ret;
+    }
+
+    // The messages left keep their order for the next flush.
+    batch->nb_messages -= nb_sent;
+    if (nb_sent > 0 && batch->nb_messages > 0) {
+        memmove(batch->messages, batch->messages[nb_sent],
+                batch->nb_messages * MSG_LENGTH);
+        memmove(batch->dests, &batch->dests[nb_sent],
+                batch->nb_messages * sizeof(struct sockaddr_in));
+        memmove(batch->stats, &batch->stats[nb_sent],
+                batch->nb_messages * sizeof(struct stats_counters*));
+    }
+
+    return batch->nb_messages;
+}
+
+
+/**
+ * Stop counting the messages of a batch to the given counters, whose session
+ * is over. The messages are still sent.
+ */
+void sender_batch_forget(struct sender_batch* batch,
+                         struct stats_counters* stats)
+{
+    int i;
+
+    assert(batch != NULL);
+
+    for (i = 0; i < batch->nb_messages; i++) {
+        if (batch->stats[i] == stats) {
+            batch->stats[i] = NULL;
+        }
+    }
+}
+
+
+/**
+ * Add a message to a batch, flushing it first if it is full.
+ *
+ * Return 0, or -1 if the batch is full because the socket is.
+ */
+static int batch_add(struct sender_batch* batch, struct sockaddr_in* dest,
+                     const unsigned char* msg, struct stats_counters* stats)
+{
+    if (batch->nb_messages == SENDER_BATCH_SIZE &&
+        sender_flush(batch) == SENDER_BATCH_SIZE)
+    {
+        return -1;
+    }
+    memcpy(batch->messages[batch->nb_messages], msg, MSG_LENGTH);
+    batch->dests[batch->nb_messages] = *dest;
+    batch->stats[batch->nb_messages] = stats;
+    batch->nb_messages++;
+
+    return 0;
+}
+
+
+/**
+ * Send the pending message, holding nb_blocks compressed blocks starting at
+ * first, see codec.h, then notify each packet whose last block has been
+ * sent. A raw packet counts as CODEC_BLOCKS blocks.
+ *
+ * The deadline of the next message is that of this one plus the time its
+ * blocks last, unless the stream is more than a period late, in which case
+ * the schedule restarts from now rather than bursting to catch up.
+ *
+ * The message is added to the batch of the sender instead if it has one,
+ * and counted as sent once the batch is flushed.
+ *
+ * Return SENDER_SENT, SENDER_ABORTED if the on_sent callback asked to abort,
+ * or SENDER_BLOCKED if the socket is non blocking and full.
+ */
+static int transmit(struct sender* sender) {
+    struct sender_state* state;
+    uint32_t block;
+    long long now;
+    int ret;
+
+    state = sender->state;
+
+    TRACE(TRACE_SEND, state->pending_first, state->pending_nb_blocks);
+    if (sender->batch != NULL) {
+        if (batch_add(sender->batch, sender->dest, state->pending,
+                      sender->stats) < 0)
+        {
+            return SENDER_BLOCKED;
+        }
+        ret = MSG_LENGTH;
+    }
+    else if (sender->nonblocking) {
+        sender->nb_syscalls++;
+        ret = sendto(sender->sock, state->pending, MSG_LENGTH, MSG_DONTWAIT,
+                     (struct sockaddr *) sender->dest,
+                     sizeof(struct sockaddr_in));
+        if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            if (sender->stats != NULL) {
+                stats_count_send(sender->stats, ret);
+            }
+            return SENDER_BLOCKED;
+        }
+        if (ret < 0) {
+            perror("Message sending failed");
+        }
+    }
+    else {
+        sender->nb_syscalls++;
+        ret = send_message(sender->sock, sender->dest, state->pending);
+    }
+    if (ret > 0) {
+        sender->nb_wire_bytes += MSG_LENGTH;
+    }
+    if (sender->stats != NULL && sender->batch == NULL) {
+        stats_count_send(sender->stats, ret);
+    }
+    state->pending = NULL;
+
+    if (sender->period > 0) {
+        now = deadbeef_now_us();
+        if (sender->deadline > 0 && sender->stats != NULL) {
+            stats_count_lateness(sender->stats, now > sender->deadline
+                                                ? now - sender->deadline
+                                                : 0);
+        }
+        if (sender->deadline == 0 ||
+            now > sender->deadline + sender->period)
+        {
+            sender->deadline = now;
+        }
+        sender->deadline += state->pending_nb_blocks * sender->period
+                          / CODEC_BLOCKS;
+    }
+
+    for (block = state->pending_first;
+         block < state->pending_first + state->pending_nb_blocks; block++)
+    {
+        if (block % CODEC_BLOCKS == CODEC_BLOCKS - 1 &&
+            sender->on_sent != NULL &&
+            sender->on_sent(block / CODEC_BLOCKS, sender->data) != 0)
+        {
+            return SENDER_ABORTED;
+        }
+    }
+
+    return SENDER_SENT;
+}
+
+
+/**
+ * Close the packed message being built and make it pending.
+ */
+static void seal_packed(struct sender_state* state) {
+    struct packed_header header;
+
+    header.first_block = state->first;
+    header.nb_blocks = state->nb_blocks;
+    protocol_encode_packed(state->msg_buffer, &header, state->pos);
+
+    state->pending = state->msg_buffer;
+    state->pending_first = state->first;
+    state->pending_nb_blocks = state->nb_blocks;
+    state->nb_blocks = 0;
+    state->pos = PACKED_HEADER_LENGTH;
+}
+
+
+/**
+ * Read the next packet of a preencoded stream: either the encoded packet to
+ * packet, or the raw packet to raw.
+ *
+ * Return the length of the encoded packet, 0 if the packet is raw, or -1 on
+ * error.
+ */
+static int read_packet(struct sender* sender, struct reader* reader,
+                       unsigned char* packet, unsigned char* raw)
+{
+    unsigned char header[2];
+    int length
+      , block_length
+      , pos;
+
+    if (reader_read(reader, header, 2) != 2) {
+        return -1;
+    }
+    length = header[0] | (header[1] << 8);
+    if (length == 0) {
+        if (reader_read(reader, raw, DATA_LENGTH) != DATA_LENGTH) {
+            return -1;
+        }
+        sender->nb_bytes += DATA_LENGTH;
+        return 0;
+    }
+    if (length > DATA_LENGTH ||
+        reader_read(reader, packet, length) != length)
+    {
+        return -1;
+    }
+
+    // Check the blocks, each of which starts with its raw length.
+    for (pos = 0; pos < length; pos += 2 + block_length) {
+        if (pos + 4 > length) {
+            return -1;
+        }
+        block_length = packet[pos] | (packet[pos+1] << 8);
+        if (pos + 2 + block_length > length) {
+            return -1;
+        }
+        sender->nb_bytes += packet[pos+2] | (packet[pos+3] << 8);
+    }
+
+    return length;
+}
+
+
+/**
+ * Encode a full packet read from a preencoded stream again with the
+ * reduction of the sender. An encoded packet is decoded to raw first.
+ *
+ * Return the length of the encoded packet, 0 if it is to be sent raw, or
+ * packet_length to send it as it was read.
+ */
+static int reduce_packet(struct sender* sender, int packet_length) {
+    struct sender_state* state;
+    const unsigned char* block;
+    int block_length
+      , pos
+      , len
+      , part;
+
+    state = sender->state;
+    len = packet_length > 0 ? 0 : DATA_LENGTH;
+    for (pos = 0, part = 0; pos < packet_length;
+         pos += 2 + block_length, part++)
+    {
+        block_length = state->packet[pos] | (state->packet[pos+1] << 8);
+        block = state->packet + pos + 2;
+        if (part == CODEC_BLOCKS ||
+            codec_decode(block, block_length, sender->channels,
+                         state->i * CODEC_BLOCKS + part,
+                         state->raw + len, DATA_LENGTH - len)
+            != CODEC_BLOCK_LENGTH)
+        {
+            return packet_length;
+        }
+        len += CODEC_BLOCK_LENGTH;
+    }
+    if (len != DATA_LENGTH) {
+        return packet_length;
+    }
+
+    packet_length = codec_encode_packet(state->raw, DATA_LENGTH,
+                                        sender->channels, state->i,
+                                        sender->reduction, state->packet);
+    return packet_length < 0 ? 0 : packet_length;
+}
+
+
+/**
+ * Read the next packet of the stream. When the stream is compressed, the
+ * packet is encoded, unless the file holds it encoded already, and its blocks
+ * are left to be packed. Packets that do not compress are made pending as raw
+ * messages.
+ *
+ * Return 0, or -1 if the file could not be read.
+ */
+static int next_packet(struct sender* sender) {
+    struct sender_state* state;
+
+    state = sender->state;
+    if (sender->preencoded) {
+        state->len = DATA_LENGTH;
+        state->packet_length = read_packet(sender, &state->conv.reader,
+                                           state->packet, state->raw);
+        if (state->packet_length >= 0 && sender->reduction != 0) {
+            state->packet_length = reduce_packet(sender,
+                                                 state->packet_length);
+        }
+    }
+    else {
+        state->len = sender->mixer != NULL
+                   ? mixer_read(sender->mixer, state->raw, DATA_LENGTH)
+                   : converter_read(&state->conv, state->raw, DATA_LENGTH);
+        if (state->len < 0) {
+            return -1;
+        }
+        sender->nb_bytes += state->len;
+        state->packet_length = 0;
+        if (sender->encoding == CODEC_RICE) {
+            state->packet_length = codec_encode_packet(state->raw,
+                                                       state->len,
+                                                       sender->channels,
+                                                       state->i,
+                                                       sender->reduction,
+                                                       state->packet);
+            if (state->packet_length < 0) {
+                state->packet_length = 0;
+            }
+        }
+        TRACE(TRACE_ENCODE, state->i, state->packet_length);
+    }
+    if (state->packet_length < 0) {
+        return -1;
+    }
+
+    // Messages carry the number of the packet in the session, but packets
+    // are encoded with their number in the stream.
+    if (state->packet_length == 0) {
+        memcpy(state->raw_msg + DATA_HEADER_LENGTH, state->raw, state->len);
+        protocol_encode_data(state->raw_msg, sender->first_packet + state->i,
+                             state->len);
+        state->pending = state->raw_msg;
+        state->pending_first = (sender->first_packet + state->i)
+                             * CODEC_BLOCKS;
+        state->pending_nb_blocks = CODEC_BLOCKS;
+    }
+    state->block_id = (sender->first_packet + state->i) * CODEC_BLOCKS;
+    state->p = 0;
+    state->i++;
+
+    return 0;
+}
+
+
+/**
+ * Prepare the blocking backend to send the stream one message at a time with
+ * sender_step(), so that a process can interleave the messages of several
+ * senders.
+ *
+ * Return 0, or -1 if the file could not be opened for reading.
+ */
+int sender_open(struct sender* sender) {
+    struct sender_state* state;
+
+    assert(sender != NULL);
+
+    state = malloc(sizeof(struct sender_state));
+    if (state == NULL) {
+        return -1;
+    }
+    // A mix reads its files itself.
+    if (sender->mixer == NULL &&
+        converter_init(&state->conv, sender->fd, sender->offset,
+                       sender->length, sender->file_format,
+                       sender->file_channels, sender->variant) < 0)
+    {
+        free(state);
+        return -1;
+    }
+    if (sender->mixer == NULL && sender->map != NULL) {
+        reader_map(&state->conv.reader, sender->map);
+    }
+
+    state->len = 0;
+    state->block_id = 0;
+    state->first = 0;
+    state->nb_blocks = 0;
+    state->pos = PACKED_HEADER_LENGTH;
+    state->packet_length = 0;
+    state->p = 0;
+    state->i = 0;
+    state->pending = NULL;
+    state->pending_first = 0;
+    state->pending_nb_blocks = 0;
+    sender->state = state;
+
+    return 0;
+}
+
+
+/**
+ * Build the next message of the stream, unless one is pending already, and
+ * send it. The deadline of the sender is then that of the next message.
+ *
+ * Blocks of compressed packets are appended to the packed message being built
+ * until the next one does not fit.
+ *
+ * Return SENDER_SENT if a message was sent.
+ * Return SENDER_ABORTED if sending was aborted by the on_sent callback.
+ * Return SENDER_OVER if the whole stream has been sent.
+ * Return SENDER_BLOCKED if the socket is full, the message is then pending.
+ * Return -1 if the file could not be read.
+ */
+int sender_step(struct sender* sender) {
+    struct sender_state* state;
+    int block_length;
+
+    assert(sender != NULL);
+    assert(sender->state != NULL);
+
+    state = sender->state;
+    while (state->pending == NULL) {
+        if (state->p < state->packet_length) {
+            block_length = state->packet[state->p]
+                         | (state->packet[state->p+1] << 8);
+            if (state->pos + 2 + block_length > MSG_LENGTH - 1) {
+                seal_packed(state);
+                break;
+            }
+            if (state->nb_blocks == 0) {
+                state->first = state->block_id;
+            }
+            memcpy(state->msg_buffer + state->pos, state->packet + state->p,
+                   2 + block_length);
+            state->pos += 2 + block_length;
+            state->p += 2 + block_length;
+            state->nb_blocks++;
+            state->block_id++;
+            if (state->nb_blocks == PACKED_MAX_BLOCKS) {
+                seal_packed(state);
+            }
+        }
+        else if (state->i < sender->nb_packets) {
+            if (next_packet(sender) < 0) {
+                return -1;
+            }
+        }
+        else if (state->nb_blocks > 0) {
+            seal_packed(state);
+        }
+        else {
+            return SENDER_OVER;
+        }
+    }
+
+    return transmit(sender);
+}
+
+
+/**
+ * Release what sender_open() allocated.
+ */
+void sender_close(struct sender* sender) {
+    assert(sender != NULL);
+
+    if (sender->state == NULL) {
+        return;
+    }
+    if (sender->mixer == NULL) {
+        sender->nb_syscalls += sender->state->conv.reader.nb_syscalls;
+        converter_destroy(&sender->state->conv);
+    }
+    free(sender->state);
+    sender->state = NULL;
+}
+
+
+/**
+ * Blocking backend: read, send, then sleep until the deadline of the next
+ * message.
+ */
+static int run_blocking(struct sender* sender) {
+    struct timespec deadline;
+    int ret;
+
+    if (sender_open(sender) < 0) {
+        return -1;
+    }
+
+    while ((ret = sender_step(sender)) == SENDER_SENT) {
+        if (sender->period > 0) {
+            deadline.tv_sec = sender->deadline / 1000000;
+            deadline.tv_nsec = sender->deadline % 1000000 * 1000;
+            sender->nb_syscalls++;
+            clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL);
+            TRACE(TRACE_WAKE, sender->state->pending_first, 0);
+        }
+    }
+
+    sender_close(sender);
+
+    return ret == SENDER_OVER ? 0 : ret;
+}
+
+
+#ifdef DEADBEEF_URING
+
+// Operations, stored in the lowest byte of the user data of each entry. The
+// other bytes hold the slot index.
+#define OP_READ 0
+#define OP_TIMEOUT 1
+#define OP_SEND 2
+
+// Each registered buffer is a slot that goes through: read, wait for the
+// deadline of the packet, send, then read the next packet.
+struct slot {
+    int packet_id;
+    int length;
+    struct msghdr msg;
+    struct iovec iov;
+    struct __kernel_timespec deadline;
+};
+
+
+static void submit_read(struct uring* ring, struct sender* sender,
+                        struct slot* slots, int slot, int packet_id)
+{
+    struct io_uring_sqe* sqe;
+    off_t position;
+
+    position = (off_t) packet_id * DATA_LENGTH;
+    slots[slot].packet_id = packet_id;
+    slots[slot].length = DATA_LENGTH;
+    if (position + DATA_LENGTH > sender->length) {
+        slots[slot].length = sender->length - position;
+    }
+
+    sqe = uring_get_sqe(ring);
+    assert(sqe != NULL);
+    sqe->opcode = IORING_OP_READ_FIXED;
+    sqe->flags = IOSQE_FIXED_FILE;
+    sqe->fd = URING_FILE;
+    sqe->addr = (unsigned long) (uring_buffer(ring, slot)
+                                 + DATA_HEADER_LENGTH);
+    sqe->len = slots[slot].length;
+    sqe->off = sender->offset + position;
+    sqe->buf_index = 0;
+    sqe->user_data = (slot << 8) | OP_READ;
+}
+
+
+static void submit_send(struct uring* ring, struct sender* sender,
+                        struct slot* slots, int slot, struct timespec* start)
+{
+    struct io_uring_sqe* sqe;
+    unsigned char* buffer;
+    long long deadline;
+
+    buffer = uring_buffer(ring, slot);
+    protocol_encode_data(buffer, sender->first_packet + slots[slot].packet_id,
+                         slots[slot].length);
+
+    if (sender->period > 0) {
+        deadline = start->tv_nsec
+                 + (long long) slots[slot].packet_id * sender->period * 1000;
+        slots[slot].deadline.tv_sec = start->tv_sec + deadline / 1000000000;
+        slots[slot].deadline.tv_nsec = deadline % 1000000000;
+
+        sqe = uring_get_sqe(ring);
+        assert(sqe != NULL);
+        sqe->opcode = IORING_OP_TIMEOUT;
+        sqe->flags = IOSQE_IO_LINK;
+        sqe->fd = -1;
+        sqe->addr = (unsigned long) &slots[slot].deadline;
+        sqe->len = 1;
+        sqe->timeout_flags = IORING_TIMEOUT_ABS
+                           | IORING_TIMEOUT_ETIME_SUCCESS;
+        sqe->user_data = (slot << 8) | OP_TIMEOUT;
+    }
+
+    slots[slot].iov.iov_base = buffer;
+    slots[slot].iov.iov_len = MSG_LENGTH;
+    memset(&slots[slot].msg, 0, sizeof(struct msghdr));
+    slots[slot].msg.msg_name = sender->dest;
+    slots[slot].msg.msg_namelen = sizeof(struct sockaddr_in);
+    slots[slot].msg.msg_iov = &slots[slot].iov;
+    slots[slot].msg.msg_iovlen = 1;
+
+    sqe = uring_get_sqe(ring);
+    assert(sqe != NULL);
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->flags = IOSQE_FIXED_FILE;
+    sqe->fd = URING_SOCKET;
+    sqe->addr = (unsigned long) &slots[slot].msg;
+    sqe->len = 1;
+    sqe->user_data = (slot << 8) | OP_SEND;
+}
+
+
+/**
+ * Count the lateness of a send completed now against its deadline.
+ */
+static void count_lateness(struct sender* sender,
+                           struct __kernel_timespec* deadline)
+{
+    long long lateness;
+
+    lateness = deadbeef_now_us() - (deadline->tv_sec * 1000000LL
+                           + deadline->tv_nsec / 1000);
+    stats_count_lateness(sender->stats, lateness > 0 ? lateness : 0);
+}
+
+
+/**
+ * io_uring backend: up to URING_NB_BUFFERS packets are in flight, each one
+ * moving from read to timeout to send as completions arrive. A single
+ * io_uring_enter() call both submits the next operations and waits for the
+ * next completion.
+ *
+ * Return -2 if the ring could not be set up.
+ */
+static int run_uring(struct sender* sender) {
+    struct uring ring;
+    struct io_uring_cqe* cqe;
+    struct slot slots[URING_NB_BUFFERS];
+    struct timespec start;
+    int next_packet
+      , nb_sent
+      , slot
+      , op
+      , res
+      , ret;
+
+    if (uring_init(&ring, sender->fd, sender->sock) < 0) {
+        return -2;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    next_packet = 0;
+    for (slot = 0; slot < URING_NB_BUFFERS &&
+                   next_packet < sender->nb_packets; slot++)
+    {
+        submit_read(&ring, sender, slots, slot, next_packet++);
+    }
+
+    ret = 0;
+    nb_sent = 0;
+    while (ret == 0 && nb_sent < sender->nb_packets) {
+        if (uring_submit_and_wait(&ring, 1) < 0) {
+            ret = -1;
+            break;
+        }
+        while (ret == 0 && (cqe = uring_peek_cqe(&ring)) != NULL) {
+            slot = cqe->user_data >> 8;
+            op = cqe->user_data & 0xFF;
+            res = cqe->res;
+            uring_cqe_seen(&ring);
+
+            switch (op) {
+                case OP_READ:
+                    if (res < 0) {
+                        errno = -res;
+                        ret = -1;
+                        break;
+                    }
+                    if (res < slots[slot].length) {
+                        // The file is shorter than expected.
+                        slots[slot].length = res;
+                    }
+                    submit_send(&ring, sender, slots, slot, &start);
+                    break;
+                case OP_SEND:
+                    TRACE(TRACE_SEND, (sender->first_packet
+                                       + slots[slot].packet_id)
+                                      * CODEC_BLOCKS, CODEC_BLOCKS);
+                    nb_sent++;
+                    if (res > 0) {
+                        sender->nb_bytes += slots[slot].length;
+                        sender->nb_wire_bytes += MSG_LENGTH;
+                    }
+                    if (sender->stats != NULL) {
+                        errno = -res;
+                        stats_count_send(sender->stats, res);
+                        if (sender->period > 0) {
+                            count_lateness(sender, &slots[slot].deadline);
+                        }
+                    }
+                    if (sender->on_sent != NULL &&
+                        sender->on_sent(sender->first_packet
+                                        + slots[slot].packet_id,
+                                        sender->data) != 0)
+                    {
+                        ret = 1;
+                        break;
+                    }
+                    if (next_packet < sender->nb_packets) {
+                        submit_read(&ring, sender, slots, slot,
+                                    next_packet++);
+                    }
+                    break;
+                default:
+                    break;
+            }
+        }
+    }
+
+    sender->nb_syscalls += ring.nb_syscalls;
+    uring_destroy(&ring);
+
+    return ret;
+}
+
+#endif
+
+
+/**
+ * Send the whole region with the given backend.
+ *
+ * Return 0 if all packets were sent.
+ * Return 1 if sending was aborted by the on_sent callback.
+ * Return -1 if the file could not be read.
+ */
+int sender_run(struct sender* sender, int backend) {
+    assert(sender != NULL);
+
+#ifdef DEADBEEF_URING
+    if (backend == SENDER_URING && sender->encoding == CODEC_RAW &&
+        sender->variant == 0 && sender->mixer == NULL)
+    {
+        int ret;
+
+        ret = run_uring(sender);
+        if (ret != -2) {
+            return ret;
+        }
+        fprintf(stderr, "io_uring unavailable, falling back to blocking "
+                        "I/O.\n");
+    }
+#endif
+
+    return run_blocking(sender);
+}
@@ -0,0 +1,127 @@
+/* Distributed under the terms of the GNU General Public License v2 */
+/* L3info - SYR2 Project - SYR DeaDBeeF
+ * ============================================================================
+ * Sender
+ * ----------------------------------------------------------------------------
+ * Send a region of a file to a client as a paced sequence of RESP_DATA
+ * packets. Two backends are available:
+ *
+ *  - SENDER_BLOCKING reads the file with pread(), sends each packet with
+ *    sendto() and sleeps between packets;
+ *  - SENDER_URING submits the file reads, the pacing timeouts and the sends
+ *    through a single io_uring and is driven by the completions. It is only
+ *    compiled with DEADBEEF_URING and falls back to SENDER_BLOCKING when the
+ *    ring cannot be set up.
+ *
+ * When the stream is compressed, packets are encoded as blocks, see codec.h,
+ * which are packed together in RESP_PACKED messages. The pacing remains the
+ * same in terms of audio, so a message holding n packets worth of blocks is
+ * followed by n periods. Only the blocking backend packs blocks. The blocks
+ * of the next packets are reduced as given by the reduction of the sender,
+ * which may change between two steps, so that fewer messages are sent.
+ *
+ * The blocking backend can also convert the samples to a variant on the fly,
+ * or send a stream whose blocks have been encoded beforehand, see variant.h,
+ * or the mix of several files, see mixer.h.
+ *
+ * Rather than running a sender to the end, a process serving several
+ * sessions opens each sender with sender_open() and sends a message at a
+ * time with sender_step() when the deadline of the sender is due, see
+ * sched.h. Such senders are usually non blocking, so that a full socket
+ * delays the session instead of the whole process. Their messages can also
+ * be gathered in a batch shared by the senders of the process, which sends
+ * them at once with sendmmsg(), see sender_flush().
+ *
+ * The streams of a playlist are sent by a sender each, numbered after one
+ * another with first_packet. Setting the deadline of a sender to that of the
+ * previous one before its first step keeps the pacing gapless.
+ * ----------------------------------------------------------------------------
+ * Antoine Pinsard
+ * Oct. 19, 2026
+ */
+#ifndef _SENDER_H_
+#define _SENDER_H_
+
+#include "codec.h"
+#include "deadbeef.h"
+#include "mixer.h"
+#include "protocol.h"
+#include "reader.h"
+#include "stats.h"
+#include "uring.h"
+#include "variant.h"
+
+#define SENDER_BLOCKING 0
+#define SENDER_URING 1
+
+// Delay between two packets in microseconds
+#define SENDER_PERIOD 5000
+
+// Results of sender_step()
+#define SENDER_SENT 0
+#define SENDER_ABORTED 1
+#define SENDER_OVER 2
+#define SENDER_BLOCKED 3
+
+// Messages a batch holds at most
+#define SENDER_BATCH_SIZE 32
+
+struct sender_state;
+struct sender_batch;
+
+struct sender {
+    int sock;
+    struct sockaddr_in* dest;
+    int fd;
+    off_t offset;       // Region of the file to send
+    off_t length;
+    // Mapping of the region, see aud_open(), or NULL to read it from fd
+    const unsigned char* map;
+    // Packets of the stream. It is computed from length by sender_init() and
+    // must be updated when the stream is converted or preencoded.
+    int nb_packets;
+    // Number of the first packet of the stream in the session, which follows
+    // the streams sent before it in a playlist, see deadbeef.h
+    uint32_t first_packet;
+    long period;        // Delay between two packets in microseconds
+    int encoding;       // CODEC_RAW or CODEC_RICE
+    int channels;       // Channels of the stream, for compression
+    int reduction;      // Of the blocks of the next packets, see codec.h
+    int variant;        // Conversion of the samples of the file
+    int file_format;    // Sample format of the file, see convert.h
+    int file_channels;  // Channels of the file, for conversion
+    // The file holds the encoded packets of the stream, see variant.h.
+    int preencoded;
+    // Mix sent instead of the region of fd, or NULL. It is owned by the
+    // caller.
+    struct mixer* mixer;
+    // Called after each sent packet with its number. Sending is aborted if
+    // it returns a non zero value.
+    int (*on_sent)(int, void*);
+    void* data;
+    // Server counters of the session, or NULL, see stats.h
+    struct stats_counters* stats;
+    // Send with MSG_DONTWAIT, see sender_step()
+    int nonblocking;
+    // Batch the messages are added to rather than sent, or NULL, see
+    // sender_flush(). The sender is then non blocking.
+    struct sender_batch* batch;
+    struct sender_state* state; // Set by sender_open()
+    long long deadline; // Pacing deadline of the next message in us
+    // Statistics
+    unsigned long nb_syscalls;
+    unsigned long nb_bytes;      // Audio bytes sent
+    unsigned long nb_wire_bytes; // Bytes actually sent on the network
+};
+
+void sender_init(struct sender*, int, struct sockaddr_in*, int, off_t, off_t);
+int sender_run(struct sender*, int);
+int sender_open(struct sender*);
+int sender_step(struct sender*);
+void sender_close(struct sender*);
+struct sender_batch* sender_batch_create(int);
+void sender_batch_destroy(struct sender_batch*);
+int sender_flush(struct sender_batch*);
+void sender_batch_forget(struct sender_batch*, struct stats_counters*);
+
+#endif
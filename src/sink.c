@@ -0,0 +1,217 @@
+/* Distributed under the terms of the GNU General Public License v2 */
+/* L3info - SYR2 Project - SYR DeaDBeeF
+ * ============================================================================
+ * Sink
+ * ----------------------------------------------------------------------------
+ * Audio outputs.
+ * ----------------------------------------------------------------------------
+ * Antoine Pinsard
+ * Oct. 19, 2026
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include "sink.h"
+
+
+/**
+ * Drain the simulated device buffer of the null sink up to now.
+ */
+static void drain(struct sink* sink) {
+    double t;
+
+    t = deadbeef_now_us() / 1e6;
+    sink->queued -= (t - sink->clock) * sink->bytes_per_second;
+    if (sink->queued < 0) {
+        sink->queued = 0;
+    }
+    sink->clock = t;
+}
+
+
+/**
+ * Open the sink of the given specification, or of the one in the SINK_ENV
+ * environment variable if NULL, or the sound card if unset. The sample rate,
+ * the sample size and the number of channels are updated to the ones the
+ * sink accepted. If latency is not NULL, the sink holds about latency
+ * milliseconds of samples, and latency is updated to what it actually holds.
+ *
+ * Return 0 on success, -1 on error.
+ */
+int sink_open(struct sink* sink, const char* spec, int* sample_rate,
+              int* sample_size, int* channels, int* latency)
+{
+    assert(sink != NULL);
+    assert(sample_rate != NULL);
+    assert(sample_size != NULL);
+    assert(channels != NULL);
+
+    if (spec == NULL) {
+        spec = getenv(SINK_ENV);
+    }
+    if (spec == NULL || strcmp(spec, "oss") == 0) {
+        sink->type = SINK_OSS;
+        if (latency != NULL) {
+            sink->fd = aud_writelatency(sample_rate, sample_size, channels,
+                                        latency);
+        }
+        else {
+            sink->fd = aud_writeopen(sample_rate, sample_size, channels);
+        }
+    }
+    else if (strcmp(spec, "null") == 0) {
+        sink->type = SINK_NULL;
+        sink->fd = open("/dev/null", O_WRONLY);
+    }
+    else if (strncmp(spec, "wav:", 4) == 0) {
+        sink->type = SINK_WAV;
+        sink->sample_rate = *sample_rate;
+        sink->sample_size = *sample_size;
+        sink->channels = *channels;
+        sink->fd = open(spec + 4, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (sink->fd >= 0 &&
+            (aud_writeheader(sink->fd, *sample_rate, *sample_size,
+                             *channels, 0) < 0 ||
+             lseek(sink->fd, AUD_HEADER_LENGTH, SEEK_SET) < 0))
+        {
+            close(sink->fd);
+            sink->fd = -1;
+        }
+    }
+    else {
+        errno = EINVAL;
+        return -1;
+    }
+    if (sink->fd < 0) {
+        return -1;
+    }
+
+    sink->bytes_per_second = *sample_rate * *channels * (*sample_size / 8);
+    sink->buffer_length = (long) SINK_NULL_LATENCY * sink->bytes_per_second
+                        / 1000;
+    if (sink->type == SINK_NULL && latency != NULL) {
+        sink->buffer_length = (long) *latency * sink->bytes_per_second
+                            / 1000;
+    }
+    sink->queued = 0;
+    sink->clock = deadbeef_now_us() / 1e6;
+    sink->data_length = 0;
+
+    return 0;
+}
+
+
+/**
+ * Write length bytes of samples to the sink. Like a sound card, the null
+ * sink blocks until its buffer has room for them.
+ *
+ * Return the number of bytes written, or -1 on error.
+ */
+ssize_t sink_write(struct sink* sink, const void* samples, size_t length) {
+    ssize_t len;
+
+    assert(sink != NULL);
+    assert(samples != NULL);
+
+    if (sink->type == SINK_NULL) {
+        drain(sink);
+        if (sink->queued + length > sink->buffer_length) {
+            usleep((sink->queued + length - sink->buffer_length) * 1e6
+                   / sink->bytes_per_second);
+            drain(sink);
+        }
+        sink->queued += length;
+        return length;
+    }
+
+    len = write(sink->fd, samples, length);
+    if (len > 0) {
+        sink->data_length += len;
+    }
+
+    return len;
+}
+
+
+/**
+ * Return the number of bytes that can be written without blocking, or -1 if
+ * it is unknown.
+ */
+int sink_space(struct sink* sink) {
+    assert(sink != NULL);
+
+    switch (sink->type) {
+        case SINK_OSS:
+            return aud_outspace(sink->fd, NULL);
+        case SINK_NULL:
+            drain(sink);
+            return sink->buffer_length - (long) sink->queued;
+    }
+
+    return -1;
+}
+
+
+/**
+ * Return the number of bytes written but not played yet, or -1 if it is
+ * unknown.
+ */
+int sink_delay(struct sink* sink) {
+    assert(sink != NULL);
+
+    switch (sink->type) {
+        case SINK_OSS:
+            return aud_outdelay(sink->fd);
+        case SINK_NULL:
+            drain(sink);
+            return sink->queued;
+    }
+
+    return -1;
+}
+
+
+/**
+ * Drop the samples written but not played yet.
+ */
+void sink_reset(struct sink* sink) {
+    assert(sink != NULL);
+
+    switch (sink->type) {
+        case SINK_OSS:
+            aud_outreset(sink->fd);
+            break;
+        case SINK_NULL:
+            sink->queued = 0;
+            break;
+    }
+}
+
+
+/**
+ * Close the sink. Like a sound card, the null sink first plays what it
+ * holds. The header of a WAV capture is completed.
+ *
+ * Return 0 on success, -1 on error.
+ */
+int sink_close(struct sink* sink) {
+    int ret;
+
+    assert(sink != NULL);
+
+    ret = 0;
+    if (sink->type == SINK_NULL) {
+        drain(sink);
+        usleep(sink->queued * 1e6 / sink->bytes_per_second);
+    }
+    if (sink->type == SINK_WAV &&
+        aud_writeheader(sink->fd, sink->sample_rate, sink->sample_size,
+                        sink->channels, sink->data_length) < 0)
+    {
+        ret = -1;
+    }
+    if (close(sink->fd) < 0) {
+        ret = -1;
+    }
+
+    return ret;
+}
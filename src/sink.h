@@ -0,0 +1,57 @@
+/* Distributed under the terms of the GNU General Public License v2 */
+/* L3info - SYR2 Project - SYR DeaDBeeF
+ * ============================================================================
+ * Sink
+ * ----------------------------------------------------------------------------
+ * Audio outputs. A sink is selected by a specification:
+ *
+ *  - "oss" plays to the sound card, see sysprog-audio/audio.h;
+ *  - "null" discards the samples, but consumes them at the rate of the
+ *    stream from a simulated device buffer, so that the delay, the space
+ *    left and the underruns behave as with a sound card;
+ *  - "wav:<path>" captures the samples to a WAV file, as fast as they are
+ *    written.
+ *
+ * The null and WAV sinks accept any format, so that the client pipeline can
+ * be measured on machines without sound hardware.
+ * ----------------------------------------------------------------------------
+ * Antoine Pinsard
+ * Oct. 19, 2026
+ */
+#ifndef _SINK_H_
+#define _SINK_H_
+
+#include "deadbeef.h"
+
+#define SINK_OSS 0
+#define SINK_NULL 1
+#define SINK_WAV 2
+
+// Environment variable holding the default specification
+#define SINK_ENV "AUDIOSINK"
+// Buffer of the null sink when no latency is requested, in milliseconds
+#define SINK_NULL_LATENCY 200
+
+struct sink {
+    int type;
+    int fd;                 // Sound card or WAV file
+    int bytes_per_second;
+    // Null sink
+    long buffer_length;     // Bytes the simulated device holds
+    double queued;          // Bytes not played yet
+    double clock;           // Time queued was last updated
+    // WAV sink
+    long long data_length;
+    int sample_rate;        // Format of the capture, for its header
+    int sample_size;
+    int channels;
+};
+
+int sink_open(struct sink*, const char*, int*, int*, int*, int*);
+ssize_t sink_write(struct sink*, const void*, size_t);
+int sink_space(struct sink*);
+int sink_delay(struct sink*);
+void sink_reset(struct sink*);
+int sink_close(struct sink*);
+
+#endif
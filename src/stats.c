@@ -0,0 +1,223 @@
+/* Distributed under the terms of the GNU General Public License v2 */
+/* L3info - SYR2 Project - SYR DeaDBeeF
+ * ============================================================================
+ * Statistics
+ * ----------------------------------------------------------------------------
+ * Counters of the server, kept in shared memory.
+ * ----------------------------------------------------------------------------
+ * Antoine Pinsard
+ * Oct. 19, 2026
+ */
+#include <time.h>
+#include "stats.h"
+
+
+/**
+ * Create shared statistics for the given number of client slots.
+ *
+ * Return NULL if the shared memory could not be allocated.
+ */
+struct stats* stats_create(int nb_slots) {
+    struct stats* stats;
+    size_t size;
+    int shmid;
+
+    assert(nb_slots > 0);
+
+    size = sizeof(struct stats) + nb_slots * sizeof(struct stats_slot);
+    shmid = shmget(IPC_PRIVATE, size, 0600);
+    if (shmid == -1) {
+        return NULL;
+    }
+    stats = (struct stats*) shmat(shmid, NULL, 0);
+    if (stats == (void*) -1) {
+        shmctl(shmid, IPC_RMID, NULL);
+        return NULL;
+    }
+
+    // Shared memory is zeroed already.
+    stats->shmid = shmid;
+    stats->nb_slots = nb_slots;
+    stats->start = time(NULL);
+
+    return stats;
+}
+
+
+/**
+ * Detach and free the shared statistics.
+ */
+void stats_destroy(struct stats* stats) {
+    int shmid;
+
+    assert(stats != NULL);
+
+    shmid = stats->shmid;
+    shmdt((void*) stats);
+    shmctl(shmid, IPC_RMID, NULL);
+}
+
+
+static void add_counters(struct stats_counters* sum,
+                         const struct stats_counters* counters)
+{
+    int i;
+
+    sum->packets_sent += counters->packets_sent;
+    sum->send_errors += counters->send_errors;
+    sum->send_eagain += counters->send_eagain;
+    for (i = 0; i < STATS_NB_BUCKETS; i++) {
+        sum->lateness[i] += counters->lateness[i];
+    }
+}
+
+
+/**
+ * Start counting a new session to addr on the given slot. Must be called by
+ * the main process before the handler of the session is forked, once the
+ * handler of the previous session is done.
+ */
+void stats_begin_session(struct stats* stats, int slot,
+                         struct sockaddr_in* addr)
+{
+    struct stats_slot* s;
+
+    assert(stats != NULL);
+    assert(slot >= 0 && slot < stats->nb_slots);
+    assert(addr != NULL);
+
+    s = &stats->slots[slot];
+    add_counters(&s->retired, &s->current);
+    s->retired_heartbeats += s->heartbeats;
+    s->retired_timeouts += s->timeouts;
+    memset(&s->current, 0, sizeof(struct stats_counters));
+    s->heartbeats = 0;
+    s->timeouts = 0;
+    s->nb_sessions++;
+    memcpy(&s->addr, addr, sizeof(struct sockaddr_in));
+    memset(&s->digest, 0, sizeof(struct heartbeat_digest));
+    s->heartbeat_time = 0;
+}
+
+
+/**
+ * Count a heartbeat received at now for the session on the given slot, and
+ * keep the quality digest it carries if any.
+ */
+void stats_count_heartbeat(struct stats* stats, int slot,
+                           const unsigned char* heartbeat, long long now)
+{
+    struct heartbeat_digest digest;
+    struct stats_slot* s;
+
+    assert(stats != NULL);
+    assert(slot >= 0 && slot < stats->nb_slots);
+    assert(heartbeat != NULL);
+
+    s = &stats->slots[slot];
+    protocol_decode_heartbeat(heartbeat, &digest);
+    if (digest.valid) {
+        s->digest = digest;
+        s->heartbeat_time = now;
+    }
+    __sync_synchronize();
+    s->heartbeats++;
+}
+
+
+/**
+ * Write a record of the stats response at pos, see deadbeef.h.
+ *
+ * Return the position of the next record, or -1 if it does not fit.
+ */
+static int put_record(unsigned char* output, int pos, int active,
+                      struct sockaddr_in* addr, uint64_t nb_sessions,
+                      const struct stats_counters* counters,
+                      uint64_t heartbeats, uint64_t timeouts,
+                      uint64_t rejections,
+                      const struct heartbeat_digest* digest)
+{
+    struct stats_record record;
+
+    record.active = active;
+    record.addr = addr != NULL ? ntohl(addr->sin_addr.s_addr) : 0;
+    record.port = addr != NULL ? ntohs(addr->sin_port) : 0;
+    record.nb_sessions = nb_sessions;
+    record.packets_sent = counters->packets_sent;
+    record.send_errors = counters->send_errors;
+    record.send_eagain = counters->send_eagain;
+    record.heartbeats = heartbeats;
+    record.timeouts = timeouts;
+    record.rejections = rejections;
+    record.nb_buckets = STATS_NB_BUCKETS;
+    memcpy(record.lateness, counters->lateness, sizeof(counters->lateness));
+    if (digest != NULL) {
+        record.digest = *digest;
+    }
+    else {
+        memset(&record.digest, 0, sizeof(struct heartbeat_digest));
+    }
+
+    return protocol_encode_stats_record(output, pos, &record);
+}
+
+
+/**
+ * Generate the answer to a stats request with respect to the protocol.
+ * The generated message is written to output.
+ *
+ * active tells for each slot whether its session is still running.
+ */
+void stats_gen_message(unsigned char* output, struct stats* stats,
+                       const int* active)
+{
+    struct stats_counters total;
+    struct stats_header header;
+    struct stats_slot* s;
+    uint64_t heartbeats
+           , timeouts
+           , nb_sessions;
+    int nb_active
+      , pos
+      , next
+      , i;
+
+    assert(output != NULL);
+    assert(stats != NULL);
+    assert(active != NULL);
+
+    memset(&total, 0, sizeof(struct stats_counters));
+    heartbeats = stats->unknown_heartbeats;
+    timeouts = 0;
+    nb_sessions = 0;
+    nb_active = 0;
+    for (i = 0; i < stats->nb_slots; i++) {
+        s = &stats->slots[i];
+        add_counters(&total, &s->retired);
+        add_counters(&total, &s->current);
+        heartbeats += s->retired_heartbeats + s->heartbeats;
+        timeouts += s->retired_timeouts + s->timeouts;
+        nb_sessions += s->nb_sessions;
+        nb_active += active[i] != 0;
+    }
+
+    pos = put_record(output, STATS_RESP_HEADER_LENGTH, nb_active, NULL,
+                     nb_sessions, &total, heartbeats, timeouts,
+                     stats->rejections, NULL);
+    for (i = 0; i < stats->nb_slots; i++) {
+        s = &stats->slots[i];
+        next = put_record(output, pos, active[i] != 0,
+                          s->nb_sessions > 0 ? &s->addr : NULL,
+                          s->nb_sessions, &s->current, s->heartbeats,
+                          s->timeouts, 0, &s->digest);
+        if (next < 0) {
+            break;
+        }
+        pos = next;
+    }
+
+    header.uptime = time(NULL) - stats->start;
+    header.nb_slots = stats->nb_slots;
+    header.nb_buckets = STATS_NB_BUCKETS;
+    protocol_encode_stats(output, &header, pos);
+}
@@ -0,0 +1,116 @@
+/* Distributed under the terms of the GNU General Public License v2 */
+/* L3info - SYR2 Project - SYR DeaDBeeF
+ * ============================================================================
+ * Statistics
+ * ----------------------------------------------------------------------------
+ * Counters of the server, kept in shared memory so that the main process can
+ * report those of the handlers it forked.
+ *
+ * Each client slot of the server has its own counters. The handler streaming
+ * to the slot is the only writer of the counters of its session, and the main
+ * process is the only writer of everything else, so that counting is a plain
+ * increment. Counters written by different processes live on different cache
+ * lines so that they never share one.
+ *
+ * When a session starts on a slot, the counters of the previous one are
+ * added to the totals of the slot, from which the global counters are
+ * computed.
+ *
+ * The send loop lateness is the delay between the time a message is actually
+ * sent and the time it was due according to the pacing. It is counted in
+ * power of 2 buckets: bucket 0 counts messages sent less than 1 us late and
+ * bucket i messages sent from 2^(i-1) to 2^i us late, the last bucket
+ * counting any larger lateness.
+ * ----------------------------------------------------------------------------
+ * Antoine Pinsard
+ * Oct. 19, 2026
+ */
+#ifndef _STATS_H_
+#define _STATS_H_
+
+#include <errno.h>
+#include <stdint.h>
+#include "deadbeef.h"
+#include "protocol.h"
+
+#define STATS_CACHE_LINE 64
+#define STATS_NB_BUCKETS 16
+
+// Counters of a session, written by its handler only
+struct stats_counters {
+    uint64_t packets_sent; // Data messages sent
+    uint64_t send_errors;  // Failed sends, including the ones below
+    uint64_t send_eagain;  // Sends that failed with EAGAIN
+    uint64_t lateness[STATS_NB_BUCKETS];
+} __attribute__((aligned(STATS_CACHE_LINE)));
+
+struct stats_slot {
+    struct stats_counters current;
+    // Written by the main process only
+    struct {
+        struct stats_counters retired; // Sum of the previous sessions
+        uint64_t heartbeats;           // Received for the current session
+        uint64_t retired_heartbeats;
+        uint64_t timeouts;             // 1 if the current session was
+                                       // aborted for lack of heartbeats
+        uint64_t retired_timeouts;
+        uint64_t nb_sessions;
+        struct sockaddr_in addr;       // Client of the current session
+        // Last quality digest sent by the client, see deadbeef.h, and the
+        // time it was received, see deadbeef_now_us(). Both are written
+        // before heartbeats is counted, so that the streamer may read them.
+        struct heartbeat_digest digest;
+        long long heartbeat_time;
+    } __attribute__((aligned(STATS_CACHE_LINE)));
+};
+
+struct stats {
+    int shmid; // Shared memory identifier
+    int nb_slots;
+    time_t start;
+    // Written by the main process only
+    uint64_t rejections;         // Requests answered with 0x00C0FFEE
+    uint64_t unknown_heartbeats; // Heartbeats matching no session
+    struct stats_slot slots[];
+};
+
+struct stats* stats_create(int);
+void stats_destroy(struct stats*);
+void stats_begin_session(struct stats*, int, struct sockaddr_in*);
+void stats_count_heartbeat(struct stats*, int, const unsigned char*,
+                           long long);
+void stats_gen_message(unsigned char*, struct stats*, const int*);
+
+/**
+ * Count a message sent with send_message(), given its result.
+ */
+static inline void stats_count_send(struct stats_counters* counters, int ret)
+{
+    if (ret < 0) {
+        counters->send_errors++;
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            counters->send_eagain++;
+        }
+    }
+    else {
+        counters->packets_sent++;
+    }
+}
+
+/**
+ * Count a message sent late by the given number of microseconds.
+ */
+static inline void stats_count_lateness(struct stats_counters* counters,
+                                        long lateness)
+{
+    int bucket;
+
+    for (bucket = 0; bucket < STATS_NB_BUCKETS - 1 && lateness > 0;
+         bucket++)
+    {
+        lateness >>= 1;
+    }
+    counters->lateness[bucket]++;
+}
+
+#endif
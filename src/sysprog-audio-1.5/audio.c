@@ -16,6 +16,7 @@
 #include <errno.h>
 #include <unistd.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
@@ -31,80 +32,302 @@
 /* Definitions for the WAVE format */
 
 #define RIFF		"RIFF"	
-#define WAVEFMT		"WAVEfmt"
-#define DATA		0x61746164
+#define WAVE		"WAVE"
+#define FMT		"fmt "
+#define DATA		"data"
 #define PCM_CODE	1
+#define FLOAT_CODE	3
+#define EXTENSIBLE_CODE	0xFFFE
 
-typedef struct _waveheader {
-  char		main_chunk[4];	/* 'RIFF' */
-  uint32_t	length;		/* filelen */
-  char		chunk_type[7];	/* 'WAVEfmt' */
-  uint32_t	sc_len;		/* length of sub_chunk, =16 */
-  uint16_t	format;		/* should be 1 for PCM-code */
-  uint16_t	chans;		/* 1 Mono, 2 Stereo */
+typedef struct _chunkheader {
+  char		id[4];
+  uint32_t	length;		/* without the header nor the pad byte */
+} ChunkHeader;
+
+typedef struct _fmtchunk {
+  uint16_t	format;		/* 1 for PCM, 3 for float, 0xFFFE for extensible */
+  uint16_t	chans;
   uint32_t	sample_fq;	/* frequence of sample */
   uint32_t	byte_p_sec;
-  uint16_t	byte_p_spl;	/* samplesize; 1 or 2 bytes */
-  uint16_t	bit_p_spl;	/* 8, 12 or 16 bit */ 
+  uint16_t	byte_p_spl;	/* bytes per frame */
+  uint16_t	bit_p_spl;	/* container size of a sample */
+  /* WAVE_FORMAT_EXTENSIBLE only */
+  uint16_t	ext_len;	/* =22 */
+  uint16_t	valid_bits;	/* significant bits of a sample */
+  uint32_t	chan_mask;
+  uint16_t	sub_format;	/* first two bytes of the format GUID */
+  char		guid[14];
+} __attribute__((packed)) FmtChunk;
 
-  uint32_t	data_chunk;	/* 'data' */
-  uint32_t	data_length;	/* samplecount */
-} WaveHeader;
+int aud_parse (int fd, struct aud_info *info)
+{
+  /* Walks the RIFF chunks up to the data chunk.
+   * Returns 0 if the file holds PCM or float samples */
+  char riff[12];
+  ChunkHeader ch;
+  FmtChunk fmt;
+  struct stat st;
+  off_t pos, length;
+  int has_fmt = 0, frame_length;
 
-int aud_readinit (char *filename, int *sample_rate, 
-		  int *sample_size, int *channels ) 
+  if (fstat (fd, &st) < 0)
+    return -1;
+
+  if (pread (fd, riff, sizeof(riff), 0) != sizeof(riff) ||
+      0 != bcmp(riff, RIFF, 4) || 0 != bcmp(riff + 8, WAVE, 4)) {
+    fprintf (stderr, "not a WAVE-file\n");
+    errno = 3;// EFTYPE;
+    return -1;
+  }
+
+  /* Chunks are word aligned: a chunk of odd length is followed by a pad
+   * byte. Unknown chunks (LIST, fact, cue, ...) are skipped. */
+  for (pos = sizeof(riff); ; pos += sizeof(ch) + ch.length + (ch.length & 1)) {
+    if (pread (fd, &ch, sizeof(ch), pos) != sizeof(ch)) {
+      fprintf (stderr, "no data in WAVE-file\n");
+      errno = 3;// EFTYPE;
+      return -1;
+    }
+    ch.length = swap_long(ch.length);
+
+    if (0 == bcmp(ch.id, FMT, 4)) {
+      memset (&fmt, 0, sizeof(fmt));
+      length = ch.length < sizeof(fmt) ? ch.length : sizeof(fmt);
+      if (length < 16 ||
+	  pread (fd, &fmt, length, pos + sizeof(ch)) != length) {
+	fprintf (stderr, "bad format chunk in WAVE-file\n");
+	errno = 3;// EFTYPE;
+	return -1;
+      }
+      has_fmt = 1;
+    }
+    else if (0 == bcmp(ch.id, DATA, 4) && has_fmt) {
+      break;
+    }
+  }
+
+  info->format = swap_short(fmt.format);
+  info->sample_rate = swap_long(fmt.sample_fq);
+  info->sample_size = swap_short(fmt.bit_p_spl);
+  info->valid_bits = info->sample_size;
+  info->channels = swap_short(fmt.chans);
+  info->channel_mask = 0;
+  if (info->format == EXTENSIBLE_CODE) {
+    if (swap_short(fmt.ext_len) < 22) {
+      fprintf (stderr, "bad extensible format in WAVE-file\n");
+      errno = 5;//EFTYPE;
+      return -1;
+    }
+    info->format = swap_short(fmt.sub_format);
+    if (fmt.valid_bits != 0)
+      info->valid_bits = swap_short(fmt.valid_bits);
+    info->channel_mask = swap_long(fmt.chan_mask);
+  }
+
+  if (info->format != PCM_CODE && info->format != FLOAT_CODE) {
+    fprintf (stderr, "can't play non PCM WAVE-files\n");
+    errno = 5;//EFTYPE;
+    return -1;
+  }
+  if ((info->format == PCM_CODE && (info->sample_size % 8 != 0 ||
+				    info->sample_size < 8 ||
+				    info->sample_size > 32)) ||
+      (info->format == FLOAT_CODE && info->sample_size != 32 &&
+       info->sample_size != 64) ||
+      info->valid_bits > info->sample_size) {
+    fprintf (stderr, "can't play %d bit WAVE-files\n", info->sample_size);
+    errno = 5;//EFTYPE;
+    return -1;
+  }
+  if (info->channels < 1 || info->channels > AUD_MAX_CHANNELS) {
+    fprintf (stderr, "can't play WAVE-files with %d tracks\n", info->channels);
+    errno = 5;//EFTYPE;
+    return -1;
+  }
+
+  /* The length of the data chunk is not reliable when the file was written
+   * as a stream, or truncated. */
+  info->data_offset = pos + sizeof(ch);
+  info->data_length = ch.length;
+  if (ch.length == 0 || ch.length == 0xFFFFFFFF ||
+      info->data_offset + info->data_length > st.st_size)
+    info->data_length = st.st_size - info->data_offset;
+  frame_length = info->channels * info->sample_size / 8;
+  info->data_length -= info->data_length % frame_length;
+
+  return 0;
+}
+
+int aud_readinfo (char *filename, struct aud_info *info)
 {
-  /* Sets up a descriptor to read from a wave (RIFF). 
+  /* Sets up a descriptor to read the samples of a wave (RIFF).
    * Returns file descriptor if successful*/
   int fd;
-  WaveHeader wh;
-		  
+
   if (0 > (fd = open (filename, O_RDONLY))){
     fprintf(stderr,"unable to open the audiofile\n");
     return -1;
   }
 
-  read (fd, &wh, sizeof(wh));
+  if (aud_parse (fd, info) < 0 ||
+      lseek (fd, info->data_offset, SEEK_SET) < 0) {
+    close(fd);
+    return -1;
+  }
 
-  if (0 != bcmp(wh.main_chunk, RIFF, sizeof(wh.main_chunk)) || 
-      0 != bcmp(wh.chunk_type, WAVEFMT, sizeof(wh.chunk_type)) ) {
-    fprintf (stderr, "not a WAVE-file\n");
-    errno = 3;// EFTYPE;
+  return fd;
+}
+
+int aud_open (const char *filename, struct aud_source *source)
+{
+  /* Opens a wave (RIFF) once and maps its samples.
+   * Returns 0 if successful */
+  off_t start;
+  long page;
+
+  if (0 > (source->fd = open (filename, O_RDONLY))) {
+    fprintf(stderr,"unable to open the audiofile\n");
     return -1;
   }
-  if (swap_short(wh.format) != PCM_CODE) {
-    fprintf (stderr, "can't play non PCM WAVE-files\n");
-    errno = 5;//EFTYPE;
+
+  if (aud_parse (source->fd, &source->info) < 0) {
+    close (source->fd);
+    source->fd = -1;
     return -1;
   }
-  if (swap_short(wh.chans) > 2) {
-    fprintf (stderr, "can't play WAVE-files with %d tracks\n", wh.chans);
+
+  source->data = NULL;
+  source->length = source->info.data_length;
+  source->map = NULL;
+  source->map_length = 0;
+  if (source->length == 0)
+    return 0;
+
+  /* Mappings start on a page boundary, the header is mapped as well. */
+  page = sysconf (_SC_PAGESIZE);
+  start = source->info.data_offset - source->info.data_offset % page;
+  source->map_length = source->info.data_offset - start + source->length;
+  source->map = mmap (NULL, source->map_length, PROT_READ, MAP_SHARED,
+		      source->fd, start);
+  if (source->map == MAP_FAILED) {
+    close (source->fd);
+    source->fd = -1;
+    source->map = NULL;
     return -1;
   }
-	
-  *sample_rate = (unsigned int) swap_long(wh.sample_fq);
-  *sample_size = (unsigned int) swap_short(wh.bit_p_spl);
-  *channels = (unsigned int) swap_short(wh.chans);	
+  madvise (source->map, source->map_length, MADV_SEQUENTIAL);
+  source->data = (const unsigned char *) source->map
+    + (source->info.data_offset - start);
+
+  return 0;
+}
+
+void aud_close (struct aud_source *source)
+{
+  if (source->map != NULL)
+    munmap (source->map, source->map_length);
+  if (source->fd >= 0)
+    close (source->fd);
+  source->map = NULL;
+  source->data = NULL;
+  source->fd = -1;
+}
+
+int aud_writeheader (int fd, int sample_rate, int sample_size, int channels,
+		     off_t data_length)
+{
+  /* Writes the header of a PCM wave (RIFF) before its samples.
+   * Returns 0 if successful */
+  unsigned char header[AUD_HEADER_LENGTH];
+  ChunkHeader ch;
+  FmtChunk fmt;
+  uint32_t length;
+
+  length = 0xFFFFFFFF;
+  if (data_length <= 0xFFFFFFFF - 36)
+    length = data_length;
+
+  memcpy (header, RIFF, 4);
+  ch.length = swap_long(length == 0xFFFFFFFF ? length : length + 36);
+  memcpy (header + 4, &ch.length, 4);
+  memcpy (header + 8, WAVE, 4);
+
+  memcpy (ch.id, FMT, 4);
+  ch.length = swap_long(16);
+  memcpy (header + 12, &ch, sizeof(ch));
+  fmt.format = swap_short(PCM_CODE);
+  fmt.chans = swap_short(channels);
+  fmt.sample_fq = swap_long(sample_rate);
+  fmt.byte_p_sec = swap_long(sample_rate * channels * (sample_size / 8));
+  fmt.byte_p_spl = swap_short(channels * (sample_size / 8));
+  fmt.bit_p_spl = swap_short(sample_size);
+  memcpy (header + 20, &fmt, 16);
+
+  memcpy (ch.id, DATA, 4);
+  ch.length = swap_long(length);
+  memcpy (header + 36, &ch, sizeof(ch));
+
+  if (pwrite (fd, header, sizeof(header), 0) != sizeof(header))
+    return -1;
+  return 0;
+}
+
+int aud_readinit (char *filename, int *sample_rate, 
+		  int *sample_size, int *channels ) 
+{
+  /* Sets up a descriptor to read from a wave (RIFF). 
+   * Returns file descriptor if successful*/
+  int fd;
+  struct aud_info info;
+
+  if (0 > (fd = aud_readinfo (filename, &info)))
+    return -1;
+
+  *sample_rate = info.sample_rate;
+  *sample_size = info.sample_size;
+  *channels = info.channels;
 	
   fprintf (stderr, "%s chan=%u, freq=%u bitrate=%u format=%hu\n", 
-	   filename, *channels, *sample_rate, *sample_size, wh.format);
+	   filename, *channels, *sample_rate, *sample_size, info.format);
   return fd;
 }
 
-int aud_writeinit (int sample_rate, int sample_size, int channels) 
+static int fragment_setting (int latency, int sample_rate, int sample_size,
+			     int channels)
 {
-  /* Sets up the audio device params. 
+  /* Fragments of 2^shift bytes, four to seven of them, holding about
+   * latency milliseconds of samples. Smaller fragments let the writer
+   * follow the device more closely. */
+  long length;
+  int shift, count;
+
+  length = (long) latency * sample_rate * channels * (sample_size / 8) / 1000;
+  for (shift = 4; (8L << shift) <= length && shift < 16; shift++)
+    ;
+  count = length >> shift;
+  if (count < 4)
+    count = 4;
+  if (count > 0x7FFF)
+    count = 0x7FFF;
+
+  return (count << 16) | shift;
+}
+
+static int open_device (const char *devicename, int mode, int *sample_rate,
+			int *sample_size, int *channels, int *latency)
+{
+  /* Sets up the audio device params, keeping the ones the device accepted.
    * Returns device file descriptor if successful*/
-  int audio_fd, error;
-  char *devicename;
+  int audio_fd, error, fragment;
+  audio_buf_info space;
 
   printf("requested chans=%d, sample rate=%d sample size=%d\n", 
-	 channels, sample_rate, sample_size);
+	 *channels, *sample_rate, *sample_size);
   
-  if (NULL == (devicename = getenv("AUDIODEV")))
+  if (devicename == NULL && NULL == (devicename = getenv("AUDIODEV")))
     devicename = AUDIODEV;
     	
-  if ((audio_fd = open (devicename, O_WRONLY, 0)) < 0) {
+  if ((audio_fd = open (devicename, mode, 0)) < 0) {
     perror ("setparams : open ") ;
     return -1;
   } 
@@ -113,20 +336,31 @@ int aud_writeinit (int sample_rate, int sample_size, int channels)
     close(audio_fd);
     return -1;	
   } 
+
+  /* The fragments must be set before the format. */
+  if (latency != NULL) {
+    fragment = fragment_setting (*latency, *sample_rate, *sample_size,
+				 *channels);
+    if (ioctl (audio_fd, SNDCTL_DSP_SETFRAGMENT, &fragment) != 0) {
+      perror ("setparams : fragment ") ;
+      close(audio_fd);
+      return -1;
+    }
+  }
 	
-  if ((error = ioctl (audio_fd, SNDCTL_DSP_SAMPLESIZE, &sample_size)) != 0) {
+  if ((error = ioctl (audio_fd, SNDCTL_DSP_SAMPLESIZE, sample_size)) != 0) {
     perror ("setparams : bitwidth ") ;
     close(audio_fd);
     return -1;
   } 
 
-  if (ioctl (audio_fd, SNDCTL_DSP_CHANNELS, &channels) != 0) {
+  if (ioctl (audio_fd, SNDCTL_DSP_CHANNELS, channels) != 0) {
     perror ("setparams : channels ") ;
     close(audio_fd);
     return -1;
   } 
 
-  if ((error = ioctl (audio_fd, SNDCTL_DSP_SPEED, &sample_rate)) != 0) {
+  if ((error = ioctl (audio_fd, SNDCTL_DSP_SPEED, sample_rate)) != 0) {
     perror ("setparams : sample rate ") ;
     close(audio_fd);
     return -1;
@@ -138,9 +372,74 @@ int aud_writeinit (int sample_rate, int sample_size, int channels)
     return -1;
   } 
   printf("set chans=%d, sample rate=%d sample size=%d\n",
-	 channels,sample_rate, sample_size);
+	 *channels, *sample_rate, *sample_size);
+
+  /* The driver may round the fragments, report what it actually holds. */
+  if (latency != NULL &&
+      ioctl (audio_fd, SNDCTL_DSP_GETOSPACE, &space) == 0 &&
+      space.fragstotal > 0) {
+    *latency = (long) space.fragstotal * space.fragsize * 1000
+      / ((long) *sample_rate * *channels * (*sample_size / 8));
+    printf("set fragments=%d, fragment size=%d latency=%dms\n",
+	   space.fragstotal, space.fragsize, *latency);
+  }
   return audio_fd;
 }
 
+int aud_writeopen (int *sample_rate, int *sample_size, int *channels)
+{
+  return open_device (NULL, O_WRONLY, sample_rate, sample_size, channels,
+		      NULL);
+}
+
+int aud_writelatency (int *sample_rate, int *sample_size, int *channels,
+		      int *latency)
+{
+  return open_device (NULL, O_WRONLY, sample_rate, sample_size, channels,
+		      latency);
+}
+
+int aud_captureopen (const char *devicename, int *sample_rate,
+		     int *sample_size, int *channels)
+{
+  return open_device (devicename, O_RDONLY, sample_rate, sample_size,
+		      channels, NULL);
+}
+
+int aud_outspace (int fd, int *fragment_length)
+{
+  /* Returns the number of bytes that can be written without blocking */
+  audio_buf_info space;
+
+  if (ioctl (fd, SNDCTL_DSP_GETOSPACE, &space) != 0)
+    return -1;
+  if (fragment_length != NULL)
+    *fragment_length = space.fragsize;
+  return space.bytes;
+}
+
+int aud_outreset (int fd)
+{
+  /* Drops the samples written but not played yet */
+  return ioctl (fd, SNDCTL_DSP_RESET, 0);
+}
+
+int aud_outdelay (int fd)
+{
+  /* Returns the number of bytes written but not played yet */
+  int delay;
+
+  if (ioctl (fd, SNDCTL_DSP_GETODELAY, &delay) != 0)
+    return -1;
+  return delay;
+}
+
+int aud_writeinit (int sample_rate, int sample_size, int channels) 
+{
+  /* Sets up the audio device params. 
+   * Returns device file descriptor if successful*/
+  return aud_writeopen (&sample_rate, &sample_size, &channels);
+}
+
 
 
@@ -4,12 +4,101 @@
  * (c) Vrije Universiteit Amsterdam, BSD License applies
  * contact info : wdb -_at-_ few.vu.nl
  * */
+#ifndef _AUDIO_H_
+#define _AUDIO_H_
+
+#include <sys/types.h>
+
+#define AUD_FORMAT_PCM		1
+#define AUD_FORMAT_FLOAT	3
+#define AUD_MAX_CHANNELS	32
+#define AUD_HEADER_LENGTH	44	/* of the files written by aud_writeheader */
+
+/** description of the samples of a WAV-file */
+struct aud_info {
+  int format;		/* AUD_FORMAT_PCM or AUD_FORMAT_FLOAT */
+  int sample_rate;
+  int sample_size;	/* bits per sample, as stored: 8, 16, 24, 32 or 64 */
+  int valid_bits;	/* significant bits per sample, e.g., 20 of 24 */
+  int channels;
+  unsigned int channel_mask;	/* speaker positions, 0 if unknown */
+  off_t data_offset;	/* offset of the first sample in the file */
+  off_t data_length;	/* length of the samples, in whole frames */
+};
+
+/** a WAV-file opened once, with its samples mapped in memory */
+struct aud_source {
+  int fd;			/* the opened file */
+  struct aud_info info;
+  const unsigned char *data;	/* the samples, NULL if there are none */
+  size_t length;		/* length of the samples, = info.data_length */
+  void *map;			/* the mapping, from the page holding data */
+  size_t map_length;
+};
+
+/** parse the header of an opened WAV-file
+ *
+ * this function walks the RIFF chunks of the file up to the data chunk, so
+ * that files holding other chunks (LIST, fact, ...) before their samples are
+ * supported, as well as WAVE_FORMAT_EXTENSIBLE files. Samples may be integers
+ * of 8 to 32 bits or floats, on any number of channels up to AUD_MAX_CHANNELS.
+ * The position of fd is left unchanged.
+ *
+ * @param fd	a descriptor of the file, opened for reading
+ * @param info	the description of the samples, filled on success
+ *
+ * @return 0 on success, <0 on failure
+ */
+int aud_parse (int fd, struct aud_info *info);
+
+/** open a WAV-file for reading its samples
+ *
+ * same as aud_readinit below, with the full description of the samples.
+ *
+ * @return a descriptor of the opened file positioned at the first sample on
+ *         success, <0 on failure. The caller is responsible for closing it.
+ */
+int aud_readinfo (char *filename, struct aud_info *info);
+
+/** open a WAV-file and map its samples
+ *
+ * the file is opened once: the same descriptor is used to parse the header
+ * and to map the samples read-only. The kernel is told the samples will be
+ * read sequentially. The file must not be truncated while it is mapped.
+ *
+ * @param filename	a non-NULL pointer to a string denoting a local file
+ * @param source	the opened file, filled on success
+ *
+ * @return 0 on success, <0 on failure
+ */
+int aud_open (const char *filename, struct aud_source *source);
+
+/** unmap and close a WAV-file opened with aud_open */
+void aud_close (struct aud_source *source);
+
+/** write the header of a PCM WAV-file
+ *
+ * the canonical header of AUD_HEADER_LENGTH bytes is written at the start of
+ * the file, the samples following it. The position of fd is left unchanged,
+ * so that the header may be written again once the length of the samples is
+ * known. A length that does not fit the header is written as unknown, which
+ * aud_parse reads up to the end of the file.
+ *
+ * @param fd	a descriptor of the file, opened for writing
+ * @param sample_rate, sample_size, channels: see aud_readinit below
+ * @param data_length	the length of the samples in bytes
+ *
+ * @return 0 on success, <0 on failure
+ */
+int aud_writeheader (int fd, int sample_rate, int sample_size, int channels,
+		     off_t data_length);
 
 /** open a WAV-file for reading
  *
  * this function checks whether the file pointed to by filename exists,
  * and if it is of the right type. Note that not all WAV filetypes are
- * supported. Only the simplest uncompressed PCM streams can be read.
+ * supported. Only uncompressed PCM and float streams can be read, see
+ * aud_parse.
  *
  * the function writes metadata about the opened file in the integers pointed
  * to by the parameters.
@@ -17,9 +106,10 @@
  * @param filename	a non-NULL pointer to a string denoting a local file
  * @param sample_rate	the number of samples per second, e.g., 44kHz
  * @param sample_size	the precision of the wave-approximations, e.g., 16bit
- * @param channels	the number of channels. No THX or dobly, we only accept mono and stereo
+ * @param channels	the number of channels
  *
- * @return 0 on success, <0 on failure
+ * @return a descriptor of the opened file positioned at the first sample on
+ *         success, <0 on failure. The caller is responsible for closing it.
  */
 int aud_readinit (char *filename, int *sample_rate, int*sample_size, int* channels );
 
@@ -33,3 +123,54 @@ int aud_readinit (char *filename, int *sample_rate, int*sample_size, int* channe
  */
 int aud_writeinit (int sample_rate, int sample_size, int channels); 
 
+/** write an uncompressed PCM stream to the speaker, in the format it accepts
+ *
+ * same as aud_writeinit above, except that the parameters are updated to the
+ * ones the device actually accepted, which may differ from the requested ones.
+ * The stream must then be converted to them.
+ */
+int aud_writeopen (int *sample_rate, int *sample_size, int *channels);
+
+/** write an uncompressed PCM stream to the speaker, with a bounded latency
+ *
+ * same as aud_writeopen above, except that the device buffer is split in
+ * fragments holding about latency milliseconds of samples, rather than the
+ * driver default. latency is updated to what the device buffer actually
+ * holds. Writes should not exceed aud_outspace below, so that they do not
+ * block.
+ */
+int aud_writelatency (int *sample_rate, int *sample_size, int *channels,
+		      int *latency);
+
+/** read an uncompressed PCM stream from a capture device
+ *
+ * same as aud_writeopen above, but the given device, e.g. /dev/dsp, is
+ * opened for reading, so that the returned descriptor reads what it captures
+ * in the format it accepted.
+ */
+int aud_captureopen (const char *devicename, int *sample_rate,
+		     int *sample_size, int *channels);
+
+/** query the space left in the buffer of the speaker
+ *
+ * @param fd		a descriptor returned by one of the functions above
+ * @param fragment_length	the size of a fragment, if non-NULL
+ *
+ * @return the number of bytes that can be written without blocking, <0 on
+ *         failure
+ */
+int aud_outspace (int fd, int *fragment_length);
+
+/** query the delay of the speaker
+ *
+ * @return the number of bytes written but not played yet, <0 on failure
+ */
+int aud_outdelay (int fd);
+
+/** drop the samples written to the speaker but not played yet
+ *
+ * @return 0 on success, <0 on failure
+ */
+int aud_outreset (int fd);
+
+#endif
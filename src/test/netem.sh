@@ -0,0 +1,161 @@
+#!/bin/sh
+# Distributed under the terms of the GNU General Public License v2
+# L3info - SYR2 Project - SYR DeaDBeeF
+# =============================================================================
+# Network Impairment Tests
+# -----------------------------------------------------------------------------
+# Stream a generated WAV file from audioserver to audioclient through netem,
+# see netem.h, once per impairment profile, and check that:
+#
+#  - the client exits successfully;
+#  - the WAV capture of the client holds as many bytes as the file, lost
+#    blocks being concealed rather than dropped;
+#  - the QoS summary of the client, see qos.h, reports a loss, a jitter and a
+#    number of underruns within the bounds of the profile, and a duration
+#    within TIME_SLACK seconds of the length of the file: the WAV sink does
+#    not play at real time, but the stream must arrive at least as fast as it
+#    would play, lost blocks included.
+#
+# Usage: netem.sh [bin_dir]
+#
+# bin_dir holds the binaries, bin by default. The server listens on its usual
+# port, which must be free, and the relay on NETEM_PORT. Each failure is
+# reported, and the exit status is a failure if any check failed.
+# -----------------------------------------------------------------------------
+# Antoine Pinsard
+# Oct. 19, 2026
+
+BIN=$(cd "${1:-bin}" && pwd) || exit 1
+NETEM_PORT=16640
+DURATION=10
+TIME_SLACK=3
+CLIENT_TIMEOUT=30
+
+# name, netem options, max loss ratio, max jitter in ms, max underruns
+PROFILES="clean||0|5|0
+loss|loss=5 dir=down seed=1|0.1|5|10
+burst|loss=10 burst=4 dir=down seed=2|0.25|5|10
+delay|delay=40 jitter=5 seed=3|0.01|20|10
+reorder|reorder=10 duplicate=5 seed=4|0.01|20|10
+rate|rate=3000 dir=down|0.05|50|10"
+
+DIR=$(mktemp -d /tmp/deadbeef-test-XXXXXX) || exit 1
+SERVER=
+RELAY=
+trap 'cleanup' EXIT INT TERM
+
+cleanup() {
+    [ -n "$RELAY" ] && kill "$RELAY" 2>/dev/null
+    [ -n "$SERVER" ] && kill "$SERVER" 2>/dev/null
+    wait 2>/dev/null
+    rm -rf "$DIR"
+}
+
+# Print value as n little-endian bytes.
+le() {
+    value=$1
+    i=0
+    while [ $i -lt "$2" ]; do
+        printf "\\$(printf %03o $((value % 256)))"
+        value=$((value / 256))
+        i=$((i + 1))
+    done
+}
+
+# Print the number of the given JSON field of a line.
+field() {
+    sed -n "s/.*\"$2\": \([-0-9.]*\).*/\1/p" "$1" | tail -n 1
+}
+
+# Succeed if a <= b, as decimal numbers.
+at_most() {
+    awk -v a="$1" -v b="$2" 'BEGIN { exit !(a <= b) }'
+}
+
+# 16-bit stereo at 44.1 kHz, random so that blocks are not all compressed
+LENGTH=$((44100 * 4 * DURATION))
+{
+    printf RIFF
+    le $((36 + LENGTH)) 4
+    printf "WAVEfmt "
+    le 16 4
+    le 1 2
+    le 2 2
+    le 44100 4
+    le $((44100 * 4)) 4
+    le 4 2
+    le 16 2
+    printf data
+    le $LENGTH 4
+    head -c $LENGTH /dev/urandom
+} > "$DIR/test.wav"
+
+cd "$DIR" || exit 1
+"$BIN/audioserver" -r > server.log 2>&1 &
+SERVER=$!
+sleep 1
+if ! kill -0 "$SERVER" 2>/dev/null; then
+    echo "The server did not start:" >&2
+    cat server.log >&2
+    exit 1
+fi
+
+failures=0
+fail() {
+    echo "FAIL $name: $*"
+    failures=$((failures + 1))
+}
+
+while IFS='|' read -r name options max_loss max_jitter max_underruns; do
+    # Word splitting of the options is intended.
+    # shellcheck disable=SC2086
+    "$BIN/netem" $NETEM_PORT 127.0.0.1 $options < /dev/null > netem.log \
+        2>&1 &
+    RELAY=$!
+    sleep 0.2
+
+    rm -f out.wav
+    timeout $CLIENT_TIMEOUT "$BIN/audioclient" 127.0.0.1:$NETEM_PORT \
+        test.wav sink=wav:out.wav qos=- < /dev/null > client.log 2>&1
+    status=$?
+    kill -INT "$RELAY" 2>/dev/null
+    wait "$RELAY" 2>/dev/null
+    RELAY=
+
+    grep '"type": "summary"' client.log > summary.json
+    duration=$(field summary.json duration_s)
+    loss=$(field summary.json loss)
+    jitter=$(field summary.json jitter_ms)
+    underruns=$(field summary.json underruns)
+
+    if [ $status -ne 0 ]; then
+        fail "the client exited with status $status"
+    fi
+    if [ ! -f out.wav ] ||
+       [ "$(wc -c < out.wav)" -ne "$(wc -c < test.wav)" ]
+    then
+        fail "the capture does not hold as many bytes as the file"
+    fi
+    if [ -z "$duration" ]; then
+        fail "no QoS summary"
+    else
+        at_most "$duration" $((DURATION + TIME_SLACK)) ||
+            fail "received in ${duration}s, over $((DURATION + TIME_SLACK))s"
+        at_most "$loss" "$max_loss" ||
+            fail "loss $loss over $max_loss"
+        at_most "$jitter" "$max_jitter" ||
+            fail "jitter ${jitter}ms over ${max_jitter}ms"
+        at_most "$underruns" "$max_underruns" ||
+            fail "$underruns underruns over $max_underruns"
+    fi
+    echo "profile=$name duration_s=$duration loss=$loss jitter_ms=$jitter" \
+         "underruns=$underruns"
+done <<EOF
+$PROFILES
+EOF
+
+if [ "$failures" -ne 0 ]; then
+    echo "$failures check(s) failed."
+    exit 1
+fi
+echo "All profiles passed."
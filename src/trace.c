@@ -0,0 +1,217 @@
+/* Distributed under the terms of the GNU General Public License v2 */
+/* L3info - SYR2 Project - SYR DeaDBeeF
+ * ============================================================================
+ * Trace
+ * ----------------------------------------------------------------------------
+ * Binary tracing of the streaming hot path.
+ * ----------------------------------------------------------------------------
+ * Antoine Pinsard
+ * Oct. 19, 2026
+ */
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+#include "trace.h"
+
+
+__thread struct trace_ring* trace_current = NULL;
+
+// Rings of all the threads of the process
+static struct trace_ring* rings = NULL;
+static char trace_dir[PATH_MAX] = TRACE_DEFAULT_DIR;
+static uint64_t clock_start = 0;
+static uint64_t ns_start = 0;
+
+static const char* event_names[TRACE_NB_TYPES] = {
+    "unknown", "encode", "send", "wake", NULL, NULL, "heartbeat", "timeout",
+    "receive", "tier"
+};
+
+
+static uint64_t monotonic_ns() {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+
+/**
+ * Allocate the ring of the calling thread.
+ *
+ * Return NULL if the allocation failed.
+ */
+struct trace_ring* trace_ring_create() {
+    struct trace_ring* ring;
+
+    ring = calloc(1, sizeof(struct trace_ring));
+    if (ring == NULL) {
+        return NULL;
+    }
+    ring->tid = syscall(SYS_gettid);
+    ring->next = __atomic_load_n(&rings, __ATOMIC_ACQUIRE);
+    while (!__atomic_compare_exchange_n(&rings, &ring->next, ring, 0,
+                                        __ATOMIC_RELEASE, __ATOMIC_ACQUIRE));
+    trace_current = ring;
+
+    return ring;
+}
+
+
+/**
+ * Forget the events of the parent in a forked child. Only the ring of the
+ * forking thread is kept, since the other threads do not exist in the child.
+ */
+static void reset_child() {
+    rings = trace_current;
+    if (trace_current != NULL) {
+        trace_current->next = NULL;
+        trace_current->tid = syscall(SYS_gettid);
+        trace_current->head = 0;
+    }
+}
+
+
+static void dump_signal(int signum) {
+    trace_dump();
+}
+
+
+/**
+ * Set the tracing of the process up: the rings are dumped at exit and on
+ * TRACE_SIGNAL, and start over in forked children.
+ */
+void trace_init() {
+    struct sigaction action;
+    char* dir;
+
+    dir = getenv(TRACE_ENV);
+    if (dir != NULL && strlen(dir) < PATH_MAX - 64) {
+        strcpy(trace_dir, dir);
+    }
+    clock_start = trace_clock();
+    ns_start = monotonic_ns();
+
+    if (atexit(trace_dump) != 0) {
+        fprintf(stderr, "Unable to dump the trace at exit.\n");
+    }
+    memset(&action, 0, sizeof(struct sigaction));
+    action.sa_handler = dump_signal;
+    action.sa_flags = SA_RESTART;
+    sigaction(TRACE_SIGNAL, &action, NULL);
+    pthread_atfork(NULL, NULL, reset_child);
+}
+
+
+/**
+ * Append the decimal representation of value to s.
+ * Async-signal-safe, unlike snprintf().
+ */
+static char* append_number(char* s, unsigned long value) {
+    char digits[24];
+    int n;
+
+    n = 0;
+    do {
+        digits[n++] = '0' + value % 10;
+        value /= 10;
+    } while (value > 0);
+    while (n > 0) {
+        *s++ = digits[--n];
+    }
+    *s = '\0';
+
+    return s;
+}
+
+
+static void dump_ring(struct trace_ring* ring) {
+    char path[PATH_MAX];
+    struct trace_header header;
+    uint64_t head
+           , first
+           , nb_events;
+    size_t length
+         , start;
+    char* s;
+    int fd;
+
+    head = ring->head;
+    __atomic_signal_fence(__ATOMIC_ACQUIRE);
+    nb_events = head < TRACE_NB_EVENTS ? head : TRACE_NB_EVENTS;
+    if (nb_events == 0) {
+        return;
+    }
+
+    s = path + strlen(trace_dir);
+    memcpy(path, trace_dir, s - path);
+    strcpy(s, "/deadbeef-");
+    s = append_number(s + 10, getpid());
+    *s++ = '-';
+    s = append_number(s, ring->tid);
+    strcpy(s, ".trace");
+    fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return;
+    }
+
+    memset(&header, 0, sizeof(struct trace_header));
+    memcpy(header.magic, TRACE_MAGIC, 8);
+    header.pid = getpid();
+    header.tid = ring->tid;
+#if defined(__x86_64__) || defined(__i386__)
+    header.clock = TRACE_CLOCK_TSC;
+#else
+    header.clock = TRACE_CLOCK_MONOTONIC;
+#endif
+    header.clock_start = clock_start;
+    header.ns_start = ns_start;
+    header.clock_end = trace_clock();
+    header.ns_end = monotonic_ns();
+    header.nb_events = nb_events;
+
+    // The oldest events may wrap around the end of the ring.
+    first = head - nb_events;
+    start = first & (TRACE_NB_EVENTS - 1);
+    length = nb_events;
+    if (start + length > TRACE_NB_EVENTS) {
+        length = TRACE_NB_EVENTS - start;
+    }
+    if (write(fd, &header, sizeof(header)) != sizeof(header) ||
+        write(fd, ring->events + start, length * sizeof(struct trace_event))
+            != length * sizeof(struct trace_event) ||
+        (length < nb_events &&
+         write(fd, ring->events, (nb_events - length)
+                                 * sizeof(struct trace_event)) < 0))
+    {
+        close(fd);
+        return;
+    }
+    close(fd);
+}
+
+
+/**
+ * Dump the ring of each thread of the process. Async-signal-safe.
+ */
+void trace_dump() {
+    struct trace_ring* ring;
+
+    for (ring = __atomic_load_n(&rings, __ATOMIC_ACQUIRE); ring != NULL;
+         ring = ring->next)
+    {
+        dump_ring(ring);
+    }
+}
+
+
+/**
+ * Return the name of the given type of event.
+ */
+const char* trace_event_name(int type) {
+    if (type <= 0 || type >= TRACE_NB_TYPES || event_names[type] == NULL) {
+        return event_names[0];
+    }
+    return event_names[type];
+}
@@ -0,0 +1,139 @@
+/* Distributed under the terms of the GNU General Public License v2 */
+/* L3info - SYR2 Project - SYR DeaDBeeF
+ * ============================================================================
+ * Trace
+ * ----------------------------------------------------------------------------
+ * Binary tracing of the streaming hot path, for when pacing misbehaves.
+ *
+ * Each thread records fixed-size events to its own ring of the last
+ * TRACE_NB_EVENTS ones, so that recording takes no lock and no system call:
+ * a time stamp, read from the TSC on x86 and from the monotonic clock
+ * elsewhere, and a few stores. The rings of the process are dumped to
+ * <dir>/deadbeef-<pid>-<tid>.trace at exit or on TRACE_SIGNAL, where dir is
+ * given by the TRACE_DIR environment variable, /tmp by default. tracedump
+ * turns the dumps into a timeline.
+ *
+ * The TRACE() macros record nothing unless built with DEADBEEF_TRACE, see
+ * make TRACE=1, so that the hot path is unchanged otherwise.
+ * ----------------------------------------------------------------------------
+ * Antoine Pinsard
+ * Oct. 19, 2026
+ */
+#ifndef _TRACE_H_
+#define _TRACE_H_
+
+#include <stdint.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#include "deadbeef.h"
+
+// Number of events kept per thread, a power of 2
+#define TRACE_NB_EVENTS 65536
+#define TRACE_SIGNAL SIGUSR2
+#define TRACE_ENV "TRACE_DIR"
+#define TRACE_DEFAULT_DIR "/tmp"
+#define TRACE_MAGIC "DBTRACE1"
+
+// Events, with the meaning of their arguments
+#define TRACE_ENCODE 1       // packet, encoded length or 0 if raw
+#define TRACE_SEND 2         // first block, number of blocks
+#define TRACE_WAKE 3         // first block, end of the pacing sleep
+// 4 and 5 were the heartbeat semaphore events of older servers: they are
+// dumped as unknown.
+#define TRACE_HEARTBEAT 6    // client or blocks received, server or client
+#define TRACE_TIMEOUT 7      // client, milliseconds since its heartbeat
+#define TRACE_RECEIVE 8      // first block, number of new blocks
+#define TRACE_TIER 9         // client, quality tier of its session
+#define TRACE_NB_TYPES 10
+
+// Clocks
+#define TRACE_CLOCK_MONOTONIC 0 // Nanoseconds
+#define TRACE_CLOCK_TSC 1
+
+struct trace_event {
+    uint64_t time;
+    uint32_t arg;
+    uint16_t arg2;
+    uint8_t type;
+    uint8_t reserved;
+};
+
+struct trace_ring {
+    struct trace_ring* next; // Rings of the other threads
+    pid_t tid;
+    uint64_t head;           // Number of events recorded
+    struct trace_event events[TRACE_NB_EVENTS];
+};
+
+// Header of a dump, followed by the events, oldest first.
+struct trace_header {
+    char magic[8];
+    int32_t pid;
+    int32_t tid;
+    int32_t clock;
+    int32_t reserved;
+    // Two readings of both the trace clock and the monotonic clock, to
+    // convert time stamps to nanoseconds.
+    uint64_t clock_start;
+    uint64_t ns_start;
+    uint64_t clock_end;
+    uint64_t ns_end;
+    uint64_t nb_events;
+};
+
+extern __thread struct trace_ring* trace_current;
+
+void trace_init();
+struct trace_ring* trace_ring_create();
+void trace_dump();
+const char* trace_event_name(int);
+
+/**
+ * Return the current time of the trace clock.
+ */
+static inline uint64_t trace_clock() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+/**
+ * Record an event to the ring of the calling thread.
+ */
+static inline void trace_event(int type, uint32_t arg, uint16_t arg2) {
+    struct trace_ring* ring;
+    struct trace_event* event;
+
+    ring = trace_current;
+    if (ring == NULL) {
+        ring = trace_ring_create();
+        if (ring == NULL) {
+            return;
+        }
+    }
+    event = &ring->events[ring->head & (TRACE_NB_EVENTS - 1)];
+    event->time = trace_clock();
+    event->arg = arg;
+    event->arg2 = arg2;
+    event->type = type;
+    // A dump from a signal handler sees the event once it is complete.
+    __atomic_signal_fence(__ATOMIC_RELEASE);
+    ring->head++;
+}
+
+#ifdef DEADBEEF_TRACE
+#define TRACE_INIT() trace_init()
+#define TRACE(type, arg, arg2) trace_event((type), (arg), (arg2))
+#else
+#define TRACE_INIT() ((void) 0)
+#define TRACE(type, arg, arg2) ((void) 0)
+#endif
+
+#endif
@@ -0,0 +1,183 @@
+/* Distributed under the terms of the GNU General Public License v2 */
+/* L3info - SYR2 Project - SYR DeaDBeeF
+ * ============================================================================
+ * Trace Dump
+ * ----------------------------------------------------------------------------
+ * Merge the trace dumps given as arguments, see trace.h, into a single
+ * timeline: one line per event, in time order, with its time since the first
+ * event, the delay since the previous event of the same thread, and its
+ * arguments. The number of events of each type of each thread follows.
+ *
+ * Usage: tracedump <trace_file>...
+ * ----------------------------------------------------------------------------
+ * Antoine Pinsard
+ * Oct. 19, 2026
+ */
+#include "trace.h"
+
+struct record {
+    double ns;
+    int thread;
+    struct trace_event event;
+};
+
+struct thread {
+    int pid;
+    int tid;
+    double last;
+    unsigned long counts[TRACE_NB_TYPES];
+};
+
+
+static int compare_records(const void* a, const void* b) {
+    const struct record* ra = a;
+    const struct record* rb = b;
+
+    if (ra->ns != rb->ns) {
+        return ra->ns < rb->ns ? -1 : 1;
+    }
+    return ra->thread - rb->thread;
+}
+
+
+/**
+ * Append the events of the dump at path to records, converted to
+ * nanoseconds of the monotonic clock.
+ *
+ * Return the new number of records, or -1 on error.
+ */
+static long load_dump(const char* path, struct record** records,
+                      long nb_records, int thread, struct thread* info)
+{
+    struct trace_header header;
+    struct trace_event* events;
+    struct record* grown;
+    double ns_per_tick;
+    FILE* file;
+    uint64_t i;
+
+    file = fopen(path, "rb");
+    if (file == NULL) {
+        perror(path);
+        return -1;
+    }
+    if (fread(&header, sizeof(header), 1, file) != 1 ||
+        memcmp(header.magic, TRACE_MAGIC, 8) != 0)
+    {
+        fprintf(stderr, "%s: not a trace dump\n", path);
+        fclose(file);
+        return -1;
+    }
+
+    events = malloc(header.nb_events * sizeof(struct trace_event));
+    grown = realloc(*records, (nb_records + header.nb_events)
+                              * sizeof(struct record));
+    if (events == NULL || grown == NULL) {
+        perror("Allocation failed");
+        free(events);
+        fclose(file);
+        return -1;
+    }
+    *records = grown;
+    if (fread(events, sizeof(struct trace_event), header.nb_events, file)
+        != header.nb_events)
+    {
+        fprintf(stderr, "%s: truncated dump\n", path);
+        header.nb_events = 0;
+    }
+    fclose(file);
+
+    ns_per_tick = 1;
+    if (header.clock == TRACE_CLOCK_TSC &&
+        header.clock_end > header.clock_start)
+    {
+        ns_per_tick = (double) (header.ns_end - header.ns_start)
+                    / (header.clock_end - header.clock_start);
+    }
+
+    info->pid = header.pid;
+    info->tid = header.tid;
+    info->last = -1;
+    memset(info->counts, 0, sizeof(info->counts));
+    for (i = 0; i < header.nb_events; i++) {
+        grown[nb_records].ns = header.ns_start
+                             + ((double) events[i].time
+                                - (double) header.clock_start) * ns_per_tick;
+        grown[nb_records].thread = thread;
+        grown[nb_records].event = events[i];
+        nb_records++;
+    }
+    free(events);
+
+    return nb_records;
+}
+
+
+int main(int argc, char** argv) {
+    struct record* records;
+    struct record* record;
+    struct thread* threads;
+    struct thread* thread;
+    long nb_records
+       , i;
+    int type
+      , t;
+
+    if (argc < 2) {
+        fprintf(stderr, "Usage: tracedump <trace_file>...\n");
+        exit(EXIT_FAILURE);
+    }
+
+    threads = calloc(argc - 1, sizeof(struct thread));
+    if (threads == NULL) {
+        perror("Allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    records = NULL;
+    nb_records = 0;
+    for (t = 0; t < argc - 1; t++) {
+        nb_records = load_dump(argv[t+1], &records, nb_records, t,
+                               &threads[t]);
+        if (nb_records < 0) {
+            exit(EXIT_FAILURE);
+        }
+    }
+    qsort(records, nb_records, sizeof(struct record), compare_records);
+
+    printf("%12s %10s %7s %7s  %-13s %10s %6s\n", "time_ms", "delta_us",
+           "pid", "tid", "event", "arg", "arg2");
+    for (i = 0; i < nb_records; i++) {
+        record = &records[i];
+        thread = &threads[record->thread];
+        type = record->event.type < TRACE_NB_TYPES ? record->event.type : 0;
+        printf("%12.3f ", (record->ns - records[0].ns) / 1e6);
+        if (thread->last >= 0) {
+            printf("%10.1f ", (record->ns - thread->last) / 1e3);
+        }
+        else {
+            printf("%10s ", "-");
+        }
+        printf("%7d %7d  %-13s %10u %6u\n", thread->pid, thread->tid,
+               trace_event_name(type), record->event.arg,
+               record->event.arg2);
+        thread->last = record->ns;
+        thread->counts[type]++;
+    }
+
+    printf("\n");
+    for (t = 0; t < argc - 1; t++) {
+        printf("pid %d tid %d:", threads[t].pid, threads[t].tid);
+        for (type = 0; type < TRACE_NB_TYPES; type++) {
+            if (threads[t].counts[type] > 0) {
+                printf(" %s=%lu", trace_event_name(type),
+                       threads[t].counts[type]);
+            }
+        }
+        printf("\n");
+    }
+
+    free(records);
+    free(threads);
+
+    return EXIT_SUCCESS;
+}
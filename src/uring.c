@@ -0,0 +1,196 @@
+/* Distributed under the terms of the GNU General Public License v2 */
+/* L3info - SYR2 Project - SYR DeaDBeeF
+ * ============================================================================
+ * Uring
+ * ----------------------------------------------------------------------------
+ * Minimal io_uring wrapper.
+ * ----------------------------------------------------------------------------
+ * Antoine Pinsard
+ * Oct. 19, 2026
+ */
+#include "uring.h"
+
+#ifdef DEADBEEF_URING
+
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+
+
+/**
+ * Set up a ring, register URING_NB_BUFFERS packet buffers and register
+ * file_fd and sock as the fixed files URING_FILE and URING_SOCKET.
+ *
+ * Return 0 on success, -1 if io_uring is not available.
+ */
+int uring_init(struct uring* ring, int file_fd, int sock) {
+    struct io_uring_params params;
+    struct iovec iov;
+    int files[2];
+    unsigned char* sq_ptr;
+    unsigned char* cq_ptr;
+    size_t sq_length
+         , cq_length;
+
+    assert(ring != NULL);
+
+    memset(&params, 0, sizeof(params));
+    ring->fd = syscall(__NR_io_uring_setup, URING_DEPTH, &params);
+    if (ring->fd < 0) {
+        return -1;
+    }
+    if (!(params.features & IORING_FEAT_SINGLE_MMAP)) {
+        close(ring->fd);
+        return -1;
+    }
+
+    sq_length = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_length = params.cq_off.cqes
+              + params.cq_entries * sizeof(struct io_uring_cqe);
+    ring->ring_map_length = sq_length > cq_length ? sq_length : cq_length;
+    ring->ring_map = mmap(NULL, ring->ring_map_length,
+                          PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                          ring->fd, IORING_OFF_SQ_RING);
+    if (ring->ring_map == MAP_FAILED) {
+        close(ring->fd);
+        return -1;
+    }
+
+    ring->sqes_length = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqes_length, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) {
+        munmap(ring->ring_map, ring->ring_map_length);
+        close(ring->fd);
+        return -1;
+    }
+
+    sq_ptr = ring->ring_map;
+    cq_ptr = ring->ring_map;
+    ring->sq_head = (unsigned*) (sq_ptr + params.sq_off.head);
+    ring->sq_tail = (unsigned*) (sq_ptr + params.sq_off.tail);
+    ring->sq_mask = (unsigned*) (sq_ptr + params.sq_off.ring_mask);
+    ring->sq_array = (unsigned*) (sq_ptr + params.sq_off.array);
+    ring->cq_head = (unsigned*) (cq_ptr + params.cq_off.head);
+    ring->cq_tail = (unsigned*) (cq_ptr + params.cq_off.tail);
+    ring->cq_mask = (unsigned*) (cq_ptr + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe*) (cq_ptr + params.cq_off.cqes);
+    ring->to_submit = 0;
+    ring->nb_syscalls = 0;
+
+    ring->buffers = mmap(NULL, URING_NB_BUFFERS * MSG_LENGTH,
+                         PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+                         -1, 0);
+    if (ring->buffers == MAP_FAILED) {
+        munmap(ring->sqes, ring->sqes_length);
+        munmap(ring->ring_map, ring->ring_map_length);
+        close(ring->fd);
+        return -1;
+    }
+
+    iov.iov_base = ring->buffers;
+    iov.iov_len = URING_NB_BUFFERS * MSG_LENGTH;
+    files[URING_FILE] = file_fd;
+    files[URING_SOCKET] = sock;
+    if (syscall(__NR_io_uring_register, ring->fd, IORING_REGISTER_BUFFERS,
+                &iov, 1) < 0 ||
+        syscall(__NR_io_uring_register, ring->fd, IORING_REGISTER_FILES,
+                files, 2) < 0)
+    {
+        uring_destroy(ring);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/**
+ * Tear down the ring. Pending operations are cancelled.
+ */
+void uring_destroy(struct uring* ring) {
+    assert(ring != NULL);
+
+    close(ring->fd);
+    munmap(ring->buffers, URING_NB_BUFFERS * MSG_LENGTH);
+    munmap(ring->sqes, ring->sqes_length);
+    munmap(ring->ring_map, ring->ring_map_length);
+}
+
+
+/**
+ * Return a zeroed submission queue entry, or NULL if the queue is full.
+ * The entry is submitted by the next call to uring_submit_and_wait().
+ */
+struct io_uring_sqe* uring_get_sqe(struct uring* ring) {
+    struct io_uring_sqe* sqe;
+    unsigned head
+           , tail
+           , index;
+
+    head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+    tail = *ring->sq_tail + ring->to_submit;
+    if (tail - head >= URING_DEPTH) {
+        return NULL;
+    }
+
+    index = tail & *ring->sq_mask;
+    sqe = &ring->sqes[index];
+    memset(sqe, 0, sizeof(struct io_uring_sqe));
+    ring->sq_array[index] = index;
+    ring->to_submit++;
+
+    return sqe;
+}
+
+
+/**
+ * Submit the pending entries and wait until at least wait_nr completions are
+ * available.
+ *
+ * Return the number of submitted entries, or -1 if io_uring_enter() failed.
+ */
+int uring_submit_and_wait(struct uring* ring, unsigned wait_nr) {
+    unsigned to_submit;
+    int ret;
+
+    to_submit = ring->to_submit;
+    __atomic_store_n(ring->sq_tail, *ring->sq_tail + to_submit,
+                     __ATOMIC_RELEASE);
+    ring->to_submit = 0;
+
+    do {
+        ring->nb_syscalls++;
+        ret = syscall(__NR_io_uring_enter, ring->fd, to_submit, wait_nr,
+                      wait_nr > 0 ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+    } while (ret < 0 && errno == EINTR);
+
+    return ret;
+}
+
+
+/**
+ * Return the oldest available completion, or NULL if there is none.
+ * The completion must be released with uring_cqe_seen().
+ */
+struct io_uring_cqe* uring_peek_cqe(struct uring* ring) {
+    unsigned head;
+
+    head = *ring->cq_head;
+    if (head == __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)) {
+        return NULL;
+    }
+
+    return &ring->cqes[head & *ring->cq_mask];
+}
+
+
+/**
+ * Release the completion returned by uring_peek_cqe().
+ */
+void uring_cqe_seen(struct uring* ring) {
+    __atomic_store_n(ring->cq_head, *ring->cq_head + 1, __ATOMIC_RELEASE);
+}
+
+#endif
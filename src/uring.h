@@ -0,0 +1,66 @@
+/* Distributed under the terms of the GNU General Public License v2 */
+/* L3info - SYR2 Project - SYR DeaDBeeF
+ * ============================================================================
+ * Uring
+ * ----------------------------------------------------------------------------
+ * Minimal io_uring wrapper, built on the raw system calls so that it does not
+ * depend on liburing. A ring has a set of registered packet buffers and the
+ * streamed file and the socket are registered as fixed files.
+ *
+ * Only available when compiled with DEADBEEF_URING (make URING=1).
+ * ----------------------------------------------------------------------------
+ * Antoine Pinsard
+ * Oct. 19, 2026
+ */
+#ifndef _URING_H_
+#define _URING_H_
+
+#ifdef DEADBEEF_URING
+
+#include <linux/io_uring.h>
+#include "deadbeef.h"
+
+#define URING_DEPTH 64
+// Number of registered packet buffers, each one MSG_LENGTH long
+#define URING_NB_BUFFERS 16
+
+// Fixed file indexes
+#define URING_FILE 0
+#define URING_SOCKET 1
+
+struct uring {
+    int fd;
+    unsigned* sq_head;
+    unsigned* sq_tail;
+    unsigned* sq_mask;
+    unsigned* sq_array;
+    unsigned* cq_head;
+    unsigned* cq_tail;
+    unsigned* cq_mask;
+    struct io_uring_sqe* sqes;
+    struct io_uring_cqe* cqes;
+    void* ring_map;
+    size_t ring_map_length;
+    size_t sqes_length;
+    unsigned to_submit;
+    unsigned char* buffers; // URING_NB_BUFFERS registered packet buffers
+    unsigned long nb_syscalls;
+};
+
+int uring_init(struct uring*, int, int);
+void uring_destroy(struct uring*);
+struct io_uring_sqe* uring_get_sqe(struct uring*);
+int uring_submit_and_wait(struct uring*, unsigned);
+struct io_uring_cqe* uring_peek_cqe(struct uring*);
+void uring_cqe_seen(struct uring*);
+
+/**
+ * Return the registered packet buffer with the given index.
+ */
+static inline unsigned char* uring_buffer(struct uring* ring, int index) {
+    return ring->buffers + index * MSG_LENGTH;
+}
+
+#endif
+
+#endif
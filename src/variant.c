@@ -0,0 +1,534 @@
+/* Distributed under the terms of the GNU General Public License v2 */
+/* L3info - SYR2 Project - SYR DeaDBeeF
+ * ============================================================================
+ * Variant
+ * ----------------------------------------------------------------------------
+ * Live conversion of streams to their variants and cache of prebuilt ones.
+ * ----------------------------------------------------------------------------
+ * Antoine Pinsard
+ * Oct. 19, 2026
+ */
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <time.h>
+#include <sys/stat.h>
+#include "variant.h"
+
+
+struct cache_item {
+    char name[256];
+    off_t length;
+    time_t mtime;
+};
+
+// Cache directory of the library, empty if there is no cache. Its name is
+// short, see variant_cache_init().
+static char cache_dir[128] = "";
+
+
+/**
+ * Return the variant actually applicable to the given entry among the
+ * requested ones. Unknown and useless variants are dropped, and samples that
+ * are not 16-bit are converted whenever they are halved or downmixed.
+ */
+int variant_select(struct catalog_entry* entry, int requested) {
+    int variant
+      , format;
+
+    assert(entry != NULL);
+
+    format = convert_format(entry->format, entry->sample_size);
+    if (format < 0 || entry->channels <= 0 ||
+        entry->channels > CODEC_MAX_CHANNELS)
+    {
+        return 0;
+    }
+
+    variant = requested & (VARIANT_HALF_RATE | VARIANT_MONO | VARIANT_S16);
+    if (entry->channels == 1) {
+        variant &= ~VARIANT_MONO;
+    }
+    if (format == CONVERT_S16) {
+        variant &= ~VARIANT_S16;
+    }
+    else if (variant != 0) {
+        variant |= VARIANT_S16;
+    }
+
+    return variant;
+}
+
+
+/**
+ * Update the sample format, the sample rate, the sample size and the number
+ * of channels of a stream to the ones of its variant.
+ */
+void variant_format(int variant, int* format, int* sample_rate,
+                    int* sample_size, int* channels)
+{
+    assert(format != NULL);
+    assert(sample_rate != NULL);
+    assert(sample_size != NULL);
+    assert(channels != NULL);
+
+    if (variant & VARIANT_S16) {
+        *format = AUD_FORMAT_PCM;
+        *sample_size = 16;
+    }
+    if (variant & VARIANT_HALF_RATE) {
+        *sample_rate /= 2;
+    }
+    if (variant & VARIANT_MONO) {
+        *channels = 1;
+    }
+}
+
+
+/**
+ * Return the length of the variant of length bytes of samples of the given
+ * format (see convert.h) on the given number of channels. An odd trailing
+ * frame is dropped when halving the sample rate.
+ */
+off_t variant_length(off_t length, int format, int channels, int variant) {
+    off_t nb_frames;
+    int sample_length;
+
+    nb_frames = length / (convert_sample_length(format) * channels);
+    if (variant & VARIANT_HALF_RATE) {
+        nb_frames /= 2;
+    }
+    if (variant & VARIANT_MONO) {
+        channels = 1;
+    }
+    sample_length = (variant & VARIANT_S16) ? 2
+                  : convert_sample_length(format);
+
+    return nb_frames * sample_length * channels;
+}
+
+
+/**
+ * Initialize a converter of the length bytes of samples of the given format
+ * (see convert.h) on channels channels starting at offset in fd. The caller
+ * keeps the ownership of fd.
+ *
+ * Return 0 on success, -1 on error.
+ */
+int converter_init(struct converter* conv, int fd, off_t offset, off_t length,
+                   int format, int channels, int variant)
+{
+    assert(conv != NULL);
+    assert(variant == 0 || (channels > 0 && channels <= CODEC_MAX_CHANNELS));
+    assert(variant == 0 || format == CONVERT_S16 || (variant & VARIANT_S16));
+
+    conv->variant = variant;
+    conv->format = format;
+    conv->channels = channels;
+    dither_init(&conv->dither, offset);
+    conv->pending_start = 0;
+    conv->pending_fill = 0;
+
+    return reader_init(&conv->reader, fd, offset, length);
+}
+
+
+void converter_destroy(struct converter* conv) {
+    assert(conv != NULL);
+
+    reader_destroy(&conv->reader);
+}
+
+
+/**
+ * Read and convert the next chunk of frames to the pending buffer.
+ */
+static int refill(struct converter* conv) {
+    const int16_t* in;
+    int16_t* out;
+    ssize_t len;
+    int frame_length
+      , step
+      , nb_frames
+      , sum
+      , i
+      , j
+      , c;
+
+    frame_length = convert_sample_length(conv->format) * conv->channels;
+    step = (conv->variant & VARIANT_HALF_RATE) ? 2 : 1;
+
+    len = reader_read(&conv->reader, conv->input,
+                      step * VARIANT_CHUNK_FRAMES * frame_length);
+    if (len < 0) {
+        return -1;
+    }
+    nb_frames = len / frame_length / step;
+
+    // Samples are little endian, like the host.
+    in = (const int16_t*) conv->input;
+    if (conv->format != CONVERT_S16) {
+        convert(conv->input, conv->format, conv->samples, CONVERT_S16,
+                (size_t) nb_frames * step * conv->channels, &conv->dither);
+        in = conv->samples;
+    }
+    out = (int16_t*) conv->pending;
+    for (i = 0; i < nb_frames; i++) {
+        if (conv->variant & VARIANT_MONO) {
+            sum = 0;
+            for (j = 0; j < step; j++) {
+                for (c = 0; c < conv->channels; c++) {
+                    sum += in[(step*i + j) * conv->channels + c];
+                }
+            }
+            out[i] = sum / (step * conv->channels);
+            continue;
+        }
+        for (c = 0; c < conv->channels; c++) {
+            sum = 0;
+            for (j = 0; j < step; j++) {
+                sum += in[(step*i + j) * conv->channels + c];
+            }
+            out[i * conv->channels + c] = sum / step;
+        }
+    }
+
+    conv->pending_start = 0;
+    conv->pending_fill = nb_frames * 2
+                       * ((conv->variant & VARIANT_MONO) ? 1 : conv->channels);
+
+    return 0;
+}
+
+
+/**
+ * Read the next n bytes of the converted stream to output.
+ *
+ * Return the number of bytes read, which is less than n only at the end of
+ * the stream, or -1 on error.
+ */
+ssize_t converter_read(struct converter* conv, unsigned char* output,
+                       size_t n)
+{
+    size_t done
+         , chunk;
+
+    assert(conv != NULL);
+    assert(output != NULL);
+
+    if (conv->variant == 0) {
+        return reader_read(&conv->reader, output, n);
+    }
+
+    done = 0;
+    while (done < n) {
+        if (conv->pending_start == conv->pending_fill) {
+            if (refill(conv) < 0) {
+                return -1;
+            }
+            if (conv->pending_fill == 0) {
+                break;
+            }
+        }
+        chunk = conv->pending_fill - conv->pending_start;
+        if (chunk > n - done) {
+            chunk = n - done;
+        }
+        memcpy(output + done, conv->pending + conv->pending_start, chunk);
+        conv->pending_start += chunk;
+        done += chunk;
+    }
+
+    return done;
+}
+
+
+/**
+ * Create the cache directory of the library at root if needed. It is named
+ * after the device and inode of root, so that it is found again by the next
+ * servers of the library, whatever their working directory, and is private
+ * to the user.
+ *
+ * Return 0 on success, -1 if there is no usable cache directory, in which
+ * case streams are always converted live.
+ */
+int variant_cache_init(const char* root) {
+    struct stat st;
+
+    assert(root != NULL);
+
+    cache_dir[0] = '\0';
+    if (stat(root, &st) < 0) {
+        return -1;
+    }
+    snprintf(cache_dir, sizeof(cache_dir), "%s/%s-%llx-%llx",
+             P_tmpdir, VARIANT_CACHE_DIR, (unsigned long long) st.st_dev,
+             (unsigned long long) st.st_ino);
+    // Another user could have created it first.
+    if ((mkdir(cache_dir, 0700) < 0 && errno != EEXIST) ||
+        lstat(cache_dir, &st) < 0 || !S_ISDIR(st.st_mode) ||
+        st.st_uid != getuid())
+    {
+        cache_dir[0] = '\0';
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/**
+ * Write the path of the cached stream of the given entry, variant and
+ * encoding to path. The key includes the modification time of the file and
+ * the location of its samples, so that streams of modified files are never
+ * served and end up evicted.
+ *
+ * Return -1 if there is no cache or if the path does not fit in size bytes.
+ */
+int variant_cache_path(char* path, size_t size, struct catalog* catalog,
+                       struct catalog_entry* entry, int variant, int encoding)
+{
+    const char* name;
+    uint64_t hash;
+    int i;
+
+    assert(path != NULL);
+    assert(catalog != NULL);
+    assert(entry != NULL);
+
+    if (cache_dir[0] == '\0') {
+        return -1;
+    }
+
+    // FNV-1a
+    hash = 0xcbf29ce484222325ULL;
+    name = catalog_name(catalog, entry);
+    for (i = 0; i < entry->name_length; i++) {
+        hash = (hash ^ (unsigned char) name[i]) * 0x100000001b3ULL;
+    }
+    for (i = 0; i < 8; i++) {
+        hash = (hash ^ ((entry->mtime >> (8*i)) & 0xFF)) * 0x100000001b3ULL;
+        hash = (hash ^ ((entry->data_offset >> (8*i)) & 0xFF))
+             * 0x100000001b3ULL;
+        hash = (hash ^ ((entry->data_length >> (8*i)) & 0xFF))
+             * 0x100000001b3ULL;
+    }
+
+    if (snprintf(path, size, "%s/%016llx-%x-%x", cache_dir,
+                 (unsigned long long) hash, variant, encoding) >= size)
+    {
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/**
+ * Open a cached stream and mark it as recently served.
+ *
+ * Return a file descriptor, or -1 if the stream is not cached.
+ */
+int variant_cache_open(const char* path) {
+    int fd;
+
+    assert(path != NULL);
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+    futimens(fd, NULL);
+
+    return fd;
+}
+
+
+/**
+ * Build a stream to the cache: the variant of the length bytes of samples of
+ * the given format on channels channels found at offset in filename, with
+ * the given encoding. The cache is then trimmed down to max_length bytes.
+ *
+ * The stream is written to a temporary file which is renamed once complete.
+ * The temporary file also prevents concurrent builds of the same stream.
+ *
+ * Return 0 on success or if the stream is already being built, -1 on error.
+ */
+int variant_build(const char* path, const char* filename, off_t offset,
+                  off_t length, int format, int channels, int variant,
+                  int encoding, long max_length)
+{
+    struct converter* conv;
+    struct aud_source source;
+    struct stat st;
+    unsigned char raw[DATA_LENGTH];
+    unsigned char packet[2 + DATA_LENGTH];
+    char tmp_path[PATH_MAX];
+    ssize_t len;
+    int out_fd
+      , out_channels
+      , packet_length
+      , ret;
+    uint32_t packet_id;
+
+    assert(path != NULL);
+    assert(filename != NULL);
+
+    // The temporary directory may have been cleaned meanwhile.
+    if (mkdir(cache_dir, 0700) < 0 && errno != EEXIST) {
+        return -1;
+    }
+
+    snprintf(tmp_path, PATH_MAX, "%s.tmp", path);
+    out_fd = open(tmp_path, O_WRONLY | O_CREAT | O_EXCL, 0644);
+    if (out_fd < 0 && errno == EEXIST && stat(tmp_path, &st) == 0 &&
+        st.st_mtime + VARIANT_BUILD_TIMEOUT < time(NULL))
+    {
+        // Left over by a dead builder
+        unlink(tmp_path);
+        out_fd = open(tmp_path, O_WRONLY | O_CREAT | O_EXCL, 0644);
+    }
+    if (out_fd < 0) {
+        return errno == EEXIST ? 0 : -1;
+    }
+
+    source.fd = -1;
+    conv = malloc(sizeof(struct converter));
+    if (conv == NULL || aud_open(filename, &source) < 0 ||
+        converter_init(conv, source.fd, offset, length, format, channels,
+                       variant) < 0)
+    {
+        free(conv);
+        if (source.fd >= 0) {
+            aud_close(&source);
+        }
+        close(out_fd);
+        unlink(tmp_path);
+        return -1;
+    }
+    // The file is read instead if it changed since it was cataloged.
+    if (source.info.data_offset == offset && source.length == length &&
+        source.data != NULL)
+    {
+        reader_map(&conv->reader, source.data);
+    }
+
+    out_channels = (variant & VARIANT_MONO) ? 1 : channels;
+    ret = 0;
+    packet_id = 0;
+    do {
+        bzero(raw, DATA_LENGTH);
+        len = converter_read(conv, raw, DATA_LENGTH);
+        if (len <= 0) {
+            ret = len;
+            break;
+        }
+        if (encoding == CODEC_RAW) {
+            if (write(out_fd, raw, len) != len) {
+                ret = -1;
+            }
+            continue;
+        }
+        packet_length = codec_encode_packet(raw, len, out_channels,
+                                            packet_id++, 0, packet + 2);
+        if (packet_length < 0) {
+            packet_length = 0;
+        }
+        packet[0] = packet_length & 0xFF;
+        packet[1] = (packet_length >> 8) & 0xFF;
+        if (write(out_fd, packet, 2 + packet_length) != 2 + packet_length ||
+            (packet_length == 0 &&
+             write(out_fd, raw, DATA_LENGTH) != DATA_LENGTH))
+        {
+            ret = -1;
+        }
+    } while (ret == 0 && len == DATA_LENGTH);
+
+    converter_destroy(conv);
+    free(conv);
+    aud_close(&source);
+    if (close(out_fd) < 0 || ret < 0 || rename(tmp_path, path) < 0) {
+        unlink(tmp_path);
+        return -1;
+    }
+
+    return variant_cache_trim(max_length);
+}
+
+
+static int compare_items(const void* a, const void* b) {
+    const struct cache_item* ia = a;
+    const struct cache_item* ib = b;
+
+    return (ia->mtime > ib->mtime) - (ia->mtime < ib->mtime);
+}
+
+
+/**
+ * Evict the least recently served streams until the cache holds at most
+ * max_length bytes.
+ *
+ * Return 0 on success, -1 if the cache could not be listed.
+ */
+int variant_cache_trim(long max_length) {
+    DIR* dir;
+    struct dirent* dirent;
+    struct stat st;
+    struct cache_item* items;
+    struct cache_item* tmp;
+    char path[PATH_MAX];
+    off_t total;
+    int nb_items
+      , capacity
+      , i;
+
+    dir = opendir(cache_dir);
+    if (dir == NULL) {
+        return -1;
+    }
+
+    items = NULL;
+    nb_items = 0;
+    capacity = 0;
+    total = 0;
+    while ((dirent = readdir(dir)) != NULL) {
+        // Skip ".", ".." and streams being built.
+        if (dirent->d_name[0] == '.' || strchr(dirent->d_name, '.') != NULL) {
+            continue;
+        }
+        snprintf(path, PATH_MAX, "%s/%s", cache_dir, dirent->d_name);
+        if (stat(path, &st) < 0 || !S_ISREG(st.st_mode)) {
+            continue;
+        }
+        if (nb_items == capacity) {
+            capacity = capacity == 0 ? 64 : 2 * capacity;
+            tmp = realloc(items, capacity * sizeof(struct cache_item));
+            if (tmp == NULL) {
+                break;
+            }
+            items = tmp;
+        }
+        strncpy(items[nb_items].name, dirent->d_name, 255);
+        items[nb_items].name[255] = '\0';
+        items[nb_items].length = st.st_size;
+        items[nb_items].mtime = st.st_mtime;
+        total += st.st_size;
+        nb_items++;
+    }
+    closedir(dir);
+
+    if (total > max_length) {
+        qsort(items, nb_items, sizeof(struct cache_item), compare_items);
+        for (i = 0; i < nb_items && total > max_length; i++) {
+            snprintf(path, PATH_MAX, "%s/%s", cache_dir, items[i].name);
+            if (unlink(path) == 0) {
+                total -= items[i].length;
+            }
+        }
+    }
+
+    free(items);
+
+    return 0;
+}
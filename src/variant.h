@@ -0,0 +1,85 @@
+/* Distributed under the terms of the GNU General Public License v2 */
+/* L3info - SYR2 Project - SYR DeaDBeeF
+ * ============================================================================
+ * Variant
+ * ----------------------------------------------------------------------------
+ * Variants are cheaper versions of a stream: converted to 16-bit PCM,
+ * downsampled to half the sample rate, downmixed to mono, or a combination.
+ * Halving the sample rate and downmixing work on 16-bit samples, so that
+ * other sample formats are converted first.
+ *
+ * A stream is either converted live, while it is sent, or served from the
+ * variant cache. The cache is a directory of the temporary directory, one per
+ * library, see variant_cache_init(), that holds the streams that have been
+ * built in the background, keyed by the file, the variant and the encoding.
+ * It is kept out of the library, so that building it never makes the catalog
+ * look outdated, see catalog_outdated().
+ *
+ *
+ *  - a raw stream is stored as the converted samples, so that it is sent the
+ *    same way as a wave file;
+ *  - a compressed stream is stored as the sequence of its encoded packets,
+ *    see codec.h, each one preceded by its length on 2 bytes. A length of 0
+ *    is followed by a raw packet of DATA_LENGTH bytes instead.
+ *
+ * The least recently served streams are evicted when the cache grows beyond
+ * its maximum size.
+ * ----------------------------------------------------------------------------
+ * Antoine Pinsard
+ * Oct. 19, 2026
+ */
+#ifndef _VARIANT_H_
+#define _VARIANT_H_
+
+#include <sys/types.h>
+#include "catalog.h"
+#include "codec.h"
+#include "convert.h"
+#include "deadbeef.h"
+#include "reader.h"
+
+#define VARIANT_HALF_RATE 0x01
+#define VARIANT_MONO 0x02
+#define VARIANT_S16 0x04
+
+// Prefix of the cache directories in the temporary directory
+#define VARIANT_CACHE_DIR "deadbeef-cache"
+// Default maximum size of the cache
+#define VARIANT_CACHE_MAX_LENGTH (512L << 20)
+// A stream still being built after this delay in seconds is considered dead.
+#define VARIANT_BUILD_TIMEOUT 600
+
+// Number of frames converted at once
+#define VARIANT_CHUNK_FRAMES 1024
+
+// Sequential reader of the converted samples of a region of a file.
+struct converter {
+    struct reader reader;
+    int variant;
+    int format;           // Sample format of the file, see convert.h
+    int channels;         // Channels of the file
+    size_t pending_start; // Converted bytes not read yet
+    size_t pending_fill;
+    struct dither dither;
+    unsigned char input[2 * VARIANT_CHUNK_FRAMES * CODEC_MAX_CHANNELS * 4];
+    int16_t samples[2 * VARIANT_CHUNK_FRAMES * CODEC_MAX_CHANNELS];
+    unsigned char pending[VARIANT_CHUNK_FRAMES * CODEC_MAX_CHANNELS * 2];
+};
+
+int variant_select(struct catalog_entry*, int);
+void variant_format(int, int*, int*, int*, int*);
+off_t variant_length(off_t, int, int, int);
+
+int converter_init(struct converter*, int, off_t, off_t, int, int, int);
+void converter_destroy(struct converter*);
+ssize_t converter_read(struct converter*, unsigned char*, size_t);
+
+int variant_cache_init(const char*);
+int variant_cache_path(char*, size_t, struct catalog*, struct catalog_entry*,
+                       int, int);
+int variant_cache_open(const char*);
+int variant_build(const char*, const char*, off_t, off_t, int, int, int, int,
+                  long);
+int variant_cache_trim(long);
+
+#endif